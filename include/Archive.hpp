@@ -0,0 +1,177 @@
+/*!
+ * \file Archive.hpp
+ *
+ * \brief Compact binary archives of Computations, which can be memory
+ * mapped and read without parsing.
+ */
+
+#ifndef SPFIE_ARCHIVE_HPP
+#define SPFIE_ARCHIVE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SetRelationSpec.hpp"
+#include "iegenlib.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+//! Magic number at the start of every archive ("SPFA", little-endian)
+#define ARCHIVE_MAGIC 0x41465053
+//! Version of the archive format, to be increased whenever it changes
+#define ARCHIVE_FORMAT_VERSION 4
+
+namespace spf_ie {
+
+/*!
+ * \class ArchiveWriter
+ *
+ * \brief Collects the statement specs of built Computations and writes them
+ * as an archive.
+ *
+ * An archive is a sequence of little-endian 32-bit words. It starts with a
+ * header (magic, version, number of functions, offset of the function
+ * index), which is followed by a table of every distinct string, the
+ * function index sorted by name, and then the records of statements, sets,
+ * relations and expressions. Records refer to strings and to each other by
+ * byte offset from the start of the archive, so a reader can use a mapped
+ * archive in place.
+ */
+class ArchiveWriter {
+   public:
+    //! Add a function's Computation to the archive. May be called from
+    //! several threads at once.
+    //! \param[in] fileName Source file the function is in
+    //! \param[in] name Qualified name of the function
+    //! \param[in] stmts Specs of every statement of its Computation, in order
+    void addFunction(std::string fileName, std::string name,
+                     std::vector<StmtSpec> stmts);
+
+    //! Write the archive
+    //! \param[in] os Stream to write to, which should be binary
+    void write(llvm::raw_ostream& os) const;
+
+   private:
+    /*!
+     * \struct ArchivedFunction
+     *
+     * \brief A function added to the archive
+     */
+    struct ArchivedFunction {
+        std::string fileName;
+        std::string name;
+        std::vector<StmtSpec> stmts;
+    };
+
+    //! Functions added so far
+    std::vector<ArchivedFunction> functions;
+    //! Guards functions
+    mutable std::mutex functionsMutex;
+};
+
+/*!
+ * \class ArchiveReader
+ *
+ * \brief Reads an archive in place, such as from a memory-mapped file.
+ *
+ * Names and source code are returned as references into the archive, and
+ * Computations are only rebuilt when asked for. Every offset is checked
+ * against the archive's bounds as it is followed, so a damaged archive
+ * gives errors rather than crashes.
+ */
+class ArchiveReader {
+   public:
+    //! Open an archive file, mapping it into memory where possible
+    //! \param[in] path Path of the archive
+    //! \param[out] error Description of the problem, if there was one
+    //! \return the reader, or nullptr if the file is not a valid archive
+    static std::unique_ptr<ArchiveReader> open(llvm::StringRef path,
+                                               std::string& error);
+
+    //! Read an archive already in memory
+    //! \param[in] buffer Contents of the archive
+    //! \param[out] error Description of the problem, if there was one
+    //! \return the reader, or nullptr if buffer is not a valid archive
+    static std::unique_ptr<ArchiveReader> create(
+        std::unique_ptr<llvm::MemoryBuffer> buffer, std::string& error);
+
+    //! Get the number of functions in the archive
+    uint32_t getNumFunctions() const { return numFunctions; }
+
+    //! Get the qualified name of a function, by its position in the index
+    //! (in order of name)
+    llvm::StringRef getFunctionName(uint32_t function) const;
+
+    //! Get the source file a function is in
+    llvm::StringRef getFileName(uint32_t function) const;
+
+    //! Find a function by name, with a binary search of the index. If
+    //! several functions share the name, the first is found.
+    //! \param[in] name Qualified name of the function
+    //! \param[out] function Position of the function in the index
+    //! \return whether the function was found
+    bool findFunction(llvm::StringRef name, uint32_t& function) const;
+
+    //! Get the number of statements of a function
+    uint32_t getNumStmts(uint32_t function) const;
+
+    //! Get the source code of a statement
+    llvm::StringRef getStmtSourceCode(uint32_t function, uint32_t stmt) const;
+
+    //! Read the spec of a statement
+    //! \return whether the statement could be read
+    bool readStmtSpec(uint32_t function, uint32_t stmt, StmtSpec& spec) const;
+
+    //! Rebuild a function's Computation, without parsing anything
+    //! \return the Computation, or nullptr if it could not be read
+    std::unique_ptr<iegenlib::Computation> loadComputation(
+        uint32_t function) const;
+
+   private:
+    explicit ArchiveReader(std::unique_ptr<llvm::MemoryBuffer> buffer);
+
+    //! Contents of the archive
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    //! Number of functions in the archive
+    uint32_t numFunctions;
+    //! Offset of the function index
+    uint32_t indexOffset;
+
+    //! Read a word, or 0 if offset is out of bounds
+    uint32_t readWord(uint64_t offset) const;
+
+    //! Whether the given number of words starting at offset are in bounds
+    bool inBounds(uint64_t offset, uint64_t numWords) const;
+
+    //! Get the string at an offset, or an empty string if it is out of
+    //! bounds
+    llvm::StringRef readString(uint64_t offset) const;
+
+    //! Get the offset of a function's entry in the index
+    uint64_t getIndexEntry(uint32_t function) const;
+
+    //! Get the offset of a statement's record, or 0 if out of bounds
+    uint64_t getStmtRecord(uint32_t function, uint32_t stmt) const;
+
+    //! Read a set or relation record
+    bool readSetRelationSpec(uint64_t offset, SetRelationSpec& spec) const;
+
+    //! Read an expression record
+    //! \param[in] depth Nesting depth of the expression, which is limited
+    //! to stop cyclic references
+    bool readSpecExp(uint64_t offset, SpecExp& exp, int depth) const;
+
+    //! Read an array of data access records
+    bool readAccesses(
+        uint64_t offset, uint32_t count,
+        std::vector<std::pair<std::string, SetRelationSpec>>& accesses) const;
+};
+
+}  // namespace spf_ie
+
+#endif
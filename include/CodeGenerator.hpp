@@ -0,0 +1,170 @@
+/*!
+ * \file CodeGenerator.hpp
+ *
+ * \brief Generation of C code from the specs of a Computation's statements.
+ */
+
+#ifndef SPFIE_CODEGENERATOR_HPP
+#define SPFIE_CODEGENERATOR_HPP
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/*!
+ * \class CodeGenerator
+ *
+ * \brief Writes the statements of a function as C code, in the loops and if
+ * statements described by their iteration spaces and execution schedules.
+ *
+ * Statements are ordered by their schedules, and those whose schedules
+ * share a prefix ending in an iterator share the loop over it. Each loop
+ * starts at the first lower bound on its iterator common to every statement
+ * in it, and runs while the iterator is below every upper bound they have in
+ * common, which may scale it (as in 32 * ti < n, for a loop over tiles);
+ * every other constraint becomes an if statement, placed around the
+ * outermost group of statements it applies to once the iterators it uses
+ * are defined. Uninterpreted function calls, such as
+ * index(i), are written as the array reads they stand for (index[i]).
+ * Statements are written as their source code, so the result is equivalent
+ * to the original function as long as the schedules are those made by the
+ * builder, or any transformation of them which is legal.
+ */
+class CodeGenerator {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! which must outlive the generator
+    explicit CodeGenerator(const std::vector<StmtSpec>& stmts)
+        : stmts(stmts) {}
+
+    //! Write the statements, in their loops and if statements
+    //! \param[in] os Stream to write to
+    //! \param[in] indent Number of levels (of 4 spaces) to indent the
+    //! outermost statements by
+    //! \return whether the code could be generated; if not, nothing is
+    //! written
+    bool writeBody(llvm::raw_ostream& os, int indent = 1) const;
+
+    //! Write a function definition with the statements as its body
+    //! \param[in] os Stream to write to
+    //! \param[in] prototype Declaration of the function, without a body
+    //! \return whether the code could be generated; if not, nothing is
+    //! written
+    bool writeFunction(llvm::raw_ostream& os,
+                       const std::string& prototype) const;
+
+    //! Write a line (such as a pragma) before a loop
+    //! \param[in] prefix Schedule of the statements in the loop, up to and
+    //! including the loop's iterator
+    //! \param[in] line Line to write
+    void annotateLoop(const ExecSchedule& prefix, const std::string& line) {
+        loopAnnotations.emplace_back(prefix, line);
+    }
+
+    //! Get whether some statement declares a variable, so that loops over
+    //! it do not declare it again
+    bool isDeclared(const std::string& var) const;
+
+    //! Get whether a statement is a declaration of a variable
+    static bool declares(const StmtSpec& stmt, const std::string& var);
+
+    //! Get the source code of a function's declaration, up to its body
+    //! \param[in] funcDecl Function, which must have a body
+    //! \param[in] Context ASTContext the function belongs to
+    static std::string getPrototype(clang::FunctionDecl* funcDecl,
+                                    const clang::ASTContext* Context);
+
+    //! Get the source code of a function's parameter declarations, without
+    //! the parentheses around them
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    static std::string getParameters(clang::FunctionDecl* funcDecl,
+                                     const clang::ASTContext* Context);
+
+    //! Get the element types of a function's array and pointer parameters
+    //! \param[in] funcDecl The function
+    //! \return the type of each parameter's elements, by parameter name
+    static std::map<std::string, std::string> getElementTypes(
+        clang::FunctionDecl* funcDecl);
+
+    //! Get the code which names generated for a function must not appear
+    //! in: its parameters, statements and iterators
+    //! \param[in] stmts Specs of the function's statements
+    //! \param[in] parameters Parameter declarations of the function
+    static std::string getUsedCode(const std::vector<StmtSpec>& stmts,
+                                   const std::string& parameters);
+
+    //! Find the bounds of a loop as code for it would be generated: the
+    //! first lower and upper bounds on its iterator which every statement in
+    //! it has
+    //! \param[in] loopStmts Specs of the statements in the loop
+    //! \param[in] level Depth of the loop
+    //! \param[out] lowerBound Inequality bounding the iterator from below
+    //! \param[out] upperBound Inequality bounding the iterator from above
+    //! \return whether both bounds were found, with an upper bound which
+    //! does not scale the iterator
+    static bool getLoopBounds(const std::vector<const StmtSpec*>& loopStmts,
+                              int level, SpecExp& lowerBound,
+                              SpecExp& upperBound);
+
+    //! Get the value a bound on a loop's iterator gives: the iterator's
+    //! first value for a lower bound, or the value it stays below for an
+    //! upper bound (or the iterator times its coefficient does, if the
+    //! bound scales it)
+    //! \param[in] bound Inequality bounding the iterator
+    //! \param[in] level Depth of the loop
+    static SpecExp getBoundValue(const SpecExp& bound, int level);
+
+    //! Write an expression as C, with uninterpreted function calls as
+    //! array reads
+    //! \param[in] exp Expression to write
+    //! \param[in] tuple Tuple declaration naming the tuple variables
+    static std::string expToString(const SpecExp& exp,
+                                   const std::vector<TupleElem>& tuple);
+
+   private:
+    /*!
+     * \struct PendingStmt
+     *
+     * \brief A statement yet to be written, with the constraints of its
+     * iteration space not yet enforced by enclosing loops or if statements
+     */
+    struct PendingStmt {
+        //! Position of the statement
+        unsigned int index;
+        //! Execution schedule
+        ExecSchedule schedule;
+        //! Remaining equalities, each equal to 0
+        std::vector<SpecExp> equalities;
+        //! Remaining inequalities, each greater than or equal to 0
+        std::vector<SpecExp> inequalities;
+    };
+
+    //! Specs of every statement
+    const std::vector<StmtSpec>& stmts;
+    //! Lines to write before loops, with the schedule prefixes of the loops
+    std::vector<std::pair<ExecSchedule, std::string>> loopAnnotations;
+
+    //! Write statements nested in the same loops, in schedule order
+    //! \param[in,out] pending Statements to write, ordered by schedule,
+    //! whose constraints are removed as they are enforced
+    //! \param[in] level Number of loops around the statements
+    //! \param[in] indent Number of levels to indent by
+    //! \param[out] os Stream to write to
+    //! \return whether the statements could be written
+    bool writeBlock(std::vector<PendingStmt>& pending, int level, int indent,
+                    llvm::raw_ostream& os) const;
+};
+
+}  // namespace spf_ie
+
+#endif
@@ -0,0 +1,81 @@
+/*!
+ * \file ComputationCache.hpp
+ *
+ * \brief On-disk cache of built Computations, keyed by the content of the
+ * functions they were built from.
+ */
+
+#ifndef SPFIE_COMPUTATIONCACHE_HPP
+#define SPFIE_COMPUTATIONCACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include "SetRelationSpec.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "llvm/ADT/StringRef.h"
+
+//! Version of spf-ie, which is part of every cache key so that entries
+//! built by other versions are never used
+#ifndef SPFIE_VERSION
+#define SPFIE_VERSION "unknown"
+#endif
+
+//! Version of the cache entry format, to be increased whenever the format
+//! or the meaning of entries changes
+#define CACHE_FORMAT_VERSION 4
+
+using namespace clang;
+
+namespace spf_ie {
+
+/*!
+ * \class ComputationCache
+ *
+ * \brief A directory of cached Computations, each stored as specs of its
+ * statements so that it can be rebuilt without the IEGenLib parser.
+ *
+ * Entries are named by a hash of everything that affects what is built
+ * from a function. They are written to a temporary file and then renamed
+ * into place, so that any number of processes may use the same directory
+ * concurrently and readers only ever see complete entries. Entries that
+ * cannot be read are treated as missing.
+ */
+class ComputationCache {
+   public:
+    //! \param[in] directory Directory holding the cache, which is created
+    //! if it does not exist
+    explicit ComputationCache(std::string directory);
+
+    //! Get the key identifying what would be built from a function: a hash
+    //! of its text as written and after preprocessing, the declarations it
+    //! refers to from outside itself, and the tool version
+    //! \param[in] funcDecl Function to get the key of
+    //! \param[in] Context ASTContext the function belongs to
+    static std::string getKey(FunctionDecl* funcDecl,
+                              const ASTContext* Context);
+
+    //! Load the statements of a cached Computation
+    //! \param[in] key Key of the function built
+    //! \param[out] stmts Specs of every statement, in order
+    //! \return whether the entry was found and read successfully
+    bool load(llvm::StringRef key, std::vector<StmtSpec>& stmts) const;
+
+    //! Store the statements of a built Computation. Failure to write is
+    //! ignored, since it only costs a rebuild later.
+    //! \param[in] key Key of the function built
+    //! \param[in] stmts Specs of every statement, in order
+    void store(llvm::StringRef key, const std::vector<StmtSpec>& stmts) const;
+
+   private:
+    //! Directory holding the cache
+    std::string directory;
+
+    //! Get the path of the entry for a key
+    std::string getEntryPath(llvm::StringRef key) const;
+};
+
+}  // namespace spf_ie
+
+#endif
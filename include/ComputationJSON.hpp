@@ -0,0 +1,74 @@
+/*!
+ * \file ComputationJSON.hpp
+ *
+ * \brief Output of built Computations as JSON, for other tools to consume.
+ */
+
+#ifndef SPFIE_COMPUTATIONJSON_HPP
+#define SPFIE_COMPUTATIONJSON_HPP
+
+#include <mutex>
+
+#include "iegenlib.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/*!
+ * \class ComputationJSON
+ *
+ * \brief Writes Computations as JSON objects, with sets and relations in
+ * IEGenLib syntax.
+ */
+class ComputationJSON {
+   public:
+    //! Write a Computation as a JSON object holding its data spaces (sorted)
+    //! and its statements, each with its source code, iteration space,
+    //! execution schedule, reads and writes
+    //! \param[in] json Stream to write to
+    //! \param[in] name Qualified name of the function the Computation was
+    //! built from
+    //! \param[in] computation Computation to write
+    //! \param[in] fileName Source file to record in the object, if not
+    //! empty
+    static void write(llvm::json::OStream& json, llvm::StringRef name,
+                      iegenlib::Computation* computation,
+                      llvm::StringRef fileName = "");
+
+   private:
+    ComputationJSON() = delete;
+};
+
+/*!
+ * \class NDJSONEmitter
+ *
+ * \brief Streams Computations as newline-delimited JSON, one record per
+ * function, so that consumers can start before processing is done.
+ *
+ * Records may be emitted from any thread; each is written and flushed as a
+ * whole line.
+ */
+class NDJSONEmitter {
+   public:
+    //! \param[in] os Stream to write records to
+    explicit NDJSONEmitter(llvm::raw_ostream& os) : os(os) {}
+
+    //! Write the record for a function
+    //! \param[in] fileName Source file the function is in
+    //! \param[in] name Qualified name of the function
+    //! \param[in] computation Computation built from the function
+    void emit(llvm::StringRef fileName, llvm::StringRef name,
+              iegenlib::Computation* computation);
+
+   private:
+    //! Stream to write records to
+    llvm::raw_ostream& os;
+    //! Guards os, so that records are not interleaved
+    std::mutex osMutex;
+};
+
+}  // namespace spf_ie
+
+#endif
@@ -0,0 +1,45 @@
+/*!
+ * \file ConstraintSolver.hpp
+ *
+ * \brief Conservative satisfiability checks for the constraints of sets and
+ * relations described by specs.
+ */
+
+#ifndef SPFIE_CONSTRAINTSOLVER_HPP
+#define SPFIE_CONSTRAINTSOLVER_HPP
+
+#include "SetRelationSpec.hpp"
+
+//! Largest number of constraints kept while eliminating variables, beyond
+//! which a set or relation is assumed to be satisfiable
+#define SOLVER_MAX_CONSTRAINTS 512
+
+namespace spf_ie {
+
+/*!
+ * \class ConstraintSolver
+ *
+ * \brief Decides whether a set or relation may be non-empty.
+ *
+ * Symbolic constants and tuple variables are treated as integer unknowns,
+ * and each distinct uninterpreted function call as an unknown of its own
+ * (so nothing is assumed about what functions return). Equalities are
+ * eliminated by substitution and inequalities by Fourier-Motzkin
+ * elimination, tightening each constraint to integer solutions as it goes.
+ * Answers are conservative: "empty" is only reported when the constraints
+ * truly cannot be satisfied.
+ */
+class ConstraintSolver {
+   public:
+    //! Check whether a set or relation may have any elements
+    //! \param[in] spec Set or relation to check
+    //! \return false if spec is certainly empty, otherwise true
+    static bool maybeSatisfiable(const SetRelationSpec& spec);
+
+   private:
+    ConstraintSolver() = delete;
+};
+
+}  // namespace spf_ie
+
+#endif
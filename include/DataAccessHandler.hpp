@@ -3,15 +3,23 @@
 
 #include <stack>
 #include <string>
-#include <unordered_set>
-#include <utility>
-#include <vector>
 
+#include "SymbolTable.hpp"
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Expr.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/raw_ostream.h"
 
 //! Maximum allowed array dimension (a safe estimate to avoid stack overflow)
 #define MAX_ARRAY_DIM 50
 
+//! Number of array accesses per statement stored inline, without heap
+//! allocation
+#define ACCESSES_INLINE_SIZE 4
+
 using namespace clang;
 
 namespace spf_ie {
@@ -19,21 +27,32 @@ namespace spf_ie {
 /*!
  * \struct ArrayAccess
  *
- * \brief Representation of an array (subscript) access
+ * \brief Representation of an array (subscript) access, or of an access to a
+ * scalar, which has no indexes
  *
  * Used because the AST's representation of a multidimensional array access
- * is difficult to work with for our purposes.
+ * is difficult to work with for our purposes. Indexes are stored in the
+ * per-function arena, so an ArrayAccess is cheap to copy but must not
+ * outlive the processing of its function.
  */
 struct ArrayAccess {
-    ArrayAccess(int64_t id, Expr* base, std::vector<Expr*> indexes, bool isRead)
-        : id(id), base(base), indexes(indexes), isRead(isRead) {}
+    ArrayAccess(int64_t id, Expr* base, SymbolID dataSpace,
+                llvm::ArrayRef<Expr*> indexes, bool isRead)
+        : id(id),
+          base(base),
+          dataSpace(dataSpace),
+          indexes(indexes),
+          isRead(isRead) {}
 
     //! ID of original AST array access expression
     int64_t id;
-    //! Base array being accessed
+    //! Base array (or scalar) being accessed, or null for a scalar
+    //! initialized in its declaration
     Expr* base;
+    //! Name of the data space (base array) accessed
+    SymbolID dataSpace;
     //! Indexes accessed in the array
-    std::vector<Expr*> indexes;
+    llvm::ArrayRef<Expr*> indexes;
     //! Whether this access is a read or not (a write)
     bool isRead;
 };
@@ -45,37 +64,80 @@ struct ArrayAccess {
  */
 struct DataAccessHandler {
    public:
+    //! \param[in] symbols Symbol table of the code whose accesses are
+    //! handled
+    //! \param[in] arena Allocator for access information, which lives as
+    //! long as the function being processed
+    DataAccessHandler(SymbolTable* symbols, llvm::BumpPtrAllocator* arena)
+        : Context(symbols->getContext()), symbols(symbols), arena(arena) {}
+
     //! Add all the arrays accessed in the expression as reads
     void processAsReads(Expr* expr);
 
     //! Add the array accessed as a write, and any accessed within it as reads
     void processAsWrite(ArraySubscriptExpr* expr);
 
+    //! Add an access to a scalar, which is a data space with a single
+    //! element
+    //! \param[in] id ID of the AST node accessing the scalar
+    //! \param[in] base Expression naming the scalar, or null for a scalar
+    //! initialized in its declaration
+    //! \param[in] name Name of the scalar
+    //! \param[in] isRead Whether this access is a read
+    void processScalarAccess(int64_t id, Expr* base, SymbolID name,
+                             bool isRead);
+
     //! Make ArrayAccess and sub-accesses (recursively) from the given
     //! expression
     //! \param[in] expr Expression to process
     //! \param[in] isRead Whether this access is a read
     //! \param[in,out] accessComponents Current list of sub-accesses; after
     //! processing completes, the last element will be the outermost access.
+    //! \param[in] symbols Symbol table of the code the expression belongs to
+    //! \param[in] arena Allocator to store access indexes in
     static void buildDataAccess(
         ArraySubscriptExpr* expr, bool isRead,
-        std::vector<std::pair<std::string, ArrayAccess>>& accessComponents);
-
-    //! Get a string representation of the array access, like A(i,j).
-    //! This method isn't on ArrayAccess itself in case we run into something
-    //! like A[B[i]]; in this case, the B[j] component will already have a
-    //! string representation saved, and we use that instead of building a new
-    //! one.
-    static std::string makeStringForArrayAccess(
-        ArrayAccess* access,
-        const std::vector<std::pair<std::string, ArrayAccess>>& components);
-
-    //! Data spaces accessed
-    std::unordered_set<std::string> dataSpaces;
+        llvm::SmallVectorImpl<ArrayAccess>& accessComponents,
+        SymbolTable* symbols, llvm::BumpPtrAllocator& arena);
+
+    //! Split a (possibly multidimensional) array access into the base array
+    //! and its indexes, outermost dimension first
+    //! \param[in] expr Array access to split
+    //! \param[out] base Base array being accessed
+    //! \param[out] indexes Indexes accessed in the array
+    //! \param[in] Context ASTContext the expression belongs to
+    static void getArrayAccessParts(ArraySubscriptExpr* expr, Expr*& base,
+                                    llvm::SmallVectorImpl<Expr*>& indexes,
+                                    const ASTContext* Context);
+
+    //! Get a string representation of the array access, like A(i,j), with
+    //! any accesses in its indexes also written as function calls
+    static std::string makeStringForArrayAccess(ArrayAccess* access,
+                                                SymbolTable* symbols);
+
+    //! Print an expression with every array access in it written as a
+    //! function call (for example, "i < A[i]" becomes "i < A(i)").
+    //! Works in a single walk over the expression's AST, so the cost is
+    //! linear in the size of the expression.
+    //! \param[in] expr Expression to print
+    //! \param[out] os Stream to print to
+    //! \param[in] symbols Symbol table of the code the expression belongs to
+    static void printExprWithSafeArrays(Expr* expr, llvm::raw_ostream& os,
+                                        SymbolTable* symbols);
+
+    //! Data spaces accessed, in order of first access
+    llvm::SmallSetVector<SymbolID, ACCESSES_INLINE_SIZE> dataSpaces;
     //! Array accesses
-    std::vector<std::pair<std::string, ArrayAccess>> arrayAccesses;
+    llvm::SmallVector<ArrayAccess, ACCESSES_INLINE_SIZE> arrayAccesses;
 
    private:
+    //! ASTContext of the code being processed
+    const ASTContext* Context;
+    //! Symbol table of the code being processed
+    SymbolTable* symbols;
+    //! Allocator for access information of the function being processed
+    llvm::BumpPtrAllocator* arena;
+
     //! Make an ArrayAccess from an ArraySubscriptExpr and add it to the
     //! appropriate map appropriate map
     void addDataAccess(ArraySubscriptExpr* expr, bool isRead);
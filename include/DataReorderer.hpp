@@ -0,0 +1,160 @@
+/*!
+ * \file DataReorderer.hpp
+ *
+ * \brief Generation of reverse Cuthill-McKee reordering inspectors and of
+ * executors running a loop nest over reordered rows and data.
+ */
+
+#ifndef SPFIE_DATAREORDERER_HPP
+#define SPFIE_DATAREORDERER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PrivatizationAnalysis.hpp"
+#include "SetRelationSpec.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/*!
+ * \class DataReorderer
+ *
+ * \brief Finds an outermost loop over the rows of a sparse matrix in CSR
+ * format whose iterations may run in any order, and writes C code
+ * renumbering its rows, and the elements of arrays indexed by row or
+ * column, for locality.
+ *
+ * In a loop like that of a sparse matrix-vector product, y[i] +=
+ * A[k] * x[col[k]], the elements of x read by nearby rows are only close
+ * together if the matrix's nonzeros are close to its diagonal. The
+ * inspector finds a reverse Cuthill-McKee ordering of the rows, which
+ * narrows the band the nonzeros are in, treating row i as adjacent to every
+ * col[k] in it. Arrays accessed only at a row i or a column col[k] are
+ * permuted into copies, and the executor runs the rows in the new order,
+ * with access relations (and statements) reading the copies through the
+ * inverse permutation as an uninterpreted function: y[i] becomes y_rcm[p],
+ * and x[col[k]] becomes x_rcm[inv_perm[col[k]]]. Other functions copy the
+ * arrays into the new order and copy those written back.
+ */
+class DataReorderer {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! which must outlive the reorderer
+    //! \param[in] analysis Dependences and scalar uses of the statements,
+    //! which must outlive the reorderer
+    DataReorderer(const std::vector<StmtSpec>& stmts,
+                  const PrivatizationAnalysis& analysis)
+        : stmts(stmts), analysis(analysis) {}
+
+    //! Find the first outermost loop whose rows and data can be reordered
+    //! \param[out] reason Why no loop can be, if none can
+    //! \return whether a loop was found
+    bool findLoop(std::string& reason);
+
+    //! Write the inspector, the functions permuting the data, and the
+    //! executor for the loop found by findLoop
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the original function, which the names of
+    //! the generated functions start with
+    //! \param[in] returnType Return type of the original function, which
+    //! the executor also has
+    //! \param[in] parameters Parameter declarations of the original
+    //! function, which every generated function takes first
+    //! \param[in] elementTypes Element types of the function's arrays, by
+    //! name, which must include those permuted
+    //! \return whether the code could be generated; if not, nothing is
+    //! written
+    bool writeFunctions(
+        llvm::raw_ostream& os, const std::string& name,
+        const std::string& returnType, const std::string& parameters,
+        const std::map<std::string, std::string>& elementTypes) const;
+
+    //! Get the arrays permuted, in order of first access, once findLoop
+    //! has found a loop
+    const std::vector<std::string>& getPermutedArrays() const {
+        return permutedArrays;
+    }
+
+   private:
+    /*!
+     * \struct Names
+     *
+     * \brief Names of the permutations, copies and iterators generated
+     */
+    struct Names {
+        //! Array giving the original row at each new position
+        std::string perm;
+        //! Array giving the new position of each original row
+        std::string invPerm;
+        //! Iterator over new positions
+        std::string position;
+        //! Copies of the permuted arrays, by original name
+        std::map<std::string, std::string> copies;
+        //! Local variables of the inspector
+        std::vector<std::string> locals;
+    };
+
+    //! Specs of every statement
+    const std::vector<StmtSpec>& stmts;
+    //! Dependences and scalar uses of the statements
+    const PrivatizationAnalysis& analysis;
+    //! Statements in the loop found
+    std::vector<unsigned int> loopStmts;
+    //! Array of starts of rows
+    std::string rowPointers;
+    //! Array of column indexes
+    std::string columnIndexes;
+    //! Arrays accessed only at a row or column, which are permuted
+    std::vector<std::string> permutedArrays;
+    //! Those of the permuted arrays which the loop writes
+    std::vector<std::string> writtenArrays;
+    //! Inequality bounding the loop's iterator from below
+    SpecExp lowerBound;
+    //! Inequality bounding the loop's iterator from above
+    SpecExp upperBound;
+
+    //! Check whether the rows and data of an outermost loop can be
+    //! reordered, recording the details of the loop if so
+    //! \param[in] loop Statements in the loop
+    //! \param[out] reason Why they cannot be, if they cannot
+    bool checkLoop(const std::vector<unsigned int>& loop,
+                   std::string& reason);
+
+    //! Make the names of the permutations, copies and iterators
+    //! \param[in] usedCode Code the names may not appear in
+    Names makeNames(const std::string& usedCode) const;
+
+    //! Rewrite the source code of a statement in the loop to access the
+    //! copies of the permuted arrays
+    //! \param[in] source The original source code
+    //! \param[in] names Names of the permutations, copies and iterators
+    //! \param[out] rewritten The rewritten source code
+    //! \return whether every use of a permuted array is an access to one
+    //! of its elements, so that it could be rewritten
+    bool rewriteSource(const std::string& source, const Names& names,
+                       std::string& rewritten) const;
+
+    //! Make the specs of the executor's statements: those of the original
+    //! function, with the loop running over the new positions of its rows
+    //! \param[in] names Names of the permutations, copies and iterators
+    //! \param[in] isIteratorDeclared Whether the loop's iterator is
+    //! declared outside the loop
+    std::vector<StmtSpec> makeExecutorStmts(const Names& names,
+                                            bool isIteratorDeclared) const;
+
+    //! Write the inspector, which finds the reverse Cuthill-McKee ordering
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the original function
+    //! \param[in] parameters Parameter declarations of the original
+    //! function
+    //! \param[in] names Names of the permutations and inspector's locals
+    void writeInspector(llvm::raw_ostream& os, const std::string& name,
+                        const std::string& parameters,
+                        const Names& names) const;
+};
+
+}  // namespace spf_ie
+
+#endif
@@ -0,0 +1,186 @@
+/*!
+ * \file DependenceGraph.hpp
+ *
+ * \brief Data dependences between the statements of a Computation, found
+ * from the specs of their iteration spaces, schedules and data accesses.
+ */
+
+#ifndef SPFIE_DEPENDENCEGRAPH_HPP
+#define SPFIE_DEPENDENCEGRAPH_HPP
+
+#include <string>
+#include <vector>
+
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Kinds of data dependence
+enum class DependenceKind {
+    //! Read after write
+    Flow,
+    //! Write after read
+    Anti,
+    //! Write after write
+    Output
+};
+
+/*!
+ * \struct Dependence
+ *
+ * \brief A dependence of some instances of one statement (the sink) on
+ * earlier instances of another (the source), through one data space
+ */
+struct Dependence {
+    //! Get whether the dependence is carried by a loop, rather than being
+    //! between instances in the same iteration of every common loop
+    bool isLoopCarried() const { return level >= 0; }
+
+    //! Position of the source statement in its Computation
+    unsigned int source;
+    //! Position of the sink statement in its Computation
+    unsigned int sink;
+    //! Kind of dependence
+    DependenceKind kind;
+    //! Data space both statements access
+    std::string dataSpace;
+    //! Depth (0 being outermost) of the common loop carrying the
+    //! dependence, or -1 if it is loop-independent
+    int level;
+    //! Operator of the reduction both statements make into the data space,
+    //! or None if they are not reductions with the same operator. Such a
+    //! dependence does not order the instances, as long as each is made
+    //! atomically or into a private copy.
+    ReductionOp reduction;
+    //! Relation from source to sink iterations which are dependent, with
+    //! sink iterators primed
+    SetRelationSpec relation;
+};
+
+/*!
+ * \class DependenceGraph
+ *
+ * \brief The flow, anti and output dependences between every pair of
+ * statements (including a statement and itself) of one function.
+ *
+ * Each dependence is split by the common loop carrying it, so that a
+ * dependence is recorded at a loop level only if some source and sink
+ * iterations are equal in every loop outside that level and ordered at it.
+ * Dependence relations whose constraints cannot be satisfied, as decided
+ * by ConstraintSolver, are left out; the rest may over-approximate, since
+ * nothing is known about uninterpreted functions. Data spaces are
+ * identified by name, so distinct arrays (such as two pointer parameters)
+ * are assumed not to overlap.
+ */
+class DependenceGraph {
+   public:
+    //! Find the dependences between statements
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! with schedules as made by SPFComputationBuilder
+    explicit DependenceGraph(const std::vector<StmtSpec>& stmts);
+
+    //! Get every dependence found, ordered by source, then sink
+    const std::vector<Dependence>& getDependences() const {
+        return dependences;
+    }
+
+    //! Get the number of statements in the graph
+    unsigned int getNumStmts() const { return sourceCodes.size(); }
+
+    //! Get the number of loops enclosing a statement
+    int getLoopDepth(unsigned int stmt) const;
+
+    //! Get whether two statements are both inside the same loop
+    //! \param[in] stmt1 One statement
+    //! \param[in] stmt2 Other statement
+    //! \param[in] level Depth of the loop enclosing stmt1
+    bool shareLoop(unsigned int stmt1, unsigned int stmt2, int level) const;
+
+    //! Get whether any dependence other than between reductions is carried
+    //! by a loop
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    bool isCarriedByLoop(unsigned int stmt, int level) const {
+        return findCarriedDependence(stmt, level) != nullptr;
+    }
+
+    //! Find the first dependence carried by a loop, other than between
+    //! reductions
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    //! \return the dependence, or nullptr if the loop carries none
+    const Dependence* findCarriedDependence(unsigned int stmt,
+                                            int level) const;
+
+    //! Find the dependences between reductions carried by a loop, which
+    //! allow its iterations to run in parallel only if each reduction is
+    //! made into a private copy, and the copies then combined
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    std::vector<const Dependence*> findCarriedReductions(unsigned int stmt,
+                                                         int level) const;
+
+    //! Get whether an instance of one statement runs before an instance of
+    //! another in the same iteration of every common loop
+    bool isTextuallyBefore(unsigned int stmt1, unsigned int stmt2) const;
+
+    //! Get the source code of a statement
+    const std::string& getSourceCode(unsigned int stmt) const {
+        return sourceCodes[stmt];
+    }
+
+    //! Get the execution schedule of a statement
+    const ExecSchedule& getSchedule(unsigned int stmt) const {
+        return schedules[stmt];
+    }
+
+    //! Write the graph in Graphviz DOT format, with an edge per dependence
+    //! labeled with its kind, data space and carrying loop
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the graph, such as the function's name
+    void writeDot(llvm::raw_ostream& os, llvm::StringRef name) const;
+
+    //! Get the name of a kind of dependence
+    static const char* getKindName(DependenceKind kind);
+
+    //! Check whether transformed statements still run every source
+    //! instance of a dependence before the sink instances depending on it,
+    //! comparing their new execution schedules lexicographically
+    //! \param[in] dependence Dependence between the original statements
+    //! \param[in] source Transformed source statement, whose tuple ends with
+    //! the original statement's iterators, after any it adds (such as the
+    //! iterators of loops over tiles)
+    //! \param[in] sink Transformed sink statement, likewise
+    //! \return false if some sink instance may run first, or at the same
+    //! time
+    static bool isPreservedBy(const Dependence& dependence,
+                              const StmtSpec& source, const StmtSpec& sink);
+
+   private:
+    //! Source code of each statement, for output
+    std::vector<std::string> sourceCodes;
+    //! Iterator names of each statement
+    std::vector<std::vector<std::string>> iterators;
+    //! Execution schedule of each statement
+    std::vector<ExecSchedule> schedules;
+    //! Dependences found
+    std::vector<Dependence> dependences;
+
+    //! Get the number of loops enclosing both of two statements
+    int getCommonLoopDepth(unsigned int stmt1, unsigned int stmt2) const;
+
+    //! Add the dependences between a pair of accesses to the same data
+    //! space, at every level they may be carried at
+    void addDependences(const std::vector<StmtSpec>& stmts,
+                        unsigned int source, unsigned int sink,
+                        DependenceKind kind, const std::string& dataSpace,
+                        const SetRelationSpec& sourceAccess,
+                        const SetRelationSpec& sinkAccess);
+};
+
+}  // namespace spf_ie
+
+#endif
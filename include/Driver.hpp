@@ -1,13 +1,37 @@
 #ifndef SPFIE_DRIVER_HPP
 #define SPFIE_DRIVER_HPP
 
-#include "clang/AST/ASTContext.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "iegenlib.h"
 
 namespace spf_ie {
 
-//! Globally-accessible pointer to the ASTContext, initialized before the
-//! tool runs.
-extern const clang::ASTContext* Context;
+/*!
+ * \struct TUResult
+ *
+ * \brief Everything produced by processing one translation unit, kept
+ * separate per file so that concurrently processed files can be reported in
+ * a deterministic order.
+ */
+struct TUResult {
+    //! Name of the processed source file
+    std::string fileName;
+    //! Computations built, paired with the qualified name of the function
+    //! each was built from, in source order. Only kept if they will be
+    //! printed.
+    std::vector<std::pair<std::string, std::unique_ptr<iegenlib::Computation>>>
+        computations;
+    //! Report of which loops were parallelized, if parallelizing
+    std::string parallelizationReport;
+    //! Nonzero if the file could not be processed completely, in which case
+    //! an error has been printed and only the functions before the failure
+    //! have Computations
+    int status = 0;
+};
 
 }  // namespace spf_ie
 
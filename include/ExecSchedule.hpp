@@ -1,59 +1,66 @@
 #ifndef SPFIE_EXECSCHEDULE_HPP
 #define SPFIE_EXECSCHEDULE_HPP
 
-#include <memory>
-#include <string>
-#include <vector>
+#include "llvm/ADT/SmallVector.h"
+
+//! Number of schedule tuple entries stored inline, without heap allocation;
+//! enough for loop nests up to depth 4
+#define SCHEDULE_INLINE_SIZE 9
 
 namespace spf_ie {
 
-struct ScheduleVal;
+/*!
+ * \struct ScheduleVal
+ *
+ * \brief An entry of an execution schedule, which may be a variable or
+ * simply a number.
+ *
+ * Variables are always iterators of enclosing loops, so they are identified
+ * by their position in the iterator tuple rather than by name.
+ */
+struct ScheduleVal {
+    //! Make an entry holding a number
+    static ScheduleVal makeNum(int num) { return ScheduleVal(num, false); }
+    //! Make an entry holding the iterator at the given tuple position
+    static ScheduleVal makeVar(int iteratorPos) {
+        return ScheduleVal(iteratorPos, true);
+    }
+
+    //! The number, or the iterator's tuple position for a variable
+    int value;
+    //! Whether this ScheduleVal contains a variable
+    bool valueIsVar;
+
+   private:
+    ScheduleVal(int value, bool valueIsVar)
+        : value(value), valueIsVar(valueIsVar) {}
+};
 
 /*!
  * \struct ExecSchedule
  *
  * \brief An execution schedule tuple, plus a few utilities for it
+ *
+ * Schedules are cheap to copy: entries are plain values stored inline for
+ * typical nesting depths. Schedules of different dimensions are not padded
+ * here; callers pad them with zeroes when producing output.
  */
 struct ExecSchedule {
-    ExecSchedule() {}
-
-    //! Copy constructor
-    ExecSchedule(const ExecSchedule &other);
-
     //! Add a value to the end of the schedule tuple
-    void pushValue(ScheduleVal value);
+    void pushValue(ScheduleVal value) { scheduleTuple.push_back(value); }
 
     //! Remove the value at the end of the schedule tuple
     //! \return the removed value
-    ScheduleVal popValue();
+    ScheduleVal popValue() { return scheduleTuple.pop_back_val(); }
 
     //! Move statement number forward in the execution schedule
     void advanceSchedule();
 
     //! Get the dimension of the execution schedule
-    int getDimension() { return scheduleTuple.size(); }
-
-    //! Zero-pad this execution schedule up to a certain dimension
-    void zeroPadDimension(int dim);
+    int getDimension() const { return scheduleTuple.size(); }
 
     //! Actual execution schedule ordering tuple
-    std::vector<std::shared_ptr<ScheduleVal>> scheduleTuple;
-};
-
-/*!
- * \struct ScheduleVal
- *
- * \brief An entry of an execution schedule, which may be a variable or
- * simply a number.
- */
-struct ScheduleVal {
-    ScheduleVal(std::string var);
-    ScheduleVal(int num);
-
-    std::string var;
-    int num;
-    //! Whether this ScheduleVal contains a variable
-    bool valueIsVar;
+    llvm::SmallVector<ScheduleVal, SCHEDULE_INLINE_SIZE> scheduleTuple;
 };
 
 }  // namespace spf_ie
@@ -0,0 +1,203 @@
+/*!
+ * \file FormatConverter.hpp
+ *
+ * \brief Generation of inspectors converting the CSR matrix a loop nest
+ * traverses to another sparse format, and of executors traversing the new
+ * format instead.
+ */
+
+#ifndef SPFIE_FORMATCONVERTER_HPP
+#define SPFIE_FORMATCONVERTER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SetRelationSpec.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Sparse matrix formats a CSR traversal can be converted to
+enum class SparseFormat {
+    //! ELLPACK: every row padded with zeros to the length of the longest,
+    //! stored in two-dimensional arrays with a row each
+    ELL,
+    //! Block CSR: the nonzero square blocks of a fixed size, stored by
+    //! block row
+    BCSR,
+    //! Compressed sparse column
+    CSC
+};
+
+/*!
+ * \class FormatConverter
+ *
+ * \brief Finds an outermost loop nest traversing a matrix in compressed
+ * sparse row (CSR) format and writes C code converting the matrix to another
+ * format, along with a version of the function traversing that format.
+ *
+ * A CSR traversal is a loop over rows i with an inner loop over entries k,
+ * from ptr[i] to ptr[i + 1], which reads arrays holding the matrix (such as
+ * the values, A[k], and column indexes, col[k]) only at k, and other arrays
+ * only through the column index (x[col[k]]). Every statement in the inner
+ * loop must be a sum reduction, which gives the same result with its
+ * contributions reordered, and, since ELL and BCSR store explicit zeros, the
+ * contribution of every entry must be zero when its values are: for them,
+ * every statement must add (with += or -=) a product one of whose factors
+ * is the entry's value, such as A[k].
+ *
+ * Inspectors find the size of the new format, for the caller to allocate,
+ * and convert the matrix. The executor has the rewritten statements, with
+ * their iteration spaces and access relations describing the traversal of
+ * the new format, and is written by CodeGenerator.
+ */
+class FormatConverter {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! which must outlive the converter
+    //! \param[in] format Format to convert to
+    //! \param[in] blockSize Number of rows and columns in each block, for
+    //! BCSR
+    FormatConverter(const std::vector<StmtSpec>& stmts, SparseFormat format,
+                    int blockSize)
+        : stmts(stmts), format(format), blockSize(blockSize) {}
+
+    //! Find the first outermost loop nest which traverses a CSR matrix in a
+    //! way which can be converted
+    //! \param[out] reason Why no loop nest can, if none can
+    //! \return whether a loop nest was found
+    bool findLoop(std::string& reason);
+
+    //! Write the inspectors and executor for the loop nest found by
+    //! findLoop
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the original function, which the names of
+    //! the generated functions start with
+    //! \param[in] returnType Return type of the original function, which
+    //! the executor also has
+    //! \param[in] parameters Parameter declarations of the original
+    //! function, which every generated function takes first
+    //! \param[in] elementTypes Element types of the function's arrays, by
+    //! name, which must include those holding the matrix
+    //! \return whether the code could be generated; if not, nothing is
+    //! written
+    bool writeFunctions(
+        llvm::raw_ostream& os, const std::string& name,
+        const std::string& returnType, const std::string& parameters,
+        const std::map<std::string, std::string>& elementTypes) const;
+
+    //! Get the specs of the executor's statements: those of the original
+    //! function, with the loop nest found by findLoop traversing the new
+    //! format, under the default names of the new arrays
+    std::vector<StmtSpec> getExecutorStmts() const;
+
+    //! Get the lowercase name of a format, as used in generated names
+    static const char* getFormatName(SparseFormat format);
+
+   private:
+    /*!
+     * \struct Names
+     *
+     * \brief Names of the arrays, sizes and iterators of the new format
+     */
+    struct Names {
+        //! Size of the new format: the row width for ELL, or number of
+        //! columns for BCSR and CSC
+        std::string size;
+        //! Number of block rows, for BCSR
+        std::string blockRows;
+        //! Array of starts of columns (CSC) or block rows (BCSR)
+        std::string pointers;
+        //! Array of row indexes (CSC) or block column indexes (BCSR)
+        std::string indexes;
+        //! Array holding the column indexes, for ELL
+        std::string columns;
+        //! Arrays holding the matrix's values, by original name
+        std::map<std::string, std::string> values;
+        //! Iterators of the executor's loops, outermost first
+        std::vector<std::string> iterators;
+        //! Local variables of the inspectors
+        std::vector<std::string> locals;
+    };
+
+    //! Specs of every statement
+    const std::vector<StmtSpec>& stmts;
+    //! Format to convert to
+    SparseFormat format;
+    //! Number of rows and columns in each BCSR block
+    int blockSize;
+    //! Statements in the loop nest found
+    std::vector<unsigned int> loopStmts;
+    //! Statements in the loop over the entries of a row
+    std::vector<unsigned int> entryStmts;
+    //! Array of starts of rows
+    std::string rowPointers;
+    //! Array of column indexes
+    std::string columnIndexes;
+    //! Arrays holding the matrix's values, other than the column indexes
+    std::vector<std::string> valueArrays;
+    //! Inequality bounding the row iterator from below
+    SpecExp rowLowerBound;
+    //! Inequality bounding the row iterator from above
+    SpecExp rowUpperBound;
+    //! Inequality bounding the entry iterator from below
+    SpecExp entryLowerBound;
+    //! Inequality bounding the entry iterator from above
+    SpecExp entryUpperBound;
+
+    //! Check whether an outermost loop nest traverses a CSR matrix in a way
+    //! which can be converted, recording the details of the loop if so
+    //! \param[in] loop Statements in the loop nest
+    //! \param[out] reason Why it cannot be, if it cannot
+    bool checkLoop(const std::vector<unsigned int>& loop,
+                   std::string& reason);
+
+    //! Make the names of the new format's arrays, sizes and iterators
+    //! \param[in] usedCode Code the names may not appear in
+    Names makeNames(const std::string& usedCode) const;
+
+    //! Get the expression the row iterator equals in the new traversal
+    SpecExp getRowExp(const Names& names) const;
+
+    //! Get the expression the column index of an entry equals in the new
+    //! traversal
+    SpecExp getColumnExp(const Names& names) const;
+
+    //! Get the indexes of an entry's element in the new format's arrays,
+    //! in terms of the new traversal's iterators
+    std::vector<SpecExp> getEntryIndexes() const;
+
+    //! Rewrite an expression in terms of the original loop nest's
+    //! iterators for the new traversal
+    SpecExp rewriteExp(const SpecExp& exp, const Names& names) const;
+
+    //! Rewrite the source code of a statement in the loop over entries for
+    //! the new traversal
+    //! \param[in] source The original source code
+    //! \param[in] names Names of the new format's arrays and iterators
+    //! \param[out] rewritten The rewritten source code
+    //! \return whether the statement only uses the entry iterator to index
+    //! the matrix's arrays, so that it could be rewritten
+    bool rewriteSource(const std::string& source, const Names& names,
+                       std::string& rewritten) const;
+
+    //! Make the specs of the executor's statements
+    std::vector<StmtSpec> makeExecutorStmts(const Names& names) const;
+
+    //! Write the inspectors finding the new format's size and converting
+    //! the matrix to it
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the original function
+    //! \param[in] parameters Parameter declarations of the original
+    //! function
+    //! \param[in] names Names of the new format's arrays and sizes
+    //! \param[in] newArrays Declarations of the new format's arrays
+    void writeInspectors(llvm::raw_ostream& os, const std::string& name,
+                         const std::string& parameters, const Names& names,
+                         const std::string& newArrays) const;
+};
+
+}  // namespace spf_ie
+
+#endif
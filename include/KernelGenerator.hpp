@@ -0,0 +1,68 @@
+/*!
+ * \file KernelGenerator.hpp
+ *
+ * \brief Synthesis of C kernels with a given shape, for benchmarking.
+ */
+
+#ifndef SPFIE_KERNELGENERATOR_HPP
+#define SPFIE_KERNELGENERATOR_HPP
+
+#include <string>
+
+namespace spf_ie {
+
+/*!
+ * \struct KernelShape
+ *
+ * \brief Parameters controlling the structure of a generated kernel
+ */
+struct KernelShape {
+    //! Number of nested for loops around the statements
+    int loopDepth = 2;
+    //! Number of statements in the innermost loop body
+    int stmtsPerBody = 1;
+    //! Dimension of each array accessed
+    int arrayDims = 1;
+    //! Number of levels of indirection in each index, so that 1 gives
+    //! accesses like x[col[k]]
+    int indirectionDepth = 0;
+    //! Number of nested if statements inside the innermost loop
+    int ifDepth = 0;
+    //! Number of (identical, separately named) functions to generate
+    int numFunctions = 1;
+};
+
+/*!
+ * \class KernelGenerator
+ *
+ * \brief Generates C source code for kernels that the builder accepts.
+ *
+ * Each statement of the innermost body writes its own array and reads two
+ * others, so statements grow the number of data spaces as well as the
+ * number of accesses.
+ */
+class KernelGenerator {
+   public:
+    //! Generate a translation unit containing kernels of the given shape
+    //! \param[in] shape Structure of the kernels to generate
+    //! \return C source code
+    static std::string generate(const KernelShape& shape);
+
+    //! Get the number of statements the builder will find in each function
+    //! generated with the given shape
+    static int getStmtsPerFunction(const KernelShape& shape);
+
+   private:
+    //! Generate one kernel function
+    static std::string generateFunction(const KernelShape& shape,
+                                        const std::string& name);
+
+    //! Generate the index expression for one array dimension
+    static std::string generateIndex(const KernelShape& shape, int dim);
+
+    KernelGenerator() = delete;
+};
+
+}  // namespace spf_ie
+
+#endif
@@ -0,0 +1,119 @@
+/*!
+ * \file LevelSetGenerator.hpp
+ *
+ * \brief Generation of level-set (wavefront) inspectors and executors for
+ * loops whose carried dependences go through index arrays, such as sparse
+ * triangular solves.
+ */
+
+#ifndef SPFIE_LEVELSETGENERATOR_HPP
+#define SPFIE_LEVELSETGENERATOR_HPP
+
+#include <string>
+#include <vector>
+
+#include "PrivatizationAnalysis.hpp"
+#include "SetRelationSpec.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/*!
+ * \class LevelSetGenerator
+ *
+ * \brief Finds an outermost loop whose iterations depend on each other only
+ * through one array, each writing only the element indexed by its own
+ * iteration, and writes C code running it a wavefront at a time.
+ *
+ * In such a loop, like the one over rows of a sparse lower triangular solve
+ * (which writes x[i] and reads x[col[k]]), which iterations depend on which
+ * is only known once the index arrays are. The inspector, run once for each
+ * set of index arrays, gives each iteration a level one greater than that
+ * of every earlier iteration whose element it reads, or later iteration
+ * whose element it reads before that iteration writes it; it then orders
+ * the iterations by level. The executor runs the levels in order, running
+ * the iterations of each level in parallel with `#pragma omp parallel for`,
+ * with every statement in the loop copied from the source.
+ */
+class LevelSetGenerator {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! which must outlive the generator
+    //! \param[in] analysis Dependences and scalar uses of the statements,
+    //! which must outlive the generator
+    LevelSetGenerator(const std::vector<StmtSpec>& stmts,
+                      const PrivatizationAnalysis& analysis)
+        : stmts(stmts), analysis(analysis) {}
+
+    //! Find the first outermost loop whose iterations can be run by level
+    //! \param[out] reason Why no loop can, if none can
+    //! \return whether a loop was found
+    bool findLoop(std::string& reason);
+
+    //! Write the inspector and executor for the loop found by findLoop.
+    //! The inspector fills two arrays given by the caller: level_ptr, with
+    //! the start of each level and one past the end of the last
+    //! (num_levels + 1 entries), and level_order, with the iterations
+    //! ordered by level (one entry per iteration). Since there are at most
+    //! as many levels as iterations, for a loop from 0 to n the caller must
+    //! allocate n + 1 ints for level_ptr and n ints for level_order; a
+    //! comment above the inspector gives these sizes in terms of the loop's
+    //! upper bound.
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the original function, which the names of
+    //! the generated functions start with
+    //! \param[in] returnType Return type of the original function, which
+    //! the executor also has
+    //! \param[in] parameters Parameter declarations of the original
+    //! function, which both generated functions take first
+    //! \return whether the code could be generated; if not, nothing is
+    //! written
+    bool writeFunctions(llvm::raw_ostream& os, const std::string& name,
+                        const std::string& returnType,
+                        const std::string& parameters) const;
+
+   private:
+    //! Specs of every statement
+    const std::vector<StmtSpec>& stmts;
+    //! Dependences and scalar uses of the statements
+    const PrivatizationAnalysis& analysis;
+    //! Statements in the loop found
+    std::vector<unsigned int> loopStmts;
+    //! Array the loop's carried dependences are through
+    std::string dataSpace;
+    //! Inequality bounding the loop's iterator from below
+    SpecExp lowerBound;
+    //! Inequality bounding the loop's iterator from above
+    SpecExp upperBound;
+    //! Scalars private to each iteration of the loop
+    std::vector<std::string> privateScalars;
+
+    //! Check whether the iterations of an outermost loop can be run by
+    //! level, recording the details of the loop if so
+    //! \param[in] loop Statements in the loop
+    //! \param[out] reason Why they cannot, if they cannot
+    bool checkLoop(const std::vector<unsigned int>& loop,
+                   std::string& reason);
+
+    //! Make the specs of the inspector's statements, which compute each
+    //! iteration's level and the number of levels
+    //! \param[in] levelName Name of the array of levels
+    //! \param[in] numLevelsName Name of the number of levels
+    std::vector<StmtSpec> makeInspectorStmts(
+        const std::string& levelName, const std::string& numLevelsName) const;
+
+    //! Make the specs of the executor's statements: those of the original
+    //! function, with the loop replaced by loops over levels and over the
+    //! iterations of each level
+    //! \param[in] names Names of the number of levels, level pointer
+    //! array, level order array, level iterator and position iterator
+    //! \param[in] isIteratorDeclared Whether the loop's iterator is
+    //! declared outside the loop
+    std::vector<StmtSpec> makeExecutorStmts(
+        const std::vector<std::string>& names,
+        bool isIteratorDeclared) const;
+};
+
+}  // namespace spf_ie
+
+#endif
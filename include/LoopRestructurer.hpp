@@ -0,0 +1,134 @@
+/*!
+ * \file LoopRestructurer.hpp
+ *
+ * \brief Fusion and distribution of loops, by rewriting the execution
+ * schedules of the statements in them.
+ */
+
+#ifndef SPFIE_LOOPRESTRUCTURER_HPP
+#define SPFIE_LOOPRESTRUCTURER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+
+namespace spf_ie {
+
+/*!
+ * \class LoopRestructurer
+ *
+ * \brief Fuses adjacent loops, so that data one produces is used by the
+ * other while it is still in cache, and distributes loops into several, so
+ * that statements which carry no dependences end up in loops of their own
+ * which can run in parallel.
+ *
+ * Two loops are adjacent when no other loop with the same parent comes
+ * between them; statements between them run before the fused loop. They can
+ * be fused if they have the same bounds, with the body of the first running
+ * before that of the second in each iteration. Their iterators are given
+ * one name, unless that would change what some statement uses.
+ *
+ * A loop is distributed by splitting it between its children, each part
+ * becoming a loop with the same bounds, wherever that is legal.
+ *
+ * A change is only made if the new schedules still run every instance a
+ * dependence's sink depends on first, which DependenceGraph checks.
+ * Dependences between reductions with the same operator do not order their
+ * instances, so they are not checked. Iteration spaces are left as they are
+ * (but for renamed iterators), so the restructured statements can be built
+ * into a Computation, or written as code, like the original ones.
+ */
+class LoopRestructurer {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! with schedules as made by SPFComputationBuilder, which are copied
+    explicit LoopRestructurer(const std::vector<StmtSpec>& stmts);
+
+    //! Fuse a loop with the adjacent loop after it
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    //! \param[out] reason Why the loops cannot be fused, if they cannot
+    //! \return whether they were fused
+    bool fuseWithNext(unsigned int stmt, int level, std::string& reason);
+
+    //! Distribute a loop into as many loops as it legally can be
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    //! \param[out] reason Why the loop cannot be distributed, if it cannot
+    //! \return whether it was
+    bool distribute(unsigned int stmt, int level, std::string& reason);
+
+    //! Fuse every pair of adjacent loops which can be, outermost first
+    //! \param[out] notes Why each pair of adjacent loops which could not be
+    //! fused was not
+    //! \return the number of fusions made
+    unsigned int fuseAll(std::vector<std::string>& notes);
+
+    //! Distribute every loop with several children which can be, outermost
+    //! first
+    //! \param[out] notes Why each loop which could not be distributed was
+    //! not
+    //! \return the number of loops distributed
+    unsigned int distributeAll(std::vector<std::string>& notes);
+
+    //! Get the specs of every statement, with the loops restructured
+    const std::vector<StmtSpec>& getStmts() const { return stmts; }
+
+   private:
+    //! Specs of every statement
+    std::vector<StmtSpec> stmts;
+    //! Execution schedule of each statement
+    std::vector<ExecSchedule> schedules;
+    //! Dependences between the statements, as they are scheduled
+    std::unique_ptr<DependenceGraph> graph;
+    //! Source code of a statement whose schedule is not made of numbers and
+    //! iterators, if any, in which case no loop is restructured
+    std::string unscheduledStmt;
+
+    //! Get whether a statement is a sibling of a loop, or in it: whether
+    //! both are inside every loop around the loop
+    bool isSibling(unsigned int stmt, unsigned int other, int level) const;
+
+    //! Find the order, among its siblings, of the adjacent loop after a loop
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    //! \return the order, or -1 if no loop comes after it
+    int findNextLoop(unsigned int stmt, int level) const;
+
+    //! Find the orders of a loop's children among themselves
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    //! \return the orders, in increasing order
+    std::vector<int> findChildren(unsigned int stmt, int level) const;
+
+    //! Find one statement in each loop at a depth
+    std::vector<unsigned int> findLoops(int level) const;
+
+    //! Get whether a loop's iterator can be renamed without changing what
+    //! any statement uses
+    //! \param[in] loop Statements in the loop
+    //! \param[in] level Depth of the loop
+    //! \param[in] from Current name of the iterator
+    //! \param[in] to New name of the iterator
+    bool canRename(const std::vector<unsigned int>& loop, int level,
+                   const std::string& from, const std::string& to) const;
+
+    //! Find a dependence which new schedules of some statements would not
+    //! respect
+    //! \param[in] changed Specs of every statement, with the new schedules
+    //! \param[in] isChanged Whether each statement's schedule changed
+    //! \return the dependence, or nullptr if all are respected
+    const Dependence* findViolation(const std::vector<StmtSpec>& changed,
+                                    const std::vector<bool>& isChanged) const;
+
+    //! Make the new statements current, and find their dependences
+    void update(std::vector<StmtSpec>& changed);
+};
+
+}  // namespace spf_ie
+
+#endif
@@ -0,0 +1,125 @@
+/*!
+ * \file LoopTiler.hpp
+ *
+ * \brief Rectangular tiling of a loop nest, by rewriting the iteration
+ * spaces and execution schedules of the statements in it.
+ */
+
+#ifndef SPFIE_LOOPTILER_HPP
+#define SPFIE_LOOPTILER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DependenceGraph.hpp"
+#include "SetRelationSpec.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/*!
+ * \class LoopTiler
+ *
+ * \brief Tiles the outermost loops of a loop nest, so that each tile of
+ * their iterations, and the data it uses, is finished before the next is
+ * started.
+ *
+ * A loop over i from L to U, with tiles of S iterations, becomes a loop over
+ * tiles ti with S * ti < U - L, around a loop over the iterations of each
+ * tile, from L + S * ti while i < L + S * ti + S and i < U. Each statement
+ * gets a tuple variable for the loop over tiles of each tiled loop around
+ * it, constrained as above, and its schedule runs the loops over tiles
+ * outside the loops over iterations. A statement in fewer of the tiled
+ * loops than others (such as one initializing a sum an inner loop adds to)
+ * runs for a whole tile of the loops around it, in its original order
+ * among the inner loops over tiles. The bounds of the tiled loops may not
+ * depend on each other's iterators, so the tiles are rectangular.
+ *
+ * Tiling is legal if the new schedules still run every instance a
+ * dependence's sink depends on first, which DependenceGraph checks.
+ * Dependences between reductions with the same operator do not order their
+ * instances, so they are not checked.
+ */
+class LoopTiler {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! which must outlive the tiler
+    //! \param[in] graph Dependences between the statements, which must
+    //! outlive the tiler
+    //! \param[in] tileSizes Number of iterations of each loop in a tile,
+    //! outermost first, which are all positive; a loop is tiled for each
+    //! \param[in] loop Position, counting from 1, of the outermost loop
+    //! whose nest to tile among the function's outermost loops, or 0 to
+    //! tile the first which can be
+    LoopTiler(const std::vector<StmtSpec>& stmts,
+              const DependenceGraph& graph, std::vector<int> tileSizes,
+              unsigned int loop = 0)
+        : stmts(stmts), graph(graph), tileSizes(tileSizes), loop(loop) {}
+
+    //! Find the loop nest to tile, and check that it can be
+    //! \param[out] reason Why no loop nest can be, if none can
+    //! \return whether a loop nest was found
+    bool findLoop(std::string& reason);
+
+    //! Write the function with the loop nest found by findLoop tiled
+    //! \param[in] os Stream to write to
+    //! \param[in] name Name of the original function, which the name of the
+    //! generated function starts with
+    //! \param[in] returnType Return type of the original function
+    //! \param[in] parameters Parameter declarations of the original
+    //! function, which the generated function also takes
+    //! \return whether the code could be generated; if not, nothing is
+    //! written
+    bool writeFunction(llvm::raw_ostream& os, const std::string& name,
+                       const std::string& returnType,
+                       const std::string& parameters) const;
+
+    //! Get the specs of every statement, with the loop nest found by
+    //! findLoop tiled
+    const std::vector<StmtSpec>& getTiledStmts() const { return tiledStmts; }
+
+   private:
+    //! Specs of every statement
+    const std::vector<StmtSpec>& stmts;
+    //! Dependences between the statements
+    const DependenceGraph& graph;
+    //! Number of iterations of each tiled loop in a tile
+    std::vector<int> tileSizes;
+    //! Position of the outermost loop to tile, or 0 for any
+    unsigned int loop;
+    //! Statements in the loop nest found
+    std::vector<unsigned int> loopStmts;
+    //! Specs of every statement, with the loop nest tiled
+    std::vector<StmtSpec> tiledStmts;
+
+    //! Check whether a loop nest can be tiled, recording it and its tiled
+    //! statements if so
+    //! \param[in] nest Statements in the loop nest
+    //! \param[out] reason Why it cannot be, if it cannot
+    bool checkLoop(const std::vector<unsigned int>& nest,
+                   std::string& reason);
+
+    //! Make the names of the iterators of the loops over tiles
+    //! \param[in] nest Statements in the loop nest
+    //! \param[in] usedCode Code the names may not appear in
+    //! \return the name for each tiled loop's iterator, by its name
+    std::map<std::string, std::string> makeNames(
+        const std::vector<unsigned int>& nest,
+        const std::string& usedCode) const;
+
+    //! Make the specs of every statement, with a loop nest tiled
+    //! \param[in] nest Statements in the loop nest
+    //! \param[in] names Names of the iterators of the loops over tiles
+    //! \param[out] tiled The specs
+    //! \param[out] reason Why the loop nest cannot be tiled, if it cannot
+    //! \return whether the tiled loops are rectangular, so that it can be
+    bool makeTiledStmts(const std::vector<unsigned int>& nest,
+                        const std::map<std::string, std::string>& names,
+                        std::vector<StmtSpec>& tiled,
+                        std::string& reason) const;
+};
+
+}  // namespace spf_ie
+
+#endif
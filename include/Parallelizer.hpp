@@ -0,0 +1,208 @@
+/*!
+ * \file Parallelizer.hpp
+ *
+ * \brief Annotation of loops which carry no dependences with OpenMP
+ * parallel-for pragmas, by rewriting the original source.
+ */
+
+#ifndef SPFIE_PARALLELIZER_HPP
+#define SPFIE_PARALLELIZER_HPP
+
+#include <string>
+#include <vector>
+
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "PrivatizationAnalysis.hpp"
+#include "SetRelationSpec.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+namespace spf_ie {
+
+/*!
+ * \struct LoopDecision
+ *
+ * \brief Whether one loop was parallelized, and why
+ */
+struct LoopDecision {
+    //! The loop
+    ForStmt* loop;
+    //! Name of the loop's iterator
+    std::string iterator;
+    //! Whether the loop was annotated
+    bool parallelized;
+    //! Why the loop was not annotated, if it was not
+    std::string reason;
+    //! Variables made private to each iteration by the annotation
+    std::vector<std::string> privateVars;
+    //! Variables made private to each iteration by the annotation, keeping
+    //! the value from the last iteration
+    std::vector<std::string> lastPrivateVars;
+    //! Items of the annotation's reduction clauses, each an operator and
+    //! the array section reduced into, like "+:sum[0:1]"
+    std::vector<std::string> reductions;
+    //! Pointer parameters (other than restrict ones) the loop accesses,
+    //! writing through some, which the annotation assumes do not overlap
+    std::vector<std::string> assumedDisjoint;
+};
+
+/*!
+ * \class Parallelizer
+ *
+ * \brief Decides which loops of a translation unit's functions to run in
+ * parallel, and rewrites the source with `#pragma omp parallel for` on
+ * them.
+ *
+ * In each loop nest, the outermost loops carrying no dependence (according
+ * to DependenceGraph) are annotated; loops inside them are left alone.
+ * Iterators of inner loops declared outside an annotated loop are made
+ * private. Dependences between reductions are allowed if every iteration
+ * reduces into the same element, which is then given a reduction clause.
+ * Scalars declared outside the loop which PrivatizationAnalysis finds
+ * private to each iteration are made private (or lastprivate, if they are
+ * read after the loop); a loop assigning to any other scalar declared
+ * outside it, which is not a reduction, is not annotated. Neither is a loop
+ * calling a function, unless it is a library function known to have no side
+ * effects (such as sqrt) or is declared const or pure.
+ *
+ * Arrays are told apart by name, so pointer parameters are assumed not to
+ * overlap. Where an annotated loop writes through one of two or more
+ * pointer parameters which are not restrict, the annotation is preceded by
+ * a comment naming them.
+ */
+class Parallelizer {
+   public:
+    //! \param[in] Context ASTContext of the translation unit to rewrite
+    explicit Parallelizer(ASTContext* Context);
+
+    //! Decide which loops of a function to parallelize
+    //! \param[in] funcDecl Function to process
+    //! \param[in] stmtSpecs Specs of the function's statements, as built by
+    //! SPFComputationBuilder, or nullptr if they could not all be described
+    void addFunction(FunctionDecl* funcDecl,
+                     const std::vector<StmtSpec>* stmtSpecs);
+
+    //! Get the decision made for every loop, in source order
+    const std::vector<LoopDecision>& getDecisions() const {
+        return decisions;
+    }
+
+    //! Write a line per loop saying whether it was parallelized, and if
+    //! not, why
+    void writeReport(llvm::raw_ostream& os) const;
+
+    //! Write the rewritten main file
+    void writeRewrittenFile(llvm::raw_ostream& os) const;
+
+    //! Get the path to write the rewritten version of a file to, which is
+    //! next to it: a.c becomes a.omp.c
+    static std::string getOutputPath(llvm::StringRef inputPath);
+
+   private:
+    /*!
+     * \struct LoopInfo
+     *
+     * \brief A loop of the function being processed
+     */
+    struct LoopInfo {
+        //! The loop
+        ForStmt* loop;
+        //! Depth of the loop (0 being outermost)
+        int depth;
+        //! Execution schedule prefix shared by every statement in the loop
+        ExecSchedule schedulePrefix;
+        //! Positions of the loops directly inside this one
+        std::vector<size_t> innerLoops;
+    };
+
+    //! ASTContext of the translation unit being rewritten
+    ASTContext* Context;
+    //! Rewriter of the main file
+    Rewriter rewriter;
+    //! Decisions made so far
+    std::vector<LoopDecision> decisions;
+    //! Statements of the function being processed, in the order of their
+    //! specs
+    std::vector<clang::Stmt*> functionStmts;
+
+    //! Find the loops of a statement, numbering schedules as the builder
+    //! does, and add the statements in it to functionStmts
+    //! \param[in] stmt Statement to search
+    //! \param[in,out] schedule Schedule of the statement
+    //! \param[in] depth Number of loops enclosing the statement
+    //! \param[in] parent Position of the enclosing loop, or -1
+    //! \param[out] loops Loops found, outer loops before inner ones
+    void collectLoops(clang::Stmt* stmt, ExecSchedule& schedule, int depth,
+                      int parent, std::vector<LoopInfo>& loops);
+
+    //! Decide on a loop, and then on the loops inside it if it is not
+    //! parallelized
+    //! \param[in] loops Every loop of the function
+    //! \param[in] loop Position of the loop to decide on
+    //! \param[in] analysis Dependences and scalar uses of the function, or
+    //! nullptr if it could not be analyzed
+    //! \param[in] insideParallelLoop Whether an enclosing loop was
+    //! parallelized
+    void decide(const std::vector<LoopInfo>& loops, size_t loop,
+                const PrivatizationAnalysis* analysis,
+                bool insideParallelLoop);
+
+    //! Get the iterator variable of a loop
+    static VarDecl* getIterator(ForStmt* loop);
+
+    //! Get the reduction clause items for the reductions carried by a loop
+    //! \param[in] loop The loop
+    //! \param[in] reductions Dependences between reductions it carries
+    //! \param[out] items Clause items, without duplicates
+    //! \return the data space of a reduction into an element which is not
+    //! the same in every iteration of the loop, or an empty string if every
+    //! reduction has a clause item
+    std::string getReductionItems(
+        ForStmt* loop, const std::vector<const Dependence*>& reductions,
+        std::vector<std::string>& items) const;
+
+    //! Get whether an expression has the same value in every iteration of
+    //! a loop: it refers only to variables declared outside the loop, none
+    //! of which are iterators of it or loops inside it, and reads no arrays
+    bool isInvariantIn(Expr* expr, ForStmt* loop) const;
+
+    //! Get whether a declaration is within a loop
+    bool isDeclaredIn(const VarDecl* decl, ForStmt* loop) const;
+
+    //! Find a scalar declared outside a loop which is assigned to in it,
+    //! other than iterators of loops inside it
+    //! \param[in] loop The loop
+    //! \param[in] stmt Statement in the loop to search
+    //! \param[in] handledScalars Scalars which the annotation makes private
+    //! or reduces, and so are not shared
+    //! \return the scalar, or nullptr if there is none
+    VarDecl* findSharedScalarWrite(
+        ForStmt* loop, clang::Stmt* stmt,
+        const std::vector<std::string>& handledScalars) const;
+
+    //! Find a call in a statement to a function which may have side
+    //! effects
+    //! \return the call, or nullptr if there is none
+    CallExpr* findImpureCall(clang::Stmt* stmt) const;
+
+    //! Find the declaration of a variable referred to or declared in a
+    //! statement
+    //! \return the declaration, or nullptr if there is none
+    static VarDecl* findVarDecl(clang::Stmt* stmt, llvm::StringRef name);
+
+    //! Add the iterators of every loop in a statement
+    static void collectInnerIterators(clang::Stmt* stmt,
+                                      std::vector<VarDecl*>& iterators);
+};
+
+}  // namespace spf_ie
+
+#endif
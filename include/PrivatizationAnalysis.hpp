@@ -0,0 +1,130 @@
+/*!
+ * \file PrivatizationAnalysis.hpp
+ *
+ * \brief Classification of the scalars written in a loop by how the loop's
+ * iterations may share them.
+ */
+
+#ifndef SPFIE_PRIVATIZATIONANALYSIS_HPP
+#define SPFIE_PRIVATIZATIONANALYSIS_HPP
+
+#include <string>
+#include <vector>
+
+#include "DependenceGraph.hpp"
+#include "SetRelationSpec.hpp"
+
+namespace spf_ie {
+
+//! How the iterations of a loop use a scalar written in it
+enum class ScalarUse {
+    //! Every read in an iteration follows a write in the same iteration,
+    //! so each iteration may have its own copy
+    Private,
+    //! Every access is made by reductions with the same operator
+    Reduction,
+    //! A value written in one iteration may be read in another
+    Carried
+};
+
+/*!
+ * \struct ScalarClassification
+ *
+ * \brief How one scalar is used by a loop
+ */
+struct ScalarClassification {
+    //! Name of the scalar
+    std::string scalar;
+    //! How the loop uses it
+    ScalarUse use;
+    //! Operator of the reductions, if it is a reduction
+    ReductionOp reduction;
+    //! Whether a value written in the loop may be read after it, so that
+    //! a private copy's value from the last iteration must be kept
+    bool isLiveOut;
+};
+
+/*!
+ * \class PrivatizationAnalysis
+ *
+ * \brief Classifies each scalar written in a loop as private, a reduction,
+ * or carried between iterations.
+ *
+ * A scalar is a data space with a single element, so DependenceGraph finds
+ * a dependence carried by a loop between every write and read of it in the
+ * loop. Those dependences are removed by giving each iteration its own copy
+ * if every read is preceded, in the same iteration, by a statement directly
+ * in the loop (rather than in a loop or if statement inside it) writing the
+ * scalar. A private scalar whose value may be read after the loop must
+ * also be written by such a statement, unconditionally, since the value
+ * kept is the one from the last iteration. A scalar appearing in the
+ * constraints of a statement in the loop is always carried, since such uses
+ * are not data accesses.
+ */
+class PrivatizationAnalysis {
+   public:
+    //! \param[in] stmts Specs of every statement of a function, in order,
+    //! which must outlive the analysis
+    //! \param[in] graph Dependences between the statements, which must
+    //! outlive the analysis
+    PrivatizationAnalysis(const std::vector<StmtSpec>& stmts,
+                          const DependenceGraph& graph)
+        : stmts(stmts), graph(graph) {}
+
+    //! Get the dependences the analysis is based on
+    const DependenceGraph& getGraph() const { return graph; }
+
+    //! Classify the scalars written in a loop
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    //! \return how each scalar written in the loop is used, in order of
+    //! first write
+    std::vector<ScalarClassification> classifyScalars(unsigned int stmt,
+                                                      int level) const;
+
+    //! Find the dependences carried by a loop, other than between
+    //! reductions and through scalars which are private or reductions in
+    //! it
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    std::vector<const Dependence*> findCarriedDependences(unsigned int stmt,
+                                                          int level) const;
+
+    //! Find the first of the dependences findCarriedDependences finds
+    //! \return the dependence, or nullptr if the loop carries none
+    const Dependence* findCarriedDependence(unsigned int stmt,
+                                            int level) const;
+
+   private:
+    //! Specs of every statement
+    const std::vector<StmtSpec>& stmts;
+    //! Dependences between the statements
+    const DependenceGraph& graph;
+
+    //! Classify one scalar written in a loop
+    //! \param[in] scalar Name of the scalar
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    ScalarClassification classifyScalar(const std::string& scalar,
+                                        unsigned int stmt, int level) const;
+
+    //! Get whether a statement directly in a loop, and in no if statement
+    //! inside it, writes a scalar, so that every iteration writes it
+    //! \param[in] scalar Name of the scalar
+    //! \param[in] stmt Any statement inside the loop
+    //! \param[in] level Depth of the loop enclosing stmt
+    bool isWrittenInEveryIteration(const std::string& scalar,
+                                   unsigned int stmt, int level) const;
+
+    //! Get whether a statement's read of a scalar is always preceded by a
+    //! write to it in the same iteration of a loop
+    //! \param[in] reader Statement reading the scalar
+    //! \param[in] scalar Name of the scalar
+    //! \param[in] level Depth of the loop enclosing reader
+    bool isReadCovered(unsigned int reader, const std::string& scalar,
+                       int level) const;
+};
+
+}  // namespace spf_ie
+
+#endif
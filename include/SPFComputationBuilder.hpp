@@ -1,50 +1,185 @@
 #ifndef SPFIE_SPFCOMPUTATIONBUILDER_HPP
 #define SPFIE_SPFCOMPUTATIONBUILDER_HPP
 
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "Archive.hpp"
+#include "ComputationCache.hpp"
+#include "SetRelationSpec.hpp"
 #include "StmtContext.hpp"
+#include "SymbolTable.hpp"
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/Stmt.h"
 #include "iegenlib.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/Allocator.h"
 
 using namespace clang;
 
 namespace spf_ie {
 
+//! Callback receiving a built Computation, along with the index of the
+//! function it was built from and the specs of its statements (or nullptr,
+//! if specs were not kept or some statement could not be described)
+using ComputationHandler =
+    std::function<void(size_t, std::unique_ptr<iegenlib::Computation>,
+                       const std::vector<StmtSpec>*)>;
+
 /*!
  * \class SPFComputationBuilder
  *
  * \brief Class handling building up the sparse polyhedral model for a function
  *
  * Contains the entry point for function processing. Recursively visits each
- * statement in the source.
+ * statement in the source. A builder holds no state shared with other
+ * builders, so separate builders may be used concurrently.
  */
 class SPFComputationBuilder {
    public:
-    SPFComputationBuilder();
+    //! \param[in] Context ASTContext of the translation unit whose functions
+    //! will be processed
+    explicit SPFComputationBuilder(const ASTContext* Context);
+    //! Releases any Computation left partly built by an error, holding the
+    //! IEGenLib mutex
+    ~SPFComputationBuilder();
     //! Entry point for each function; gather information about its
     //! statements and data accesses into an Computation
     //! \param[in] funcDecl Function declaration to process
     std::unique_ptr<iegenlib::Computation> buildComputationFromFunction(
         FunctionDecl* funcDecl);
 
+    //! Build Computations for several functions of one translation unit,
+    //! using up to the given number of threads, each with its own builder
+    //! \param[in] Context ASTContext the functions belong to, which must no
+    //! longer be modified
+    //! \param[in] funcDecls Function declarations to process
+    //! \param[in] numThreads Maximum number of threads to use
+    //! \param[in] cache Cache to load Computations from and store them in,
+    //! if any
+    //! \param[in] archive Archive to add Computations to, if any
+    //! \return Computations built, in the same order as funcDecls
+    static std::vector<std::unique_ptr<iegenlib::Computation>>
+    buildComputationsFromFunctions(const ASTContext* Context,
+                                   const std::vector<FunctionDecl*>& funcDecls,
+                                   unsigned int numThreads,
+                                   ComputationCache* cache = nullptr,
+                                   ArchiveWriter* archive = nullptr);
+
+    //! Build Computations for several functions of one translation unit as
+    //! above, but pass each to a handler as soon as it and every function
+    //! before it are built, rather than keeping them all
+    //! \param[in] Context ASTContext the functions belong to, which must no
+    //! longer be modified
+    //! \param[in] funcDecls Function declarations to process
+    //! \param[in] numThreads Maximum number of threads to use
+    //! \param[in] cache Cache to load Computations from and store them in,
+    //! if any
+    //! \param[in] archive Archive to add Computations to, if any
+    //! \param[in] onBuilt Handler for each Computation, called once per
+    //! function in the same order as funcDecls, and never concurrently
+    //! \param[in] keepStmtSpecs Whether to pass the handler the specs of
+    //! each function's statements
+    //! \throws BuildError if some function is invalid and exiting is
+    //! deferred on the calling thread; functions after it may not be built
+    static void buildComputationsFromFunctions(
+        const ASTContext* Context, const std::vector<FunctionDecl*>& funcDecls,
+        unsigned int numThreads, ComputationCache* cache,
+        ArchiveWriter* archive, const ComputationHandler& onBuilt,
+        bool keepStmtSpecs = false);
+
+    //! Set whether to construct IEGenLib sets and relations by printing and
+    //! re-parsing strings, rather than directly. This is slower, and only
+    //! intended for debugging.
+    void setConstructFromStrings(bool value) { constructFromStrings = value; }
+
+    //! Set a cache to load Computations from instead of building them,
+    //! and to store newly built Computations in
+    //! \param[in] value Cache to use, or nullptr to use none
+    void setCache(ComputationCache* value) { cache = value; }
+
+    //! Set an archive to add every Computation built (or loaded from the
+    //! cache) to
+    //! \param[in] value Archive to use, or nullptr to use none
+    void setArchive(ArchiveWriter* value) { archive = value; }
+
+    //! Set whether to keep the specs of each function's statements once it
+    //! is built, for analyses which work on them
+    void setKeepStmtSpecs(bool value) { keepStmtSpecs = value; }
+
+    //! Take the kept specs of the statements of the function built last
+    //! \param[out] stmts Specs of every statement, in order
+    //! \return whether specs were kept and every statement was described
+    bool takeStmtSpecs(std::vector<StmtSpec>& stmts);
+
+    //! Make a Computation from specs of its statements, as loaded from the
+    //! cache or an archive
+    //! \param[in] stmts Specs of every statement, in order
+    static std::unique_ptr<iegenlib::Computation> makeComputationFromSpecs(
+        const std::vector<StmtSpec>& stmts);
+
+    //! Get the mutex which must be held while using IEGenLib objects, such
+    //! as built Computations, since IEGenLib is not reentrant
+    static std::mutex& getIEGenLibMutex() { return iegenlibMutex; }
+
    private:
+    //! ASTContext of the translation unit being processed
+    const ASTContext* Context;
+    //! Interned names and source text of the translation unit, kept across
+    //! functions built by this builder
+    SymbolTable symbols;
+    //! Allocator for scopes, constraints and accesses of the function being
+    //! processed, all released at once when the function is done
+    llvm::BumpPtrAllocator functionArena;
+    //! Whether to construct IEGenLib objects from strings
+    bool constructFromStrings;
+    //! Cache of previously built Computations, if any
+    ComputationCache* cache;
+    //! Archive to add Computations to, if any
+    ArchiveWriter* archive;
+    //! Whether to keep the specs of each function's statements
+    bool keepStmtSpecs;
+    //! Specs of the statements of the function being built, kept to store
+    //! in the cache or archive, or to be taken
+    std::vector<StmtSpec> stmtSpecs;
+    //! Specs of the statements of the function built last, if kept
+    std::vector<StmtSpec> keptStmtSpecs;
+    //! Whether keptStmtSpecs describes every statement of its function
+    bool keptStmtSpecsComplete;
+    //! Whether every statement of the function being built so far was
+    //! constructed from specs, so that the function may be cached
+    bool allStmtsDescribed;
     //! Number of the statement currently being processed
     unsigned int stmtNumber;
-    //! The length of the longest schedule tuple
+    //! Number to be used (and incremented) when creating replacement
+    //! variable names, reset for each function
+    unsigned int replacementVarNumber;
+    //! The length of the longest schedule tuple, which all schedules are
+    //! zero-padded to on output
     int largestScheduleDimension;
     //! The information about the context we are currently in, which is
     //! copied for completed statements
     StmtContext currentStmtContext;
     //! Context information attached to each completed statement
     std::vector<StmtContext> stmtContexts;
+    //! Scalars assigned to by some statement of the function being built,
+    //! which are tracked as data spaces
+    llvm::SmallPtrSet<const VarDecl*, 8> writtenScalars;
     //! Computation being built up
     std::unique_ptr<iegenlib::Computation> computation;
 
+    //! Guards IEGenLib object construction and use, since IEGenLib's parser
+    //! and environment are not reentrant
+    static std::mutex iegenlibMutex;
+
+    //! Get the name of the main file of the translation unit
+    std::string getMainFileName() const;
+
     //! Process the body of a control structure, such as a for loop
     //! \param[in] stmt Body statement (which may be compound) to process
     void processBody(clang::Stmt* stmt);
@@ -56,6 +191,47 @@ class SPFComputationBuilder {
     //! Add info about a completed statement to the builder
     //! \param[in] stmt Completed statement to save
     void addStmt(clang::Stmt* stmt);
+
+    //! Find the scalars assigned to by statements (but not by loop headers)
+    //! in a statement, recursing as processSingleStmt does, and add them to
+    //! writtenScalars
+    //! \param[in] stmt Statement to search
+    void collectWrittenScalars(clang::Stmt* stmt);
+
+    //! Remove from writtenScalars those whose name is declared more than
+    //! once in a function, as when one declaration shadows another, since
+    //! data spaces are identified by name
+    //! \param[in] funcDecl Function being built
+    void untrackShadowedScalars(FunctionDecl* funcDecl);
+
+    //! Get the tracked scalar an expression refers to, unless it is the
+    //! iterator of an enclosing loop
+    //! \param[in] expr Expression to check
+    //! \return the reference to the scalar, or nullptr if there is none
+    DeclRefExpr* getTrackedScalar(Expr* expr);
+
+    //! Add a read of each tracked scalar referred to in an expression
+    //! \param[in] expr Expression to process
+    void processScalarReads(Expr* expr);
+
+    //! Record the statement being processed as a reduction, if the value it
+    //! combines into the element written does not read that data space
+    //! \param[in] reduction Operator of the assignment, if it has the form
+    //! of a reduction
+    //! \param[in] numLHSReads Number of times that form reads the element
+    void recordReduction(ReductionOp reduction, int numLHSReads);
+
+    //! Make the IEGenLib Stmt for a completed statement, constructing its
+    //! sets and relations directly where possible
+    //! \param[in] stmtContext Context of the completed statement
+    iegenlib::Stmt makeStmt(StmtContext& stmtContext);
+
+    //! Make the IEGenLib Stmt for a completed statement by way of strings
+    //! in IEGenLib syntax
+    //! \param[in] stmtContext Context of the completed statement
+    //! \param[in] stmtSourceCode Source code of the statement
+    iegenlib::Stmt makeStmtFromStrings(StmtContext& stmtContext,
+                                       const std::string& stmtSourceCode);
 };
 
 }  // namespace spf_ie
@@ -0,0 +1,86 @@
+/*!
+ * \file Server.hpp
+ *
+ * \brief Persistent server answering requests to analyze files, keeping
+ * parsed translation units warm between requests.
+ */
+
+#ifndef SPFIE_SERVER_HPP
+#define SPFIE_SERVER_HPP
+
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "ComputationCache.hpp"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+namespace spf_ie {
+
+/*!
+ * \class Server
+ *
+ * \brief Answers requests read one per line, each a JSON object like
+ * {"file": "path.c"} or {"file": "path.c", "function": "name"}, with one
+ * line of JSON holding the Computations built.
+ *
+ * Each file is parsed into an ASTUnit which is kept between requests. The
+ * unit precompiles the file's preamble (its leading #includes), so later
+ * requests for the same file reparse only the rest of it, and only if it
+ * has changed.
+ */
+class Server {
+   public:
+    //! \param[in] compilations Compilation database giving the command
+    //! line for each file
+    //! \param[in] resourceDir Path of Clang's resource directory
+    //! \param[in] numFunctionJobs Number of threads to build each file's
+    //! functions on
+    //! \param[in] cache Cache of Computations to use, if any
+    Server(const tooling::CompilationDatabase& compilations,
+           std::string resourceDir, unsigned int numFunctionJobs,
+           ComputationCache* cache);
+
+    //! Answer requests until the input ends
+    //! \param[in] in Stream to read requests from
+    //! \param[in] out Stream to write responses to
+    void serve(std::istream& in, llvm::raw_ostream& out);
+
+   private:
+    //! Compilation database giving the command line for each file
+    const tooling::CompilationDatabase& compilations;
+    //! Path of Clang's resource directory
+    std::string resourceDir;
+    //! Number of threads to build each file's functions on
+    unsigned int numFunctionJobs;
+    //! Cache of Computations to use, if any
+    ComputationCache* cache;
+    //! Shared by every unit's parses
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps;
+    //! Parsed translation units, by absolute path
+    std::map<std::string, std::unique_ptr<ASTUnit>> units;
+
+    //! Answer one request
+    //! \param[in] request Text of the request
+    //! \param[in] json Stream to write the response to
+    void handleRequest(llvm::StringRef request, llvm::json::OStream& json);
+
+    //! Get the up-to-date translation unit for a file, parsing it if this
+    //! is the first request for it and reparsing it otherwise
+    //! \param[in] path Absolute path of the file
+    //! \param[out] error Description of the problem, if there was one
+    //! \return the unit, or nullptr if it could not be parsed
+    ASTUnit* getUnit(const std::string& path, std::string& error);
+};
+
+}  // namespace spf_ie
+
+#endif
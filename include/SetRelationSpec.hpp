@@ -0,0 +1,235 @@
+/*!
+ * \file SetRelationSpec.hpp
+ *
+ * \brief Plain descriptions of IEGenLib sets and relations, which can be
+ * turned into IEGenLib objects directly rather than through the IEGenLib
+ * parser.
+ */
+
+#ifndef SPFIE_SETRELATIONSPEC_HPP
+#define SPFIE_SETRELATIONSPEC_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ExecSchedule.hpp"
+#include "iegenlib.h"
+
+namespace spf_ie {
+
+struct SpecExp;
+
+/*!
+ * \struct SpecTerm
+ *
+ * \brief One term of an expression: a constant, symbolic constant, tuple
+ * variable, or uninterpreted function call, multiplied by a coefficient
+ */
+struct SpecTerm {
+    enum class Kind { Const, Symbol, TupleVar, UFCall };
+
+    //! Make a constant term
+    static SpecTerm makeConst(int value);
+    //! Make a symbolic constant term
+    static SpecTerm makeSymbol(std::string name, int coeff = 1);
+    //! Make a tuple variable term, referring to a position in the tuple
+    static SpecTerm makeTupleVar(int position, int coeff = 1);
+    //! Make an uninterpreted function call term
+    static SpecTerm makeUFCall(std::string name, std::vector<SpecExp> args,
+                               int coeff = 1);
+
+    //! Check whether another term is the same, including its coefficient
+    bool operator==(const SpecTerm& other) const;
+
+    //! What kind of term this is
+    Kind kind;
+    //! Coefficient, or the value itself for a constant
+    int coeff;
+    //! Symbol or function name
+    std::string name;
+    //! Tuple position of a tuple variable
+    int tuplePos;
+    //! Arguments to an uninterpreted function call
+    std::vector<SpecExp> args;
+};
+
+/*!
+ * \struct SpecExp
+ *
+ * \brief A sum of terms
+ */
+struct SpecExp {
+    //! Add another expression's terms to this one
+    void add(const SpecExp& other);
+
+    //! Multiply every term by a constant
+    void multiplyBy(int factor);
+
+    //! Whether this expression is a constant, and if so, its value
+    bool isConst(int* value) const;
+
+    //! Move every tuple variable (including those in call arguments) by
+    //! the same number of positions, as when placing the tuple after others
+    void shiftTupleVars(int offset);
+
+    //! Whether this expression is exactly a tuple variable
+    bool isTupleVar(int position) const;
+
+    //! Whether this expression uses a tuple variable after a position,
+    //! including within call arguments
+    bool usesTupleVarAfter(int position) const;
+
+    //! Whether this expression calls an uninterpreted function, including
+    //! within call arguments
+    bool calls(const std::string& function) const;
+
+    //! Whether this expression is a call of an uninterpreted function whose
+    //! one argument is a tuple variable plus a constant, like ptr(i + 1)
+    //! \param[in] position Position of the tuple variable
+    //! \param[in] offset Constant added to the tuple variable
+    //! \param[out] function Name of the function called
+    bool isCallAt(int position, int offset, std::string& function) const;
+
+    //! Check whether another expression has the same terms, in the same
+    //! order
+    bool operator==(const SpecExp& other) const;
+
+    //! Terms being summed
+    std::vector<SpecTerm> terms;
+};
+
+/*!
+ * \struct TupleElem
+ *
+ * \brief An element of a tuple declaration, which is either a named
+ * variable or a constant
+ */
+struct TupleElem {
+    TupleElem(std::string var) : var(var), constant(0), isConst(false) {}
+    TupleElem(int constant) : constant(constant), isConst(true) {}
+
+    std::string var;
+    int constant;
+    bool isConst;
+};
+
+/*!
+ * \struct SetRelationSpec
+ *
+ * \brief A set or relation with a single conjunction of constraints
+ *
+ * Equalities are of the form exp = 0, and inequalities exp >= 0. Tuple
+ * variables in expressions refer to positions in the full tuple, including
+ * the output tuple of a relation.
+ */
+struct SetRelationSpec {
+    SetRelationSpec() : inArity(0), isRelation(false) {}
+
+    //! Make an IEGenLib Set from this spec, which must not be a relation
+    //! \return a newly allocated Set, owned by the caller
+    iegenlib::Set* toSet() const;
+
+    //! Make an IEGenLib Relation from this spec, which must be a relation
+    //! \return a newly allocated Relation, owned by the caller
+    iegenlib::Relation* toRelation() const;
+
+    //! Get a string representation in IEGenLib syntax, for debugging
+    std::string toString() const;
+
+    //! Get the expression an output element of a relation (such as the
+    //! index of an access) equals, in terms of the input tuple
+    //! \param[in] outPos Position in the full tuple of the output element
+    //! \param[out] exp Expression for the element, added to
+    //! \return whether the element could be expressed
+    bool getOutputExp(int outPos, SpecExp& exp) const;
+
+    //! Get the expressions every output element of a relation equals
+    //! \param[out] exps Expression for each element, in order
+    //! \return whether every element could be expressed
+    bool getOutputExps(std::vector<SpecExp>& exps) const;
+
+    //! Make an access relation as the builder does, with outputs equal to
+    //! an iterator named after it and others named as replacement variables
+    //! \param[in] iterators Iterators of the loops around the access
+    //! \param[in] indexes Expression for each index of the element accessed
+    static SetRelationSpec makeAccess(const std::vector<TupleElem>& iterators,
+                                      const std::vector<SpecExp>& indexes);
+
+    //! Tuple declaration (input followed by output, for a relation)
+    std::vector<TupleElem> tuple;
+    //! Number of elements of the tuple which are input elements
+    int inArity;
+    //! Whether this is a relation (rather than a set)
+    bool isRelation;
+    //! Equality constraints, each equal to 0
+    std::vector<SpecExp> equalities;
+    //! Inequality constraints, each greater than or equal to 0
+    std::vector<SpecExp> inequalities;
+
+   private:
+    //! Build the IEGenLib conjunction described by this spec
+    iegenlib::Conjunction* makeConjunction() const;
+};
+
+//! Associative and commutative operators a statement may combine values
+//! into the element it writes with
+enum class ReductionOp { None, Sum, Product, Min, Max };
+
+//! Get the OpenMP reduction identifier of an operator, such as "+" or "min"
+//! \param[in] op Operator, which must not be None
+const char* getReductionIdentifier(ReductionOp op);
+
+/*!
+ * \struct StmtSpec
+ *
+ * \brief A statement whose iteration space, execution schedule and data
+ * accesses are all described by specs
+ */
+struct StmtSpec {
+    StmtSpec() : reduction(ReductionOp::None), isConditional(false) {}
+
+    //! Make an IEGenLib Stmt from this spec
+    iegenlib::Stmt toStmt() const;
+
+    //! Get the execution schedule as a tuple of numbers and iterators
+    //! \param[out] schedule The schedule
+    //! \return whether every schedule entry is a number or equal to an
+    //! iterator, as in schedules made by the builder
+    bool getSchedule(ExecSchedule& schedule) const;
+
+    //! Set the execution schedule from a tuple of numbers and iterators, as
+    //! the builder makes it
+    //! \param[in] schedule The schedule, whose iterators are positions in
+    //! the iteration space's tuple
+    void setSchedule(const ExecSchedule& schedule);
+
+    //! Source code of the statement
+    std::string sourceCode;
+    //! Iteration space
+    SetRelationSpec iterSpace;
+    //! Execution schedule
+    SetRelationSpec execSchedule;
+    //! Read access relations, paired with the data space read
+    std::vector<std::pair<std::string, SetRelationSpec>> dataReads;
+    //! Write access relations, paired with the data space written
+    std::vector<std::pair<std::string, SetRelationSpec>> dataWrites;
+    //! Data spaces the statement adds to its Computation
+    std::vector<std::string> dataSpaces;
+    //! Those of the data spaces which are scalars, each accessed as its one
+    //! element 0
+    std::vector<std::string> scalars;
+    //! Operator with which the statement combines a value into the one
+    //! element it writes, reading that element nowhere else, or None if the
+    //! statement is not a reduction. Instances of a reduction may run in any
+    //! order, as long as each update is made atomically.
+    ReductionOp reduction;
+    //! Whether an if statement inside the statement's innermost loop (or at
+    //! function level, if it is in no loop) encloses it, so that it may not
+    //! run in every iteration of that loop
+    bool isConditional;
+};
+
+}  // namespace spf_ie
+
+#endif
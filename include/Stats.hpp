@@ -0,0 +1,130 @@
+/*!
+ * \file Stats.hpp
+ *
+ * \brief Counters of work done and memory used while processing, reported
+ * as JSON.
+ */
+
+#ifndef SPFIE_STATS_HPP
+#define SPFIE_STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Kinds of events counted
+enum class Stat {
+    //! Statements added to Computations
+    StmtsProcessed,
+    //! ArrayAccesses built by DataAccessHandler
+    ArrayAccessesBuilt,
+    //! Replacement variable names issued
+    ReplacementVarsIssued,
+    //! Bytes of iteration space and execution schedule strings produced
+    ConstraintStringBytes,
+    //! Bytes of data access strings produced
+    AccessStringBytes,
+    //! IEGenLib Computations, Stmts, Sets and Relations created
+    IEGenLibObjectsCreated,
+    //! Functions loaded from the Computation cache
+    CacheHits,
+    //! Functions looked up in the Computation cache but not found
+    CacheMisses,
+    //! Number of kinds of Stat (not itself a Stat)
+    NumStats
+};
+
+/*!
+ * \struct FunctionStats
+ *
+ * \brief Memory used while producing one function's Computation
+ */
+struct FunctionStats {
+    //! Source file the function is in
+    std::string file;
+    //! Qualified name of the function
+    std::string name;
+    //! Where the Computation came from: "built", "cache" or "archive"
+    std::string source;
+    //! Number of statements in the function
+    uint64_t stmts;
+    //! Bytes allocated in the function's arena (0 unless built)
+    uint64_t arenaBytes;
+    //! Peak resident set size of the whole process (every thread) so far
+    //! when the function was done, in kilobytes. This is not memory used by
+    //! the function itself, which is arenaBytes.
+    uint64_t processPeakRSSKilobytes;
+};
+
+/*!
+ * \class Stats
+ *
+ * \brief Process-wide statistics, in the style of LLVM's Statistic.
+ *
+ * Counting is off until enabled, and then costs one atomic increment per
+ * event, so counters may be updated from any thread.
+ */
+class Stats {
+   public:
+    //! Start collecting statistics
+    static void enable() { enabled = true; }
+
+    //! Whether statistics are being collected
+    static bool isEnabled() { return enabled; }
+
+    //! Count an event, if statistics are enabled
+    //! \param[in] stat Kind of event
+    //! \param[in] amount Amount to add to the event's counter
+    static void add(Stat stat, uint64_t amount = 1) {
+        if (enabled) {
+            counters[static_cast<int>(stat)].fetch_add(
+                amount, std::memory_order_relaxed);
+        }
+    }
+
+    //! Get the current value of an event's counter
+    static uint64_t get(Stat stat) {
+        return counters[static_cast<int>(stat)].load();
+    }
+
+    //! Record the memory used to produce a function's Computation, if
+    //! statistics are enabled
+    static void recordFunction(FunctionStats function);
+
+    //! Get the functions recorded so far
+    static std::vector<FunctionStats> getFunctions();
+
+    //! Get the peak resident set size of this process so far, in kilobytes
+    static uint64_t getPeakRSSKilobytes();
+
+    //! Get the current resident set size of this process, in kilobytes, or
+    //! 0 if it cannot be read
+    static uint64_t getCurrentRSSKilobytes();
+
+    //! Write all statistics collected as a JSON object
+    static void writeJSON(llvm::raw_ostream& os);
+
+   private:
+    //! Whether statistics are being collected
+    static std::atomic<bool> enabled;
+    //! Counter for each kind of event
+    static std::atomic<uint64_t> counters[static_cast<int>(Stat::NumStats)];
+    //! Names of the counters in JSON output
+    static const char* const counterNames[static_cast<int>(Stat::NumStats)];
+    //! Memory used by each function built
+    static std::vector<FunctionStats> functions;
+    //! Guards functions
+    static std::mutex functionsMutex;
+
+    Stats() = delete;
+};
+
+}  // namespace spf_ie
+
+#endif
@@ -11,22 +11,73 @@
 #ifndef SPFIE_STMTCONTEXT_HPP
 #define SPFIE_STMTCONTEXT_HPP
 
-#include <memory>
-#include <stack>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "DataAccessHandler.hpp"
 #include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "SymbolTable.hpp"
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/OperationKinds.h"
 #include "clang/AST/Stmt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
 
 using namespace clang;
 
 namespace spf_ie {
 
+/*!
+ * \struct ConstraintSide
+ *
+ * \brief One side of a constraint: either an expression from the source, or
+ * just a variable name where there is no expression to refer to (as for an
+ * iterator declared in a for loop initializer)
+ */
+struct ConstraintSide {
+    ConstraintSide(Expr* expr) : expr(expr), var(NO_SYMBOL) {}
+    ConstraintSide(SymbolID var) : expr(nullptr), var(var) {}
+
+    //! Expression, or null if this side is just a variable
+    Expr* expr;
+    //! Variable name, used if expr is null
+    SymbolID var;
+};
+
+//! A constraint of the form (lhs, rhs, operator)
+using Constraint =
+    std::tuple<ConstraintSide, ConstraintSide, BinaryOperatorKind>;
+
+/*!
+ * \struct ScopeNode
+ *
+ * \brief One level of nesting (a for loop or if statement) around
+ * statements, linked to the scope enclosing it.
+ *
+ * Nodes are never modified once created, and are shared by every statement
+ * (and nested scope) inside them, so entering or leaving a scope and saving
+ * a statement's context take constant time. Nodes and their contents are
+ * allocated in the per-function arena and are all released together when
+ * the function is done.
+ */
+struct ScopeNode {
+    //! Enclosing scope, or null if this scope is at function level
+    const ScopeNode* parent;
+    //! Iterator introduced by this scope, which is NO_SYMBOL unless this
+    //! scope is a loop
+    SymbolID iterator;
+    //! Constraints introduced by this scope
+    llvm::ArrayRef<Constraint> constraints;
+    //! Data spaces held invariant by this scope
+    llvm::ArrayRef<SymbolID> invariants;
+    //! Number of loops from function level to this scope, inclusive
+    int loopDepth;
+};
+
 /*!
  * \struct StmtContext
  *
@@ -34,7 +85,10 @@ namespace spf_ie {
  * space and execution schedule.
  */
 struct StmtContext {
-    StmtContext();
+    //! \param[in] symbols Symbol table of the code being processed
+    //! \param[in] arena Allocator for scopes and accesses, which lives as
+    //! long as the function being processed
+    StmtContext(SymbolTable* symbols, llvm::BumpPtrAllocator* arena);
 
     //! Copy the information from an existing StmtContext.
     //! Preserves only information that builds up in nested contexts,
@@ -42,32 +96,83 @@ struct StmtContext {
     //! \param[in] other Existing StmtContext to copy
     StmtContext(StmtContext* other);
 
+    //! ASTContext of the code being processed
+    const ASTContext* Context;
+    //! Symbol table of the code being processed
+    SymbolTable* symbols;
+    //! Allocator for scopes and accesses of the function being processed
+    llvm::BumpPtrAllocator* arena;
+
     //! Actual AST Stmt
     Stmt* stmt;
 
-    //! Variables being iterated over
-    std::vector<std::string> iterators;
-    //! Constraints on iteration -- inequalities and equalities
-    std::vector<std::shared_ptr<
-        std::tuple<std::string, std::string, BinaryOperatorKind>>>
-        constraints;
+    //! Innermost scope enclosing the statement, or null at function level
+    const ScopeNode* scope;
     //! Execution schedule
     ExecSchedule schedule;
     //! Data accesses (both reads and writes)
     DataAccessHandler dataAccesses;
+    //! Operator the statement reduces into the element it writes with, or
+    //! None if it is not a reduction
+    ReductionOp reduction;
+
+    //! Get the variables being iterated over, outermost first
+    std::vector<SymbolID> getIterators() const;
+
+    //! Get the constraints on iteration (inequalities and equalities),
+    //! outermost first
+    std::vector<const Constraint*> getConstraints() const;
+
+    //! Check whether a data space is held invariant by an enclosing loop
+    bool isInvariant(SymbolID dataSpace) const;
+
+    //! Check whether a variable is the iterator of an enclosing loop
+    bool isIterator(SymbolID var) const {
+        return getIteratorPosition(var) >= 0;
+    }
+
+    //! Check whether the innermost scope enclosing the statement is an if
+    //! statement, so that the statement may not run in every iteration of
+    //! its innermost loop
+    bool isConditional() const {
+        return scope && scope->iterator == NO_SYMBOL;
+    }
 
-    //! Data spaces which are held invariant in the current context, grouped
-    //! by the loop that they are invariant in
-    std::vector<std::vector<std::string>> invariants;
+    // get*String methods produce IEGenLib syntax, for debugging and as a
+    // fallback for constraints that get*Spec methods cannot describe
 
     //! Get a string representing the iteration space
     std::string getIterSpaceString();
 
     //! Get a string representing the execution schedule
-    std::string getExecScheduleString();
+    //! \param[in] paddedDimension Dimension to zero-pad the schedule to
+    std::string getExecScheduleString(int paddedDimension);
 
     //! Get a string representing the given data access
-    std::string getDataAccessString(ArrayAccess*);
+    //! \param[in] access Access to represent
+    //! \param[in,out] replacementVarNumber Counter used to name replacement
+    //! variables introduced for non-trivial indexes
+    std::string getDataAccessString(ArrayAccess* access,
+                                    unsigned int& replacementVarNumber);
+
+    //! Describe the iteration space, for direct construction
+    //! \param[out] spec Description of the iteration space
+    //! \return whether the iteration space could be described
+    bool getIterSpaceSpec(SetRelationSpec& spec);
+
+    //! Describe the execution schedule, for direct construction
+    //! \param[in] paddedDimension Dimension to zero-pad the schedule to
+    SetRelationSpec getExecScheduleSpec(int paddedDimension);
+
+    //! Describe the given data access, for direct construction
+    //! \param[in] access Access to describe
+    //! \param[in,out] replacementVarNumber Counter used to name replacement
+    //! variables introduced for non-trivial indexes
+    //! \param[out] spec Description of the access relation
+    //! \return whether the access could be described
+    bool getDataAccessSpec(ArrayAccess* access,
+                           unsigned int& replacementVarNumber,
+                           SetRelationSpec& spec);
 
     // enter* and exit* methods add iterators and constraints when entering a
     // new scope, remove when leaving the scope
@@ -88,21 +193,45 @@ struct StmtContext {
     void exitIf();
 
    private:
-    //! Convenience function to add a new constraint from the given parameters
-    void makeAndInsertConstraint(Expr* lower, Expr* upper,
+    //! Convenience function to add a new constraint from the given
+    //! parameters to those of a scope being entered
+    void makeAndInsertConstraint(llvm::SmallVectorImpl<Constraint>& constraints,
+                                 ConstraintSide lower, Expr* upper,
                                  BinaryOperatorKind oper);
 
-    //! Convenience function to add a new constraint from the given parameters
-    void makeAndInsertConstraint(std::string lower, Expr* upper,
-                                 BinaryOperatorKind oper);
+    //! Make a new scope nested in the current one, with the given
+    //! constraints and invariants copied into the arena, and enter it
+    //! \param[in] iterator Iterator introduced by the scope, or NO_SYMBOL
+    //! if it is not a loop
+    void enterNestedScope(SymbolID iterator,
+                          llvm::ArrayRef<Constraint> constraints,
+                          llvm::ArrayRef<SymbolID> invariants);
+
+    //! Get the string form of one side of a constraint
+    std::string constraintSideToString(const ConstraintSide& side);
+
+    //! Describe one side of a constraint as an expression
+    //! \return whether the side could be described
+    bool constraintSideToSpecExp(const ConstraintSide& side, SpecExp& spec);
+
+    //! Describe a source expression in terms of the current iterators (as
+    //! tuple variables), symbolic constants and uninterpreted functions
+    //! \param[in] expr Expression to describe
+    //! \param[out] spec Expression description, added to
+    //! \return whether the expression could be described
+    bool exprToSpecExp(Expr* expr, SpecExp& spec);
+
+    //! Get the tuple position of an iterator, or -1 if the variable is not
+    //! an iterator
+    int getIteratorPosition(SymbolID var) const;
 
     //! Get the source code of an expression, with array accesses changed to
     //! function calls (for example, "i < A[i]" becomes "i < A(i)")
-    static std::string exprToStringWithSafeArrays(Expr* expr);
+    std::string exprToStringWithSafeArrays(Expr* expr);
 
     //! Get the tuple of iterators as a string, for use in other to-string
     //! methods. Output like "[i,j,k]"
-    std::string getItersTupleString();
+    std::string getItersTupleString() const;
 };
 
 }  // namespace spf_ie
@@ -0,0 +1,82 @@
+/*!
+ * \file SymbolTable.hpp
+ *
+ * \brief Interning of identifiers and expression source text, so that they
+ * can be compared and hashed as small integer IDs.
+ */
+
+#ifndef SPFIE_SYMBOLTABLE_HPP
+#define SPFIE_SYMBOLTABLE_HPP
+
+#include <string>
+#include <vector>
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Stmt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+using namespace clang;
+
+namespace spf_ie {
+
+//! Identifier of an interned string
+using SymbolID = unsigned int;
+
+//! SymbolID which no interned string has
+#define NO_SYMBOL static_cast<SymbolID>(-1)
+
+/*!
+ * \class SymbolTable
+ *
+ * \brief Interns strings, and memoizes the source text of AST nodes, for one
+ * translation unit.
+ *
+ * Each distinct string is stored once and given a dense ID; equal text
+ * always gets the same ID. Looking up the text of a node only reads the
+ * source the first time the node is seen. A table is not thread-safe, so
+ * each builder keeps its own.
+ */
+class SymbolTable {
+   public:
+    //! \param[in] Context ASTContext of the translation unit whose source
+    //! text will be looked up
+    explicit SymbolTable(const ASTContext* Context) : Context(Context) {}
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    //! Get the ID of a string, interning it if it is new
+    SymbolID intern(llvm::StringRef text);
+
+    //! Get the ID of the source text of a statement or expression
+    SymbolID getSymbol(const clang::Stmt* stmt);
+
+    //! Get the interned text with the given ID
+    llvm::StringRef getText(SymbolID id) const { return texts[id]; }
+
+    //! Get the source text of a statement or expression, as a string
+    std::string getString(const clang::Stmt* stmt) {
+        return getText(getSymbol(stmt)).str();
+    }
+
+    //! Get the ASTContext source text is looked up in
+    const ASTContext* getContext() const { return Context; }
+
+   private:
+    //! ASTContext of the translation unit
+    const ASTContext* Context;
+    //! ID of each interned string; the map owns the string data, which is
+    //! bump-allocated and only freed with the table
+    llvm::StringMap<SymbolID, llvm::BumpPtrAllocator> ids;
+    //! Interned text, indexed by ID, referring to keys of ids
+    std::vector<llvm::StringRef> texts;
+    //! Memoized source text IDs of AST nodes
+    llvm::DenseMap<const clang::Stmt*, SymbolID> nodeSymbols;
+};
+
+}  // namespace spf_ie
+
+#endif
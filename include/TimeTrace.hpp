@@ -0,0 +1,77 @@
+/*!
+ * \file TimeTrace.hpp
+ *
+ * \brief Recording of time spent in each phase of processing, in the Chrome
+ * trace format used by Clang's -ftime-trace.
+ */
+
+#ifndef SPFIE_TIMETRACE_HPP
+#define SPFIE_TIMETRACE_HPP
+
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
+
+namespace spf_ie {
+
+/*!
+ * \class TimeTrace
+ *
+ * \brief Sets up LLVM's time trace profiler for the whole program,
+ * including worker threads.
+ *
+ * Phases are marked with llvm::TimeTraceScope, which records nothing unless
+ * tracing was enabled, so Clang's own frontend spans and spf-ie's phases end
+ * up in the same trace. LLVM's profiler is per-thread, so every thread
+ * doing traced work must hold a TimeTrace::ThreadScope.
+ */
+class TimeTrace {
+   public:
+    //! Start tracing on the calling (main) thread, and on every thread
+    //! entering a ThreadScope from now on
+    //! \param[in] granularity Minimum duration of a recorded span, in
+    //! microseconds
+    //! \param[in] procName Process name to record in the trace
+    static void enable(unsigned int granularity, llvm::StringRef procName);
+
+    //! Whether tracing has been enabled
+    static bool isEnabled() { return enabled; }
+
+    //! Write the trace collected from all threads to a file, and stop
+    //! tracing. Every worker thread must have left its ThreadScope.
+    //! \param[in] fileName File to write the trace to
+    //! \return whether the trace was written successfully
+    static bool writeAndDisable(const std::string& fileName);
+
+    /*!
+     * \struct ThreadScope
+     *
+     * \brief Traces the lifetime of a worker thread, if tracing is enabled
+     */
+    struct ThreadScope {
+        ThreadScope();
+        ~ThreadScope();
+
+        ThreadScope(const ThreadScope&) = delete;
+        ThreadScope& operator=(const ThreadScope&) = delete;
+
+       private:
+        //! Whether this scope started tracing on its thread
+        bool active;
+    };
+
+   private:
+    //! Whether tracing is enabled
+    static bool enabled;
+    //! Minimum duration of a recorded span, in microseconds
+    static unsigned int granularity;
+    //! Process name to record in the trace
+    static std::string procName;
+
+    TimeTrace() = delete;
+};
+
+}  // namespace spf_ie
+
+#endif
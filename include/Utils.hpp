@@ -1,12 +1,20 @@
 #ifndef SPFIE_UTILS_HPP
 #define SPFIE_UTILS_HPP
 
+#include <functional>
 #include <map>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
+#include "SetRelationSpec.hpp"
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/OperationKinds.h"
 #include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/StringRef.h"
 
 //! Base name (will be followed by a unique string) for use in variable
 //! substitutions
@@ -16,6 +24,17 @@ using namespace clang;
 
 namespace spf_ie {
 
+/*!
+ * \struct BuildError
+ *
+ * \brief Error thrown by Utils::printErrorAndExit, once it has printed it,
+ * on a thread where exiting is deferred
+ */
+struct BuildError : public std::runtime_error {
+    explicit BuildError(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
 /*!
  * \class Utils
  *
@@ -23,50 +42,168 @@ namespace spf_ie {
  */
 class Utils {
    public:
-    //! Print an error to standard error and exit with error status
+    /*!
+     * \class ExitDeferral
+     *
+     * \brief While one exists, printErrorAndExit on its thread throws a
+     * BuildError instead of exiting, so that only the work the thread was
+     * doing fails while other threads finish theirs
+     */
+    class ExitDeferral {
+       public:
+        ExitDeferral() : wasDeferred(exitDeferred) { exitDeferred = true; }
+        ~ExitDeferral() { exitDeferred = wasDeferred; }
+
+       private:
+        //! Whether exiting was already deferred
+        bool wasDeferred;
+    };
+
+    //! Get whether exiting is deferred on this thread
+    static bool isExitDeferred() { return exitDeferred; }
+
+    /*!
+     * \class SourceSharing
+     *
+     * \brief While one exists, getSourceMutex on its thread returns the
+     * given mutex, which is owned by the code running several threads over
+     * one ASTContext (such as the function workers of one translation unit)
+     * and passed to each of them
+     */
+    class SourceSharing {
+       public:
+        explicit SourceSharing(std::recursive_mutex& mutex)
+            : previous(sharedSourceMutex) {
+            sharedSourceMutex = &mutex;
+        }
+        ~SourceSharing() { sharedSourceMutex = previous; }
+
+       private:
+        //! Mutex which was shared before
+        std::recursive_mutex* previous;
+    };
+
+    //! Print an error to standard error and exit with error status (or
+    //! throw a BuildError, if exiting is deferred)
     static void printErrorAndExit(std::string message);
 
     //! Print an error to standard error, including the context of a
-    //! statement in the source code, and exit with error status
-    static void printErrorAndExit(std::string message, clang::Stmt* stmt);
+    //! statement in the source code, and exit with error status (or throw a
+    //! BuildError, if exiting is deferred)
+    //! \param[in] message Error message to print
+    //! \param[in] stmt Statement the error relates to
+    //! \param[in] Context ASTContext the statement belongs to
+    static void printErrorAndExit(std::string message, clang::Stmt* stmt,
+                                  const ASTContext* Context);
+
+    //! Warn on standard error that something is not being done with a
+    //! function, because it has constraints that can only be built from
+    //! strings (so its statements have no complete specs)
+    //! \param[in] action What is not being done, completing "not ... function"
+    //! \param[in] name Name of the function
+    static void warnNotDescribed(llvm::StringRef action, llvm::StringRef name);
 
     //! Print a line (horizontal separator) to standard output
     static void printSmallLine();
 
     //! Get the source code of a statement as a string
-    static std::string stmtToString(clang::Stmt* stmt);
-
-    //! Get a copy of the given string with all instances of the substring to
-    //! find replaced as specified
-    //! \param[in] input String to perform substitutions on (will not be
-    //! modified)
-    //! \param[in] toFind String to find (and replace) within input
-    //! \param[in] replaceWith String to use as replacement
-    static std::string replaceInString(std::string input, std::string toFind,
-                                       std::string replaceWith);
+    static std::string stmtToString(clang::Stmt* stmt,
+                                    const ASTContext* Context);
+
+    //! Get the source text of a range, holding the source mutex
+    //! \param[in] range Range of the text
+    //! \param[in] Context ASTContext whose source the range is in
+    //! \return the text, which points into the source buffer
+    static llvm::StringRef getSourceText(CharSourceRange range,
+                                         const ASTContext* Context);
+
+    //! Get the mutex which must be held while querying an ASTContext or its
+    //! SourceManager (for source text, locations or constant evaluation),
+    //! since queries update their caches even through const references. It
+    //! is the one set by a SourceSharing on this thread, or else one of the
+    //! thread's own, so that threads working on different ASTContexts do
+    //! not wait for each other. It is recursive, so that code holding it may
+    //! call functions which take it themselves.
+    static std::recursive_mutex& getSourceMutex() {
+        return sharedSourceMutex ? *sharedSourceMutex : unsharedSourceMutex;
+    }
 
     //! Retrieve "all" array accesses, from left to right, contained in an
     //! expression.
-    //! Recurses into BinaryOperators.
+    //! Recurses into BinaryOperators and ConditionalOperators.
     //! \param[in] expr Expression to process
     //! \param[out] currentList List of accesses
     static void getExprArrayAccesses(
         Expr* expr, std::vector<ArraySubscriptExpr*>& currentList);
 
     //! Get a unique variable name to use in substitutions
-    static std::string getVarReplacementName();
+    //! \param[in,out] replacementVarNumber Number to use (and increment) in
+    //! the name, owned by the caller so that independent builders do not
+    //! share state
+    static std::string getVarReplacementName(
+        unsigned int& replacementVarNumber);
+
+    //! Get whether code uses an identifier
+    static bool usesIdentifier(const std::string& code,
+                               const std::string& name);
+
+    //! Replace every use of an identifier in code with another
+    static std::string replaceIdentifier(const std::string& code,
+                                         const std::string& name,
+                                         const std::string& replacement);
+
+    //! Make a name, starting with a base, which code does not use and which
+    //! has not already been made
+    //! \param[in] base Start of the name
+    //! \param[in] code Code the name must not appear in
+    //! \param[in,out] taken Names already made, to which the name is added
+    static std::string makeUniqueName(const std::string& base,
+                                      const std::string& code,
+                                      std::vector<std::string>& taken);
 
     //! Get a string representation of a binary operator
     static std::string binaryOperatorKindToString(BinaryOperatorKind bo);
 
+    //! Check of an outermost loop, given the statements in it, which gives
+    //! the reason the loop is rejected
+    using LoopCheck =
+        std::function<bool(const std::vector<unsigned int>&, std::string&)>;
+
+    //! Group the statements inside loops by the outermost loop they are in;
+    //! the statements of each loop are consecutive
+    //! \param[in] stmts Statements of a function
+    //! \param[out] loops Statements in each outermost loop, in order
+    //! \param[out] reason Why there are no loops, if there are none
+    //! \return whether there is a loop, and every schedule could be read
+    static bool getOutermostLoops(const std::vector<StmtSpec>& stmts,
+                                  std::vector<std::vector<unsigned int>>& loops,
+                                  std::string& reason);
+
+    //! Find the first outermost loop accepted by a check
+    //! \param[in] stmts Statements of a function
+    //! \param[in] check Check of each loop
+    //! \param[out] reason Why each loop was rejected, if none was accepted
+    //! \param[in] only Position (from 1) of the only loop to check, or 0 to
+    //! check every loop
+    //! \return whether a loop was accepted
+    static bool findOutermostLoop(const std::vector<StmtSpec>& stmts,
+                                  const LoopCheck& check, std::string& reason,
+                                  unsigned int only = 0);
+
    private:
+    //! Whether exiting is deferred on this thread
+    static thread_local bool exitDeferred;
+
+    //! Guards queries of the ASTContext this thread shares with others, if
+    //! it shares one
+    static thread_local std::recursive_mutex* sharedSourceMutex;
+
+    //! Guards queries of an ASTContext this thread does not share
+    static thread_local std::recursive_mutex unsharedSourceMutex;
+
     //! String representations of valid operators for use in constraints
     static const std::map<BinaryOperatorKind, std::string> operatorStrings;
 
-    //! Number to be used (and incremented) when creating replacement variable
-    //! names
-    static unsigned int replacementVarNumber;
-
     Utils() = delete;
 };
 
@@ -0,0 +1,605 @@
+#include "Archive.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "SPFComputationBuilder.hpp"
+#include "SetRelationSpec.hpp"
+#include "Stats.hpp"
+#include "iegenlib.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+//! Number of words in the archive header
+#define HEADER_WORDS 4
+//! Number of words in each entry of the function index
+#define INDEX_ENTRY_WORDS 4
+//! Number of words in each statement record
+#define STMT_RECORD_WORDS 13
+//! Number of words in each data access record
+#define ACCESS_RECORD_WORDS 2
+//! Number of words at the start of each set or relation record
+#define SET_RECORD_WORDS 5
+//! Number of words in each term of an expression record
+#define TERM_RECORD_WORDS 5
+//! Deepest nesting of expressions (in uninterpreted function call
+//! arguments) that a reader will follow
+#define MAX_EXP_DEPTH 64
+
+namespace spf_ie {
+
+//! Get the number of bytes a string takes in the string table: its length,
+//! then its characters and a null terminator, padded to a whole word
+static uint32_t getStringRecordSize(llvm::StringRef str) {
+    return 4 + ((str.size() + 1 + 3) & ~3u);
+}
+
+//! Gather the strings of an expression, in order of first appearance
+static void collectStrings(const SpecExp& exp,
+                           llvm::StringMap<uint32_t>& strings,
+                           std::vector<llvm::StringRef>& order) {
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::Symbol ||
+            term.kind == SpecTerm::Kind::UFCall) {
+            if (strings.insert(std::make_pair(term.name, 0)).second) {
+                order.push_back(strings.find(term.name)->first());
+            }
+        }
+        for (const auto& arg : term.args) {
+            collectStrings(arg, strings, order);
+        }
+    }
+}
+
+//! Gather the strings of a set or relation, in order of first appearance
+static void collectStrings(const SetRelationSpec& spec,
+                           llvm::StringMap<uint32_t>& strings,
+                           std::vector<llvm::StringRef>& order) {
+    for (const auto& it : spec.tuple) {
+        if (!it.isConst && strings.insert(std::make_pair(it.var, 0)).second) {
+            order.push_back(strings.find(it.var)->first());
+        }
+    }
+    for (const auto& it : spec.equalities) {
+        collectStrings(it, strings, order);
+    }
+    for (const auto& it : spec.inequalities) {
+        collectStrings(it, strings, order);
+    }
+}
+
+/*!
+ * \class ArchiveEncoder
+ *
+ * \brief Lays out the records of an archive after its string table and
+ * index, children before the records referring to them
+ */
+class ArchiveEncoder {
+   public:
+    //! \param[in] strings Offset of each string in the string table
+    //! \param[in] dataOffset Offset at which the records will start
+    ArchiveEncoder(const llvm::StringMap<uint32_t>& strings,
+                   uint32_t dataOffset)
+        : strings(strings), dataOffset(dataOffset) {}
+
+    //! Encode the statements of a function
+    //! \return offset of the first of the statement records
+    uint32_t encodeStmts(const std::vector<StmtSpec>& stmts) {
+        std::vector<uint32_t> records;
+        for (const auto& stmt : stmts) {
+            std::vector<uint32_t> dataSpaces;
+            for (const auto& it : stmt.dataSpaces) {
+                dataSpaces.push_back(getString(it));
+            }
+            std::vector<uint32_t> scalars;
+            for (const auto& it : stmt.scalars) {
+                scalars.push_back(getString(it));
+            }
+            uint32_t iterSpace = encodeSetRelationSpec(stmt.iterSpace);
+            uint32_t execSchedule = encodeSetRelationSpec(stmt.execSchedule);
+            uint32_t reads = encodeAccesses(stmt.dataReads);
+            uint32_t writes = encodeAccesses(stmt.dataWrites);
+            records.insert(
+                records.end(),
+                {getString(stmt.sourceCode), iterSpace, execSchedule,
+                 static_cast<uint32_t>(stmt.dataReads.size()), reads,
+                 static_cast<uint32_t>(stmt.dataWrites.size()), writes,
+                 static_cast<uint32_t>(dataSpaces.size()),
+                 append(dataSpaces),
+                 static_cast<uint32_t>(stmt.reduction),
+                 static_cast<uint32_t>(scalars.size()), append(scalars),
+                 static_cast<uint32_t>(stmt.isConditional)});
+        }
+        return append(records);
+    }
+
+    //! Get the words of every record encoded so far
+    const std::vector<uint32_t>& getWords() const { return words; }
+
+   private:
+    //! Offset of each string in the string table
+    const llvm::StringMap<uint32_t>& strings;
+    //! Offset at which the records will start
+    uint32_t dataOffset;
+    //! Words of every record encoded so far
+    std::vector<uint32_t> words;
+
+    //! Add words to the end of the records
+    //! \return offset of the first word added
+    uint32_t append(llvm::ArrayRef<uint32_t> newWords) {
+        const uint32_t offset = dataOffset + 4 * words.size();
+        words.insert(words.end(), newWords.begin(), newWords.end());
+        return offset;
+    }
+
+    //! Get the offset of a string in the string table
+    uint32_t getString(llvm::StringRef str) const {
+        return strings.lookup(str);
+    }
+
+    uint32_t encodeSpecExp(const SpecExp& exp) {
+        std::vector<uint32_t> record = {
+            static_cast<uint32_t>(exp.terms.size())};
+        for (const auto& term : exp.terms) {
+            uint32_t payload = 0;
+            if (term.kind == SpecTerm::Kind::TupleVar) {
+                payload = term.tuplePos;
+            } else if (term.kind != SpecTerm::Kind::Const) {
+                payload = getString(term.name);
+            }
+            std::vector<uint32_t> args;
+            for (const auto& arg : term.args) {
+                args.push_back(encodeSpecExp(arg));
+            }
+            record.insert(record.end(),
+                          {static_cast<uint32_t>(term.kind),
+                           static_cast<uint32_t>(term.coeff), payload,
+                           static_cast<uint32_t>(args.size()),
+                           append(args)});
+        }
+        return append(record);
+    }
+
+    uint32_t encodeSetRelationSpec(const SetRelationSpec& spec) {
+        std::vector<uint32_t> record = {
+            spec.isRelation, static_cast<uint32_t>(spec.inArity),
+            static_cast<uint32_t>(spec.tuple.size()),
+            static_cast<uint32_t>(spec.equalities.size()),
+            static_cast<uint32_t>(spec.inequalities.size())};
+        for (const auto& it : spec.tuple) {
+            record.push_back(it.isConst);
+            record.push_back(it.isConst ? static_cast<uint32_t>(it.constant)
+                                        : getString(it.var));
+        }
+        for (const auto& it : spec.equalities) {
+            record.push_back(encodeSpecExp(it));
+        }
+        for (const auto& it : spec.inequalities) {
+            record.push_back(encodeSpecExp(it));
+        }
+        return append(record);
+    }
+
+    uint32_t encodeAccesses(
+        const std::vector<std::pair<std::string, SetRelationSpec>>&
+            accesses) {
+        std::vector<uint32_t> records;
+        for (const auto& it : accesses) {
+            uint32_t relation = encodeSetRelationSpec(it.second);
+            records.insert(records.end(), {getString(it.first), relation});
+        }
+        return append(records);
+    }
+};
+
+/* ArchiveWriter */
+
+void ArchiveWriter::addFunction(std::string fileName, std::string name,
+                                std::vector<StmtSpec> stmts) {
+    std::lock_guard<std::mutex> lock(functionsMutex);
+    functions.push_back({std::move(fileName), std::move(name),
+                         std::move(stmts)});
+}
+
+void ArchiveWriter::write(llvm::raw_ostream& os) const {
+    std::lock_guard<std::mutex> lock(functionsMutex);
+
+    // order functions by name for lookup, and so that output does not
+    // depend on the order functions were added in
+    std::vector<const ArchivedFunction*> sorted;
+    for (const auto& it : functions) {
+        sorted.push_back(&it);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const ArchivedFunction* a, const ArchivedFunction* b) {
+                  return std::tie(a->name, a->fileName) <
+                         std::tie(b->name, b->fileName);
+              });
+
+    // lay out the string table
+    llvm::StringMap<uint32_t> strings;
+    std::vector<llvm::StringRef> stringOrder;
+    auto addString = [&](llvm::StringRef str) {
+        if (strings.insert(std::make_pair(str, 0)).second) {
+            stringOrder.push_back(strings.find(str)->first());
+        }
+    };
+    for (const auto* function : sorted) {
+        addString(function->name);
+        addString(function->fileName);
+        for (const auto& stmt : function->stmts) {
+            addString(stmt.sourceCode);
+            collectStrings(stmt.iterSpace, strings, stringOrder);
+            collectStrings(stmt.execSchedule, strings, stringOrder);
+            for (const auto& it : stmt.dataReads) {
+                addString(it.first);
+                collectStrings(it.second, strings, stringOrder);
+            }
+            for (const auto& it : stmt.dataWrites) {
+                addString(it.first);
+                collectStrings(it.second, strings, stringOrder);
+            }
+            for (const auto& it : stmt.dataSpaces) {
+                addString(it);
+            }
+            for (const auto& it : stmt.scalars) {
+                addString(it);
+            }
+        }
+    }
+    uint32_t offset = 4 * HEADER_WORDS;
+    for (const auto& it : stringOrder) {
+        strings[it] = offset;
+        offset += getStringRecordSize(it);
+    }
+    const uint32_t indexOffset = offset;
+
+    // lay out the records, then the index pointing to them
+    ArchiveEncoder encoder(
+        strings, indexOffset + 4 * INDEX_ENTRY_WORDS * sorted.size());
+    std::vector<uint32_t> index;
+    for (const auto* function : sorted) {
+        index.insert(index.end(),
+                     {strings.lookup(function->name),
+                      strings.lookup(function->fileName),
+                      static_cast<uint32_t>(function->stmts.size()),
+                      encoder.encodeStmts(function->stmts)});
+    }
+
+    llvm::support::endian::Writer writer(os, llvm::support::little);
+    writer.write<uint32_t>(ARCHIVE_MAGIC);
+    writer.write<uint32_t>(ARCHIVE_FORMAT_VERSION);
+    writer.write<uint32_t>(sorted.size());
+    writer.write<uint32_t>(indexOffset);
+    for (const auto& it : stringOrder) {
+        writer.write<uint32_t>(it.size());
+        os << it;
+        os.write_zeros(getStringRecordSize(it) - 4 - it.size());
+    }
+    for (uint32_t word : index) {
+        writer.write<uint32_t>(word);
+    }
+    for (uint32_t word : encoder.getWords()) {
+        writer.write<uint32_t>(word);
+    }
+}
+
+/* ArchiveReader */
+
+ArchiveReader::ArchiveReader(std::unique_ptr<llvm::MemoryBuffer> buffer)
+    : buffer(std::move(buffer)), numFunctions(0), indexOffset(0) {}
+
+std::unique_ptr<ArchiveReader> ArchiveReader::open(llvm::StringRef path,
+                                                   std::string& error) {
+    uint64_t size;
+    if (std::error_code EC = llvm::sys::fs::file_size(path, size)) {
+        error = EC.message();
+        return nullptr;
+    }
+    // a slice needs no null terminator, so large files are mapped
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileBuffer =
+        llvm::MemoryBuffer::getFileSlice(path, size, 0);
+    if (!fileBuffer) {
+        error = fileBuffer.getError().message();
+        return nullptr;
+    }
+    return create(std::move(*fileBuffer), error);
+}
+
+std::unique_ptr<ArchiveReader> ArchiveReader::create(
+    std::unique_ptr<llvm::MemoryBuffer> buffer, std::string& error) {
+    std::unique_ptr<ArchiveReader> reader(
+        new ArchiveReader(std::move(buffer)));
+    if (!reader->inBounds(0, HEADER_WORDS) ||
+        reader->readWord(0) != ARCHIVE_MAGIC) {
+        error = "Not an spf-ie archive";
+        return nullptr;
+    }
+    // offsets are 32-bit, so nothing in range can be past this size
+    if (reader->buffer->getBufferSize() > UINT32_MAX) {
+        error = "Archive is too large";
+        return nullptr;
+    }
+    if (reader->readWord(4) != ARCHIVE_FORMAT_VERSION) {
+        error = "Unsupported archive format version " +
+                std::to_string(reader->readWord(4));
+        return nullptr;
+    }
+    reader->numFunctions = reader->readWord(8);
+    reader->indexOffset = reader->readWord(12);
+    if (!reader->inBounds(reader->indexOffset,
+                          INDEX_ENTRY_WORDS *
+                              static_cast<uint64_t>(reader->numFunctions))) {
+        error = "Archive is truncated";
+        return nullptr;
+    }
+    return reader;
+}
+
+llvm::StringRef ArchiveReader::getFunctionName(uint32_t function) const {
+    return readString(readWord(getIndexEntry(function)));
+}
+
+llvm::StringRef ArchiveReader::getFileName(uint32_t function) const {
+    return readString(readWord(getIndexEntry(function) + 4));
+}
+
+bool ArchiveReader::findFunction(llvm::StringRef name,
+                                 uint32_t& function) const {
+    uint32_t low = 0;
+    uint32_t high = numFunctions;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (getFunctionName(middle) < name) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == numFunctions || getFunctionName(low) != name) {
+        return false;
+    }
+    function = low;
+    return true;
+}
+
+uint32_t ArchiveReader::getNumStmts(uint32_t function) const {
+    return readWord(getIndexEntry(function) + 8);
+}
+
+llvm::StringRef ArchiveReader::getStmtSourceCode(uint32_t function,
+                                                 uint32_t stmt) const {
+    const uint64_t record = getStmtRecord(function, stmt);
+    return record ? readString(readWord(record)) : llvm::StringRef();
+}
+
+bool ArchiveReader::readStmtSpec(uint32_t function, uint32_t stmt,
+                                 StmtSpec& spec) const {
+    const uint64_t record = getStmtRecord(function, stmt);
+    if (!record) {
+        return false;
+    }
+    spec.sourceCode = readString(readWord(record)).str();
+    if (!readSetRelationSpec(readWord(record + 4), spec.iterSpace) ||
+        !readSetRelationSpec(readWord(record + 8), spec.execSchedule) ||
+        !readAccesses(readWord(record + 16), readWord(record + 12),
+                      spec.dataReads) ||
+        !readAccesses(readWord(record + 24), readWord(record + 20),
+                      spec.dataWrites)) {
+        return false;
+    }
+    const uint32_t numDataSpaces = readWord(record + 28);
+    const uint32_t dataSpaces = readWord(record + 32);
+    if (!inBounds(dataSpaces, numDataSpaces)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < numDataSpaces; ++i) {
+        spec.dataSpaces.push_back(
+            readString(readWord(dataSpaces + 4 * i)).str());
+    }
+    const uint32_t reduction = readWord(record + 36);
+    if (reduction > static_cast<uint32_t>(ReductionOp::Max)) {
+        return false;
+    }
+    spec.reduction = static_cast<ReductionOp>(reduction);
+    const uint32_t numScalars = readWord(record + 40);
+    const uint32_t scalars = readWord(record + 44);
+    if (!inBounds(scalars, numScalars)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < numScalars; ++i) {
+        spec.scalars.push_back(readString(readWord(scalars + 4 * i)).str());
+    }
+    const uint32_t conditional = readWord(record + 48);
+    if (conditional > 1) {
+        return false;
+    }
+    spec.isConditional = conditional;
+    return true;
+}
+
+std::unique_ptr<iegenlib::Computation> ArchiveReader::loadComputation(
+    uint32_t function) const {
+    // check the count against the archive before allocating for it
+    if (function >= numFunctions) {
+        return nullptr;
+    }
+    const uint32_t numStmts = getNumStmts(function);
+    if (!inBounds(readWord(getIndexEntry(function) + 12),
+                  STMT_RECORD_WORDS * static_cast<uint64_t>(numStmts))) {
+        return nullptr;
+    }
+    std::vector<StmtSpec> stmts(numStmts);
+    for (uint32_t i = 0; i < stmts.size(); ++i) {
+        if (!readStmtSpec(function, i, stmts[i])) {
+            return nullptr;
+        }
+    }
+    if (Stats::isEnabled()) {
+        Stats::recordFunction({getFileName(function).str(),
+                               getFunctionName(function).str(), "archive",
+                               numStmts, 0, Stats::getPeakRSSKilobytes()});
+    }
+    return SPFComputationBuilder::makeComputationFromSpecs(stmts);
+}
+
+uint32_t ArchiveReader::readWord(uint64_t offset) const {
+    if (!inBounds(offset, 1)) {
+        return 0;
+    }
+    return llvm::support::endian::read32le(buffer->getBufferStart() +
+                                           offset);
+}
+
+bool ArchiveReader::inBounds(uint64_t offset, uint64_t numWords) const {
+    return offset + 4 * numWords <= buffer->getBufferSize();
+}
+
+llvm::StringRef ArchiveReader::readString(uint64_t offset) const {
+    const uint32_t length = readWord(offset);
+    if (!inBounds(offset, 1) ||
+        offset + 4 + length > buffer->getBufferSize()) {
+        return llvm::StringRef();
+    }
+    return llvm::StringRef(buffer->getBufferStart() + offset + 4, length);
+}
+
+uint64_t ArchiveReader::getIndexEntry(uint32_t function) const {
+    return indexOffset +
+           4 * INDEX_ENTRY_WORDS * static_cast<uint64_t>(function);
+}
+
+uint64_t ArchiveReader::getStmtRecord(uint32_t function,
+                                      uint32_t stmt) const {
+    if (function >= numFunctions || stmt >= getNumStmts(function)) {
+        return 0;
+    }
+    const uint64_t record = readWord(getIndexEntry(function) + 12) +
+                            4 * STMT_RECORD_WORDS * static_cast<uint64_t>(stmt);
+    return inBounds(record, STMT_RECORD_WORDS) ? record : 0;
+}
+
+bool ArchiveReader::readSetRelationSpec(uint64_t offset,
+                                        SetRelationSpec& spec) const {
+    if (!inBounds(offset, SET_RECORD_WORDS)) {
+        return false;
+    }
+    spec.isRelation = readWord(offset);
+    spec.inArity = readWord(offset + 4);
+    const uint32_t tupleSize = readWord(offset + 8);
+    const uint32_t numEqualities = readWord(offset + 12);
+    const uint32_t numInequalities = readWord(offset + 16);
+    const uint64_t tuple = offset + 4 * SET_RECORD_WORDS;
+    const uint64_t exps = tuple + 8 * static_cast<uint64_t>(tupleSize);
+    if (!inBounds(tuple, 2 * static_cast<uint64_t>(tupleSize)) ||
+        !inBounds(exps, static_cast<uint64_t>(numEqualities) +
+                            numInequalities)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < tupleSize; ++i) {
+        const uint32_t value = readWord(tuple + 8 * i + 4);
+        if (readWord(tuple + 8 * i)) {
+            spec.tuple.emplace_back(static_cast<int>(value));
+        } else {
+            spec.tuple.emplace_back(readString(value).str());
+        }
+    }
+    spec.equalities.resize(numEqualities);
+    spec.inequalities.resize(numInequalities);
+    for (uint32_t i = 0; i < numEqualities; ++i) {
+        if (!readSpecExp(readWord(exps + 4 * i), spec.equalities[i], 0)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < numInequalities; ++i) {
+        const uint64_t inequality =
+            exps + 4 * (static_cast<uint64_t>(numEqualities) + i);
+        if (!readSpecExp(readWord(inequality), spec.inequalities[i], 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArchiveReader::readSpecExp(uint64_t offset, SpecExp& exp,
+                                int depth) const {
+    const uint32_t numTerms = readWord(offset);
+    if (depth > MAX_EXP_DEPTH || !inBounds(offset, 1) ||
+        !inBounds(offset + 4,
+                  TERM_RECORD_WORDS * static_cast<uint64_t>(numTerms))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < numTerms; ++i) {
+        const uint64_t term =
+            offset + 4 + 4 * TERM_RECORD_WORDS * static_cast<uint64_t>(i);
+        const uint32_t kind = readWord(term);
+        const int coeff = static_cast<int32_t>(readWord(term + 4));
+        const uint32_t payload = readWord(term + 8);
+        switch (static_cast<SpecTerm::Kind>(kind)) {
+            case SpecTerm::Kind::Const:
+                exp.terms.push_back(SpecTerm::makeConst(coeff));
+                break;
+            case SpecTerm::Kind::Symbol:
+                exp.terms.push_back(
+                    SpecTerm::makeSymbol(readString(payload).str(), coeff));
+                break;
+            case SpecTerm::Kind::TupleVar:
+                exp.terms.push_back(
+                    SpecTerm::makeTupleVar(static_cast<int>(payload), coeff));
+                break;
+            case SpecTerm::Kind::UFCall: {
+                const uint32_t numArgs = readWord(term + 12);
+                const uint32_t args = readWord(term + 16);
+                if (!inBounds(args, numArgs)) {
+                    return false;
+                }
+                std::vector<SpecExp> argExps(numArgs);
+                for (uint32_t j = 0; j < numArgs; ++j) {
+                    if (!readSpecExp(readWord(args + 4 * j), argExps[j],
+                                     depth + 1)) {
+                        return false;
+                    }
+                }
+                exp.terms.push_back(SpecTerm::makeUFCall(
+                    readString(payload).str(), std::move(argExps), coeff));
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ArchiveReader::readAccesses(
+    uint64_t offset, uint32_t count,
+    std::vector<std::pair<std::string, SetRelationSpec>>& accesses) const {
+    if (!inBounds(offset, ACCESS_RECORD_WORDS * static_cast<uint64_t>(count))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint64_t access =
+            offset + 4 * ACCESS_RECORD_WORDS * static_cast<uint64_t>(i);
+        SetRelationSpec relation;
+        if (!readSetRelationSpec(readWord(access + 4), relation)) {
+            return false;
+        }
+        accesses.emplace_back(readString(readWord(access)).str(),
+                              std::move(relation));
+    }
+    return true;
+}
+
+}  // namespace spf_ie
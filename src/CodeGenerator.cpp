@@ -0,0 +1,563 @@
+#include "CodeGenerator.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/Stmt.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+namespace spf_ie {
+
+//! Get the deepest tuple variable an expression uses, including within
+//! uninterpreted function call arguments, or -1 if it uses none
+static int getDeepestTupleVar(const SpecExp& exp) {
+    int deepest = -1;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar) {
+            deepest = std::max(deepest, term.tuplePos);
+        }
+        for (const auto& arg : term.args) {
+            deepest = std::max(deepest, getDeepestTupleVar(arg));
+        }
+    }
+    return deepest;
+}
+
+//! Get the coefficient of a tuple variable outside of any call in an
+//! expression, or 0 if it also appears in a call argument
+static int getTupleVarCoeff(const SpecExp& exp, int position) {
+    int coeff = 0;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar &&
+            term.tuplePos == position) {
+            coeff += term.coeff;
+        }
+        for (const auto& arg : term.args) {
+            if (getDeepestTupleVar(arg) >= position) {
+                return 0;
+            }
+        }
+    }
+    return coeff;
+}
+
+//! Get an expression without the terms of a tuple variable
+static SpecExp withoutTupleVar(const SpecExp& exp, int position) {
+    SpecExp rest;
+    for (const auto& term : exp.terms) {
+        if (term.kind != SpecTerm::Kind::TupleVar ||
+            term.tuplePos != position) {
+            rest.terms.push_back(term);
+        }
+    }
+    return rest;
+}
+
+//! Get a schedule's value at a position, which must be a number
+static int getScheduleNum(const ExecSchedule& schedule, int position) {
+    return position < schedule.getDimension()
+               ? schedule.scheduleTuple[position].value
+               : 0;
+}
+
+//! Get whether one schedule comes before another (iterator entries, which
+//! are equal for statements sharing a loop, are not compared)
+static bool isScheduledBefore(const ExecSchedule& a, const ExecSchedule& b) {
+    const int dimension = std::max(a.getDimension(), b.getDimension());
+    for (int i = 0; i < dimension; i += 2) {
+        const int aValue = getScheduleNum(a, i);
+        const int bValue = getScheduleNum(b, i);
+        if (aValue != bValue) {
+            return aValue < bValue;
+        }
+    }
+    return false;
+}
+
+//! Get whether a schedule prefix ends with the iterator of a statement's
+//! loop at a depth
+static bool isLoopPrefix(const ExecSchedule& prefix,
+                         const ExecSchedule& schedule, int level) {
+    if (prefix.getDimension() != 2 * level + 2 ||
+        schedule.getDimension() < prefix.getDimension()) {
+        return false;
+    }
+    for (int i = 0; i < prefix.getDimension(); ++i) {
+        if (prefix.scheduleTuple[i].valueIsVar !=
+                schedule.scheduleTuple[i].valueIsVar ||
+            prefix.scheduleTuple[i].value != schedule.scheduleTuple[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Get whether a statement is in a loop at a depth
+static bool isInLoop(const ExecSchedule& schedule, int level) {
+    const int position = 2 * level + 1;
+    return position < schedule.getDimension() &&
+           schedule.scheduleTuple[position].valueIsVar;
+}
+
+//! Take the constraints satisfying a condition which are common to every
+//! one of a group of statements, removing them from each
+//! \param[in,out] lists Constraints of each statement
+//! \param[in] condition Condition on the constraints to take
+//! \return the constraints taken, in the first statement's order
+template <typename Condition>
+static std::vector<SpecExp> takeCommon(
+    const std::vector<std::vector<SpecExp>*>& lists, Condition condition) {
+    std::vector<SpecExp> taken;
+    for (const auto& candidate : *lists.front()) {
+        if (!condition(candidate)) {
+            continue;
+        }
+        bool common = std::all_of(
+            lists.begin() + 1, lists.end(),
+            [&](const std::vector<SpecExp>* list) {
+                return std::find(list->begin(), list->end(), candidate) !=
+                       list->end();
+            });
+        if (common) {
+            taken.push_back(candidate);
+        }
+    }
+    for (const auto& list : lists) {
+        for (const auto& it : taken) {
+            auto found = std::find(list->begin(), list->end(), it);
+            if (found != list->end()) {
+                list->erase(found);
+            }
+        }
+    }
+    return taken;
+}
+
+//! Take the bounds of a loop from the inequalities of the statements in it:
+//! the first lower bound on its iterator which they all have, and every
+//! upper bound they have in common. Other lower bounds are left among the
+//! inequalities.
+//! \param[in,out] lists Inequalities of each statement
+//! \param[in] level Depth of the loop
+//! \param[out] lowerBound The lower bound
+//! \param[out] upperBounds The upper bounds, in the first statement's order
+//! \return whether a lower and an upper bound were found
+static bool takeLoopBounds(const std::vector<std::vector<SpecExp>*>& lists,
+                           int level, SpecExp& lowerBound,
+                           std::vector<SpecExp>& upperBounds) {
+    std::vector<SpecExp> lowerBounds =
+        takeCommon(lists, [&](const SpecExp& it) {
+            return getDeepestTupleVar(it) == level &&
+                   getTupleVarCoeff(it, level) == 1;
+        });
+    // an upper bound may scale the iterator, as for a loop over tiles
+    upperBounds = takeCommon(lists, [&](const SpecExp& it) {
+        return getDeepestTupleVar(it) == level &&
+               getTupleVarCoeff(it, level) < 0;
+    });
+    if (lowerBounds.empty() || upperBounds.empty()) {
+        return false;
+    }
+    for (const auto& it : lists) {
+        it->insert(it->end(), lowerBounds.begin() + 1, lowerBounds.end());
+    }
+    lowerBound = lowerBounds.front();
+    return true;
+}
+
+//! Write the condition a loop's iterator meets while it stays below an
+//! upper bound: -c * i + rest >= 0 gives c * i < rest + 1
+//! \param[in] bound Inequality bounding the iterator from above
+//! \param[in] level Depth of the loop
+//! \param[in] tuple Tuple declaration naming the tuple variables
+static std::string upperBoundToString(const SpecExp& bound, int level,
+                                      const std::vector<TupleElem>& tuple) {
+    SpecExp scaled;
+    scaled.terms.push_back(
+        SpecTerm::makeTupleVar(level, -getTupleVarCoeff(bound, level)));
+    return CodeGenerator::expToString(scaled, tuple) + " < " +
+           CodeGenerator::expToString(
+               CodeGenerator::getBoundValue(bound, level), tuple);
+}
+
+//! Write a constraint as a C comparison
+//! \param[in] constraint The constraint's expression
+//! \param[in] oper Operator comparing the expression to 0
+//! \param[in] tuple Tuple declaration naming the tuple variables
+static std::string constraintToString(const SpecExp& constraint,
+                                      const std::string& oper,
+                                      const std::vector<TupleElem>& tuple) {
+    // move terms subtracted to the other side, so that exp >= 0 becomes
+    // a >= b
+    SpecExp lhs;
+    SpecExp rhs;
+    for (const auto& term : constraint.terms) {
+        if (term.coeff < 0) {
+            SpecTerm negated = term;
+            negated.coeff = -term.coeff;
+            rhs.terms.push_back(negated);
+        } else if (term.coeff > 0) {
+            lhs.terms.push_back(term);
+        }
+    }
+    return CodeGenerator::expToString(lhs, tuple) + " " + oper + " " +
+           CodeGenerator::expToString(rhs, tuple);
+}
+
+//! Write a line of code
+static void writeLine(llvm::raw_ostream& os, int indent,
+                      const std::string& line) {
+    os.indent(4 * indent) << line << "\n";
+}
+
+/* CodeGenerator */
+
+bool CodeGenerator::writeBody(llvm::raw_ostream& os, int indent) const {
+    llvm::TimeTraceScope generateScope("GenerateCode");
+    std::vector<PendingStmt> pending;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        PendingStmt stmt;
+        stmt.index = i;
+        if (!stmts[i].getSchedule(stmt.schedule)) {
+            return false;
+        }
+        stmt.equalities = stmts[i].iterSpace.equalities;
+        stmt.inequalities = stmts[i].iterSpace.inequalities;
+        pending.push_back(stmt);
+    }
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const PendingStmt& a, const PendingStmt& b) {
+                         return isScheduledBefore(a.schedule, b.schedule);
+                     });
+
+    // write nothing unless all of it can be written
+    std::string body;
+    llvm::raw_string_ostream bodyStream(body);
+    if (!writeBlock(pending, 0, indent, bodyStream)) {
+        return false;
+    }
+    os << bodyStream.str();
+    return true;
+}
+
+bool CodeGenerator::writeFunction(llvm::raw_ostream& os,
+                                  const std::string& prototype) const {
+    std::string body;
+    llvm::raw_string_ostream bodyStream(body);
+    if (!writeBody(bodyStream)) {
+        return false;
+    }
+    os << prototype << " {\n" << bodyStream.str() << "}\n";
+    return true;
+}
+
+std::string CodeGenerator::getPrototype(FunctionDecl* funcDecl,
+                                        const ASTContext* Context) {
+    const SourceLocation begin = funcDecl->getBeginLoc();
+    const SourceLocation end = funcDecl->getBody()->getBeginLoc();
+    return Utils::getSourceText(CharSourceRange::getCharRange(begin, end),
+                                Context)
+        .rtrim()
+        .str();
+}
+
+std::string CodeGenerator::getParameters(FunctionDecl* funcDecl,
+                                         const ASTContext* Context) {
+    if (funcDecl->getNumParams() == 0) {
+        return "";
+    }
+    const SourceRange range(
+        funcDecl->getParamDecl(0)->getBeginLoc(),
+        funcDecl->getParamDecl(funcDecl->getNumParams() - 1)
+            ->getSourceRange()
+            .getEnd());
+    return Utils::getSourceText(CharSourceRange::getTokenRange(range), Context)
+        .str();
+}
+
+std::map<std::string, std::string> CodeGenerator::getElementTypes(
+    FunctionDecl* funcDecl) {
+    std::map<std::string, std::string> elementTypes;
+    for (unsigned int i = 0; i < funcDecl->getNumParams(); ++i) {
+        const ParmVarDecl* param = funcDecl->getParamDecl(i);
+        // array parameters are adjusted to pointers
+        if (param->getType()->isPointerType()) {
+            elementTypes[param->getNameAsString()] =
+                param->getType()->getPointeeType().getAsString();
+        }
+    }
+    return elementTypes;
+}
+
+std::string CodeGenerator::getUsedCode(const std::vector<StmtSpec>& stmts,
+                                       const std::string& parameters) {
+    std::string usedCode = parameters;
+    for (const auto& spec : stmts) {
+        usedCode += "\n" + spec.sourceCode;
+        for (const auto& it : spec.iterSpace.tuple) {
+            usedCode += "\n" + it.var;
+        }
+    }
+    return usedCode;
+}
+
+bool CodeGenerator::getLoopBounds(const std::vector<const StmtSpec*>& loopStmts,
+                                  int level, SpecExp& lowerBound,
+                                  SpecExp& upperBound) {
+    std::vector<std::vector<SpecExp>> inequalities;
+    for (const auto& it : loopStmts) {
+        inequalities.push_back(it->iterSpace.inequalities);
+    }
+    std::vector<std::vector<SpecExp>*> lists;
+    for (auto& it : inequalities) {
+        lists.push_back(&it);
+    }
+    std::vector<SpecExp> upperBounds;
+    if (lists.empty() ||
+        !takeLoopBounds(lists, level, lowerBound, upperBounds) ||
+        getTupleVarCoeff(upperBounds.front(), level) != -1) {
+        return false;
+    }
+    upperBound = upperBounds.front();
+    return true;
+}
+
+SpecExp CodeGenerator::getBoundValue(const SpecExp& bound, int level) {
+    // i + rest >= 0 gives i >= -rest, and -c * i + rest >= 0 gives
+    // c * i < rest + 1
+    SpecExp value = withoutTupleVar(bound, level);
+    if (getTupleVarCoeff(bound, level) > 0) {
+        value.multiplyBy(-1);
+    } else {
+        value.terms.push_back(SpecTerm::makeConst(1));
+    }
+    return value;
+}
+
+std::string CodeGenerator::expToString(const SpecExp& exp,
+                                       const std::vector<TupleElem>& tuple) {
+    // combine the constants, and repeated symbols and tuple variables
+    std::vector<SpecTerm> terms;
+    int constant = 0;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::Const) {
+            constant += term.coeff;
+            continue;
+        }
+        auto same = std::find_if(
+            terms.begin(), terms.end(), [&](const SpecTerm& other) {
+                return term.kind != SpecTerm::Kind::UFCall &&
+                       other.kind == term.kind && other.name == term.name &&
+                       other.tuplePos == term.tuplePos;
+            });
+        if (same != terms.end()) {
+            same->coeff += term.coeff;
+        } else {
+            terms.push_back(term);
+        }
+    }
+
+    std::string str;
+    for (const auto& term : terms) {
+        if (term.coeff == 0) {
+            continue;
+        }
+        std::string name;
+        if (term.kind == SpecTerm::Kind::TupleVar) {
+            const TupleElem& elem = tuple[term.tuplePos];
+            name = elem.isConst ? std::to_string(elem.constant) : elem.var;
+        } else if (term.kind == SpecTerm::Kind::UFCall) {
+            // as the array read the call was made from
+            name = term.name;
+            for (const auto& arg : term.args) {
+                name += "[" + expToString(arg, tuple) + "]";
+            }
+        } else {
+            name = term.name;
+        }
+        if (str.empty()) {
+            str = term.coeff < 0 ? "-" : "";
+        } else {
+            str += term.coeff < 0 ? " - " : " + ";
+        }
+        if (std::abs(term.coeff) != 1) {
+            str += std::to_string(std::abs(term.coeff)) + " * ";
+        }
+        str += name;
+    }
+    if (str.empty()) {
+        str = std::to_string(constant);
+    } else if (constant != 0) {
+        str += (constant < 0 ? " - " : " + ") +
+               std::to_string(std::abs(constant));
+    }
+    return str;
+}
+
+bool CodeGenerator::writeBlock(std::vector<PendingStmt>& pending, int level,
+                               int indent, llvm::raw_ostream& os) const {
+    // split into groups, each either a loop or a single statement, and find
+    // the guards each group needs
+    struct Group {
+        size_t begin;
+        size_t end;
+        std::vector<SpecExp> equalities;
+        std::vector<SpecExp> inequalities;
+    };
+    std::vector<Group> groups;
+    for (size_t i = 0; i < pending.size();) {
+        const int order = getScheduleNum(pending[i].schedule, 2 * level);
+        const bool isLoop = isInLoop(pending[i].schedule, level);
+        size_t end = i + 1;
+        while (isLoop && end < pending.size() &&
+               isInLoop(pending[end].schedule, level) &&
+               getScheduleNum(pending[end].schedule, 2 * level) == order) {
+            ++end;
+        }
+        std::vector<std::vector<SpecExp>*> equalities;
+        std::vector<std::vector<SpecExp>*> inequalities;
+        for (size_t j = i; j < end; ++j) {
+            equalities.push_back(&pending[j].equalities);
+            inequalities.push_back(&pending[j].inequalities);
+        }
+        // a guard may be checked once the iterators it uses are defined
+        auto isDefined = [&](const SpecExp& it) {
+            return getDeepestTupleVar(it) < level;
+        };
+        Group group;
+        group.begin = i;
+        group.end = end;
+        group.equalities = takeCommon(equalities, isDefined);
+        group.inequalities = takeCommon(inequalities, isDefined);
+        groups.push_back(group);
+        i = end;
+    }
+
+    for (size_t i = 0; i < groups.size();) {
+        // consecutive groups with the same guards share if statements
+        size_t end = i + 1;
+        while (end < groups.size() &&
+               groups[end].equalities == groups[i].equalities &&
+               groups[end].inequalities == groups[i].inequalities) {
+            ++end;
+        }
+        const std::vector<TupleElem>& outerTuple =
+            stmts[pending[groups[i].begin].index].iterSpace.tuple;
+        int depth = indent;
+        for (const auto& it : groups[i].equalities) {
+            writeLine(os, depth++,
+                      "if (" + constraintToString(it, "==", outerTuple) +
+                          ") {");
+        }
+        for (const auto& it : groups[i].inequalities) {
+            writeLine(os, depth++,
+                      "if (" + constraintToString(it, ">=", outerTuple) +
+                          ") {");
+        }
+
+        for (size_t j = i; j < end; ++j) {
+            PendingStmt& first = pending[groups[j].begin];
+            const StmtSpec& spec = stmts[first.index];
+            if (!isInLoop(first.schedule, level)) {
+                // every constraint is enforced by now
+                if (!first.equalities.empty() ||
+                    !first.inequalities.empty()) {
+                    return false;
+                }
+                std::string source = spec.sourceCode;
+                if (source.empty() ||
+                    (source.back() != ';' && source.back() != '}')) {
+                    source += ";";
+                }
+                writeLine(os, depth, source);
+                continue;
+            }
+            if (first.schedule.scheduleTuple[2 * level + 1].value != level) {
+                return false;
+            }
+
+            std::vector<std::vector<SpecExp>*> inequalities;
+            for (size_t k = groups[j].begin; k < groups[j].end; ++k) {
+                inequalities.push_back(&pending[k].inequalities);
+            }
+            SpecExp lowerBound;
+            std::vector<SpecExp> upperBounds;
+            if (!takeLoopBounds(inequalities, level, lowerBound,
+                                upperBounds)) {
+                return false;
+            }
+
+            for (const auto& it : loopAnnotations) {
+                if (isLoopPrefix(it.first, first.schedule, level)) {
+                    writeLine(os, depth, it.second);
+                }
+            }
+            const std::vector<TupleElem>& tuple = spec.iterSpace.tuple;
+            const std::string iterator = tuple[level].var;
+            const std::string declaration = isDeclared(iterator) ? "" : "int ";
+            // the iterator only grows, so the loop may stop at the first
+            // upper bound it reaches
+            std::string condition;
+            for (const auto& it : upperBounds) {
+                condition += (condition.empty() ? "" : " && ") +
+                             upperBoundToString(it, level, tuple);
+            }
+            writeLine(os, depth,
+                      "for (" + declaration + iterator + " = " +
+                          expToString(getBoundValue(lowerBound, level),
+                                      tuple) +
+                          "; " + condition + "; " + iterator + "++) {");
+            std::vector<PendingStmt> body(
+                pending.begin() + groups[j].begin,
+                pending.begin() + groups[j].end);
+            if (!writeBlock(body, level + 1, depth + 1, os)) {
+                return false;
+            }
+            writeLine(os, depth, "}");
+        }
+
+        while (depth > indent) {
+            writeLine(os, --depth, "}");
+        }
+        i = end;
+    }
+    return true;
+}
+
+bool CodeGenerator::isDeclared(const std::string& var) const {
+    return std::any_of(
+        stmts.begin(), stmts.end(),
+        [&](const StmtSpec& it) { return declares(it, var); });
+}
+
+bool CodeGenerator::declares(const StmtSpec& stmt, const std::string& var) {
+    // a declaration like "int i;", "long *i;" or "double i = 0;"
+    llvm::StringRef source = llvm::StringRef(stmt.sourceCode).trim();
+    source = source.take_until([](char c) { return c == '=' || c == ';'; })
+                 .rtrim();
+    if (!source.consume_back(var) || source.empty() ||
+        (source.back() != ' ' && source.back() != '*')) {
+        return false;
+    }
+    const bool isTypeName =
+        std::all_of(source.begin(), source.end(), [](char c) {
+            return std::isalnum(c) || c == '_' || c == ' ' || c == '*';
+        });
+    return isTypeName &&
+           (std::isalpha(source.front()) || source.front() == '_');
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,456 @@
+#include "ComputationCache.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Basic/Version.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Gather the declarations referred to by a statement which are not local
+//! to its function, such as global variables and enumerators, in order of
+//! first reference
+static void gatherExternalDecls(
+    clang::Stmt* stmt, llvm::SmallSetVector<const Decl*, 8>& decls) {
+    if (!stmt) {
+        return;
+    }
+    if (DeclRefExpr* asDeclRef = dyn_cast<DeclRefExpr>(stmt)) {
+        const ValueDecl* decl = asDeclRef->getDecl();
+        const VarDecl* asVarDecl = dyn_cast<VarDecl>(decl);
+        if (!asVarDecl ||
+            !(asVarDecl->isLocalVarDecl() || isa<ParmVarDecl>(asVarDecl))) {
+            decls.insert(decl);
+        }
+    }
+    for (clang::Stmt* child : stmt->children()) {
+        gatherExternalDecls(child, decls);
+    }
+}
+
+static void writeSpecExp(llvm::json::OStream& json, const SpecExp& exp);
+
+//! Write a spec term as a JSON object
+static void writeSpecTerm(llvm::json::OStream& json, const SpecTerm& term) {
+    json.object([&]() {
+        switch (term.kind) {
+            case SpecTerm::Kind::Const:
+                json.attribute("kind", "const");
+                break;
+            case SpecTerm::Kind::Symbol:
+                json.attribute("kind", "symbol");
+                json.attribute("name", term.name);
+                break;
+            case SpecTerm::Kind::TupleVar:
+                json.attribute("kind", "tuple_var");
+                json.attribute("pos", term.tuplePos);
+                break;
+            case SpecTerm::Kind::UFCall:
+                json.attribute("kind", "uf_call");
+                json.attribute("name", term.name);
+                json.attributeArray("args", [&]() {
+                    for (const auto& it : term.args) {
+                        writeSpecExp(json, it);
+                    }
+                });
+                break;
+        }
+        json.attribute("coeff", term.coeff);
+    });
+}
+
+//! Write a spec expression as a JSON array of its terms
+static void writeSpecExp(llvm::json::OStream& json, const SpecExp& exp) {
+    json.array([&]() {
+        for (const auto& it : exp.terms) {
+            writeSpecTerm(json, it);
+        }
+    });
+}
+
+//! Write a set or relation spec as a JSON object
+static void writeSetRelationSpec(llvm::json::OStream& json,
+                                 const SetRelationSpec& spec) {
+    json.object([&]() {
+        json.attributeArray("tuple", [&]() {
+            for (const auto& it : spec.tuple) {
+                if (it.isConst) {
+                    json.value(it.constant);
+                } else {
+                    json.value(it.var);
+                }
+            }
+        });
+        json.attribute("in_arity", spec.inArity);
+        json.attribute("is_relation", spec.isRelation);
+        json.attributeArray("equalities", [&]() {
+            for (const auto& it : spec.equalities) {
+                writeSpecExp(json, it);
+            }
+        });
+        json.attributeArray("inequalities", [&]() {
+            for (const auto& it : spec.inequalities) {
+                writeSpecExp(json, it);
+            }
+        });
+    });
+}
+
+//! Write data access relations as a JSON array
+static void writeAccesses(
+    llvm::json::OStream& json,
+    const std::vector<std::pair<std::string, SetRelationSpec>>& accesses) {
+    json.array([&]() {
+        for (const auto& it : accesses) {
+            json.object([&]() {
+                json.attribute("data_space", it.first);
+                json.attributeBegin("relation");
+                writeSetRelationSpec(json, it.second);
+                json.attributeEnd();
+            });
+        }
+    });
+}
+
+//! Write a statement spec as a JSON object
+static void writeStmtSpec(llvm::json::OStream& json, const StmtSpec& stmt) {
+    json.object([&]() {
+        json.attribute("source", stmt.sourceCode);
+        json.attributeBegin("iter_space");
+        writeSetRelationSpec(json, stmt.iterSpace);
+        json.attributeEnd();
+        json.attributeBegin("exec_schedule");
+        writeSetRelationSpec(json, stmt.execSchedule);
+        json.attributeEnd();
+        json.attributeBegin("reads");
+        writeAccesses(json, stmt.dataReads);
+        json.attributeEnd();
+        json.attributeBegin("writes");
+        writeAccesses(json, stmt.dataWrites);
+        json.attributeEnd();
+        json.attributeArray("data_spaces", [&]() {
+            for (const auto& it : stmt.dataSpaces) {
+                json.value(it);
+            }
+        });
+        json.attributeArray("scalars", [&]() {
+            for (const auto& it : stmt.scalars) {
+                json.value(it);
+            }
+        });
+        json.attribute("reduction", static_cast<int64_t>(stmt.reduction));
+        json.attribute("conditional", stmt.isConditional);
+    });
+}
+
+static bool readSpecExp(const llvm::json::Value& value, SpecExp& exp);
+
+//! Read a spec term written by writeSpecTerm, failing on anything
+//! unexpected
+static bool readSpecTerm(const llvm::json::Value& value, SpecTerm& term) {
+    const llvm::json::Object* object = value.getAsObject();
+    if (!object) {
+        return false;
+    }
+    llvm::Optional<llvm::StringRef> kind = object->getString("kind");
+    llvm::Optional<int64_t> coeff = object->getInteger("coeff");
+    if (!kind || !coeff) {
+        return false;
+    }
+    if (*kind == "const") {
+        term = SpecTerm::makeConst(*coeff);
+        return true;
+    }
+    if (*kind == "tuple_var") {
+        llvm::Optional<int64_t> pos = object->getInteger("pos");
+        if (!pos) {
+            return false;
+        }
+        term = SpecTerm::makeTupleVar(*pos, *coeff);
+        return true;
+    }
+    llvm::Optional<llvm::StringRef> name = object->getString("name");
+    if (!name) {
+        return false;
+    }
+    if (*kind == "symbol") {
+        term = SpecTerm::makeSymbol(name->str(), *coeff);
+        return true;
+    }
+    const llvm::json::Array* args = object->getArray("args");
+    if (*kind != "uf_call" || !args) {
+        return false;
+    }
+    std::vector<SpecExp> argExps(args->size());
+    for (size_t i = 0; i < args->size(); ++i) {
+        if (!readSpecExp((*args)[i], argExps[i])) {
+            return false;
+        }
+    }
+    term = SpecTerm::makeUFCall(name->str(), std::move(argExps), *coeff);
+    return true;
+}
+
+//! Read a spec expression written by writeSpecExp
+static bool readSpecExp(const llvm::json::Value& value, SpecExp& exp) {
+    const llvm::json::Array* terms = value.getAsArray();
+    if (!terms) {
+        return false;
+    }
+    for (const auto& it : *terms) {
+        SpecTerm term;
+        if (!readSpecTerm(it, term)) {
+            return false;
+        }
+        exp.terms.push_back(std::move(term));
+    }
+    return true;
+}
+
+//! Read an array of spec expressions
+static bool readSpecExps(const llvm::json::Array* values,
+                         std::vector<SpecExp>& exps) {
+    if (!values) {
+        return false;
+    }
+    exps.resize(values->size());
+    for (size_t i = 0; i < values->size(); ++i) {
+        if (!readSpecExp((*values)[i], exps[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Read a set or relation spec written by writeSetRelationSpec
+static bool readSetRelationSpec(const llvm::json::Value* value,
+                                SetRelationSpec& spec) {
+    const llvm::json::Object* object = value ? value->getAsObject() : nullptr;
+    if (!object) {
+        return false;
+    }
+    const llvm::json::Array* tuple = object->getArray("tuple");
+    llvm::Optional<int64_t> inArity = object->getInteger("in_arity");
+    llvm::Optional<bool> isRelation = object->getBoolean("is_relation");
+    if (!tuple || !inArity || !isRelation) {
+        return false;
+    }
+    for (const auto& it : *tuple) {
+        if (llvm::Optional<int64_t> constant = it.getAsInteger()) {
+            spec.tuple.emplace_back(static_cast<int>(*constant));
+        } else if (llvm::Optional<llvm::StringRef> var = it.getAsString()) {
+            spec.tuple.emplace_back(var->str());
+        } else {
+            return false;
+        }
+    }
+    spec.inArity = *inArity;
+    spec.isRelation = *isRelation;
+    return readSpecExps(object->getArray("equalities"), spec.equalities) &&
+           readSpecExps(object->getArray("inequalities"), spec.inequalities);
+}
+
+//! Read data access relations written by writeAccesses
+static bool readAccesses(
+    const llvm::json::Array* values,
+    std::vector<std::pair<std::string, SetRelationSpec>>& accesses) {
+    if (!values) {
+        return false;
+    }
+    for (const auto& it : *values) {
+        const llvm::json::Object* object = it.getAsObject();
+        llvm::Optional<llvm::StringRef> dataSpace =
+            object ? object->getString("data_space") : llvm::None;
+        SetRelationSpec relation;
+        if (!dataSpace ||
+            !readSetRelationSpec(object->get("relation"), relation)) {
+            return false;
+        }
+        accesses.emplace_back(dataSpace->str(), std::move(relation));
+    }
+    return true;
+}
+
+//! Read a statement spec written by writeStmtSpec
+static bool readStmtSpec(const llvm::json::Value& value, StmtSpec& stmt) {
+    const llvm::json::Object* object = value.getAsObject();
+    if (!object) {
+        return false;
+    }
+    llvm::Optional<llvm::StringRef> source = object->getString("source");
+    const llvm::json::Array* dataSpaces = object->getArray("data_spaces");
+    const llvm::json::Array* scalars = object->getArray("scalars");
+    llvm::Optional<int64_t> reduction = object->getInteger("reduction");
+    llvm::Optional<bool> conditional = object->getBoolean("conditional");
+    if (!source || !dataSpaces || !scalars || !reduction || !conditional ||
+        *reduction < 0 ||
+        *reduction > static_cast<int64_t>(ReductionOp::Max) ||
+        !readSetRelationSpec(object->get("iter_space"), stmt.iterSpace) ||
+        !readSetRelationSpec(object->get("exec_schedule"),
+                             stmt.execSchedule) ||
+        !readAccesses(object->getArray("reads"), stmt.dataReads) ||
+        !readAccesses(object->getArray("writes"), stmt.dataWrites)) {
+        return false;
+    }
+    stmt.sourceCode = source->str();
+    stmt.reduction = static_cast<ReductionOp>(*reduction);
+    stmt.isConditional = *conditional;
+    for (const auto& it : *dataSpaces) {
+        llvm::Optional<llvm::StringRef> dataSpace = it.getAsString();
+        if (!dataSpace) {
+            return false;
+        }
+        stmt.dataSpaces.push_back(dataSpace->str());
+    }
+    for (const auto& it : *scalars) {
+        llvm::Optional<llvm::StringRef> scalar = it.getAsString();
+        if (!scalar) {
+            return false;
+        }
+        stmt.scalars.push_back(scalar->str());
+    }
+    return true;
+}
+
+/* ComputationCache */
+
+ComputationCache::ComputationCache(std::string directory)
+    : directory(directory) {
+    if (std::error_code EC = llvm::sys::fs::create_directories(directory)) {
+        Utils::printErrorAndExit("Could not create cache directory '" +
+                                 directory + "': " + EC.message());
+    }
+}
+
+std::string ComputationCache::getKey(FunctionDecl* funcDecl,
+                                     const ASTContext* Context) {
+    llvm::MD5 hash;
+    // end each field with a null character, so that moving text from one
+    // field to the next changes the key
+    auto addField = [&hash](llvm::StringRef field) {
+        hash.update(field);
+        hash.update(llvm::StringRef("\0", 1));
+    };
+
+    addField("spf-ie " SPFIE_VERSION);
+    addField(std::to_string(CACHE_FORMAT_VERSION));
+    addField(clang::getClangFullVersion());
+
+    // the text as written appears in the Computation (as statement source
+    // code), and the preprocessed text determines everything else; printing
+    // queries the ASTContext, which other functions' builders share
+    std::lock_guard<std::recursive_mutex> lock(Utils::getSourceMutex());
+    addField(Utils::getSourceText(
+        CharSourceRange::getTokenRange(funcDecl->getSourceRange()), Context));
+    std::string printed;
+    llvm::raw_string_ostream printedStream(printed);
+    funcDecl->print(printedStream, Context->getPrintingPolicy());
+    addField(printedStream.str());
+
+    llvm::SmallSetVector<const Decl*, 8> externalDecls;
+    gatherExternalDecls(funcDecl->getBody(), externalDecls);
+    for (const Decl* decl : externalDecls) {
+        std::string printedDecl;
+        llvm::raw_string_ostream declStream(printedDecl);
+        decl->print(declStream, Context->getPrintingPolicy());
+        addField(declStream.str());
+    }
+
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    return result.digest().str().str();
+}
+
+bool ComputationCache::load(llvm::StringRef key,
+                            std::vector<StmtSpec>& stmts) const {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFile(getEntryPath(key));
+    if (!buffer) {
+        return false;
+    }
+    llvm::Expected<llvm::json::Value> parsed =
+        llvm::json::parse((*buffer)->getBuffer());
+    if (!parsed) {
+        llvm::consumeError(parsed.takeError());
+        return false;
+    }
+    const llvm::json::Object* entry = parsed->getAsObject();
+    if (!entry) {
+        return false;
+    }
+    llvm::Optional<int64_t> format = entry->getInteger("format");
+    const llvm::json::Array* stmtValues = entry->getArray("stmts");
+    if (!format || *format != CACHE_FORMAT_VERSION || !stmtValues) {
+        return false;
+    }
+    std::vector<StmtSpec> loaded(stmtValues->size());
+    for (size_t i = 0; i < stmtValues->size(); ++i) {
+        if (!readStmtSpec((*stmtValues)[i], loaded[i])) {
+            return false;
+        }
+    }
+    stmts = std::move(loaded);
+    return true;
+}
+
+void ComputationCache::store(llvm::StringRef key,
+                             const std::vector<StmtSpec>& stmts) const {
+    // write to a uniquely named file next to the entry, then rename it into
+    // place, which atomically replaces any entry a concurrent writer made
+    const std::string entryPath = getEntryPath(key);
+    int fd;
+    llvm::SmallString<128> tempPath;
+    if (llvm::sys::fs::createUniqueFile(entryPath + "-%%%%%%%%.tmp", fd,
+                                        tempPath)) {
+        return;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, true);
+        llvm::json::OStream json(os);
+        json.object([&]() {
+            json.attribute("format", CACHE_FORMAT_VERSION);
+            json.attributeArray("stmts", [&]() {
+                for (const auto& it : stmts) {
+                    writeStmtSpec(json, it);
+                }
+            });
+        });
+        os.close();
+        if (os.has_error()) {
+            os.clear_error();
+            llvm::sys::fs::remove(tempPath);
+            return;
+        }
+    }
+    if (llvm::sys::fs::rename(tempPath, entryPath)) {
+        llvm::sys::fs::remove(tempPath);
+    }
+}
+
+std::string ComputationCache::getEntryPath(llvm::StringRef key) const {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, key + ".json");
+    return path.str().str();
+}
+
+}  // namespace spf_ie
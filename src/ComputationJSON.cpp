@@ -0,0 +1,92 @@
+#include "ComputationJSON.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "SPFComputationBuilder.hpp"
+#include "iegenlib.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Write data access relations as a JSON array
+static void writeAccesses(
+    llvm::json::OStream& json,
+    const std::vector<std::pair<std::string, iegenlib::Relation*>>&
+        accesses) {
+    json.array([&]() {
+        for (const auto& it : accesses) {
+            json.object([&]() {
+                json.attribute("data_space", it.first);
+                json.attribute("relation", it.second->prettyPrintString());
+            });
+        }
+    });
+}
+
+/* ComputationJSON */
+
+void ComputationJSON::write(llvm::json::OStream& json, llvm::StringRef name,
+                            iegenlib::Computation* computation,
+                            llvm::StringRef fileName) {
+    std::lock_guard<std::mutex> lock(
+        SPFComputationBuilder::getIEGenLibMutex());
+    json.object([&]() {
+        if (!fileName.empty()) {
+            json.attribute("file", fileName);
+        }
+        json.attribute("name", name);
+        // data spaces are unordered in the Computation
+        std::unordered_set<std::string> dataSpaceSet =
+            computation->getDataSpaces();
+        std::vector<std::string> dataSpaces(dataSpaceSet.begin(),
+                                            dataSpaceSet.end());
+        std::sort(dataSpaces.begin(), dataSpaces.end());
+        json.attributeArray("data_spaces", [&]() {
+            for (const auto& it : dataSpaces) {
+                json.value(it);
+            }
+        });
+        json.attributeArray("stmts", [&]() {
+            for (int i = 0; i < computation->getNumStmts(); ++i) {
+                iegenlib::Stmt* stmt = computation->getStmt(i);
+                json.object([&]() {
+                    json.attribute("source", stmt->getStmtSourceCode());
+                    json.attribute(
+                        "iter_space",
+                        stmt->getIterationSpace()->prettyPrintString());
+                    json.attribute(
+                        "exec_schedule",
+                        stmt->getExecutionSchedule()->prettyPrintString());
+                    json.attributeBegin("reads");
+                    writeAccesses(json, stmt->getDataReads());
+                    json.attributeEnd();
+                    json.attributeBegin("writes");
+                    writeAccesses(json, stmt->getDataWrites());
+                    json.attributeEnd();
+                });
+            }
+        });
+    });
+}
+
+/* NDJSONEmitter */
+
+void NDJSONEmitter::emit(llvm::StringRef fileName, llvm::StringRef name,
+                         iegenlib::Computation* computation) {
+    std::lock_guard<std::mutex> lock(osMutex);
+    {
+        llvm::json::OStream json(os);
+        ComputationJSON::write(json, name, computation, fileName);
+    }
+    os << "\n";
+    os.flush();
+}
+
+}  // namespace spf_ie
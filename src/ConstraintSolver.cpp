@@ -0,0 +1,252 @@
+#include "ConstraintSolver.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "SetRelationSpec.hpp"
+#include "llvm/Support/MathExtras.h"
+
+namespace spf_ie {
+
+/*!
+ * \struct LinearExp
+ *
+ * \brief An affine expression over named unknowns, compared against 0
+ */
+struct LinearExp {
+    LinearExp() : constant(0) {}
+
+    //! Coefficient of each unknown, with no zero coefficients
+    std::map<std::string, int64_t> coeffs;
+    //! Constant part of the expression
+    int64_t constant;
+
+    bool operator<(const LinearExp& other) const {
+        return std::tie(coeffs, constant) <
+               std::tie(other.coeffs, other.constant);
+    }
+
+    //! Add a multiple of another expression to this one
+    void addMultiple(const LinearExp& other, int64_t factor) {
+        for (const auto& it : other.coeffs) {
+            int64_t& coeff = coeffs[it.first];
+            coeff += factor * it.second;
+            if (coeff == 0) {
+                coeffs.erase(it.first);
+            }
+        }
+        constant += factor * other.constant;
+    }
+
+    //! Get the greatest common divisor of the coefficients of the unknowns
+    int64_t getCoeffGCD() const {
+        uint64_t gcd = 0;
+        for (const auto& it : coeffs) {
+            gcd = llvm::GreatestCommonDivisor64(gcd, std::abs(it.second));
+        }
+        return gcd;
+    }
+};
+
+//! Get a name for an unknown standing for a term (without its coefficient)
+//! which is the same for every occurrence of equal terms
+static std::string getUnknownName(const SpecTerm& term);
+
+//! Get a name for an expression which is the same for equal expressions,
+//! regardless of the order of their terms
+static std::string getCanonicalName(const SpecExp& exp) {
+    std::map<std::string, int64_t> terms;
+    for (const auto& term : exp.terms) {
+        terms[term.kind == SpecTerm::Kind::Const ? "" : getUnknownName(term)] +=
+            term.coeff;
+    }
+    std::string name;
+    for (const auto& it : terms) {
+        if (it.second != 0) {
+            name += std::to_string(it.second) + "*" + it.first + ";";
+        }
+    }
+    return name;
+}
+
+static std::string getUnknownName(const SpecTerm& term) {
+    switch (term.kind) {
+        case SpecTerm::Kind::Symbol:
+            return "$" + term.name;
+        case SpecTerm::Kind::TupleVar:
+            return "#" + std::to_string(term.tuplePos);
+        case SpecTerm::Kind::UFCall: {
+            std::string name = "@" + term.name + "(";
+            for (const auto& arg : term.args) {
+                name += getCanonicalName(arg) + ",";
+            }
+            return name + ")";
+        }
+        case SpecTerm::Kind::Const:
+            break;
+    }
+    return "";
+}
+
+//! Make a linear expression from a spec expression
+static LinearExp makeLinearExp(const SpecExp& exp) {
+    LinearExp linear;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::Const) {
+            linear.constant += term.coeff;
+            continue;
+        }
+        LinearExp single;
+        single.coeffs[getUnknownName(term)] = 1;
+        linear.addMultiple(single, term.coeff);
+    }
+    return linear;
+}
+
+//! Divide an equality by the GCD of its coefficients
+//! \return false if it has no integer solutions
+static bool tightenEquality(LinearExp& exp) {
+    const int64_t gcd = exp.getCoeffGCD();
+    if (gcd == 0) {
+        return exp.constant == 0;
+    }
+    if (exp.constant % gcd != 0) {
+        return false;
+    }
+    for (auto& it : exp.coeffs) {
+        it.second /= gcd;
+    }
+    exp.constant /= gcd;
+    return true;
+}
+
+//! Divide an inequality by the GCD of its coefficients, rounding the
+//! constant down since only integer solutions matter
+//! \return false if it has no solutions
+static bool tightenInequality(LinearExp& exp) {
+    const int64_t gcd = exp.getCoeffGCD();
+    if (gcd == 0) {
+        return exp.constant >= 0;
+    }
+    for (auto& it : exp.coeffs) {
+        it.second /= gcd;
+    }
+    // floor division
+    exp.constant = exp.constant >= 0 ? exp.constant / gcd
+                                     : -((-exp.constant + gcd - 1) / gcd);
+    return true;
+}
+
+/* ConstraintSolver */
+
+bool ConstraintSolver::maybeSatisfiable(const SetRelationSpec& spec) {
+    std::vector<LinearExp> equalities;
+    std::vector<LinearExp> inequalities;
+    for (const auto& it : spec.equalities) {
+        equalities.push_back(makeLinearExp(it));
+    }
+    for (const auto& it : spec.inequalities) {
+        inequalities.push_back(makeLinearExp(it));
+    }
+    for (unsigned int i = 0; i < spec.tuple.size(); ++i) {
+        if (spec.tuple[i].isConst) {
+            SpecExp exp;
+            exp.terms.push_back(SpecTerm::makeTupleVar(i));
+            exp.terms.push_back(SpecTerm::makeConst(-spec.tuple[i].constant));
+            equalities.push_back(makeLinearExp(exp));
+        }
+    }
+
+    // substitute each equality away, preferring unknowns with coefficient
+    // 1 or -1, which introduce no multiples
+    while (!equalities.empty()) {
+        LinearExp eq = equalities.back();
+        equalities.pop_back();
+        if (!tightenEquality(eq)) {
+            return false;
+        }
+        if (eq.coeffs.empty()) {
+            continue;
+        }
+        auto pivot = eq.coeffs.begin();
+        for (auto it = eq.coeffs.begin(); it != eq.coeffs.end(); ++it) {
+            if (std::abs(it->second) == 1) {
+                pivot = it;
+                break;
+            }
+        }
+        const std::string unknown = pivot->first;
+        if (pivot->second < 0) {
+            LinearExp negated;
+            negated.addMultiple(eq, -1);
+            eq = negated;
+        }
+        const int64_t pivotCoeff = eq.coeffs[unknown];
+        for (auto* constraints : {&equalities, &inequalities}) {
+            for (auto& it : *constraints) {
+                auto found = it.coeffs.find(unknown);
+                if (found == it.coeffs.end()) {
+                    continue;
+                }
+                const int64_t coeff = found->second;
+                LinearExp scaled;
+                scaled.addMultiple(it, pivotCoeff);
+                scaled.addMultiple(eq, -coeff);
+                it = scaled;
+            }
+        }
+    }
+
+    // eliminate unknowns from the inequalities one at a time
+    std::set<LinearExp> remaining;
+    for (auto& it : inequalities) {
+        if (!tightenInequality(it)) {
+            return false;
+        }
+        if (!it.coeffs.empty()) {
+            remaining.insert(it);
+        }
+    }
+    while (!remaining.empty()) {
+        const std::string unknown = remaining.begin()->coeffs.begin()->first;
+        std::vector<LinearExp> lower;
+        std::vector<LinearExp> upper;
+        std::set<LinearExp> next;
+        for (const auto& it : remaining) {
+            auto found = it.coeffs.find(unknown);
+            if (found == it.coeffs.end()) {
+                next.insert(it);
+            } else if (found->second > 0) {
+                lower.push_back(it);
+            } else {
+                upper.push_back(it);
+            }
+        }
+        for (const auto& low : lower) {
+            for (const auto& up : upper) {
+                LinearExp combined;
+                combined.addMultiple(low, -up.coeffs.at(unknown));
+                combined.addMultiple(up, low.coeffs.at(unknown));
+                if (!tightenInequality(combined)) {
+                    return false;
+                }
+                if (!combined.coeffs.empty()) {
+                    next.insert(combined);
+                }
+            }
+        }
+        if (next.size() > SOLVER_MAX_CONSTRAINTS) {
+            return true;
+        }
+        remaining = std::move(next);
+    }
+    return true;
+}
+
+}  // namespace spf_ie
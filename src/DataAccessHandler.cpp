@@ -1,14 +1,16 @@
 #include "DataAccessHandler.hpp"
 
-#include <sstream>
 #include <stack>
 #include <string>
-#include <utility>
-#include <vector>
 
-#include "Driver.hpp"
+#include "Stats.hpp"
+#include "SymbolTable.hpp"
 #include "Utils.hpp"
 #include "clang/AST/Expr.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
@@ -28,89 +30,124 @@ void DataAccessHandler::processAsWrite(ArraySubscriptExpr* expr) {
     addDataAccess(expr, false);
 }
 
+void DataAccessHandler::processScalarAccess(int64_t id, Expr* base,
+                                            SymbolID name, bool isRead) {
+    arrayAccesses.push_back(
+        ArrayAccess(id, base, name, llvm::ArrayRef<Expr*>(), isRead));
+    dataSpaces.insert(name);
+}
+
 void DataAccessHandler::addDataAccess(ArraySubscriptExpr* fullExpr,
                                       bool isRead) {
-    std::vector<std::pair<std::string, ArrayAccess>> accesses;
-    buildDataAccess(fullExpr, isRead, accesses);
+    const size_t firstNewAccess = arrayAccesses.size();
+    buildDataAccess(fullExpr, isRead, arrayAccesses, symbols, *arena);
 
-    for (const auto& accessInfo : accesses) {
-        dataSpaces.emplace(Utils::stmtToString(accessInfo.second.base));
-        arrayAccesses.push_back(accessInfo);
+    for (size_t i = firstNewAccess; i < arrayAccesses.size(); ++i) {
+        dataSpaces.insert(arrayAccesses[i].dataSpace);
     }
 }
 
 void DataAccessHandler::buildDataAccess(
     ArraySubscriptExpr* fullExpr, bool isRead,
-    std::vector<std::pair<std::string, ArrayAccess>>& accessComponents) {
+    llvm::SmallVectorImpl<ArrayAccess>& accessComponents, SymbolTable* symbols,
+    llvm::BumpPtrAllocator& arena) {
+    const ASTContext* Context = symbols->getContext();
     // extract information from subscript expression
+    Expr* base;
+    llvm::SmallVector<Expr*, 4> indexes;
+    getArrayAccessParts(fullExpr, base, indexes, Context);
+
+    // recurse when an index is itself another array access; such
+    // sub-accesses are always reads
+    for (const auto& index : indexes) {
+        if (ArraySubscriptExpr* indexAsArrayAccess =
+                dyn_cast<ArraySubscriptExpr>(index)) {
+            buildDataAccess(indexAsArrayAccess, true, accessComponents,
+                            symbols, arena);
+        }
+    }
+
+    // construct ArrayAccess object, with its indexes kept in the arena
+    Stats::add(Stat::ArrayAccessesBuilt);
+    accessComponents.push_back(
+        ArrayAccess(fullExpr->getID(*Context), base, symbols->getSymbol(base),
+                    llvm::ArrayRef<Expr*>(indexes).copy(arena), isRead));
+}
+
+void DataAccessHandler::getArrayAccessParts(
+    ArraySubscriptExpr* fullExpr, Expr*& base,
+    llvm::SmallVectorImpl<Expr*>& indexes, const ASTContext* Context) {
     std::stack<Expr*> info;
     if (getArrayExprInfo(fullExpr, &info)) {
         Utils::printErrorAndExit("Array dimension exceeds maximum of " +
                                      std::to_string(MAX_ARRAY_DIM),
-                                 fullExpr);
+                                 fullExpr, Context);
     }
-
-    // construct ArrayAccess object
-    Expr* base = info.top();
+    base = info.top();
     info.pop();
-    std::vector<Expr*> indexes;
     while (!info.empty()) {
-        // recurse when an index is itself another array access; such
-        // sub-accesses are always reads
-        if (ArraySubscriptExpr* indexAsArrayAccess =
-                dyn_cast<ArraySubscriptExpr>(info.top())) {
-            buildDataAccess(indexAsArrayAccess, true, accessComponents);
-        }
         indexes.push_back(info.top());
         info.pop();
     }
-    ArrayAccess access =
-        ArrayAccess(fullExpr->getID(*Context), base, indexes, isRead);
-    accessComponents.push_back(
-        {makeStringForArrayAccess(&access, accessComponents), access});
 }
 
 std::string DataAccessHandler::makeStringForArrayAccess(
-    ArrayAccess* access,
-    const std::vector<std::pair<std::string, ArrayAccess>>& components) {
-    std::ostringstream os;
-    os << Utils::stmtToString(access->base);
-    os << "(";
-    bool first = true;
+    ArrayAccess* access, SymbolTable* symbols) {
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    os << symbols->getText(access->dataSpace) << "(";
     for (const auto& it : access->indexes) {
-        if (!first) {
+        if (it != access->indexes.front()) {
             os << ",";
-        } else {
-            first = false;
         }
-        std::string indexString;
-        if (ArraySubscriptExpr* asArrayAccess =
-                dyn_cast<ArraySubscriptExpr>(it->IgnoreParenImpCasts())) {
-            // there is another array acccess used as an index for this one;
-            // it should have already been processed (depth-first), so we look
-            // for its string equivalent in thealready-processed accesses
-            bool foundSubaccess = false;
-            for (const auto& it : components) {
-                if (it.second.id == asArrayAccess->getID(*Context)) {
-                    foundSubaccess = true;
-                    indexString = it.first;
-                    break;
-                }
-            }
-            if (!foundSubaccess) {
-                Utils::printErrorAndExit(
-                    "Could not stringify array access because its sub-access "
-                    "had (printed below) not already been processed.\nThis "
-                    "point should be unreachable -- this is a bug.",
-                    asArrayAccess);
+        printExprWithSafeArrays(it, os, symbols);
+    }
+    os << ")";
+    Stats::add(Stat::AccessStringBytes, os.tell());
+    return os.str();
+}
+
+void DataAccessHandler::printExprWithSafeArrays(Expr* expr,
+                                                llvm::raw_ostream& os,
+                                                SymbolTable* symbols) {
+    Expr* usableExpr = expr->IgnoreImpCasts();
+    if (ArraySubscriptExpr* asArrayAccess =
+            dyn_cast<ArraySubscriptExpr>(usableExpr)) {
+        Expr* base;
+        llvm::SmallVector<Expr*, 4> indexes;
+        getArrayAccessParts(asArrayAccess, base, indexes,
+                            symbols->getContext());
+        os << symbols->getText(symbols->getSymbol(base)) << "(";
+        for (unsigned int i = 0; i < indexes.size(); ++i) {
+            if (i != 0) {
+                os << ",";
             }
+            printExprWithSafeArrays(indexes[i], os, symbols);
+        }
+        os << ")";
+    } else if (BinaryOperator* asBinOper =
+                   dyn_cast<BinaryOperator>(usableExpr)) {
+        printExprWithSafeArrays(asBinOper->getLHS(), os, symbols);
+        os << " " << asBinOper->getOpcodeStr() << " ";
+        printExprWithSafeArrays(asBinOper->getRHS(), os, symbols);
+    } else if (UnaryOperator* asUnaryOper =
+                   dyn_cast<UnaryOperator>(usableExpr)) {
+        if (asUnaryOper->getOpcode() == UO_Minus ||
+            asUnaryOper->getOpcode() == UO_Plus) {
+            os << UnaryOperator::getOpcodeStr(asUnaryOper->getOpcode());
+            printExprWithSafeArrays(asUnaryOper->getSubExpr(), os, symbols);
         } else {
-            indexString = Utils::stmtToString(it);
+            os << symbols->getText(symbols->getSymbol(usableExpr));
         }
-        os << indexString;
+    } else if (ParenExpr* asParenExpr = dyn_cast<ParenExpr>(usableExpr)) {
+        os << "(";
+        printExprWithSafeArrays(asParenExpr->getSubExpr(), os, symbols);
+        os << ")";
+    } else {
+        // leaves (and anything else, which cannot contain an array access
+        // that IEGenLib could make sense of) are printed as in the source
+        os << symbols->getText(symbols->getSymbol(usableExpr));
     }
-    os << ")";
-    return os.str();
 }
 
 int DataAccessHandler::getArrayExprInfo(ArraySubscriptExpr* fullExpr,
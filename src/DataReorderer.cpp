@@ -0,0 +1,631 @@
+#include "DataReorderer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.hpp"
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "PrivatizationAnalysis.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Replace the iterator of an outermost loop in an expression with a term
+//! giving its value
+static SpecExp replaceRow(const SpecExp& exp, const SpecTerm& row) {
+    SpecExp replaced;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar && term.tuplePos == 0) {
+            SpecTerm value = row;
+            value.coeff *= term.coeff;
+            replaced.terms.push_back(value);
+            continue;
+        }
+        SpecTerm copy = term;
+        for (auto& arg : copy.args) {
+            arg = replaceRow(arg, row);
+        }
+        replaced.terms.push_back(copy);
+    }
+    return replaced;
+}
+
+//! Get a string without the whitespace around it
+static std::string trim(const std::string& str) {
+    const size_t begin = str.find_first_not_of(" \t\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return str.substr(begin, str.find_last_not_of(" \t\n") - begin + 1);
+}
+
+/* DataReorderer */
+
+bool DataReorderer::findLoop(std::string& reason) {
+    return Utils::findOutermostLoop(
+        stmts,
+        [this](const std::vector<unsigned int>& loopStmts,
+               std::string& loopReason) {
+            return checkLoop(loopStmts, loopReason);
+        },
+        reason);
+}
+
+bool DataReorderer::checkLoop(const std::vector<unsigned int>& loop,
+                              std::string& reason) {
+    // the rows are run in a new order, which must give the same results
+    const unsigned int first = loop.front();
+    const Dependence* carried = analysis.findCarriedDependence(first, 0);
+    if (carried) {
+        reason = "it carries a dependence through '" + carried->dataSpace +
+                 "', so its iterations must run in order";
+        return false;
+    }
+    for (const auto& it : analysis.classifyScalars(first, 0)) {
+        if (it.use == ScalarUse::Private && it.isLiveOut) {
+            reason = "'" + it.scalar +
+                     "' is read after it, so its last iteration must run last";
+            return false;
+        }
+    }
+
+    std::vector<const StmtSpec*> loopSpecs;
+    std::vector<const StmtSpec*> entrySpecs;
+    for (const auto& stmt : loop) {
+        const StmtSpec& spec = stmts[stmt];
+        loopSpecs.push_back(&spec);
+        if (spec.iterSpace.tuple.size() > 2) {
+            reason = "it has loops nested more than two deep";
+            return false;
+        }
+        if (spec.iterSpace.tuple.size() == 2) {
+            entrySpecs.push_back(&spec);
+        }
+    }
+    if (entrySpecs.empty()) {
+        reason = "it has no inner loop over the entries of a row";
+        return false;
+    }
+    SpecExp rowLower;
+    SpecExp rowUpper;
+    SpecExp entryLower;
+    SpecExp entryUpper;
+    if (!CodeGenerator::getLoopBounds(loopSpecs, 0, rowLower, rowUpper) ||
+        !CodeGenerator::getLoopBounds(entrySpecs, 1, entryLower,
+                                      entryUpper)) {
+        reason = "its bounds could not be found";
+        return false;
+    }
+    std::string lowerPointers;
+    std::string upperPointers;
+    if (!CodeGenerator::getBoundValue(entryLower, 1)
+             .isCallAt(0, 0, lowerPointers) ||
+        !CodeGenerator::getBoundValue(entryUpper, 1)
+             .isCallAt(0, 1, upperPointers) ||
+        lowerPointers != upperPointers) {
+        reason = "its inner loop does not run from ptr[i] to ptr[i + 1] for "
+                 "an array ptr";
+        return false;
+    }
+
+    // an array may be permuted if every access to it is in the loop, at a
+    // row or a column, and it is not an index array
+    std::vector<std::string> candidates;
+    std::vector<std::string> excluded;
+    std::string column;
+    auto exclude = [&](const std::string& array) {
+        if (std::find(excluded.begin(), excluded.end(), array) ==
+            excluded.end()) {
+            excluded.push_back(array);
+        }
+    };
+    auto addCandidate = [&](const std::string& array) {
+        if (std::find(candidates.begin(), candidates.end(), array) ==
+            candidates.end()) {
+            candidates.push_back(array);
+        }
+    };
+    std::vector<std::string> readThroughColumn;
+    std::vector<const SpecExp*> constraints;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        const StmtSpec& spec = stmts[i];
+        const bool isInLoop =
+            std::find(loop.begin(), loop.end(), i) != loop.end();
+        for (const auto& it : spec.iterSpace.equalities) {
+            constraints.push_back(&it);
+        }
+        for (const auto& it : spec.iterSpace.inequalities) {
+            constraints.push_back(&it);
+        }
+        for (const auto* accesses : {&spec.dataReads, &spec.dataWrites}) {
+            for (const auto& it : *accesses) {
+                for (const auto& exp : it.second.equalities) {
+                    constraints.push_back(&exp);
+                }
+                std::vector<SpecExp> indexes;
+                std::string function;
+                const bool isScalar =
+                    std::find(spec.scalars.begin(), spec.scalars.end(),
+                              it.first) != spec.scalars.end();
+                if (!isInLoop || isScalar ||
+                    !it.second.getOutputExps(indexes) ||
+                    indexes.size() != 1) {
+                    exclude(it.first);
+                } else if (indexes[0].isTupleVar(0)) {
+                    addCandidate(it.first);
+                } else if (indexes[0].isCallAt(1, 0, function) &&
+                           (column.empty() || function == column)) {
+                    column = function;
+                    addCandidate(it.first);
+                    readThroughColumn.push_back(it.first);
+                } else {
+                    exclude(it.first);
+                }
+            }
+        }
+    }
+    for (const auto& array : candidates) {
+        if (std::any_of(
+                constraints.begin(), constraints.end(),
+                [&](const SpecExp* it) { return it->calls(array); })) {
+            exclude(array);
+        }
+    }
+
+    std::vector<std::string> permuted;
+    for (const auto& it : candidates) {
+        if (std::find(excluded.begin(), excluded.end(), it) ==
+            excluded.end()) {
+            permuted.push_back(it);
+        }
+    }
+    if (std::none_of(readThroughColumn.begin(), readThroughColumn.end(),
+                     [&](const std::string& it) {
+                         return std::find(permuted.begin(), permuted.end(),
+                                          it) != permuted.end();
+                     })) {
+        reason = "it accesses no array through column indexes which is "
+                 "only accessed at rows and columns of the matrix";
+        return false;
+    }
+
+    std::vector<std::string> written;
+    for (const auto& stmt : loop) {
+        for (const auto& it : stmts[stmt].dataWrites) {
+            if (std::find(permuted.begin(), permuted.end(), it.first) !=
+                    permuted.end() &&
+                std::find(written.begin(), written.end(), it.first) ==
+                    written.end()) {
+                written.push_back(it.first);
+            }
+        }
+    }
+
+    loopStmts = loop;
+    rowPointers = lowerPointers;
+    columnIndexes = column;
+    permutedArrays = permuted;
+    writtenArrays = written;
+    lowerBound = rowLower;
+    upperBound = rowUpper;
+
+    const Names names = makeNames(CodeGenerator::getUsedCode(stmts, ""));
+    for (const auto& stmt : loop) {
+        std::string rewritten;
+        if (!rewriteSource(stmts[stmt].sourceCode, names, rewritten)) {
+            reason = "'" + stmts[stmt].sourceCode +
+                     "' uses a permuted array other than by accessing one of "
+                     "its elements";
+            return false;
+        }
+    }
+    return true;
+}
+
+DataReorderer::Names DataReorderer::makeNames(
+    const std::string& usedCode) const {
+    std::vector<std::string> taken;
+    auto makeName = [&](const std::string& base) {
+        return Utils::makeUniqueName(base, usedCode, taken);
+    };
+    Names names;
+    names.perm = makeName("perm");
+    names.invPerm = makeName("inv_perm");
+    names.position = makeName("p");
+    for (const auto& it : permutedArrays) {
+        names.copies[it] = makeName(it + "_rcm");
+    }
+    for (const auto& it :
+         {"head", "tail", "start", "first", "a", "b", "next"}) {
+        names.locals.push_back(makeName(it));
+    }
+    return names;
+}
+
+bool DataReorderer::rewriteSource(const std::string& source,
+                                  const Names& names,
+                                  std::string& rewritten) const {
+    const std::string& row = stmts[loopStmts.front()].iterSpace.tuple[0].var;
+    auto isIdentifierChar = [](char c) { return std::isalnum(c) || c == '_'; };
+
+    rewritten.clear();
+    size_t pos = 0;
+    while (pos < source.size()) {
+        if (std::isdigit(source[pos]) || source[pos] == '.') {
+            // a number, which may contain letters
+            const size_t begin = pos;
+            while (pos < source.size() &&
+                   (isIdentifierChar(source[pos]) || source[pos] == '.')) {
+                ++pos;
+            }
+            rewritten += source.substr(begin, pos - begin);
+            continue;
+        }
+        if (!std::isalpha(source[pos]) && source[pos] != '_') {
+            rewritten += source[pos++];
+            continue;
+        }
+        size_t end = pos;
+        while (end < source.size() && isIdentifierChar(source[end])) {
+            ++end;
+        }
+        const std::string identifier = source.substr(pos, end - pos);
+        auto copy = names.copies.find(identifier);
+        if (copy == names.copies.end()) {
+            rewritten += identifier;
+            pos = end;
+            continue;
+        }
+
+        // an element of a permuted array, at the new position of the row or
+        // column indexing it
+        size_t open = end;
+        while (open < source.size() && std::isspace(source[open])) {
+            ++open;
+        }
+        if (open == source.size() || source[open] != '[') {
+            return false;
+        }
+        size_t close = open + 1;
+        for (int depth = 1; close < source.size(); ++close) {
+            depth += source[close] == '[' ? 1 : source[close] == ']' ? -1 : 0;
+            if (depth == 0) {
+                break;
+            }
+        }
+        if (close == source.size()) {
+            return false;
+        }
+        const std::string index =
+            trim(source.substr(open + 1, close - open - 1));
+        std::string newIndex;
+        if (index == row) {
+            newIndex = names.position;
+        } else if (rewriteSource(index, names, newIndex)) {
+            newIndex = names.invPerm + "[" + newIndex + "]";
+        } else {
+            return false;
+        }
+        rewritten += copy->second + "[" + newIndex + "]";
+        pos = close + 1;
+    }
+    return true;
+}
+
+std::vector<StmtSpec> DataReorderer::makeExecutorStmts(
+    const Names& names, bool isIteratorDeclared) const {
+    const DependenceGraph& graph = analysis.getGraph();
+    SpecExp positionExp;
+    positionExp.terms.push_back(SpecTerm::makeTupleVar(0));
+    const SpecTerm rowValue = SpecTerm::makeUFCall(names.perm, {positionExp});
+
+    // the original iterator is only set if statements still use it once
+    // accesses to permuted arrays are rewritten
+    const std::string& row = stmts[loopStmts.front()].iterSpace.tuple[0].var;
+    bool isRowUsed = false;
+    for (const auto& stmt : loopStmts) {
+        std::string rewritten;
+        rewriteSource(stmts[stmt].sourceCode, names, rewritten);
+        isRowUsed = isRowUsed || Utils::usesIdentifier(rewritten, row);
+    }
+
+    std::vector<StmtSpec> executorStmts;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (std::find(loopStmts.begin(), loopStmts.end(), i) ==
+            loopStmts.end()) {
+            executorStmts.push_back(stmts[i]);
+            continue;
+        }
+        const StmtSpec& spec = stmts[i];
+        ExecSchedule original = graph.getSchedule(i);
+        while (original.getDimension() < 3) {
+            original.pushValue(ScheduleVal::makeNum(0));
+        }
+        std::vector<TupleElem> tuple = spec.iterSpace.tuple;
+        tuple[0] = TupleElem(names.position);
+
+        if (i == loopStmts.front() && isRowUsed) {
+            // each iteration starts by setting the original iterator
+            StmtSpec assignment;
+            assignment.iterSpace.tuple = {tuple[0]};
+            assignment.iterSpace.inequalities = {lowerBound, upperBound};
+            ExecSchedule schedule;
+            schedule.pushValue(original.scheduleTuple[0]);
+            schedule.pushValue(ScheduleVal::makeVar(0));
+            schedule.pushValue(ScheduleVal::makeNum(0));
+            assignment.setSchedule(schedule);
+            assignment.sourceCode = (isIteratorDeclared ? "" : "int ") +
+                                    row + " = " + names.perm + "[" +
+                                    names.position + "];";
+            executorStmts.push_back(assignment);
+        }
+
+        // the new positions have the same bounds as the rows, and other
+        // constraints are on the row at each position
+        StmtSpec moved;
+        rewriteSource(spec.sourceCode, names, moved.sourceCode);
+        moved.reduction = spec.reduction;
+        moved.scalars = spec.scalars;
+        moved.isConditional = spec.isConditional;
+        moved.iterSpace.tuple = tuple;
+        for (const auto& it : spec.iterSpace.equalities) {
+            moved.iterSpace.equalities.push_back(replaceRow(it, rowValue));
+        }
+        moved.iterSpace.inequalities = {lowerBound, upperBound};
+        bool lowerRemoved = false;
+        bool upperRemoved = false;
+        for (const auto& it : spec.iterSpace.inequalities) {
+            if (!lowerRemoved && it == lowerBound) {
+                lowerRemoved = true;
+            } else if (!upperRemoved && it == upperBound) {
+                upperRemoved = true;
+            } else {
+                moved.iterSpace.inequalities.push_back(
+                    replaceRow(it, rowValue));
+            }
+        }
+        // [c0, i, c1, ...] becomes [c0, p, c1 + 1, ...], after the
+        // assignment at [c0, p, 0]
+        ExecSchedule schedule;
+        for (int j = 0; j < original.getDimension(); ++j) {
+            ScheduleVal value = original.scheduleTuple[j];
+            if (j == 2) {
+                value.value += 1;
+            }
+            schedule.pushValue(value);
+        }
+        moved.setSchedule(schedule);
+
+        // permuted arrays are accessed at the new position of the row or
+        // column, and others at the row at the position
+        for (const auto& it : spec.dataSpaces) {
+            auto copy = names.copies.find(it);
+            moved.dataSpaces.push_back(copy == names.copies.end()
+                                           ? it
+                                           : copy->second);
+        }
+        auto rewriteAccesses =
+            [&](const std::vector<std::pair<std::string, SetRelationSpec>>&
+                    accesses,
+                std::vector<std::pair<std::string, SetRelationSpec>>&
+                    rewritten) {
+                for (const auto& it : accesses) {
+                    std::vector<SpecExp> indexes;
+                    it.second.getOutputExps(indexes);
+                    auto copy = names.copies.find(it.first);
+                    if (copy == names.copies.end()) {
+                        for (auto& index : indexes) {
+                            index = replaceRow(index, rowValue);
+                        }
+                        rewritten.emplace_back(
+                            it.first,
+                            SetRelationSpec::makeAccess(tuple, indexes));
+                        continue;
+                    }
+                    if (!indexes[0].isTupleVar(0)) {
+                        SpecExp newIndex;
+                        newIndex.terms.push_back(SpecTerm::makeUFCall(
+                            names.invPerm, {indexes[0]}));
+                        indexes[0] = newIndex;
+                    }
+                    rewritten.emplace_back(
+                        copy->second,
+                        SetRelationSpec::makeAccess(tuple, indexes));
+                }
+            };
+        rewriteAccesses(spec.dataReads, moved.dataReads);
+        rewriteAccesses(spec.dataWrites, moved.dataWrites);
+        executorStmts.push_back(moved);
+    }
+    return executorStmts;
+}
+
+void DataReorderer::writeInspector(llvm::raw_ostream& os,
+                                   const std::string& name,
+                                   const std::string& parameters,
+                                   const Names& names) const {
+    const std::vector<TupleElem>& loopTuple =
+        stmts[loopStmts.front()].iterSpace.tuple;
+    const std::string& row = loopTuple[0].var;
+    std::string entry;
+    for (const auto& stmt : loopStmts) {
+        if (stmts[stmt].iterSpace.tuple.size() == 2) {
+            entry = stmts[stmt].iterSpace.tuple[1].var;
+            break;
+        }
+    }
+    const std::string lower = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(lowerBound, 0), loopTuple);
+    const std::string upper = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(upperBound, 0), loopTuple);
+    const std::string& perm = names.perm;
+    const std::string& invPerm = names.invPerm;
+    const std::string& head = names.locals[0];
+    const std::string& tail = names.locals[1];
+    const std::string& start = names.locals[2];
+    const std::string& first = names.locals[3];
+    const std::string& a = names.locals[4];
+    const std::string& b = names.locals[5];
+    const std::string& next = names.locals[6];
+    auto degree = [&](const std::string& of) {
+        return rowPointers + "[" + of + " + 1] - " + rowPointers + "[" + of +
+               "]";
+    };
+    const std::string rowLoop = "for (int " + row + " = " + lower + "; " +
+                                row + " < " + upper + "; " + row + "++) {\n";
+    const std::string entryLoop = "for (int " + entry + " = " + rowPointers +
+                                  "[" + row + "]; " + entry + " < " +
+                                  rowPointers + "[" + row + " + 1]; " +
+                                  entry + "++) {\n";
+    const std::string column = columnIndexes + "[" + entry + "]";
+
+    os << "int " << name << "_rcm(" << parameters
+       << (parameters.empty() ? "" : ", ") << "int " << perm << "[], int "
+       << invPerm << "[]) {\n";
+    // rows are only reordered along with columns, so every column must be
+    // a row
+    os.indent(4) << rowLoop;
+    os.indent(8) << entryLoop;
+    os.indent(12) << "if (" << column << " < " << lower << " || " << column
+                  << " >= " << upper << ") {\n";
+    os.indent(16) << "return 0;\n";
+    os.indent(12) << "}\n";
+    os.indent(8) << "}\n";
+    os.indent(8) << invPerm << "[" << row << "] = -1;\n";
+    os.indent(4) << "}\n";
+    // a breadth-first search from a row of least degree in each connected
+    // component, visiting the neighbors of each row by increasing degree;
+    // rows are marked visited by a nonnegative inv_perm
+    os.indent(4) << "int " << tail << " = " << lower << ";\n";
+    os.indent(4) << "for (int " << head << " = " << lower << "; " << head
+                 << " < " << upper << "; " << head << "++) {\n";
+    os.indent(8) << "if (" << head << " == " << tail << ") {\n";
+    os.indent(12) << "int " << start << " = -1;\n";
+    os.indent(12) << rowLoop;
+    os.indent(16) << "if (" << invPerm << "[" << row << "] < 0 && (" << start
+                  << " < 0 || " << degree(row) << " < " << degree(start)
+                  << ")) {\n";
+    os.indent(20) << start << " = " << row << ";\n";
+    os.indent(16) << "}\n";
+    os.indent(12) << "}\n";
+    os.indent(12) << perm << "[" << tail << "] = " << start << ";\n";
+    os.indent(12) << invPerm << "[" << start << "] = " << tail << "++;\n";
+    os.indent(8) << "}\n";
+    os.indent(8) << "int " << row << " = " << perm << "[" << head << "];\n";
+    os.indent(8) << "int " << first << " = " << tail << ";\n";
+    os.indent(8) << entryLoop;
+    os.indent(12) << "if (" << invPerm << "[" << column << "] < 0) {\n";
+    os.indent(16) << perm << "[" << tail << "] = " << column << ";\n";
+    os.indent(16) << invPerm << "[" << column << "] = " << tail << "++;\n";
+    os.indent(12) << "}\n";
+    os.indent(8) << "}\n";
+    os.indent(8) << "for (int " << a << " = " << first << " + 1; " << a
+                 << " < " << tail << "; " << a << "++) {\n";
+    os.indent(12) << "int " << next << " = " << perm << "[" << a << "];\n";
+    os.indent(12) << "int " << b << " = " << a << ";\n";
+    os.indent(12) << "for (; " << b << " > " << first << " && "
+                  << degree(perm + "[" + b + " - 1]") << " > "
+                  << degree(next) << "; " << b << "--) {\n";
+    os.indent(16) << perm << "[" << b << "] = " << perm << "[" << b
+                  << " - 1];\n";
+    os.indent(12) << "}\n";
+    os.indent(12) << perm << "[" << b << "] = " << next << ";\n";
+    os.indent(8) << "}\n";
+    os.indent(4) << "}\n";
+    // reversing the Cuthill-McKee order gives one with a smaller profile
+    os.indent(4) << "for (int " << a << " = " << lower << ", " << b << " = "
+                 << upper << " - 1; " << a << " < " << b << "; " << a
+                 << "++, " << b << "--) {\n";
+    os.indent(8) << "int " << next << " = " << perm << "[" << a << "];\n";
+    os.indent(8) << perm << "[" << a << "] = " << perm << "[" << b << "];\n";
+    os.indent(8) << perm << "[" << b << "] = " << next << ";\n";
+    os.indent(4) << "}\n";
+    os.indent(4) << "for (int " << a << " = " << lower << "; " << a << " < "
+                 << upper << "; " << a << "++) {\n";
+    os.indent(8) << invPerm << "[" << perm << "[" << a << "]] = " << a
+                 << ";\n";
+    os.indent(4) << "}\n";
+    os.indent(4) << "return 1;\n";
+    os << "}\n\n";
+}
+
+bool DataReorderer::writeFunctions(
+    llvm::raw_ostream& os, const std::string& name,
+    const std::string& returnType, const std::string& parameters,
+    const std::map<std::string, std::string>& elementTypes) const {
+    const Names names =
+        makeNames(CodeGenerator::getUsedCode(stmts, parameters));
+    const std::string prefix = parameters.empty() ? "" : parameters + ", ";
+    std::string copies;
+    for (const auto& it : permutedArrays) {
+        auto type = elementTypes.find(it);
+        if (type == elementTypes.end()) {
+            return false;
+        }
+        copies += ", " + type->second + " " + names.copies.at(it) + "[]";
+    }
+
+    const std::vector<TupleElem>& loopTuple =
+        stmts[loopStmts.front()].iterSpace.tuple;
+    const std::string& position = names.position;
+    const std::string lower = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(lowerBound, 0), loopTuple);
+    const std::string upper = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(upperBound, 0), loopTuple);
+    const std::string positionLoop = "for (int " + position + " = " + lower +
+                                     "; " + position + " < " + upper + "; " +
+                                     position + "++) {\n";
+    const std::string original = "[" + names.perm + "[" + position + "]]";
+    const std::string permuted = "[" + position + "]";
+
+    std::string code;
+    llvm::raw_string_ostream out(code);
+    writeInspector(out, name, parameters, names);
+
+    out << "void " << name << "_permute(" << prefix << "const int "
+        << names.perm << "[]" << copies << ") {\n";
+    out.indent(4) << positionLoop;
+    for (const auto& it : permutedArrays) {
+        out.indent(8) << names.copies.at(it) << permuted << " = " << it
+                      << original << ";\n";
+    }
+    out.indent(4) << "}\n";
+    out << "}\n\n";
+
+    bool isIteratorDeclared = false;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (std::find(loopStmts.begin(), loopStmts.end(), i) ==
+                loopStmts.end() &&
+            CodeGenerator::declares(stmts[i], loopTuple[0].var)) {
+            isIteratorDeclared = true;
+        }
+    }
+    out << returnType << " " << name << "_reordered(" << prefix
+        << "const int " << names.perm << "[], const int " << names.invPerm
+        << "[]" << copies << ") {\n";
+    if (!CodeGenerator(makeExecutorStmts(names, isIteratorDeclared))
+             .writeBody(out)) {
+        return false;
+    }
+    out << "}\n\n";
+
+    out << "void " << name << "_unpermute(" << prefix << "const int "
+        << names.perm << "[]" << copies << ") {\n";
+    out.indent(4) << positionLoop;
+    for (const auto& it : writtenArrays) {
+        out.indent(8) << it << original << " = " << names.copies.at(it)
+                      << permuted << ";\n";
+    }
+    out.indent(4) << "}\n";
+    out << "}\n";
+    os << out.str();
+    return true;
+}
+
+}  // namespace spf_ie
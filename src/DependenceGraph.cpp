@@ -0,0 +1,415 @@
+#include "DependenceGraph.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ConstraintSolver.hpp"
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Escape a string for use within double quotes in DOT
+static std::string escapeDotString(llvm::StringRef str) {
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c == '\n' ? ' ' : c;
+    }
+    return escaped;
+}
+
+//! Get an expression with every tuple variable (including those in call
+//! arguments) moved to a new position
+//! \param[in] exp The expression
+//! \param[in] newPosition Function giving the new position of each one
+template <typename Mapping>
+static SpecExp remapTupleVars(const SpecExp& exp, Mapping newPosition) {
+    SpecExp remapped = exp;
+    for (auto& term : remapped.terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar) {
+            term.tuplePos = newPosition(term.tuplePos);
+        }
+        for (auto& arg : term.args) {
+            arg = remapTupleVars(arg, newPosition);
+        }
+    }
+    return remapped;
+}
+
+//! Get the expression an entry of a schedule (padded with zeroes) gives
+//! \param[in] schedule The schedule
+//! \param[in] position Position of the entry
+//! \param[in] offset Position of the schedule's first iterator in the
+//! tuple the expression is over
+static SpecExp getScheduleExp(const ExecSchedule& schedule, int position,
+                              int offset) {
+    SpecExp exp;
+    if (position >= schedule.getDimension()) {
+        exp.terms.push_back(SpecTerm::makeConst(0));
+    } else if (schedule.scheduleTuple[position].valueIsVar) {
+        exp.terms.push_back(SpecTerm::makeTupleVar(
+            offset + schedule.scheduleTuple[position].value));
+    } else {
+        exp.terms.push_back(
+            SpecTerm::makeConst(schedule.scheduleTuple[position].value));
+    }
+    return exp;
+}
+
+/* DependenceGraph */
+
+DependenceGraph::DependenceGraph(const std::vector<StmtSpec>& stmts) {
+    llvm::TimeTraceScope analyzeScope("AnalyzeDependences");
+    for (const auto& stmt : stmts) {
+        sourceCodes.push_back(stmt.sourceCode);
+        std::vector<std::string> stmtIterators;
+        for (const auto& it : stmt.iterSpace.tuple) {
+            stmtIterators.push_back(it.isConst ? std::to_string(it.constant)
+                                               : it.var);
+        }
+        iterators.push_back(std::move(stmtIterators));
+        ExecSchedule schedule;
+        if (!stmt.getSchedule(schedule)) {
+            // without a known schedule, treat the statement as outside
+            // every loop, so nothing is claimed about its order
+            schedule = ExecSchedule();
+        }
+        schedules.push_back(schedule);
+    }
+
+    for (unsigned int source = 0; source < stmts.size(); ++source) {
+        for (unsigned int sink = 0; sink < stmts.size(); ++sink) {
+            for (const auto& write : stmts[source].dataWrites) {
+                for (const auto& read : stmts[sink].dataReads) {
+                    if (write.first == read.first) {
+                        addDependences(stmts, source, sink,
+                                       DependenceKind::Flow, write.first,
+                                       write.second, read.second);
+                    }
+                }
+            }
+            for (const auto& read : stmts[source].dataReads) {
+                for (const auto& write : stmts[sink].dataWrites) {
+                    if (read.first == write.first) {
+                        addDependences(stmts, source, sink,
+                                       DependenceKind::Anti, read.first,
+                                       read.second, write.second);
+                    }
+                }
+            }
+            for (const auto& write : stmts[source].dataWrites) {
+                for (const auto& otherWrite : stmts[sink].dataWrites) {
+                    if (write.first == otherWrite.first) {
+                        addDependences(stmts, source, sink,
+                                       DependenceKind::Output, write.first,
+                                       write.second, otherWrite.second);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int DependenceGraph::getLoopDepth(unsigned int stmt) const {
+    return std::count_if(schedules[stmt].scheduleTuple.begin(),
+                         schedules[stmt].scheduleTuple.end(),
+                         [](const ScheduleVal& it) { return it.valueIsVar; });
+}
+
+bool DependenceGraph::shareLoop(unsigned int stmt1, unsigned int stmt2,
+                                int level) const {
+    return level < getCommonLoopDepth(stmt1, stmt2);
+}
+
+const Dependence* DependenceGraph::findCarriedDependence(unsigned int stmt,
+                                                        int level) const {
+    for (const auto& it : dependences) {
+        if (it.level == level && it.reduction == ReductionOp::None &&
+            shareLoop(it.source, stmt, level)) {
+            return &it;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const Dependence*> DependenceGraph::findCarriedReductions(
+    unsigned int stmt, int level) const {
+    std::vector<const Dependence*> reductions;
+    for (const auto& it : dependences) {
+        if (it.level == level && it.reduction != ReductionOp::None &&
+            shareLoop(it.source, stmt, level)) {
+            reductions.push_back(&it);
+        }
+    }
+    return reductions;
+}
+
+void DependenceGraph::writeDot(llvm::raw_ostream& os,
+                               llvm::StringRef name) const {
+    os << "digraph \"" << escapeDotString(name) << "\" {\n";
+    for (unsigned int i = 0; i < sourceCodes.size(); ++i) {
+        os << "    S" << i << " [label=\"S" << i << ": "
+           << escapeDotString(sourceCodes[i]) << "\"];\n";
+    }
+    for (const auto& it : dependences) {
+        os << "    S" << it.source << " -> S" << it.sink << " [label=\""
+           << getKindName(it.kind) << " " << escapeDotString(it.dataSpace);
+        if (it.isLoopCarried()) {
+            const ScheduleVal& loopVar =
+                schedules[it.source].scheduleTuple[2 * it.level + 1];
+            os << ", carried by "
+               << escapeDotString(iterators[it.source][loopVar.value]);
+        }
+        if (it.reduction != ReductionOp::None) {
+            os << ", " << getReductionIdentifier(it.reduction)
+               << " reduction";
+        }
+        os << (it.isLoopCarried() ? "\"];\n" : "\", style=dashed];\n");
+    }
+    os << "}\n";
+}
+
+const char* DependenceGraph::getKindName(DependenceKind kind) {
+    switch (kind) {
+        case DependenceKind::Flow:
+            return "flow";
+        case DependenceKind::Anti:
+            return "anti";
+        case DependenceKind::Output:
+            return "output";
+    }
+    return "";
+}
+
+bool DependenceGraph::isPreservedBy(const Dependence& dependence,
+                                    const StmtSpec& source,
+                                    const StmtSpec& sink) {
+    ExecSchedule sourceSchedule;
+    ExecSchedule sinkSchedule;
+    if (!source.getSchedule(sourceSchedule) ||
+        !sink.getSchedule(sinkSchedule)) {
+        return false;
+    }
+    const SetRelationSpec& relation = dependence.relation;
+    const int sourceArity = relation.inArity;
+    const int sinkArity = relation.tuple.size() - relation.inArity;
+    const int sinkOffset = source.iterSpace.tuple.size();
+    const int sourceShift = sinkOffset - sourceArity;
+    const int sinkShift = sink.iterSpace.tuple.size() - sinkArity;
+    if (sourceShift < 0 || sinkShift < 0) {
+        return false;
+    }
+
+    // the dependent instances, over the transformed statements' tuples, with
+    // sink iterators primed
+    SetRelationSpec ordered;
+    ordered.isRelation = true;
+    ordered.tuple = source.iterSpace.tuple;
+    for (const auto& it : sink.iterSpace.tuple) {
+        ordered.tuple.push_back(it.isConst ? TupleElem(it.constant)
+                                           : TupleElem(it.var + "'"));
+    }
+    ordered.inArity = sinkOffset;
+    auto newPosition = [&](int position) {
+        return position < sourceArity
+                   ? position + sourceShift
+                   : position - sourceArity + sinkOffset + sinkShift;
+    };
+    for (const auto& it : relation.equalities) {
+        ordered.equalities.push_back(remapTupleVars(it, newPosition));
+    }
+    for (const auto& it : relation.inequalities) {
+        ordered.inequalities.push_back(remapTupleVars(it, newPosition));
+    }
+    ordered.equalities.insert(ordered.equalities.end(),
+                              source.iterSpace.equalities.begin(),
+                              source.iterSpace.equalities.end());
+    ordered.inequalities.insert(ordered.inequalities.end(),
+                                source.iterSpace.inequalities.begin(),
+                                source.iterSpace.inequalities.end());
+    for (auto exp : sink.iterSpace.equalities) {
+        exp.shiftTupleVars(sinkOffset);
+        ordered.equalities.push_back(exp);
+    }
+    for (auto exp : sink.iterSpace.inequalities) {
+        exp.shiftTupleVars(sinkOffset);
+        ordered.inequalities.push_back(exp);
+    }
+
+    // at each entry, with the entries before it equal, the sink must not be
+    // able to come first
+    const int dimension =
+        std::max(sourceSchedule.getDimension(), sinkSchedule.getDimension());
+    for (int i = 0; i < dimension; ++i) {
+        SpecExp difference = getScheduleExp(sourceSchedule, i, 0);
+        SpecExp sinkExp = getScheduleExp(sinkSchedule, i, sinkOffset);
+        sinkExp.multiplyBy(-1);
+        difference.add(sinkExp);
+        int constant;
+        if (difference.isConst(&constant)) {
+            if (constant < 0) {
+                return true;
+            }
+            if (constant > 0) {
+                return !ConstraintSolver::maybeSatisfiable(ordered);
+            }
+            continue;
+        }
+        SetRelationSpec reversed = ordered;
+        reversed.inequalities.push_back(difference);
+        reversed.inequalities.back().terms.push_back(
+            SpecTerm::makeConst(-1));
+        if (ConstraintSolver::maybeSatisfiable(reversed)) {
+            return false;
+        }
+        ordered.equalities.push_back(difference);
+    }
+    return !ConstraintSolver::maybeSatisfiable(ordered);
+}
+
+int DependenceGraph::getCommonLoopDepth(unsigned int stmt1,
+                                        unsigned int stmt2) const {
+    const auto& schedule1 = schedules[stmt1].scheduleTuple;
+    const auto& schedule2 = schedules[stmt2].scheduleTuple;
+    int depth = 0;
+    // statements share a loop when their schedules match up to it: the
+    // numbers place loops and statements among their siblings
+    for (size_t i = 0; i + 1 < std::min(schedule1.size(), schedule2.size());
+         i += 2) {
+        if (schedule1[i].valueIsVar || schedule2[i].valueIsVar ||
+            schedule1[i].value != schedule2[i].value ||
+            !schedule1[i + 1].valueIsVar || !schedule2[i + 1].valueIsVar) {
+            break;
+        }
+        depth++;
+    }
+    return depth;
+}
+
+bool DependenceGraph::isTextuallyBefore(unsigned int stmt1,
+                                        unsigned int stmt2) const {
+    const auto& schedule1 = schedules[stmt1].scheduleTuple;
+    const auto& schedule2 = schedules[stmt2].scheduleTuple;
+    for (size_t i = 2 * getCommonLoopDepth(stmt1, stmt2);
+         i < std::max(schedule1.size(), schedule2.size()); ++i) {
+        const int value1 = i < schedule1.size() ? schedule1[i].value : 0;
+        const int value2 = i < schedule2.size() ? schedule2[i].value : 0;
+        const bool isVar1 = i < schedule1.size() && schedule1[i].valueIsVar;
+        const bool isVar2 = i < schedule2.size() && schedule2[i].valueIsVar;
+        if (isVar1 || isVar2) {
+            return false;
+        }
+        if (value1 != value2) {
+            return value1 < value2;
+        }
+    }
+    return false;
+}
+
+void DependenceGraph::addDependences(const std::vector<StmtSpec>& stmts,
+                                     unsigned int source, unsigned int sink,
+                                     DependenceKind kind,
+                                     const std::string& dataSpace,
+                                     const SetRelationSpec& sourceAccess,
+                                     const SetRelationSpec& sinkAccess) {
+    const SetRelationSpec& sourceSpace = stmts[source].iterSpace;
+    const SetRelationSpec& sinkSpace = stmts[sink].iterSpace;
+    const int sinkOffset = sourceSpace.tuple.size();
+
+    // both iterations are in their iteration spaces and access the same
+    // element
+    SetRelationSpec common;
+    common.isRelation = true;
+    for (const auto& it : iterators[source]) {
+        common.tuple.emplace_back(it);
+    }
+    for (const auto& it : iterators[sink]) {
+        common.tuple.emplace_back(it + "'");
+    }
+    common.inArity = sinkOffset;
+    common.equalities = sourceSpace.equalities;
+    common.inequalities = sourceSpace.inequalities;
+    for (auto exp : sinkSpace.equalities) {
+        exp.shiftTupleVars(sinkOffset);
+        common.equalities.push_back(exp);
+    }
+    for (auto exp : sinkSpace.inequalities) {
+        exp.shiftTupleVars(sinkOffset);
+        common.inequalities.push_back(exp);
+    }
+    const int numIndexes = sourceAccess.tuple.size() - sourceAccess.inArity;
+    if (numIndexes ==
+        static_cast<int>(sinkAccess.tuple.size()) - sinkAccess.inArity) {
+        for (int i = 0; i < numIndexes; ++i) {
+            SpecExp sourceIndex;
+            SpecExp sinkIndex;
+            if (!sourceAccess.getOutputExp(sourceAccess.inArity + i,
+                                           sourceIndex) ||
+                !sinkAccess.getOutputExp(sinkAccess.inArity + i,
+                                         sinkIndex)) {
+                continue;
+            }
+            sinkIndex.shiftTupleVars(sinkOffset);
+            sinkIndex.multiplyBy(-1);
+            sourceIndex.add(sinkIndex);
+            common.equalities.push_back(sourceIndex);
+        }
+    }
+
+    // instances of reductions into the same data space with the same
+    // operator may be reordered
+    ReductionOp reduction = stmts[source].reduction;
+    for (unsigned int stmt : {source, sink}) {
+        if (stmts[stmt].reduction != reduction ||
+            stmts[stmt].dataWrites.empty() ||
+            stmts[stmt].dataWrites.front().first != dataSpace) {
+            reduction = ReductionOp::None;
+        }
+    }
+
+    // split by the loop ordering the source iteration before the sink's
+    const auto& sourceSchedule = schedules[source].scheduleTuple;
+    const auto& sinkSchedule = schedules[sink].scheduleTuple;
+    const int commonDepth = getCommonLoopDepth(source, sink);
+    for (int level = -1; level < commonDepth; ++level) {
+        const int numEqualLoops = level < 0 ? commonDepth : level;
+        if (level < 0 && (source == sink || !isTextuallyBefore(source, sink))) {
+            continue;
+        }
+        Dependence dependence;
+        dependence.source = source;
+        dependence.sink = sink;
+        dependence.kind = kind;
+        dependence.dataSpace = dataSpace;
+        dependence.level = level;
+        dependence.reduction = reduction;
+        dependence.relation = common;
+        for (int i = 0; i <= numEqualLoops && i < commonDepth; ++i) {
+            SpecExp difference;
+            difference.terms.push_back(SpecTerm::makeTupleVar(
+                sinkOffset + sinkSchedule[2 * i + 1].value));
+            difference.terms.push_back(SpecTerm::makeTupleVar(
+                sourceSchedule[2 * i + 1].value, -1));
+            if (i < numEqualLoops) {
+                dependence.relation.equalities.push_back(difference);
+            } else {
+                // sink iteration is later at the carrying loop
+                difference.terms.push_back(SpecTerm::makeConst(-1));
+                dependence.relation.inequalities.push_back(difference);
+            }
+        }
+        if (ConstraintSolver::maybeSatisfiable(dependence.relation)) {
+            dependences.push_back(std::move(dependence));
+        }
+    }
+}
+
+}  // namespace spf_ie
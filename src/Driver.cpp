@@ -11,20 +11,54 @@
 
 #include "Driver.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "Archive.hpp"
+#include "ComputationCache.hpp"
+#include "ComputationJSON.hpp"
+#include "DataReorderer.hpp"
+#include "CodeGenerator.hpp"
+#include "DependenceGraph.hpp"
+#include "FormatConverter.hpp"
+#include "LevelSetGenerator.hpp"
+#include "LoopRestructurer.hpp"
+#include "LoopTiler.hpp"
+#include "Parallelizer.hpp"
+#include "PrivatizationAnalysis.hpp"
 #include "SPFComputationBuilder.hpp"
+#include "Server.hpp"
+#include "Stats.hpp"
+#include "TimeTrace.hpp"
 #include "Utils.hpp"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "clang/Serialization/PCHContainerOperations.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 using namespace clang::tooling;
@@ -32,60 +66,736 @@ using namespace clang::tooling;
 static llvm::cl::opt<bool> PrintOutputToConsole(
     "print-info", llvm::cl::desc("Output info to console"));
 
+static llvm::cl::opt<unsigned> NumJobs(
+    "j",
+    llvm::cl::desc("Number of translation units to process concurrently "
+                   "(0 to use all hardware threads); IEGenLib work is still "
+                   "done by one thread at a time"),
+    llvm::cl::init(1));
+
+static llvm::cl::opt<unsigned> NumFunctionJobs(
+    "function-jobs",
+    llvm::cl::desc("Number of functions within a translation unit to build "
+                   "concurrently (0 to use all hardware threads); IEGenLib "
+                   "work is still done by one thread at a time"),
+    llvm::cl::init(1));
+
+static llvm::cl::opt<std::string> TimeTraceFile(
+    "time-trace",
+    llvm::cl::desc("Record the time spent in each phase of processing to the "
+                   "given file, in Chrome trace format"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<unsigned> TimeTraceGranularity(
+    "time-trace-granularity",
+    llvm::cl::desc("Minimum duration, in microseconds, of spans recorded by "
+                   "--time-trace"),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<bool> PrintStats(
+    "stats",
+    llvm::cl::desc("Output statistics on work done and memory used, as "
+                   "JSON, to standard error"));
+
+static llvm::cl::opt<std::string> StatsFile(
+    "stats-file",
+    llvm::cl::desc("Output statistics (as with --stats) to the given file "
+                   "instead"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> CacheDir(
+    "cache-dir",
+    llvm::cl::desc("Reuse Computations built by earlier runs for functions "
+                   "that have not changed, keeping them in the given "
+                   "directory"),
+    llvm::cl::value_desc("directory"));
+
+static llvm::cl::opt<bool> Serve(
+    "serve",
+    llvm::cl::desc("Keep running, answering requests to analyze files read "
+                   "one per line from standard input (as JSON, like "
+                   "{\"file\": \"a.c\", \"function\": \"f\"}) with "
+                   "one line of JSON each on standard output"));
+
+static llvm::cl::opt<std::string> EmitJSONFile(
+    "emit-json",
+    llvm::cl::desc("Write each function's Computation to the given file "
+                   "('-' for standard output) as soon as it is built, as "
+                   "one line of JSON"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> ArchiveFile(
+    "archive",
+    llvm::cl::desc("Write every function's Computation to the given file "
+                   "in a binary format which can be mapped into memory and "
+                   "searched without parsing it"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> DependencesFile(
+    "dependences",
+    llvm::cl::desc("Write the graph of data dependences between the "
+                   "statements of each function to the given file ('-' for "
+                   "standard output) in Graphviz DOT format"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> EmitCFile(
+    "emit-c",
+    llvm::cl::desc("Write C code generated from each function's Computation "
+                   "to the given file ('-' for standard output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> LevelSetsFile(
+    "level-sets",
+    llvm::cl::desc("Write a level-set inspector and executor for each "
+                   "function with a loop whose iterations depend on each "
+                   "other through index arrays to the given file ('-' for "
+                   "standard output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> SparseFormatFile(
+    "sparse-format-file",
+    llvm::cl::desc("Write inspectors converting the CSR matrix each function "
+                   "traverses to the format given by --sparse-format, and "
+                   "executors traversing that format, to the given file "
+                   "('-' for standard output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<spf_ie::SparseFormat> SparseFormatOpt(
+    "sparse-format",
+    llvm::cl::desc("Format to convert CSR matrices to, for "
+                   "--sparse-format-file"),
+    llvm::cl::values(clEnumValN(spf_ie::SparseFormat::ELL, "ell", "ELLPACK"),
+                     clEnumValN(spf_ie::SparseFormat::BCSR, "bcsr",
+                                "Block CSR, with blocks of --block-size"),
+                     clEnumValN(spf_ie::SparseFormat::CSC, "csc",
+                                "Compressed sparse column")),
+    llvm::cl::init(spf_ie::SparseFormat::ELL));
+
+static llvm::cl::opt<unsigned int> BlockSize(
+    "block-size",
+    llvm::cl::desc("Number of rows and columns in each block of a BCSR "
+                   "matrix (default 4)"),
+    llvm::cl::value_desc("N"), llvm::cl::init(4));
+
+static llvm::cl::opt<std::string> ReorderFile(
+    "reorder",
+    llvm::cl::desc("Write a reverse Cuthill-McKee reordering inspector and "
+                   "an executor running over the reordered rows and data "
+                   "for each function with a loop over the rows of a CSR "
+                   "matrix to the given file ('-' for standard output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> TileFile(
+    "tile",
+    llvm::cl::desc("Write each function with a loop nest tiled, in tiles of "
+                   "--tile-sizes, to the given file ('-' for standard "
+                   "output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::list<unsigned int> TileSizes(
+    "tile-sizes",
+    llvm::cl::desc("Number of iterations in a tile of each loop tiled by "
+                   "--tile, outermost first (default 32,32)"),
+    llvm::cl::value_desc("N,..."), llvm::cl::CommaSeparated);
+
+static llvm::cl::opt<unsigned int> TileLoop(
+    "tile-loop",
+    llvm::cl::desc("Position, counting from 1, of the outermost loop whose "
+                   "nest --tile tiles (default: the first which can be)"),
+    llvm::cl::value_desc("N"), llvm::cl::init(0));
+
+static llvm::cl::opt<std::string> FuseFile(
+    "fuse",
+    llvm::cl::desc("Write each function with every pair of adjacent loops "
+                   "which can legally be fused fused, and why others were "
+                   "not, to the given file ('-' for standard output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<std::string> DistributeFile(
+    "distribute",
+    llvm::cl::desc("Write each function with its loops distributed wherever "
+                   "that is legal, and why others were not, to the given "
+                   "file ('-' for standard output)"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<bool> Parallelize(
+    "parallelize",
+    llvm::cl::desc("Annotate loops which carry no dependences with OpenMP "
+                   "parallel-for pragmas, writing each rewritten file next "
+                   "to its input (a.c becomes a.omp.c) and reporting why "
+                   "other loops were not annotated"));
+
 namespace spf_ie {
 
-const ASTContext *Context;
+//! Cache of built Computations, if enabled
+static std::unique_ptr<ComputationCache> Cache;
+
+//! Output stream for emitted JSON, if enabled
+static std::unique_ptr<llvm::raw_fd_ostream> EmitJSONStream;
+//! Emitter of Computations as they are built, if enabled
+static std::unique_ptr<NDJSONEmitter> Emitter;
+
+//! Archive of built Computations, if enabled
+static std::unique_ptr<ArchiveWriter> Archive;
+
+/*!
+ * \class OutputFile
+ *
+ * \brief An output file which files processed concurrently share
+ */
+class OutputFile {
+   public:
+    explicit OutputFile(std::unique_ptr<llvm::raw_fd_ostream> stream)
+        : stream(std::move(stream)) {}
+
+    //! Write text to the file as one block, and flush it
+    void write(const std::string &text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        *stream << text;
+        stream->flush();
+    }
+
+   private:
+    std::unique_ptr<llvm::raw_fd_ostream> stream;
+    //! Guards stream
+    std::mutex mutex;
+};
+
+//! Open an output file, if it was asked for
+//! \param[in] path Path of the file ('-' for standard output), or empty if
+//! it was not asked for
+//! \param[in] description What the file holds, for the error message
+//! \param[out] file The file opened, left null if path is empty
+//! \return false if the file could not be opened, in which case an error
+//! has been printed
+static bool openOutputFile(const std::string &path,
+                           const std::string &description,
+                           std::unique_ptr<OutputFile> &file) {
+    if (path.empty()) {
+        return true;
+    }
+    std::error_code EC;
+    auto stream = std::make_unique<llvm::raw_fd_ostream>(
+        path, EC, llvm::sys::fs::OF_None);
+    if (EC) {
+        llvm::errs() << "Could not write " << description << " to " << path
+                     << ": " << EC.message() << "\n";
+        return false;
+    }
+    file = std::make_unique<OutputFile>(std::move(stream));
+    return true;
+}
+
+//! Output file for dependence graphs, if enabled
+static std::unique_ptr<OutputFile> DependencesOutput;
+//! Output file for generated code, if enabled
+static std::unique_ptr<OutputFile> EmitCOutput;
+//! Output file for level-set inspectors and executors, if enabled
+static std::unique_ptr<OutputFile> LevelSetsOutput;
+//! Output file for sparse format conversions, if enabled
+static std::unique_ptr<OutputFile> SparseFormatOutput;
+//! Output file for reorderings, if enabled
+static std::unique_ptr<OutputFile> ReorderOutput;
+//! Output file for tiled functions, if enabled
+static std::unique_ptr<OutputFile> TileOutput;
+//! Output file for functions with loops fused, if enabled
+static std::unique_ptr<OutputFile> FuseOutput;
+//! Output file for functions with loops distributed, if enabled
+static std::unique_ptr<OutputFile> DistributeOutput;
+
+//! Callback receiving the results of a processed translation unit
+using TUResultHandler = std::function<void(TUResult)>;
+
+//! Free the results of processing a translation unit, whose Computations
+//! other files may be building IEGenLib objects alongside
+static void releaseTUResult(TUResult &result) {
+    std::lock_guard<std::mutex> lock(SPFComputationBuilder::getIEGenLibMutex());
+    result = TUResult();
+}
+
+//! Output the results of processing a translation unit
+static void reportTUResult(const TUResult &result) {
+    llvm::errs() << "\nProcessing: " << result.fileName << "\n";
+    llvm::outs() << result.parallelizationReport;
+    if (PrintOutputToConsole) {
+        llvm::errs() << "=================================================\n\n";
+        // other files may still be building Computations
+        std::lock_guard<std::mutex> lock(
+            SPFComputationBuilder::getIEGenLibMutex());
+        for (const auto &it : result.computations) {
+            llvm::outs() << "FUNCTION: " << it.first << "\n";
+            Utils::printSmallLine();
+            llvm::outs() << "\n";
+            // printInfo writes to std::cout, so keep the streams in order
+            llvm::outs().flush();
+            it.second->printInfo();
+        }
+    }
+}
 
 class SPFConsumer : public ASTConsumer {
    public:
-    explicit SPFConsumer(llvm::StringRef fileName) : fileName(fileName.str()) {}
-    virtual void HandleTranslationUnit(ASTContext &Ctx) {
-        // initializing globally-accessible ASTContext
-        Context = &Ctx;
-        llvm::errs() << "\nProcessing: " << fileName << "\n";
-        if (PrintOutputToConsole) {
-            llvm::errs()
-                << "=================================================\n\n";
-        }
-        SPFComputationBuilder builder;
-        // process each function (with a body) in the file
-        bool builtAComputation = false;
-        for (auto it : Context->getTranslationUnitDecl()->decls()) {
+    SPFConsumer(llvm::StringRef fileName, TUResultHandler onComplete)
+        : fileName(fileName.str()), onComplete(onComplete) {}
+    virtual void HandleTranslationUnit(ASTContext &Context) {
+        llvm::TimeTraceScope tuScope("BuildTranslationUnit", fileName);
+        // gather each function (with a body) in the file
+        std::vector<FunctionDecl *> funcs;
+        for (auto it : Context.getTranslationUnitDecl()->decls()) {
             FunctionDecl *func = dyn_cast<FunctionDecl>(it);
             if (func && func->doesThisDeclarationHaveABody()) {
-                if (PrintOutputToConsole) {
-                    llvm::outs()
-                        << "FUNCTION: " << func->getQualifiedNameAsString()
-                        << "\n";
-                    Utils::printSmallLine();
-                    llvm::outs() << "\n";
-                }
-                std::unique_ptr<iegenlib::Computation> computation =
-                    builder.buildComputationFromFunction(func);
-                builtAComputation = true;
-                if (PrintOutputToConsole) {
-                    computation->printInfo();
-                }
+                funcs.push_back(func);
             }
         }
-        if (!builtAComputation) {
-            llvm::errs() << "No valid functions found for processing!\n";
-            exit(1);
+        TUResult result;
+        result.fileName = fileName;
+        if (funcs.empty()) {
+            llvm::errs() << "No valid functions found for processing in "
+                         << fileName << "!\n";
+            result.status = 1;
+            onComplete(std::move(result));
+            return;
+        }
+
+        unsigned int numWorkers = NumFunctionJobs;
+        if (numWorkers == 0) {
+            numWorkers = std::max(1u, std::thread::hardware_concurrency());
         }
+        // Computations are only kept until the end of the file if they will
+        // be printed; otherwise each is freed as soon as every output of its
+        // function has been written
+        std::unique_ptr<Parallelizer> parallelizer;
+        if (Parallelize) {
+            parallelizer = std::make_unique<Parallelizer>(&Context);
+        }
+        // with exiting deferred, an invalid function only fails this file
+        try {
+            SPFComputationBuilder::buildComputationsFromFunctions(
+                &Context, funcs, numWorkers, Cache.get(), Archive.get(),
+                [&](size_t index,
+                    std::unique_ptr<iegenlib::Computation> computation,
+                    const std::vector<StmtSpec> *stmtSpecs) {
+                    std::string name = funcs[index]->getQualifiedNameAsString();
+                    if (Emitter) {
+                        Emitter->emit(fileName, name, computation.get());
+                    }
+                    if (DependencesOutput) {
+                        writeDependences(name, stmtSpecs);
+                    }
+                    if (EmitCOutput) {
+                        writeGeneratedCode(funcs[index], Context, stmtSpecs);
+                    }
+                    if (LevelSetsOutput) {
+                        writeLevelSets(funcs[index], Context, stmtSpecs);
+                    }
+                    if (SparseFormatOutput) {
+                        writeFormatConversion(funcs[index], Context, stmtSpecs);
+                    }
+                    if (ReorderOutput) {
+                        writeReordering(funcs[index], Context, stmtSpecs);
+                    }
+                    if (TileOutput) {
+                        writeTiling(funcs[index], Context, stmtSpecs);
+                    }
+                    if (FuseOutput) {
+                        writeRestructured(funcs[index], Context, stmtSpecs,
+                                          true);
+                    }
+                    if (DistributeOutput) {
+                        writeRestructured(funcs[index], Context, stmtSpecs,
+                                          false);
+                    }
+                    if (parallelizer) {
+                        parallelizer->addFunction(funcs[index], stmtSpecs);
+                    }
+                    if (PrintOutputToConsole) {
+                        result.computations.emplace_back(
+                            name, std::move(computation));
+                    } else {
+                        // other functions may be building Computations
+                        std::lock_guard<std::mutex> lock(
+                            SPFComputationBuilder::getIEGenLibMutex());
+                        computation.reset();
+                    }
+                },
+                DependencesOutput != nullptr || EmitCOutput != nullptr ||
+                    LevelSetsOutput != nullptr ||
+                    SparseFormatOutput != nullptr || ReorderOutput != nullptr ||
+                    TileOutput != nullptr || FuseOutput != nullptr ||
+                    DistributeOutput != nullptr || Parallelize);
+        } catch (const BuildError &) {
+            result.status = 1;
+        }
+        if (parallelizer && result.status == 0) {
+            writeParallelized(*parallelizer, result);
+        }
+        onComplete(std::move(result));
     }
 
    private:
     std::string fileName;
+    TUResultHandler onComplete;
+
+    //! Analyze and output the dependences of a function
+    //! \param[in] name Qualified name of the function
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    void writeDependences(const std::string &name,
+                          const std::vector<StmtSpec> *stmtSpecs) {
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("analyzing dependences of", name);
+            return;
+        }
+        DependenceGraph graph(*stmtSpecs);
+        std::string dot;
+        llvm::raw_string_ostream os(dot);
+        graph.writeDot(os, fileName + ":" + name);
+        DependencesOutput->write(os.str());
+    }
+
+    //! Generate and output the code of a function
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    void writeGeneratedCode(FunctionDecl *funcDecl, const ASTContext &Context,
+                            const std::vector<StmtSpec> *stmtSpecs) {
+        const std::string name = funcDecl->getQualifiedNameAsString();
+        std::string code;
+        llvm::raw_string_ostream os(code);
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("generating code for", name);
+            return;
+        }
+        if (!CodeGenerator(*stmtSpecs).writeFunction(
+                os, CodeGenerator::getPrototype(funcDecl, &Context))) {
+            llvm::errs() << "Warning: could not generate code for function '"
+                         << name << "' from its iteration spaces\n";
+            return;
+        }
+        EmitCOutput->write(os.str() + "\n");
+    }
+
+    //! Generate and output a level-set inspector and executor for a
+    //! function, or why none could be generated
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    void writeLevelSets(FunctionDecl *funcDecl, const ASTContext &Context,
+                        const std::vector<StmtSpec> *stmtSpecs) {
+        const std::string name = funcDecl->getNameAsString();
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("generating level sets for", name);
+            return;
+        }
+        DependenceGraph graph(*stmtSpecs);
+        PrivatizationAnalysis analysis(*stmtSpecs, graph);
+        LevelSetGenerator generator(*stmtSpecs, analysis);
+        std::string code;
+        llvm::raw_string_ostream os(code);
+        std::string reason;
+        if (!generator.findLoop(reason)) {
+            os << "/* " << name << ": no loop can be run by level: " << reason
+               << " */\n";
+        } else if (!generator.writeFunctions(
+                       os, name, funcDecl->getReturnType().getAsString(),
+                       CodeGenerator::getParameters(funcDecl, &Context))) {
+            llvm::errs() << "Warning: could not generate level sets for "
+                            "function '"
+                         << name << "' from its iteration spaces\n";
+            return;
+        }
+        LevelSetsOutput->write(os.str() + "\n");
+    }
+
+    //! Generate and output sparse format conversion inspectors and an
+    //! executor for a function, or why none could be generated
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    void writeFormatConversion(FunctionDecl *funcDecl,
+                               const ASTContext &Context,
+                               const std::vector<StmtSpec> *stmtSpecs) {
+        const std::string name = funcDecl->getNameAsString();
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("converting the format of", name);
+            return;
+        }
+        FormatConverter converter(*stmtSpecs, SparseFormatOpt, BlockSize);
+        std::string code;
+        llvm::raw_string_ostream os(code);
+        std::string reason;
+        if (!converter.findLoop(reason)) {
+            os << "/* " << name << ": no CSR traversal can be converted to "
+               << FormatConverter::getFormatName(SparseFormatOpt) << ": "
+               << reason << " */\n";
+        } else if (!converter.writeFunctions(
+                       os, name, funcDecl->getReturnType().getAsString(),
+                       CodeGenerator::getParameters(funcDecl, &Context),
+                       CodeGenerator::getElementTypes(funcDecl))) {
+            llvm::errs() << "Warning: could not generate a format conversion "
+                            "for function '"
+                         << name << "' from its iteration spaces\n";
+            return;
+        }
+        SparseFormatOutput->write(os.str() + "\n");
+    }
+
+    //! Generate and output a reordering inspector and executor for a
+    //! function, or why none could be generated
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    void writeReordering(FunctionDecl *funcDecl, const ASTContext &Context,
+                         const std::vector<StmtSpec> *stmtSpecs) {
+        const std::string name = funcDecl->getNameAsString();
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("reordering", name);
+            return;
+        }
+        DependenceGraph graph(*stmtSpecs);
+        PrivatizationAnalysis analysis(*stmtSpecs, graph);
+        DataReorderer reorderer(*stmtSpecs, analysis);
+        std::string code;
+        llvm::raw_string_ostream os(code);
+        std::string reason;
+        if (!reorderer.findLoop(reason)) {
+            os << "/* " << name << ": no loop can be reordered: " << reason
+               << " */\n";
+        } else if (!reorderer.writeFunctions(
+                       os, name, funcDecl->getReturnType().getAsString(),
+                       CodeGenerator::getParameters(funcDecl, &Context),
+                       CodeGenerator::getElementTypes(funcDecl))) {
+            llvm::errs() << "Warning: could not generate a reordering for "
+                            "function '"
+                         << name << "' from its iteration spaces\n";
+            return;
+        }
+        ReorderOutput->write(os.str() + "\n");
+    }
+
+    //! Generate and output a function with a loop nest tiled, or why none
+    //! could be
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    void writeTiling(FunctionDecl *funcDecl, const ASTContext &Context,
+                     const std::vector<StmtSpec> *stmtSpecs) {
+        const std::string name = funcDecl->getNameAsString();
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("tiling", name);
+            return;
+        }
+        DependenceGraph graph(*stmtSpecs);
+        std::vector<int> sizes(TileSizes.begin(), TileSizes.end());
+        if (sizes.empty()) {
+            sizes = {32, 32};
+        }
+        LoopTiler tiler(*stmtSpecs, graph, sizes, TileLoop);
+        std::string code;
+        llvm::raw_string_ostream os(code);
+        std::string reason;
+        if (!tiler.findLoop(reason)) {
+            os << "/* " << name << ": no loop nest can be tiled: " << reason
+               << " */\n";
+        } else if (!tiler.writeFunction(
+                       os, name, funcDecl->getReturnType().getAsString(),
+                       CodeGenerator::getParameters(funcDecl, &Context))) {
+            llvm::errs() << "Warning: could not generate a tiling of "
+                            "function '"
+                         << name << "' from its iteration spaces\n";
+            return;
+        }
+        TileOutput->write(os.str() + "\n");
+    }
+
+    //! Generate and output a function with its loops fused or distributed,
+    //! and why any loops were not
+    //! \param[in] funcDecl The function
+    //! \param[in] Context ASTContext the function belongs to
+    //! \param[in] stmtSpecs Specs of the function's statements, if they
+    //! could all be described
+    //! \param[in] fuse Whether to fuse loops, rather than distribute them
+    void writeRestructured(FunctionDecl *funcDecl, const ASTContext &Context,
+                           const std::vector<StmtSpec> *stmtSpecs,
+                           bool fuse) {
+        const std::string name = funcDecl->getNameAsString();
+        const std::string verb = fuse ? "fuse" : "distribute";
+        if (!stmtSpecs) {
+            Utils::warnNotDescribed("trying to " + verb + " loops of", name);
+            return;
+        }
+        LoopRestructurer restructurer(*stmtSpecs);
+        std::vector<std::string> notes;
+        const unsigned int numChanged = fuse
+                                            ? restructurer.fuseAll(notes)
+                                            : restructurer.distributeAll(notes);
+        std::string code;
+        llvm::raw_string_ostream os(code);
+        for (const auto &it : notes) {
+            os << "/* " << name << ": " << it << " */\n";
+        }
+        const std::string prototype =
+            funcDecl->getReturnType().getAsString() + " " + name +
+            (fuse ? "_fused(" : "_distributed(") +
+            CodeGenerator::getParameters(funcDecl, &Context) + ")";
+        if (numChanged == 0) {
+            if (notes.empty()) {
+                os << "/* " << name << ": "
+                   << (fuse ? "no loops are adjacent"
+                            : "no loop has several children")
+                   << " */\n";
+            }
+        } else if (!CodeGenerator(restructurer.getStmts())
+                        .writeFunction(os, prototype)) {
+            llvm::errs() << "Warning: could not generate function '" << name
+                         << "' with its loops " << verb
+                         << "d from its iteration spaces\n";
+            return;
+        }
+        (fuse ? FuseOutput : DistributeOutput)->write(os.str() + "\n");
+    }
+
+    //! Write the rewritten file and record the report of a parallelizer
+    //! \param[in] parallelizer Parallelizer every function was added to
+    //! \param[out] result Result to record the report, or failure, in
+    void writeParallelized(const Parallelizer &parallelizer,
+                           TUResult &result) {
+        const std::string outputPath = Parallelizer::getOutputPath(fileName);
+        std::error_code EC;
+        llvm::raw_fd_ostream os(outputPath, EC, llvm::sys::fs::OF_None);
+        if (EC) {
+            llvm::errs() << "Could not write parallelized source to "
+                         << outputPath << ": " << EC.message() << "\n";
+            result.status = 1;
+            return;
+        }
+        parallelizer.writeRewrittenFile(os);
+        llvm::raw_string_ostream report(result.parallelizationReport);
+        parallelizer.writeReport(report);
+        report << "Wrote " << outputPath << "\n";
+    }
 };
 
 class SPFFrontendAction : public ASTFrontendAction {
    public:
+    explicit SPFFrontendAction(TUResultHandler onComplete)
+        : onComplete(onComplete) {}
     virtual std::unique_ptr<ASTConsumer> CreateASTConsumer(
         CompilerInstance &Compiler, llvm::StringRef InFile) {
-        return std::unique_ptr<ASTConsumer>(new SPFConsumer(InFile));
+        return std::unique_ptr<ASTConsumer>(
+            new SPFConsumer(InFile, onComplete));
     }
+
+   private:
+    TUResultHandler onComplete;
 };
 
+class SPFFrontendActionFactory : public FrontendActionFactory {
+   public:
+    explicit SPFFrontendActionFactory(TUResultHandler onComplete)
+        : onComplete(onComplete) {}
+    std::unique_ptr<FrontendAction> create() override {
+        return std::make_unique<SPFFrontendAction>(onComplete);
+    }
+
+   private:
+    TUResultHandler onComplete;
+};
+
+//! Process each source file with its own ClangTool on a pool of worker
+//! threads. Workers repeatedly claim the largest remaining file; results are
+//! reported in the order the files were given, as soon as all files before
+//! them are done.
+//! \param[in] compilations Compilation database for the sources
+//! \param[in] sourcePaths Source files to process
+//! \param[in] numJobs Number of worker threads to use
+//! \return 0 if every file was processed successfully, nonzero otherwise
+static int runParallel(const CompilationDatabase &compilations,
+                       const std::vector<std::string> &sourcePaths,
+                       unsigned int numJobs) {
+    const size_t numFiles = sourcePaths.size();
+
+    // schedule the largest files first, so that a large file started late
+    // does not hold up the whole batch
+    std::vector<uint64_t> fileSizes(numFiles, 0);
+    for (size_t i = 0; i < numFiles; ++i) {
+        llvm::sys::fs::file_size(sourcePaths[i], fileSizes[i]);
+    }
+    std::vector<size_t> schedule(numFiles);
+    std::iota(schedule.begin(), schedule.end(), 0);
+    std::stable_sort(schedule.begin(), schedule.end(),
+                     [&fileSizes](size_t a, size_t b) {
+                         return fileSizes[a] > fileSizes[b];
+                     });
+
+    std::vector<TUResult> results(numFiles);
+    std::vector<int> statuses(numFiles, 0);
+    std::vector<bool> finished(numFiles, false);
+    std::mutex finishedMutex;
+    std::condition_variable finishedCond;
+    std::atomic<size_t> nextScheduled(0);
+
+    auto worker = [&]() {
+        TimeTrace::ThreadScope traceThread;
+        // an invalid file fails on its own, rather than ending the process
+        // while other files are being processed or waiting to be reported
+        Utils::ExitDeferral deferral;
+        for (size_t i = nextScheduled++; i < numFiles; i = nextScheduled++) {
+            const size_t fileIndex = schedule[i];
+            llvm::TimeTraceScope fileScope("ProcessFile",
+                                           sourcePaths[fileIndex]);
+            // ClangTool changes the working directory of its file system to
+            // each command's; with the real file system that is the
+            // process's, which the other workers share
+            ClangTool tool(compilations, {sourcePaths[fileIndex]},
+                           std::make_shared<PCHContainerOperations>(),
+                           llvm::vfs::createPhysicalFileSystem().release());
+            SPFFrontendActionFactory factory(
+                [&results, fileIndex](TUResult result) {
+                    results[fileIndex] = std::move(result);
+                });
+            int status = tool.run(&factory);
+            {
+                std::lock_guard<std::mutex> lock(finishedMutex);
+                statuses[fileIndex] = status;
+                finished[fileIndex] = true;
+            }
+            finishedCond.notify_one();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < std::min<size_t>(numJobs, numFiles); ++i) {
+        workers.emplace_back(worker);
+    }
+
+    // report in input order, freeing each result once it has been output
+    int overallStatus = 0;
+    for (size_t i = 0; i < numFiles; ++i) {
+        {
+            std::unique_lock<std::mutex> lock(finishedMutex);
+            finishedCond.wait(lock, [&finished, i]() { return finished[i]; });
+        }
+        if (!results[i].fileName.empty()) {
+            reportTUResult(results[i]);
+        }
+        if (statuses[i] != 0) {
+            overallStatus = statuses[i];
+        } else if (results[i].status != 0) {
+            overallStatus = results[i].status;
+        }
+        releaseTUResult(results[i]);
+    }
+    for (auto &it : workers) {
+        it.join();
+    }
+    return overallStatus;
+}
+
 }  // namespace spf_ie
 
 using namespace spf_ie;
@@ -95,9 +805,162 @@ static llvm::cl::OptionCategory SPFToolCategory("spf-ie options");
 //! Instantiate and run the Clang tool
 int main(int argc, const char **argv) {
     PrintOutputToConsole.addCategory(SPFToolCategory);
-    CommonOptionsParser OptionsParser(argc, argv, SPFToolCategory);
-    ClangTool Tool(OptionsParser.getCompilations(),
-                   OptionsParser.getSourcePathList());
+    NumJobs.addCategory(SPFToolCategory);
+    NumFunctionJobs.addCategory(SPFToolCategory);
+    TimeTraceFile.addCategory(SPFToolCategory);
+    TimeTraceGranularity.addCategory(SPFToolCategory);
+    PrintStats.addCategory(SPFToolCategory);
+    StatsFile.addCategory(SPFToolCategory);
+    CacheDir.addCategory(SPFToolCategory);
+    Serve.addCategory(SPFToolCategory);
+    EmitJSONFile.addCategory(SPFToolCategory);
+    ArchiveFile.addCategory(SPFToolCategory);
+    DependencesFile.addCategory(SPFToolCategory);
+    EmitCFile.addCategory(SPFToolCategory);
+    LevelSetsFile.addCategory(SPFToolCategory);
+    SparseFormatFile.addCategory(SPFToolCategory);
+    SparseFormatOpt.addCategory(SPFToolCategory);
+    BlockSize.addCategory(SPFToolCategory);
+    ReorderFile.addCategory(SPFToolCategory);
+    TileFile.addCategory(SPFToolCategory);
+    TileSizes.addCategory(SPFToolCategory);
+    TileLoop.addCategory(SPFToolCategory);
+    FuseFile.addCategory(SPFToolCategory);
+    DistributeFile.addCategory(SPFToolCategory);
+    Parallelize.addCategory(SPFToolCategory);
+    // source files are only optional when serving
+    CommonOptionsParser OptionsParser(argc, argv, SPFToolCategory,
+                                      llvm::cl::ZeroOrMore);
+    if (!Serve && OptionsParser.getSourcePathList().empty()) {
+        llvm::errs() << "No source files given!\n";
+        return 1;
+    }
+
+    if (PrintStats || !StatsFile.empty()) {
+        Stats::enable();
+    }
+
+    if (!CacheDir.empty()) {
+        Cache = std::make_unique<ComputationCache>(CacheDir);
+    }
+
+    if (!EmitJSONFile.empty()) {
+        std::error_code EC;
+        EmitJSONStream = std::make_unique<llvm::raw_fd_ostream>(
+            EmitJSONFile, EC, llvm::sys::fs::OF_None);
+        if (EC) {
+            llvm::errs() << "Could not write JSON to " << EmitJSONFile << ": "
+                         << EC.message() << "\n";
+            return 1;
+        }
+        Emitter = std::make_unique<NDJSONEmitter>(*EmitJSONStream);
+    }
+
+    if (!ArchiveFile.empty()) {
+        Archive = std::make_unique<ArchiveWriter>();
+    }
+
+    if (!SparseFormatFile.empty() && BlockSize == 0) {
+        llvm::errs() << "Block size must be positive\n";
+        return 1;
+    }
+    if (!TileFile.empty() &&
+        std::count(TileSizes.begin(), TileSizes.end(), 0u) != 0) {
+        llvm::errs() << "Tile sizes must be positive\n";
+        return 1;
+    }
+    if (!openOutputFile(DependencesFile, "dependences", DependencesOutput) ||
+        !openOutputFile(EmitCFile, "generated code", EmitCOutput) ||
+        !openOutputFile(LevelSetsFile, "level sets", LevelSetsOutput) ||
+        !openOutputFile(SparseFormatFile, "format conversions",
+                        SparseFormatOutput) ||
+        !openOutputFile(ReorderFile, "reorderings", ReorderOutput) ||
+        !openOutputFile(TileFile, "tilings", TileOutput) ||
+        !openOutputFile(FuseFile, "fused loops", FuseOutput) ||
+        !openOutputFile(DistributeFile, "distributed loops",
+                        DistributeOutput)) {
+        return 1;
+    }
+    if (LevelSetsOutput) {
+        LevelSetsOutput->write("#include <stdlib.h>\n\n");
+    }
+    if (SparseFormatOutput) {
+        SparseFormatOutput->write("#include <stdlib.h>\n\n");
+    }
 
-    return Tool.run(newFrontendActionFactory<SPFFrontendAction>().get());
+    if (!TimeTraceFile.empty()) {
+        TimeTrace::enable(TimeTraceGranularity, argv[0]);
+    }
+
+    unsigned int numJobs = NumJobs;
+    if (numJobs == 0) {
+        numJobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    int status;
+    if (Serve) {
+        unsigned int numFunctionJobs = NumFunctionJobs;
+        if (numFunctionJobs == 0) {
+            numFunctionJobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        // any address in this executable lets Clang find its resources
+        static int mainAddrMarker;
+        Server server(OptionsParser.getCompilations(),
+                      CompilerInvocation::GetResourcesPath(
+                          argv[0], static_cast<void *>(&mainAddrMarker)),
+                      numFunctionJobs, Cache.get());
+        server.serve(std::cin, llvm::outs());
+        status = 0;
+    } else if (numJobs > 1) {
+        status = runParallel(OptionsParser.getCompilations(),
+                             OptionsParser.getSourcePathList(), numJobs);
+    } else {
+        ClangTool Tool(OptionsParser.getCompilations(),
+                       OptionsParser.getSourcePathList());
+        int resultStatus = 0;
+        SPFFrontendActionFactory factory([&resultStatus](TUResult result) {
+            reportTUResult(result);
+            if (result.status != 0) {
+                resultStatus = result.status;
+            }
+            releaseTUResult(result);
+        });
+        status = Tool.run(&factory);
+        if (status == 0) {
+            status = resultStatus;
+        }
+    }
+
+    if (Archive) {
+        std::error_code EC;
+        llvm::raw_fd_ostream archiveOut(ArchiveFile, EC,
+                                        llvm::sys::fs::OF_None);
+        if (EC) {
+            llvm::errs() << "Could not write archive to " << ArchiveFile
+                         << ": " << EC.message() << "\n";
+            return 1;
+        }
+        Archive->write(archiveOut);
+    }
+
+    if (Stats::isEnabled()) {
+        if (StatsFile.empty()) {
+            Stats::writeJSON(llvm::errs());
+        } else {
+            std::error_code EC;
+            llvm::raw_fd_ostream statsOut(StatsFile, EC,
+                                          llvm::sys::fs::OF_None);
+            if (EC) {
+                llvm::errs() << "Could not write statistics to " << StatsFile
+                             << ": " << EC.message() << "\n";
+                return 1;
+            }
+            Stats::writeJSON(statsOut);
+        }
+    }
+    if (TimeTrace::isEnabled() && !TimeTrace::writeAndDisable(TimeTraceFile)) {
+        llvm::errs() << "Could not write time trace to " << TimeTraceFile
+                     << "\n";
+        return 1;
+    }
+    return status;
 }
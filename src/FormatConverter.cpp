@@ -0,0 +1,953 @@
+#include "FormatConverter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.hpp"
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Make an expression of terms
+static SpecExp makeExp(std::vector<SpecTerm> terms) {
+    SpecExp exp;
+    exp.terms = std::move(terms);
+    return exp;
+}
+
+//! Add a name to a list, unless it is already in it
+static void addUnique(std::vector<std::string>& list,
+                      const std::string& name) {
+    if (std::find(list.begin(), list.end(), name) == list.end()) {
+        list.push_back(name);
+    }
+}
+
+//! Write a line of code
+static void writeLine(llvm::raw_ostream& os, int indent,
+                      const std::string& line) {
+    os.indent(4 * indent) << line << "\n";
+}
+
+//! Get whether a statement adds a product into its left-hand side with +=
+//! or -=, one of whose factors is an element of one of the given arrays at
+//! an iterator, so that it contributes nothing when that element is zero
+//! \param[in] source Source code of the statement
+//! \param[in] arrays Arrays the factor may be from
+//! \param[in] iterator Iterator the factor must be at
+static bool isProductWith(const std::string& source,
+                          const std::vector<std::string>& arrays,
+                          const std::string& iterator) {
+    int depth = 0;
+    size_t rhsBegin = std::string::npos;
+    for (size_t pos = 0; pos + 1 < source.size(); ++pos) {
+        const char c = source[pos];
+        if (c == '[' || c == '(') {
+            ++depth;
+        } else if (c == ']' || c == ')') {
+            --depth;
+        } else if (depth == 0 && (c == '+' || c == '-') &&
+                   source[pos + 1] == '=') {
+            rhsBegin = pos + 2;
+            break;
+        }
+    }
+    if (rhsBegin == std::string::npos) {
+        return false;
+    }
+
+    // split the right-hand side into factors at the *s outside brackets,
+    // failing on any other operator there
+    std::vector<std::string> factors(1);
+    depth = 0;
+    for (size_t pos = rhsBegin; pos < source.size(); ++pos) {
+        const char c = source[pos];
+        if (c == '[' || c == '(') {
+            ++depth;
+        } else if (c == ']' || c == ')') {
+            --depth;
+        } else if (depth == 0 && c == '*') {
+            factors.emplace_back();
+            continue;
+        } else if (depth == 0 && c != ';' && c != '_' && c != '.' &&
+                   !std::isalnum(c) && !std::isspace(c)) {
+            return false;
+        }
+        if (!std::isspace(c) && c != ';') {
+            factors.back() += c;
+        }
+    }
+    return std::any_of(
+        factors.begin(), factors.end(), [&](const std::string& factor) {
+            return std::any_of(arrays.begin(), arrays.end(),
+                               [&](const std::string& array) {
+                                   return factor ==
+                                          array + "[" + iterator + "]";
+                               });
+        });
+}
+
+/* FormatConverter */
+
+bool FormatConverter::findLoop(std::string& reason) {
+    return Utils::findOutermostLoop(
+        stmts,
+        [this](const std::vector<unsigned int>& loopStmts,
+               std::string& loopReason) {
+            return checkLoop(loopStmts, loopReason);
+        },
+        reason);
+}
+
+bool FormatConverter::checkLoop(const std::vector<unsigned int>& loop,
+                                std::string& reason) {
+    const std::string formatName = getFormatName(format);
+    std::vector<unsigned int> entries;
+    int entryLoopPosition = 0;
+    std::vector<const StmtSpec*> loopSpecs;
+    std::vector<const StmtSpec*> entrySpecs;
+    for (const auto& stmt : loop) {
+        const StmtSpec& spec = stmts[stmt];
+        loopSpecs.push_back(&spec);
+        const size_t depth = spec.iterSpace.tuple.size();
+        if (depth > 2) {
+            reason = "it has loops nested more than two deep";
+            return false;
+        }
+        if (depth == 1) {
+            if (format != SparseFormat::ELL) {
+                reason = "it has statements outside its inner loop, which " +
+                         formatName + " cannot keep with their rows";
+                return false;
+            }
+            continue;
+        }
+        ExecSchedule schedule;
+        spec.getSchedule(schedule);
+        if (!entries.empty() &&
+            schedule.scheduleTuple[2].value != entryLoopPosition) {
+            reason = "it has more than one inner loop";
+            return false;
+        }
+        entryLoopPosition = schedule.scheduleTuple[2].value;
+        entries.push_back(stmt);
+        entrySpecs.push_back(&spec);
+    }
+    if (entries.empty()) {
+        reason = "it has no inner loop";
+        return false;
+    }
+
+    SpecExp rowLower;
+    SpecExp rowUpper;
+    SpecExp entryLower;
+    SpecExp entryUpper;
+    if (!CodeGenerator::getLoopBounds(loopSpecs, 0, rowLower, rowUpper) ||
+        !CodeGenerator::getLoopBounds(entrySpecs, 1, entryLower,
+                                      entryUpper)) {
+        reason = "its bounds could not be found";
+        return false;
+    }
+    std::string lowerPointers;
+    std::string upperPointers;
+    if (!CodeGenerator::getBoundValue(entryLower, 1)
+             .isCallAt(0, 0, lowerPointers) ||
+        !CodeGenerator::getBoundValue(entryUpper, 1)
+             .isCallAt(0, 1, upperPointers) ||
+        lowerPointers != upperPointers) {
+        reason = "its inner loop does not run from ptr[i] to ptr[i + 1] for "
+                 "an array ptr";
+        return false;
+    }
+    const std::vector<SpecExp> bounds = {rowLower, rowUpper, entryLower,
+                                         entryUpper};
+
+    std::string column;
+    std::vector<std::string> matrixArrays;
+    for (const auto& stmt : entries) {
+        const StmtSpec& spec = stmts[stmt];
+        const std::string quoted = "'" + spec.sourceCode + "'";
+        if (!spec.iterSpace.equalities.empty() ||
+            std::any_of(spec.iterSpace.inequalities.begin(),
+                        spec.iterSpace.inequalities.end(),
+                        [&](const SpecExp& it) {
+                            return std::find(bounds.begin(), bounds.end(),
+                                             it) == bounds.end();
+                        })) {
+            reason = "its inner loop has conditions other than its bounds";
+            return false;
+        }
+        if (spec.reduction != ReductionOp::Sum) {
+            reason = quoted + " is not a sum reduction";
+            return false;
+        }
+        std::vector<SpecExp> indexes;
+        for (const auto& it : spec.dataWrites) {
+            if (!it.second.getOutputExps(indexes) ||
+                std::any_of(indexes.begin(), indexes.end(),
+                            [](const SpecExp& index) {
+                                return index.usesTupleVarAfter(0);
+                            })) {
+                reason = quoted + " writes an element chosen by the entry";
+                return false;
+            }
+        }
+        for (const auto& it : spec.dataReads) {
+            if (!it.second.getOutputExps(indexes)) {
+                reason = "the index of a read of '" + it.first +
+                         "' could not be found";
+                return false;
+            }
+            for (const auto& index : indexes) {
+                std::string function;
+                if (index.isTupleVar(1) && indexes.size() == 1) {
+                    addUnique(matrixArrays, it.first);
+                } else if (index.isCallAt(1, 0, function) &&
+                           (column.empty() || column == function)) {
+                    column = function;
+                } else if (index.usesTupleVarAfter(0)) {
+                    reason = "'" + it.first +
+                             "' is read at an index computed from the entry "
+                             "other than as its column";
+                    return false;
+                }
+            }
+        }
+    }
+    if (column.empty()) {
+        reason = "its inner loop reads no column indexes";
+        return false;
+    }
+    std::vector<std::string> values;
+    for (const auto& it : matrixArrays) {
+        if (it != column) {
+            values.push_back(it);
+        }
+    }
+    // the zeros ELL and BCSR store must contribute nothing
+    if (format != SparseFormat::CSC) {
+        for (const auto& stmt : entries) {
+            const StmtSpec& spec = stmts[stmt];
+            if (!isProductWith(spec.sourceCode, values,
+                               spec.iterSpace.tuple[1].var)) {
+                reason = "'" + spec.sourceCode +
+                         "' does not add a product with the matrix's values, "
+                         "so the zeros " +
+                         formatName + " stores would change its result";
+                return false;
+            }
+        }
+    }
+    // the matrix may not change during the traversal
+    for (const auto& stmt : loop) {
+        for (const auto& it : stmts[stmt].dataWrites) {
+            if (it.first == lowerPointers ||
+                std::find(matrixArrays.begin(), matrixArrays.end(),
+                          it.first) != matrixArrays.end()) {
+                reason = "it writes '" + it.first +
+                         "', which holds the matrix";
+                return false;
+            }
+        }
+    }
+
+    loopStmts = loop;
+    entryStmts = entries;
+    rowPointers = lowerPointers;
+    columnIndexes = column;
+    valueArrays = values;
+    rowLowerBound = rowLower;
+    rowUpperBound = rowUpper;
+    entryLowerBound = entryLower;
+    entryUpperBound = entryUpper;
+
+    const Names names = makeNames(CodeGenerator::getUsedCode(stmts, ""));
+    for (const auto& stmt : entries) {
+        std::string rewritten;
+        if (!rewriteSource(stmts[stmt].sourceCode, names, rewritten)) {
+            reason = "'" + stmts[stmt].sourceCode + "' uses '" +
+                     stmts[stmt].iterSpace.tuple[1].var +
+                     "' other than to index the matrix";
+            return false;
+        }
+    }
+    return true;
+}
+
+FormatConverter::Names FormatConverter::makeNames(
+    const std::string& usedCode) const {
+    const std::vector<TupleElem>& tuple =
+        stmts[entryStmts.front()].iterSpace.tuple;
+    const std::string suffix = std::string("_") + getFormatName(format);
+    std::vector<std::string> taken;
+    auto makeName = [&](const std::string& base) {
+        return Utils::makeUniqueName(base, usedCode, taken);
+    };
+    Names names;
+    switch (format) {
+        case SparseFormat::ELL:
+            names.size = makeName("ell_width");
+            names.columns = makeName(columnIndexes + suffix);
+            names.iterators = {tuple[0].var, tuple[1].var};
+            break;
+        case SparseFormat::BCSR:
+            names.size = makeName("num_cols");
+            names.blockRows = makeName("block_rows");
+            names.pointers = makeName(rowPointers + suffix);
+            names.indexes = makeName(columnIndexes + suffix);
+            names.iterators = {makeName("ib"), makeName("kb"), makeName("r"),
+                               makeName("c")};
+            names.locals = {makeName("block_of"), makeName("blocks"),
+                            makeName("bj")};
+            break;
+        case SparseFormat::CSC:
+            names.size = makeName("num_cols");
+            names.pointers = makeName(rowPointers + suffix);
+            names.indexes = makeName("row" + suffix);
+            names.iterators = {makeName("j"), tuple[1].var};
+            names.locals = {makeName("position")};
+            break;
+    }
+    for (const auto& it : valueArrays) {
+        names.values[it] = makeName(it + suffix);
+    }
+    return names;
+}
+
+SpecExp FormatConverter::getRowExp(const Names& names) const {
+    switch (format) {
+        case SparseFormat::ELL:
+            return makeExp({SpecTerm::makeTupleVar(0)});
+        case SparseFormat::BCSR: {
+            // the row's position in its block, after the rows of the blocks
+            // before it
+            SpecExp row;
+            for (const auto& it :
+                 CodeGenerator::getBoundValue(rowLowerBound, 0).terms) {
+                if (it.kind != SpecTerm::Kind::Const || it.coeff != 0) {
+                    row.terms.push_back(it);
+                }
+            }
+            row.terms.push_back(SpecTerm::makeTupleVar(0, blockSize));
+            row.terms.push_back(SpecTerm::makeTupleVar(2));
+            return row;
+        }
+        case SparseFormat::CSC:
+            return makeExp({SpecTerm::makeUFCall(
+                names.indexes, {makeExp({SpecTerm::makeTupleVar(1)})})});
+    }
+    return SpecExp();
+}
+
+SpecExp FormatConverter::getColumnExp(const Names& names) const {
+    switch (format) {
+        case SparseFormat::ELL:
+            return makeExp({SpecTerm::makeUFCall(
+                names.columns, {makeExp({SpecTerm::makeTupleVar(0)}),
+                                makeExp({SpecTerm::makeTupleVar(1)})})});
+        case SparseFormat::BCSR:
+            return makeExp(
+                {SpecTerm::makeUFCall(names.indexes,
+                                      {makeExp({SpecTerm::makeTupleVar(1)})},
+                                      blockSize),
+                 SpecTerm::makeTupleVar(3)});
+        case SparseFormat::CSC:
+            return makeExp({SpecTerm::makeTupleVar(0)});
+    }
+    return SpecExp();
+}
+
+std::vector<SpecExp> FormatConverter::getEntryIndexes() const {
+    switch (format) {
+        case SparseFormat::ELL:
+            return {makeExp({SpecTerm::makeTupleVar(0)}),
+                    makeExp({SpecTerm::makeTupleVar(1)})};
+        case SparseFormat::BCSR:
+            return {makeExp({SpecTerm::makeTupleVar(1)}),
+                    makeExp({SpecTerm::makeTupleVar(2)}),
+                    makeExp({SpecTerm::makeTupleVar(3)})};
+        case SparseFormat::CSC:
+            return {makeExp({SpecTerm::makeTupleVar(1)})};
+    }
+    return {};
+}
+
+SpecExp FormatConverter::rewriteExp(const SpecExp& exp,
+                                    const Names& names) const {
+    SpecExp rewritten;
+    for (const auto& term : exp.terms) {
+        SpecExp replacement;
+        std::string function;
+        if (term.kind == SpecTerm::Kind::TupleVar && term.tuplePos == 0) {
+            replacement = getRowExp(names);
+        } else if (makeExp({term}).isCallAt(1, 0, function) &&
+                   function == columnIndexes) {
+            replacement = getColumnExp(names);
+        } else {
+            SpecTerm copy = term;
+            for (auto& arg : copy.args) {
+                arg = rewriteExp(arg, names);
+            }
+            rewritten.terms.push_back(copy);
+            continue;
+        }
+        replacement.multiplyBy(term.coeff);
+        rewritten.add(replacement);
+    }
+    return rewritten;
+}
+
+bool FormatConverter::rewriteSource(const std::string& source,
+                                    const Names& names,
+                                    std::string& rewritten) const {
+    const std::vector<TupleElem>& tuple =
+        stmts[entryStmts.front()].iterSpace.tuple;
+    std::vector<TupleElem> newTuple;
+    for (const auto& it : names.iterators) {
+        newTuple.emplace_back(it);
+    }
+    std::string entryIndexes;
+    for (const auto& it : getEntryIndexes()) {
+        entryIndexes += "[" + CodeGenerator::expToString(it, newTuple) + "]";
+    }
+    const std::string row =
+        CodeGenerator::expToString(getRowExp(names), newTuple);
+    const std::string column =
+        CodeGenerator::expToString(getColumnExp(names), newTuple);
+
+    auto isIdentifierChar = [](char c) { return std::isalnum(c) || c == '_'; };
+    auto skipSpaces = [&](size_t pos) {
+        while (pos < source.size() && std::isspace(source[pos])) {
+            ++pos;
+        }
+        return pos;
+    };
+    auto isMatrixArray = [&](const std::string& name) {
+        return name == columnIndexes ||
+               std::find(valueArrays.begin(), valueArrays.end(), name) !=
+                   valueArrays.end();
+    };
+    // replacements are parenthesized unless they are a whole index
+    auto replace = [&](const std::string& replacement, size_t end) {
+        const size_t before = rewritten.find_last_not_of(" \t\n");
+        const size_t after = skipSpaces(end);
+        const bool isIndex =
+            before != std::string::npos && rewritten[before] == '[' &&
+            after < source.size() && source[after] == ']';
+        const bool isSimple =
+            std::all_of(replacement.begin(), replacement.end(),
+                        [&](char c) {
+                            return isIdentifierChar(c) || c == '[' ||
+                                   c == ']';
+                        });
+        rewritten += isIndex || isSimple ? replacement
+                                         : "(" + replacement + ")";
+    };
+
+    rewritten.clear();
+    size_t pos = 0;
+    while (pos < source.size()) {
+        if (std::isdigit(source[pos]) || source[pos] == '.') {
+            // a number, which may contain letters
+            const size_t begin = pos;
+            while (pos < source.size() &&
+                   (isIdentifierChar(source[pos]) || source[pos] == '.')) {
+                ++pos;
+            }
+            rewritten += source.substr(begin, pos - begin);
+            continue;
+        }
+        if (!std::isalpha(source[pos]) && source[pos] != '_') {
+            rewritten += source[pos++];
+            continue;
+        }
+        size_t end = pos;
+        while (end < source.size() && isIdentifierChar(source[end])) {
+            ++end;
+        }
+        const std::string identifier = source.substr(pos, end - pos);
+
+        // an element of an array holding the matrix, indexed by the entry
+        if (isMatrixArray(identifier)) {
+            const size_t open = skipSpaces(end);
+            const size_t indexBegin = skipSpaces(open + 1);
+            size_t indexEnd = indexBegin;
+            while (indexEnd < source.size() &&
+                   isIdentifierChar(source[indexEnd])) {
+                ++indexEnd;
+            }
+            const size_t close = skipSpaces(indexEnd);
+            if (open < source.size() && source[open] == '[' &&
+                source.substr(indexBegin, indexEnd - indexBegin) ==
+                    tuple[1].var &&
+                close < source.size() && source[close] == ']') {
+                if (identifier == columnIndexes) {
+                    replace(column, close + 1);
+                } else {
+                    rewritten += names.values.at(identifier) + entryIndexes;
+                }
+                pos = close + 1;
+                continue;
+            }
+        }
+        if (identifier == tuple[1].var || isMatrixArray(identifier)) {
+            return false;
+        }
+        if (identifier == tuple[0].var) {
+            replace(row, end);
+        } else {
+            rewritten += identifier;
+        }
+        pos = end;
+    }
+    return true;
+}
+
+std::vector<StmtSpec> FormatConverter::makeExecutorStmts(
+    const Names& names) const {
+    std::vector<TupleElem> newTuple;
+    for (const auto& it : names.iterators) {
+        newTuple.emplace_back(it);
+    }
+    const std::vector<SpecExp> entryIndexes = getEntryIndexes();
+    const SpecExp columnExp = getColumnExp(names);
+    auto iterator = [](int position, int coeff = 1) {
+        return SpecTerm::makeTupleVar(position, coeff);
+    };
+    auto call = [](const std::string& function, SpecExp arg, int coeff = 1) {
+        return SpecTerm::makeUFCall(function, {arg}, coeff);
+    };
+    const SpecTerm minusOne = SpecTerm::makeConst(-1);
+
+    // the bounds of the new traversal, outermost first
+    std::vector<SpecExp> space;
+    switch (format) {
+        case SparseFormat::ELL:
+            space = {rowLowerBound, rowUpperBound, makeExp({iterator(1)}),
+                     makeExp({SpecTerm::makeSymbol(names.size),
+                              iterator(1, -1), minusOne})};
+            break;
+        case SparseFormat::BCSR:
+        case SparseFormat::CSC: {
+            const std::string& outerSize = format == SparseFormat::BCSR
+                                               ? names.blockRows
+                                               : names.size;
+            space = {
+                makeExp({iterator(0)}),
+                makeExp({SpecTerm::makeSymbol(outerSize), iterator(0, -1),
+                         minusOne}),
+                makeExp({iterator(1),
+                         call(names.pointers, makeExp({iterator(0)}), -1)}),
+                makeExp({call(names.pointers,
+                              makeExp({iterator(0), SpecTerm::makeConst(1)})),
+                         iterator(1, -1), minusOne})};
+            if (format == SparseFormat::CSC) {
+                break;
+            }
+            // dense blocks, within the bounds of the rows and columns
+            for (int i = 2; i <= 3; ++i) {
+                space.push_back(makeExp({iterator(i)}));
+                space.push_back(makeExp(
+                    {SpecTerm::makeConst(blockSize - 1), iterator(i, -1)}));
+            }
+            space.push_back(rewriteExp(rowUpperBound, names));
+            SpecExp columnBound = columnExp;
+            columnBound.multiplyBy(-1);
+            columnBound.terms.push_back(SpecTerm::makeSymbol(names.size));
+            columnBound.terms.push_back(minusOne);
+            space.push_back(columnBound);
+            break;
+        }
+    }
+
+    std::vector<StmtSpec> executorStmts;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        const StmtSpec& spec = stmts[i];
+        if (std::find(entryStmts.begin(), entryStmts.end(), i) ==
+            entryStmts.end()) {
+            executorStmts.push_back(spec);
+            continue;
+        }
+        StmtSpec moved;
+        rewriteSource(spec.sourceCode, names, moved.sourceCode);
+        moved.reduction = spec.reduction;
+        moved.scalars = spec.scalars;
+        moved.isConditional = spec.isConditional;
+        moved.iterSpace = spec.iterSpace;
+        moved.iterSpace.tuple = newTuple;
+        moved.iterSpace.inequalities = space;
+
+        // [c0, i, c1, k, c2, ...] keeps its shape, except that for BCSR
+        // the entry loop becomes [c0, ib, c1, kb, 0, r, 0, c, c2, ...]
+        ExecSchedule original;
+        spec.getSchedule(original);
+        ExecSchedule schedule;
+        for (int j = 0; j < original.getDimension(); ++j) {
+            schedule.pushValue(original.scheduleTuple[j]);
+            if (j == 3 && format == SparseFormat::BCSR) {
+                schedule.pushValue(ScheduleVal::makeNum(0));
+                schedule.pushValue(ScheduleVal::makeVar(2));
+                schedule.pushValue(ScheduleVal::makeNum(0));
+                schedule.pushValue(ScheduleVal::makeVar(3));
+            }
+        }
+        moved.setSchedule(schedule);
+
+        auto rewriteAccesses =
+            [&](const std::vector<std::pair<std::string, SetRelationSpec>>&
+                    accesses,
+                std::vector<std::pair<std::string, SetRelationSpec>>&
+                    rewritten) {
+                for (const auto& it : accesses) {
+                    std::vector<SpecExp> indexes;
+                    it.second.getOutputExps(indexes);
+                    std::string name = it.first;
+                    if (indexes.size() == 1 && indexes[0].isTupleVar(1)) {
+                        // an element of the matrix
+                        if (it.first != columnIndexes) {
+                            name = names.values.at(it.first);
+                            indexes = entryIndexes;
+                        } else if (format == SparseFormat::ELL) {
+                            name = names.columns;
+                            indexes = entryIndexes;
+                        } else if (format == SparseFormat::BCSR) {
+                            name = names.indexes;
+                        } else {
+                            continue;
+                        }
+                    } else {
+                        for (auto& index : indexes) {
+                            index = rewriteExp(index, names);
+                        }
+                    }
+                    rewritten.emplace_back(
+                        name, SetRelationSpec::makeAccess(newTuple, indexes));
+                    addUnique(moved.dataSpaces, name);
+                }
+            };
+        rewriteAccesses(spec.dataReads, moved.dataReads);
+        rewriteAccesses(spec.dataWrites, moved.dataWrites);
+        if (format == SparseFormat::CSC &&
+            Utils::usesIdentifier(spec.sourceCode,
+                                  spec.iterSpace.tuple[0].var)) {
+            moved.dataReads.emplace_back(
+                names.indexes,
+                SetRelationSpec::makeAccess(newTuple,
+                                            {makeExp({iterator(1)})}));
+            addUnique(moved.dataSpaces, names.indexes);
+        }
+        executorStmts.push_back(moved);
+    }
+    return executorStmts;
+}
+
+std::vector<StmtSpec> FormatConverter::getExecutorStmts() const {
+    return makeExecutorStmts(
+        makeNames(CodeGenerator::getUsedCode(stmts, "")));
+}
+
+void FormatConverter::writeInspectors(llvm::raw_ostream& os,
+                                      const std::string& name,
+                                      const std::string& parameters,
+                                      const Names& names,
+                                      const std::string& newArrays) const {
+    const std::string prefix = parameters.empty() ? "" : parameters + ", ";
+    const std::vector<TupleElem>& tuple =
+        stmts[entryStmts.front()].iterSpace.tuple;
+    const std::string& row = tuple[0].var;
+    const std::string& entry = tuple[1].var;
+    const SpecExp lowerExp = CodeGenerator::getBoundValue(rowLowerBound, 0);
+    const std::string lower = CodeGenerator::expToString(lowerExp, tuple);
+    const std::string upper = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(rowUpperBound, 0), tuple);
+    const std::string rowLoop = "for (int " + row + " = " + lower + "; " +
+                                row + " < " + upper + "; " + row + "++) {";
+    const std::string start = rowPointers + "[" + row + "]";
+    const std::string end = rowPointers + "[" + row + " + 1]";
+    const std::string entryLoop = "for (int " + entry + " = " + start +
+                                  "; " + entry + " < " + end + "; " + entry +
+                                  "++) {";
+    const std::string column = columnIndexes + "[" + entry + "]";
+
+    if (format == SparseFormat::ELL) {
+        os << "int " << name << "_ell_width(" << parameters << ") {\n";
+        writeLine(os, 1, "int " + names.size + " = 0;");
+        writeLine(os, 1, rowLoop);
+        writeLine(os, 2, "if (" + end + " - " + start + " > " + names.size +
+                             ") {");
+        writeLine(os, 3, names.size + " = " + end + " - " + start + ";");
+        writeLine(os, 2, "}");
+        writeLine(os, 1, "}");
+        writeLine(os, 1, "return " + names.size + ";");
+        os << "}\n\n";
+
+        // padding repeats the row's last column, so reads stay in bounds
+        os << "void " << name << "_to_ell(" << prefix << "int "
+           << names.size << ", " << newArrays << ") {\n";
+        writeLine(os, 1, rowLoop);
+        writeLine(os, 2, "for (int " + entry + " = 0; " + entry + " < " +
+                             names.size + "; " + entry + "++) {");
+        const std::string element = "[" + row + "][" + entry + "]";
+        writeLine(os, 3, "if (" + entry + " < " + end + " - " + start +
+                             ") {");
+        for (const auto& it : valueArrays) {
+            writeLine(os, 4, names.values.at(it) + element + " = " + it +
+                                 "[" + start + " + " + entry + "];");
+        }
+        writeLine(os, 4, names.columns + element + " = " + columnIndexes +
+                             "[" + start + " + " + entry + "];");
+        writeLine(os, 3, "} else {");
+        for (const auto& it : valueArrays) {
+            writeLine(os, 4, names.values.at(it) + element + " = 0;");
+        }
+        writeLine(os, 4, names.columns + element + " = " + entry + " > 0 ? " +
+                             names.columns + "[" + row + "][" + entry +
+                             " - 1] : 0;");
+        writeLine(os, 3, "}");
+        writeLine(os, 2, "}");
+        writeLine(os, 1, "}");
+        os << "}\n\n";
+        return;
+    }
+
+    os << "int " << name << "_num_cols(" << parameters << ") {\n";
+    writeLine(os, 1, "int " + names.size + " = 0;");
+    writeLine(os, 1, rowLoop);
+    writeLine(os, 2, entryLoop);
+    writeLine(os, 3, "if (" + column + " >= " + names.size + ") {");
+    writeLine(os, 4, names.size + " = " + column + " + 1;");
+    writeLine(os, 3, "}");
+    writeLine(os, 2, "}");
+    writeLine(os, 1, "}");
+    writeLine(os, 1, "return " + names.size + ";");
+    os << "}\n\n";
+
+    if (format == SparseFormat::CSC) {
+        // a counting sort of the entries by column
+        const std::string& col = names.iterators[0];
+        const std::string& position = names.locals[0];
+        const std::string colPointer = names.pointers + "[" + col + "]";
+        os << "void " << name << "_to_csc(" << prefix << "int "
+           << names.size << ", " << newArrays << ") {\n";
+        writeLine(os, 1, "for (int " + col + " = 0; " + col + " <= " +
+                             names.size + "; " + col + "++) {");
+        writeLine(os, 2, colPointer + " = 0;");
+        writeLine(os, 1, "}");
+        writeLine(os, 1, rowLoop);
+        writeLine(os, 2, entryLoop);
+        writeLine(os, 3, names.pointers + "[" + column + " + 1]++;");
+        writeLine(os, 2, "}");
+        writeLine(os, 1, "}");
+        writeLine(os, 1, "for (int " + col + " = 0; " + col + " < " +
+                             names.size + "; " + col + "++) {");
+        writeLine(os, 2, names.pointers + "[" + col + " + 1] += " +
+                             colPointer + ";");
+        writeLine(os, 1, "}");
+        writeLine(os, 1, rowLoop);
+        writeLine(os, 2, entryLoop);
+        writeLine(os, 3, "int " + position + " = " + names.pointers + "[" +
+                             column + "]++;");
+        writeLine(os, 3, names.indexes + "[" + position + "] = " + row + ";");
+        for (const auto& it : valueArrays) {
+            writeLine(os, 3, names.values.at(it) + "[" + position + "] = " +
+                                 it + "[" + entry + "];");
+        }
+        writeLine(os, 2, "}");
+        writeLine(os, 1, "}");
+        // placing each entry moved the start of its column to the next one
+        writeLine(os, 1, "for (int " + col + " = " + names.size + "; " +
+                             col + " > 0; " + col + "--) {");
+        writeLine(os, 2, colPointer + " = " + names.pointers + "[" + col +
+                             " - 1];");
+        writeLine(os, 1, "}");
+        writeLine(os, 1, names.pointers + "[0] = 0;");
+        os << "}\n\n";
+        return;
+    }
+
+    // BCSR: blocks are found in order of their first entries, keeping the
+    // position of the block of each block column in the current block row
+    const std::string size = std::to_string(blockSize);
+    const std::string& blockOf = names.locals[0];
+    const std::string& blocks = names.locals[1];
+    const std::string& blockCol = names.locals[2];
+    SpecExp offsetExp = lowerExp;
+    offsetExp.multiplyBy(-1);
+    offsetExp.terms.push_back(SpecTerm::makeTupleVar(0));
+    std::string offset = CodeGenerator::expToString(offsetExp, tuple);
+    if (offset != row) {
+        offset = "(" + offset + ")";
+    }
+    const std::string blockRow = offset + " / " + size;
+    const std::string blockOfColumn =
+        blockOf + "[" + column + " / " + size + "]";
+    const std::string numBlockCols =
+        "(" + names.size + " + " + std::to_string(blockSize - 1) + ") / " +
+        size;
+    auto writeMarkers = [&]() {
+        writeLine(os, 1, "int *" + blockOf + " = (int *)malloc(" +
+                             numBlockCols + " * sizeof(int));");
+        writeLine(os, 1, "for (int " + blockCol + " = 0; " + blockCol +
+                             " < " + numBlockCols + "; " + blockCol +
+                             "++) {");
+        writeLine(os, 2, blockOf + "[" + blockCol + "] = -1;");
+        writeLine(os, 1, "}");
+        writeLine(os, 1, "int " + blocks + " = 0;");
+    };
+
+    os << "int " << name << "_bcsr_blocks(" << prefix << "int "
+       << names.size << ") {\n";
+    writeMarkers();
+    writeLine(os, 1, rowLoop);
+    writeLine(os, 2, entryLoop);
+    writeLine(os, 3, "if (" + blockOfColumn + " != " + blockRow + ") {");
+    writeLine(os, 4, blockOfColumn + " = " + blockRow + ";");
+    writeLine(os, 4, blocks + "++;");
+    writeLine(os, 3, "}");
+    writeLine(os, 2, "}");
+    writeLine(os, 1, "}");
+    writeLine(os, 1, "free(" + blockOf + ");");
+    writeLine(os, 1, "return " + blocks + ";");
+    os << "}\n\n";
+
+    const std::string& r = names.iterators[2];
+    const std::string& c = names.iterators[3];
+    const std::string blockStart = names.pointers + "[" + blockRow + "]";
+    os << "int " << name << "_to_bcsr(" << prefix << "int " << names.size
+       << ", " << newArrays << ") {\n";
+    writeMarkers();
+    writeLine(os, 1, rowLoop);
+    writeLine(os, 2, "if (" + offset + " % " + size + " == 0) {");
+    writeLine(os, 3, blockStart + " = " + blocks + ";");
+    writeLine(os, 2, "}");
+    writeLine(os, 2, entryLoop);
+    writeLine(os, 3, "if (" + blockOfColumn + " < " + blockStart + ") {");
+    writeLine(os, 4, blockOfColumn + " = " + blocks + ";");
+    writeLine(os, 4, names.indexes + "[" + blocks + "] = " + column + " / " +
+                         size + ";");
+    writeLine(os, 4, "for (int " + r + " = 0; " + r + " < " + size + "; " +
+                         r + "++) {");
+    writeLine(os, 5, "for (int " + c + " = 0; " + c + " < " + size + "; " +
+                         c + "++) {");
+    for (const auto& it : valueArrays) {
+        writeLine(os, 6, names.values.at(it) + "[" + blocks + "][" + r +
+                             "][" + c + "] = 0;");
+    }
+    writeLine(os, 5, "}");
+    writeLine(os, 4, "}");
+    writeLine(os, 4, blocks + "++;");
+    writeLine(os, 3, "}");
+    for (const auto& it : valueArrays) {
+        writeLine(os, 3, names.values.at(it) + "[" + blockOfColumn + "][" +
+                             offset + " % " + size + "][" + column + " % " +
+                             size + "] = " + it + "[" + entry + "];");
+    }
+    writeLine(os, 2, "}");
+    writeLine(os, 1, "}");
+    SpecExp rowsExp = CodeGenerator::getBoundValue(rowUpperBound, 0);
+    rowsExp.add(offsetExp);
+    rowsExp.terms.push_back(SpecTerm::makeTupleVar(0, -1));
+    rowsExp.terms.push_back(SpecTerm::makeConst(blockSize - 1));
+    std::string rows = CodeGenerator::expToString(rowsExp, tuple);
+    if (rows.find(' ') != std::string::npos) {
+        rows = "(" + rows + ")";
+    }
+    writeLine(os, 1,
+              "int " + names.blockRows + " = " + rows + " / " + size + ";");
+    writeLine(os, 1, names.pointers + "[" + names.blockRows + "] = " +
+                         blocks + ";");
+    writeLine(os, 1, "free(" + blockOf + ");");
+    writeLine(os, 1, "return " + names.blockRows + ";");
+    os << "}\n\n";
+}
+
+bool FormatConverter::writeFunctions(
+    llvm::raw_ostream& os, const std::string& name,
+    const std::string& returnType, const std::string& parameters,
+    const std::map<std::string, std::string>& elementTypes) const {
+    const Names names =
+        makeNames(CodeGenerator::getUsedCode(stmts, parameters));
+    auto getType = [&](const std::string& array, std::string& type) {
+        auto found = elementTypes.find(array);
+        if (found == elementTypes.end()) {
+            return false;
+        }
+        type = found->second;
+        return true;
+    };
+
+    // declarations of the new format's arrays
+    std::string newArrays;
+    std::vector<std::pair<std::string, std::string>> arrays;
+    std::string columnType;
+    if (!getType(columnIndexes, columnType)) {
+        return false;
+    }
+    for (const auto& it : valueArrays) {
+        std::string type;
+        if (!getType(it, type)) {
+            return false;
+        }
+        arrays.emplace_back(type, names.values.at(it));
+    }
+    std::string dimensions;
+    switch (format) {
+        case SparseFormat::ELL:
+            dimensions = "[][" + names.size + "]";
+            arrays.emplace_back(columnType, names.columns);
+            break;
+        case SparseFormat::BCSR: {
+            const std::string size = std::to_string(blockSize);
+            dimensions = "[][" + size + "][" + size + "]";
+            newArrays = "int " + names.pointers + "[], " + columnType + " " +
+                        names.indexes + "[], ";
+            break;
+        }
+        case SparseFormat::CSC:
+            dimensions = "[]";
+            newArrays = "int " + names.pointers + "[], int " +
+                        names.indexes + "[], ";
+            break;
+    }
+    for (size_t i = 0; i < arrays.size(); ++i) {
+        newArrays += (i == 0 ? "" : ", ") + arrays[i].first + " " +
+                     arrays[i].second + dimensions;
+    }
+
+    std::string code;
+    llvm::raw_string_ostream out(code);
+    writeInspectors(out, name, parameters, names, newArrays);
+    const std::string prefix = parameters.empty() ? "" : parameters + ", ";
+    std::string sizes = "int " + names.size + ", ";
+    if (format == SparseFormat::BCSR) {
+        sizes += "int " + names.blockRows + ", ";
+    }
+    out << returnType << " " << name << "_" << getFormatName(format) << "("
+        << prefix << sizes << newArrays << ") {\n";
+    if (!CodeGenerator(makeExecutorStmts(names)).writeBody(out)) {
+        return false;
+    }
+    out << "}\n";
+    os << out.str();
+    return true;
+}
+
+const char* FormatConverter::getFormatName(SparseFormat format) {
+    switch (format) {
+        case SparseFormat::ELL:
+            return "ell";
+        case SparseFormat::BCSR:
+            return "bcsr";
+        case SparseFormat::CSC:
+            return "csc";
+    }
+    return "";
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,85 @@
+#include "KernelGenerator.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace spf_ie {
+
+/* KernelGenerator */
+
+std::string KernelGenerator::generate(const KernelShape& shape) {
+    std::string code;
+    for (int f = 0; f < shape.numFunctions; ++f) {
+        code += generateFunction(shape, "kernel" + std::to_string(f));
+    }
+    return code;
+}
+
+int KernelGenerator::getStmtsPerFunction(const KernelShape& shape) {
+    // one declaration per iterator, plus the innermost body
+    return shape.loopDepth + shape.stmtsPerBody;
+}
+
+std::string KernelGenerator::generateFunction(const KernelShape& shape,
+                                              const std::string& name) {
+    std::string arrayDimsDecl;
+    for (int d = 0; d < shape.arrayDims; ++d) {
+        arrayDimsDecl += "[n]";
+    }
+
+    std::ostringstream os;
+    os << "void " << name << "(int n, int col[n]";
+    for (int s = 0; s < shape.stmtsPerBody; ++s) {
+        os << ", double w" << s << arrayDimsDecl << ", double r" << s
+           << arrayDimsDecl << ", double t" << s << arrayDimsDecl;
+    }
+    os << ") {\n";
+
+    std::string indent = "    ";
+    for (int l = 0; l < shape.loopDepth; ++l) {
+        os << indent << "int i" << l << ";\n";
+    }
+    for (int l = 0; l < shape.loopDepth; ++l) {
+        os << indent << "for (i" << l << " = 0; i" << l << " < n; i" << l
+           << "++) {\n";
+        indent += "    ";
+    }
+    for (int c = 0; c < shape.ifDepth; ++c) {
+        if (shape.loopDepth > 0) {
+            os << indent << "if (i" << c % shape.loopDepth << " + " << c
+               << " < n) {\n";
+        } else {
+            os << indent << "if (n > " << c << ") {\n";
+        }
+        indent += "    ";
+    }
+
+    std::string indexes;
+    for (int d = 0; d < shape.arrayDims; ++d) {
+        indexes += "[" + generateIndex(shape, d) + "]";
+    }
+    for (int s = 0; s < shape.stmtsPerBody; ++s) {
+        os << indent << "w" << s << indexes << " = r" << s << indexes
+           << " + t" << s << indexes << ";\n";
+    }
+
+    for (int i = 0; i < shape.loopDepth + shape.ifDepth; ++i) {
+        indent.resize(indent.size() - 4);
+        os << indent << "}\n";
+    }
+    os << "}\n";
+    return os.str();
+}
+
+std::string KernelGenerator::generateIndex(const KernelShape& shape,
+                                           int dim) {
+    std::string index =
+        shape.loopDepth > 0 ? "i" + std::to_string(dim % shape.loopDepth)
+                            : "0";
+    for (int i = 0; i < shape.indirectionDepth; ++i) {
+        index = "col[" + index + "]";
+    }
+    return index;
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,497 @@
+#include "LevelSetGenerator.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.hpp"
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "PrivatizationAnalysis.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Replace the iterator of an outermost loop in an expression with a term
+//! giving its value, moving every other tuple variable one position deeper
+static SpecExp replaceIterator(const SpecExp& exp, const SpecTerm& iterator) {
+    SpecExp replaced;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar && term.tuplePos == 0) {
+            SpecTerm value = iterator;
+            value.coeff *= term.coeff;
+            replaced.terms.push_back(value);
+            continue;
+        }
+        SpecTerm moved = term;
+        if (moved.kind == SpecTerm::Kind::TupleVar) {
+            moved.tuplePos += 1;
+        }
+        for (auto& arg : moved.args) {
+            arg = replaceIterator(arg, iterator);
+        }
+        replaced.terms.push_back(moved);
+    }
+    return replaced;
+}
+
+//! Get a statement's schedule, with at least the position of the statement
+//! in the body of its outermost loop
+static ExecSchedule getBodySchedule(const DependenceGraph& graph,
+                                    unsigned int stmt) {
+    ExecSchedule schedule = graph.getSchedule(stmt);
+    while (schedule.getDimension() < 3) {
+        schedule.pushValue(ScheduleVal::makeNum(0));
+    }
+    return schedule;
+}
+
+/* LevelSetGenerator */
+
+bool LevelSetGenerator::findLoop(std::string& reason) {
+    return Utils::findOutermostLoop(
+        stmts,
+        [this](const std::vector<unsigned int>& loopStmts,
+               std::string& loopReason) {
+            return checkLoop(loopStmts, loopReason);
+        },
+        reason);
+}
+
+bool LevelSetGenerator::checkLoop(const std::vector<unsigned int>& loop,
+                                  std::string& reason) {
+    const DependenceGraph& graph = analysis.getGraph();
+    const unsigned int first = loop.front();
+    const std::vector<const Dependence*> carried =
+        analysis.findCarriedDependences(first, 0);
+    if (carried.empty()) {
+        reason =
+            "it carries no dependences, so it can run in parallel as it is";
+        return false;
+    }
+    const std::string array = carried.front()->dataSpace;
+    for (const auto& it : carried) {
+        if (it->dataSpace != array) {
+            reason = "it carries dependences through both '" + array +
+                     "' and '" + it->dataSpace + "'";
+            return false;
+        }
+    }
+
+    std::vector<std::string> privates;
+    for (const auto& it : analysis.classifyScalars(first, 0)) {
+        if (it.scalar == array) {
+            reason = "it carries dependences through scalar '" + array + "'";
+            return false;
+        }
+        if (it.use == ScalarUse::Reduction) {
+            reason = "it reduces into scalar '" + it.scalar + "'";
+            return false;
+        }
+        if (it.use == ScalarUse::Private) {
+            if (it.isLiveOut) {
+                reason = "'" + it.scalar + "' is read after it";
+                return false;
+            }
+            privates.push_back(it.scalar);
+        }
+    }
+    for (const auto& it : graph.getDependences()) {
+        // iterations of a level run at once, so may not reduce into the
+        // same element
+        if (it.level == 0 && it.reduction != ReductionOp::None &&
+            graph.shareLoop(first, it.source, 0) &&
+            std::find(privates.begin(), privates.end(), it.dataSpace) ==
+                privates.end()) {
+            reason = "it carries reductions into '" + it.dataSpace + "'";
+            return false;
+        }
+    }
+
+    std::vector<const StmtSpec*> loopSpecs;
+    for (const auto& stmt : loop) {
+        const StmtSpec& spec = stmts[stmt];
+        loopSpecs.push_back(&spec);
+        for (const auto& it : spec.dataWrites) {
+            SpecExp index;
+            if (it.first == array &&
+                (it.second.tuple.size() != it.second.inArity + 1u ||
+                 !it.second.getOutputExp(it.second.inArity, index) ||
+                 !index.isTupleVar(0))) {
+                reason = "it writes elements of '" + array +
+                         "' other than the one indexed by its iterator";
+                return false;
+            }
+        }
+        for (const auto& it : spec.dataReads) {
+            SpecExp index;
+            if (it.first == array &&
+                (it.second.tuple.size() != it.second.inArity + 1u ||
+                 !it.second.getOutputExp(it.second.inArity, index))) {
+                reason = "the index of a read of '" + array +
+                         "' could not be found";
+                return false;
+            }
+        }
+        auto readsArray = [&](const SpecExp& it) { return it.calls(array); };
+        if (std::any_of(spec.iterSpace.equalities.begin(),
+                        spec.iterSpace.equalities.end(), readsArray) ||
+            std::any_of(spec.iterSpace.inequalities.begin(),
+                        spec.iterSpace.inequalities.end(), readsArray)) {
+            reason = "its bounds or conditions read '" + array + "'";
+            return false;
+        }
+    }
+    if (!CodeGenerator::getLoopBounds(loopSpecs, 0, lowerBound, upperBound)) {
+        reason = "its bounds could not be found";
+        return false;
+    }
+
+    loopStmts = loop;
+    dataSpace = array;
+    privateScalars = privates;
+    return true;
+}
+
+std::vector<StmtSpec> LevelSetGenerator::makeInspectorStmts(
+    const std::string& levelName, const std::string& numLevelsName) const {
+    const DependenceGraph& graph = analysis.getGraph();
+    const std::vector<TupleElem>& loopTuple =
+        stmts[loopStmts.front()].iterSpace.tuple;
+    const std::string iterator = loopTuple[0].var;
+    const std::string lower = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(lowerBound, 0), loopTuple);
+    const std::string upper = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(upperBound, 0), loopTuple);
+    const std::string ownLevel = levelName + "[" + iterator + "]";
+
+    // statements checking later iterations are placed after every
+    // statement of the loop body, by shifting their positions in it
+    int numPositions = 0;
+    for (const auto& stmt : loopStmts) {
+        numPositions = std::max(
+            numPositions,
+            getBodySchedule(graph, stmt).scheduleTuple[2].value + 1);
+    }
+
+    std::vector<StmtSpec> earlierChecks;
+    std::vector<StmtSpec> laterChecks;
+    for (const auto& stmt : loopStmts) {
+        const StmtSpec& spec = stmts[stmt];
+        for (const auto& it : spec.dataReads) {
+            SpecExp index;
+            if (it.first != dataSpace ||
+                !it.second.getOutputExp(it.second.inArity, index) ||
+                index.isTupleVar(0)) {
+                continue;
+            }
+            const std::string read =
+                CodeGenerator::expToString(index, spec.iterSpace.tuple);
+            const std::string readLevel = levelName + "[" + read + "]";
+
+            // an earlier iteration writing the element read must be at a
+            // lower level
+            StmtSpec earlier;
+            earlier.iterSpace = spec.iterSpace;
+            earlier.execSchedule = spec.execSchedule;
+            earlier.sourceCode = "if (" + read + " >= " + lower + " && " +
+                                 read + " < " + iterator + " && " +
+                                 readLevel + " >= " + ownLevel + ") " +
+                                 ownLevel + " = " + readLevel + " + 1;";
+            earlierChecks.push_back(earlier);
+
+            // and a later one at a higher level, so that it writes the
+            // element only after it is read
+            ExecSchedule schedule = getBodySchedule(graph, stmt);
+            schedule.scheduleTuple[2].value += numPositions;
+            StmtSpec later;
+            later.iterSpace = spec.iterSpace;
+            later.setSchedule(schedule);
+            later.sourceCode = "if (" + read + " > " + iterator + " && " +
+                               read + " < " + upper + " && " + ownLevel +
+                               " >= " + readLevel + ") " + readLevel + " = " +
+                               ownLevel + " + 1;";
+            laterChecks.push_back(later);
+        }
+    }
+
+    // the level of each iteration is final once it has run, so the count
+    // of levels is updated at the end of it, under the constraints common
+    // to the whole loop body
+    StmtSpec count;
+    count.iterSpace.tuple.push_back(loopTuple[0]);
+    const SetRelationSpec& firstSpace = stmts[loopStmts.front()].iterSpace;
+    auto isCommon = [&](const SpecExp& constraint, bool isEquality) {
+        return !constraint.usesTupleVarAfter(0) &&
+               std::all_of(
+                   loopStmts.begin(), loopStmts.end(), [&](unsigned int it) {
+                       const std::vector<SpecExp>& list =
+                           isEquality ? stmts[it].iterSpace.equalities
+                                      : stmts[it].iterSpace.inequalities;
+                       return std::find(list.begin(), list.end(),
+                                        constraint) != list.end();
+                   });
+    };
+    for (const auto& it : firstSpace.equalities) {
+        if (isCommon(it, true)) {
+            count.iterSpace.equalities.push_back(it);
+        }
+    }
+    for (const auto& it : firstSpace.inequalities) {
+        if (isCommon(it, false)) {
+            count.iterSpace.inequalities.push_back(it);
+        }
+    }
+    ExecSchedule schedule;
+    schedule.pushValue(graph.getSchedule(loopStmts.front()).scheduleTuple[0]);
+    schedule.pushValue(ScheduleVal::makeVar(0));
+    schedule.pushValue(ScheduleVal::makeNum(2 * numPositions));
+    count.setSchedule(schedule);
+    count.sourceCode = "if (" + ownLevel + " >= " + numLevelsName + ") " +
+                       numLevelsName + " = " + ownLevel + " + 1;";
+
+    std::vector<StmtSpec> inspectorStmts = earlierChecks;
+    inspectorStmts.insert(inspectorStmts.end(), laterChecks.begin(),
+                          laterChecks.end());
+    inspectorStmts.push_back(count);
+    return inspectorStmts;
+}
+
+std::vector<StmtSpec> LevelSetGenerator::makeExecutorStmts(
+    const std::vector<std::string>& names, bool isIteratorDeclared) const {
+    const DependenceGraph& graph = analysis.getGraph();
+    const std::string& numLevels = names[0];
+    const std::string& levelPtr = names[1];
+    const std::string& levelOrder = names[2];
+    const std::vector<TupleElem> outerTuple = {TupleElem(names[3]),
+                                               TupleElem(names[4])};
+
+    // 0 <= l < num_levels and level_ptr[l] <= p < level_ptr[l + 1]
+    SpecExp levelExp;
+    levelExp.terms.push_back(SpecTerm::makeTupleVar(0));
+    SpecExp nextLevelExp = levelExp;
+    nextLevelExp.terms.push_back(SpecTerm::makeConst(1));
+    std::vector<SpecExp> outerBounds(4);
+    outerBounds[0].terms = {SpecTerm::makeTupleVar(0)};
+    outerBounds[1].terms = {SpecTerm::makeSymbol(numLevels),
+                            SpecTerm::makeTupleVar(0, -1),
+                            SpecTerm::makeConst(-1)};
+    outerBounds[2].terms = {SpecTerm::makeTupleVar(1),
+                            SpecTerm::makeUFCall(levelPtr, {levelExp}, -1)};
+    outerBounds[3].terms = {SpecTerm::makeUFCall(levelPtr, {nextLevelExp}),
+                            SpecTerm::makeTupleVar(1, -1),
+                            SpecTerm::makeConst(-1)};
+    SpecExp positionExp;
+    positionExp.terms.push_back(SpecTerm::makeTupleVar(1));
+    const SpecTerm iteratorValue =
+        SpecTerm::makeUFCall(levelOrder, {positionExp});
+
+    std::vector<StmtSpec> executorStmts;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (std::find(loopStmts.begin(), loopStmts.end(), i) ==
+            loopStmts.end()) {
+            executorStmts.push_back(stmts[i]);
+            continue;
+        }
+        const StmtSpec& spec = stmts[i];
+        const ExecSchedule original = getBodySchedule(graph, i);
+        ExecSchedule outerSchedule;
+        outerSchedule.pushValue(original.scheduleTuple[0]);
+        outerSchedule.pushValue(ScheduleVal::makeVar(0));
+        outerSchedule.pushValue(ScheduleVal::makeNum(0));
+        outerSchedule.pushValue(ScheduleVal::makeVar(1));
+
+        if (i == loopStmts.front()) {
+            // each iteration starts by setting the original iterator
+            StmtSpec assignment;
+            assignment.iterSpace.tuple = outerTuple;
+            assignment.iterSpace.inequalities = outerBounds;
+            ExecSchedule schedule = outerSchedule;
+            schedule.pushValue(ScheduleVal::makeNum(0));
+            assignment.setSchedule(schedule);
+            assignment.sourceCode = (isIteratorDeclared ? "" : "int ") +
+                                    spec.iterSpace.tuple[0].var + " = " +
+                                    levelOrder + "[" + names[4] + "];";
+            executorStmts.push_back(assignment);
+        }
+
+        StmtSpec moved;
+        moved.sourceCode = spec.sourceCode;
+        moved.iterSpace.tuple = outerTuple;
+        moved.iterSpace.tuple.insert(moved.iterSpace.tuple.end(),
+                                     spec.iterSpace.tuple.begin() + 1,
+                                     spec.iterSpace.tuple.end());
+        for (const auto& it : spec.iterSpace.equalities) {
+            moved.iterSpace.equalities.push_back(
+                replaceIterator(it, iteratorValue));
+        }
+        moved.iterSpace.inequalities = outerBounds;
+        bool lowerRemoved = false;
+        bool upperRemoved = false;
+        for (const auto& it : spec.iterSpace.inequalities) {
+            if (!lowerRemoved && it == lowerBound) {
+                lowerRemoved = true;
+            } else if (!upperRemoved && it == upperBound) {
+                upperRemoved = true;
+            } else {
+                moved.iterSpace.inequalities.push_back(
+                    replaceIterator(it, iteratorValue));
+            }
+        }
+        // [c0, i, c1, ...] becomes [c0, l, 0, p, c1 + 1, ...], after the
+        // assignment at [c0, l, 0, p, 0]
+        ExecSchedule schedule = outerSchedule;
+        for (int j = 2; j < original.getDimension(); ++j) {
+            const ScheduleVal& value = original.scheduleTuple[j];
+            schedule.pushValue(
+                value.valueIsVar ? ScheduleVal::makeVar(value.value + 1)
+                                 : ScheduleVal::makeNum(
+                                       value.value + (j == 2 ? 1 : 0)));
+        }
+        moved.setSchedule(schedule);
+        executorStmts.push_back(moved);
+    }
+    return executorStmts;
+}
+
+bool LevelSetGenerator::writeFunctions(llvm::raw_ostream& os,
+                                       const std::string& name,
+                                       const std::string& returnType,
+                                       const std::string& parameters) const {
+    // generated names may not clash with anything the function uses
+    const std::string usedCode =
+        CodeGenerator::getUsedCode(stmts, parameters);
+    std::vector<std::string> taken;
+    const std::string level = Utils::makeUniqueName("level", usedCode, taken);
+    const std::string numLevels =
+        Utils::makeUniqueName("num_levels", usedCode, taken);
+    const std::string levelPtr =
+        Utils::makeUniqueName("level_ptr", usedCode, taken);
+    const std::string levelOrder =
+        Utils::makeUniqueName("level_order", usedCode, taken);
+    const std::string levelIter = Utils::makeUniqueName("l", usedCode, taken);
+    const std::string positionIter =
+        Utils::makeUniqueName("p", usedCode, taken);
+    const std::string separator = parameters.empty() ? "" : ", ";
+
+    const std::vector<TupleElem>& loopTuple =
+        stmts[loopStmts.front()].iterSpace.tuple;
+    const std::string iterator = loopTuple[0].var;
+    const std::string lower = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(lowerBound, 0), loopTuple);
+    const std::string upper = CodeGenerator::expToString(
+        CodeGenerator::getBoundValue(upperBound, 0), loopTuple);
+
+    // the inspector computes each iteration's level, then sorts the
+    // iterations by level
+    std::string code;
+    llvm::raw_string_ostream out(code);
+    // there are at most as many levels as iterations
+    out << "/* " << levelPtr << " must hold " << upper << " + 1 ints and "
+        << levelOrder << " must hold " << upper << " ints */\n";
+    out << "int " << name << "_inspector(" << parameters << separator
+        << "int *" << levelPtr << ", int *" << levelOrder << ") {\n";
+    out.indent(4) << "int *" << level << " = (int *)calloc(" << upper
+                  << ", sizeof(int));\n";
+    out.indent(4) << "int " << numLevels << " = 0;\n";
+    if (!CodeGenerator(makeInspectorStmts(level, numLevels)).writeBody(out)) {
+        return false;
+    }
+    const std::string levelLoop = "for (int " + levelIter + " = 0; ";
+    const std::string iterationLoop = "for (int " + iterator + " = " +
+                                      lower + "; " + iterator + " < " +
+                                      upper + "; " + iterator + "++) {\n";
+    const std::string ownLevel = level + "[" + iterator + "]";
+    out.indent(4) << levelLoop << levelIter << " <= " << numLevels << "; "
+                  << levelIter << "++) {\n";
+    out.indent(8) << levelPtr << "[" << levelIter << "] = 0;\n";
+    out.indent(4) << "}\n";
+    out.indent(4) << iterationLoop;
+    out.indent(8) << levelPtr << "[" << ownLevel << " + 1]++;\n";
+    out.indent(4) << "}\n";
+    out.indent(4) << levelLoop << levelIter << " < " << numLevels << "; "
+                  << levelIter << "++) {\n";
+    out.indent(8) << levelPtr << "[" << levelIter << " + 1] += " << levelPtr
+                  << "[" << levelIter << "];\n";
+    out.indent(4) << "}\n";
+    out.indent(4) << iterationLoop;
+    out.indent(8) << levelOrder << "[" << levelPtr << "[" << ownLevel
+                  << "]++] = " << iterator << ";\n";
+    out.indent(4) << "}\n";
+    // placing each iteration moved the start of its level to the next one
+    out.indent(4) << "for (int " << levelIter << " = " << numLevels << "; "
+                  << levelIter << " > 0; " << levelIter << "--) {\n";
+    out.indent(8) << levelPtr << "[" << levelIter << "] = " << levelPtr
+                  << "[" << levelIter << " - 1];\n";
+    out.indent(4) << "}\n";
+    out.indent(4) << levelPtr << "[0] = 0;\n";
+    out.indent(4) << "free(" << level << ");\n";
+    out.indent(4) << "return " << numLevels << ";\n";
+    out << "}\n\n";
+
+    // the executor runs the iterations of each level in parallel, with the
+    // iterators and scalars declared outside the loop private to each
+    auto isDeclaredIn = [&](const std::string& var, bool inLoop) {
+        for (unsigned int i = 0; i < stmts.size(); ++i) {
+            const bool isInLoop = std::find(loopStmts.begin(), loopStmts.end(),
+                                            i) != loopStmts.end();
+            if (isInLoop == inLoop && CodeGenerator::declares(stmts[i], var)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    const bool isIteratorDeclared = isDeclaredIn(iterator, false);
+    std::vector<std::string> privateVars;
+    if (isIteratorDeclared) {
+        privateVars.push_back(iterator);
+    }
+    for (const auto& stmt : loopStmts) {
+        const std::vector<TupleElem>& tuple = stmts[stmt].iterSpace.tuple;
+        for (size_t i = 1; i < tuple.size(); ++i) {
+            if (isDeclaredIn(tuple[i].var, false) &&
+                std::find(privateVars.begin(), privateVars.end(),
+                          tuple[i].var) == privateVars.end()) {
+                privateVars.push_back(tuple[i].var);
+            }
+        }
+    }
+    for (const auto& it : privateScalars) {
+        if (!isDeclaredIn(it, true)) {
+            privateVars.push_back(it);
+        }
+    }
+    std::string pragma = "#pragma omp parallel for";
+    if (!privateVars.empty()) {
+        pragma += " private(";
+        for (size_t i = 0; i < privateVars.size(); ++i) {
+            pragma += (i == 0 ? "" : ", ") + privateVars[i];
+        }
+        pragma += ")";
+    }
+
+    const std::vector<StmtSpec> executorStmts = makeExecutorStmts(
+        {numLevels, levelPtr, levelOrder, levelIter, positionIter},
+        isIteratorDeclared);
+    CodeGenerator executor(executorStmts);
+    ExecSchedule positionLoop;
+    positionLoop.pushValue(
+        analysis.getGraph().getSchedule(loopStmts.front()).scheduleTuple[0]);
+    positionLoop.pushValue(ScheduleVal::makeVar(0));
+    positionLoop.pushValue(ScheduleVal::makeNum(0));
+    positionLoop.pushValue(ScheduleVal::makeVar(1));
+    executor.annotateLoop(positionLoop, pragma);
+    out << returnType << " " << name << "_executor(" << parameters
+        << separator << "int " << numLevels << ", const int *" << levelPtr
+        << ", const int *" << levelOrder << ") {\n";
+    if (!executor.writeBody(out)) {
+        return false;
+    }
+    out << "}\n";
+    os << out.str();
+    return true;
+}
+
+}  // namespace spf_ie
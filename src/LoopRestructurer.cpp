@@ -0,0 +1,398 @@
+#include "LoopRestructurer.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.hpp"
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+
+namespace spf_ie {
+
+//! Rename a variable of a set's or relation's tuple
+static void renameTupleVar(SetRelationSpec& spec, int position,
+                           const std::string& from, const std::string& to) {
+    TupleElem& elem = spec.tuple[position];
+    if (!elem.isConst && elem.var == from) {
+        elem.var = to;
+    }
+}
+
+//! Rename the iterator of a loop around a statement, in its tuples and code
+static void renameIterator(StmtSpec& stmt, int level, const std::string& from,
+                           const std::string& to) {
+    renameTupleVar(stmt.iterSpace, level, from, to);
+    for (auto& it : stmt.dataReads) {
+        renameTupleVar(it.second, level, from, to);
+    }
+    for (auto& it : stmt.dataWrites) {
+        renameTupleVar(it.second, level, from, to);
+    }
+    stmt.sourceCode = Utils::replaceIdentifier(stmt.sourceCode, from, to);
+}
+
+//! Get the name of the iterator of a loop around a statement
+static const std::string& getIterator(const StmtSpec& stmt, int level) {
+    return stmt.iterSpace.tuple[level].var;
+}
+
+/* LoopRestructurer */
+
+LoopRestructurer::LoopRestructurer(const std::vector<StmtSpec>& stmts) {
+    std::vector<StmtSpec> copied = stmts;
+    update(copied);
+}
+
+bool LoopRestructurer::fuseWithNext(unsigned int stmt, int level,
+                                    std::string& reason) {
+    if (!unscheduledStmt.empty()) {
+        reason = "the schedule of '" + unscheduledStmt +
+                 "' is not made of numbers and iterators";
+        return false;
+    }
+    if (graph->getLoopDepth(stmt) <= level) {
+        reason = "'" + stmts[stmt].sourceCode + "' is not in a loop that deep";
+        return false;
+    }
+    const int position = 2 * level;
+    const int next = findNextLoop(stmt, level);
+    if (next < 0) {
+        reason = "no loop comes after it";
+        return false;
+    }
+    std::vector<unsigned int> firstLoop;
+    std::vector<unsigned int> nextLoop;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (graph->shareLoop(stmt, i, level)) {
+            firstLoop.push_back(i);
+        } else if (isSibling(stmt, i, level) &&
+                   schedules[i].scheduleTuple[position].value == next) {
+            nextLoop.push_back(i);
+        }
+    }
+
+    std::vector<const StmtSpec*> firstSpecs;
+    for (const auto& it : firstLoop) {
+        firstSpecs.push_back(&stmts[it]);
+    }
+    std::vector<const StmtSpec*> nextSpecs;
+    for (const auto& it : nextLoop) {
+        nextSpecs.push_back(&stmts[it]);
+    }
+    SpecExp firstLower, firstUpper, nextLower, nextUpper;
+    if (!CodeGenerator::getLoopBounds(firstSpecs, level, firstLower,
+                                      firstUpper) ||
+        !CodeGenerator::getLoopBounds(nextSpecs, level, nextLower,
+                                      nextUpper)) {
+        reason = "the bounds of the loops could not be found";
+        return false;
+    }
+    if (!(firstLower == nextLower) || !(firstUpper == nextUpper)) {
+        reason = "their bounds differ";
+        return false;
+    }
+
+    // the loops' iterators are given one name, which the schedules take
+    // from the tuples
+    std::vector<StmtSpec> fused = stmts;
+    const std::string& firstName = getIterator(stmts[firstLoop[0]], level);
+    const std::string& nextName = getIterator(stmts[nextLoop[0]], level);
+    if (firstName != nextName) {
+        if (canRename(nextLoop, level, nextName, firstName)) {
+            for (const auto& it : nextLoop) {
+                renameIterator(fused[it], level, nextName, firstName);
+            }
+        } else if (canRename(firstLoop, level, firstName, nextName)) {
+            for (const auto& it : firstLoop) {
+                renameIterator(fused[it], level, firstName, nextName);
+            }
+        } else {
+            reason = "their iterators '" + firstName + "' and '" + nextName +
+                     "' cannot be given one name";
+            return false;
+        }
+    }
+
+    // the fused loop takes the place of the second, with the first's body
+    // before its own
+    std::vector<bool> isChanged(stmts.size(), false);
+    int firstChildren = 0;
+    for (const auto& it : firstLoop) {
+        firstChildren = std::max(
+            firstChildren, schedules[it].scheduleTuple[position + 2].value + 1);
+    }
+    for (const auto& it : firstLoop) {
+        ExecSchedule schedule = schedules[it];
+        schedule.scheduleTuple[position].value = next;
+        fused[it].setSchedule(schedule);
+        isChanged[it] = true;
+    }
+    for (const auto& it : nextLoop) {
+        ExecSchedule schedule = schedules[it];
+        schedule.scheduleTuple[position + 2].value += firstChildren;
+        fused[it].setSchedule(schedule);
+        isChanged[it] = true;
+    }
+
+    if (const Dependence* violated = findViolation(fused, isChanged)) {
+        reason = "the fused loop would not respect a dependence through '" +
+                 violated->dataSpace + "'";
+        return false;
+    }
+    update(fused);
+    return true;
+}
+
+bool LoopRestructurer::distribute(unsigned int stmt, int level,
+                                  std::string& reason) {
+    if (!unscheduledStmt.empty()) {
+        reason = "the schedule of '" + unscheduledStmt +
+                 "' is not made of numbers and iterators";
+        return false;
+    }
+    if (graph->getLoopDepth(stmt) <= level) {
+        reason = "'" + stmts[stmt].sourceCode + "' is not in a loop that deep";
+        return false;
+    }
+    const std::vector<int> children = findChildren(stmt, level);
+    if (children.size() < 2) {
+        reason = "it has only one statement or loop in it";
+        return false;
+    }
+    const int position = 2 * level;
+    const int order = schedules[stmt].scheduleTuple[position].value;
+
+    // whether to split the loop after each child but the last
+    std::vector<bool> splits(children.size() - 1, false);
+    std::vector<bool> isChanged(stmts.size(), false);
+    auto makeDistributed = [&]() {
+        std::vector<StmtSpec> distributed = stmts;
+        const int numSplits = std::count(splits.begin(), splits.end(), true);
+        for (unsigned int i = 0; i < stmts.size(); ++i) {
+            if (!isSibling(stmt, i, level) ||
+                schedules[i].scheduleTuple[position].value < order) {
+                continue;
+            }
+            // each part of the loop comes after those before it, and later
+            // siblings after every part
+            ExecSchedule schedule = schedules[i];
+            if (graph->shareLoop(stmt, i, level)) {
+                const int child =
+                    std::find(children.begin(), children.end(),
+                              schedule.scheduleTuple[position + 2].value) -
+                    children.begin();
+                schedule.scheduleTuple[position].value +=
+                    std::count(splits.begin(), splits.begin() + child, true);
+            } else if (schedule.scheduleTuple[position].value > order) {
+                schedule.scheduleTuple[position].value += numSplits;
+            }
+            distributed[i].setSchedule(schedule);
+            isChanged[i] = true;
+        }
+        return distributed;
+    };
+
+    // a split is legal unless a dependence runs from a later child to an
+    // earlier one, so each is tried on its own
+    std::string violatedDataSpace;
+    for (unsigned int i = 0; i < splits.size(); ++i) {
+        splits[i] = true;
+        if (const Dependence* violated =
+                findViolation(makeDistributed(), isChanged)) {
+            splits[i] = false;
+            if (violatedDataSpace.empty()) {
+                violatedDataSpace = violated->dataSpace;
+            }
+        }
+    }
+    if (std::count(splits.begin(), splits.end(), true) == 0) {
+        reason = "splitting it anywhere would not respect a dependence "
+                 "through '" +
+                 violatedDataSpace + "'";
+        return false;
+    }
+    std::vector<StmtSpec> distributed = makeDistributed();
+    update(distributed);
+    return true;
+}
+
+unsigned int LoopRestructurer::fuseAll(std::vector<std::string>& notes) {
+    unsigned int numFused = 0;
+    for (int level = 0;; ++level) {
+        const std::vector<unsigned int> loops = findLoops(level);
+        if (loops.empty()) {
+            break;
+        }
+        std::vector<unsigned int> fusedLoops;
+        for (const auto& loop : loops) {
+            // a loop already fused into an earlier one was tried with the
+            // loop after it then
+            if (std::any_of(fusedLoops.begin(), fusedLoops.end(),
+                            [&](unsigned int it) {
+                                return graph->shareLoop(it, loop, level);
+                            })) {
+                continue;
+            }
+            fusedLoops.push_back(loop);
+            while (findNextLoop(loop, level) >= 0) {
+                const int position = 2 * level;
+                const int next = findNextLoop(loop, level);
+                std::string nextName;
+                for (unsigned int i = 0; i < stmts.size(); ++i) {
+                    if (isSibling(loop, i, level) &&
+                        schedules[i].scheduleTuple[position].value == next) {
+                        nextName = getIterator(stmts[i], level);
+                        break;
+                    }
+                }
+                const std::string firstName = getIterator(stmts[loop], level);
+                std::string reason;
+                if (!fuseWithNext(loop, level, reason)) {
+                    notes.push_back("loops over '" + firstName + "' and '" +
+                                    nextName + "' were not fused: " + reason);
+                    break;
+                }
+                ++numFused;
+            }
+        }
+    }
+    return numFused;
+}
+
+unsigned int LoopRestructurer::distributeAll(
+    std::vector<std::string>& notes) {
+    unsigned int numDistributed = 0;
+    for (int level = 0;; ++level) {
+        const std::vector<unsigned int> loops = findLoops(level);
+        if (loops.empty()) {
+            break;
+        }
+        for (const auto& loop : loops) {
+            if (findChildren(loop, level).size() < 2) {
+                continue;
+            }
+            std::string reason;
+            if (distribute(loop, level, reason)) {
+                ++numDistributed;
+            } else {
+                notes.push_back("loop over '" +
+                                getIterator(stmts[loop], level) +
+                                "' was not distributed: " + reason);
+            }
+        }
+    }
+    return numDistributed;
+}
+
+bool LoopRestructurer::isSibling(unsigned int stmt, unsigned int other,
+                                 int level) const {
+    return level == 0 || graph->shareLoop(stmt, other, level - 1);
+}
+
+int LoopRestructurer::findNextLoop(unsigned int stmt, int level) const {
+    const int position = 2 * level;
+    const int order = schedules[stmt].scheduleTuple[position].value;
+    int next = -1;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (!isSibling(stmt, i, level) || graph->getLoopDepth(i) <= level) {
+            continue;
+        }
+        const int otherOrder = schedules[i].scheduleTuple[position].value;
+        if (otherOrder > order && (next < 0 || otherOrder < next)) {
+            next = otherOrder;
+        }
+    }
+    return next;
+}
+
+std::vector<int> LoopRestructurer::findChildren(unsigned int stmt,
+                                                int level) const {
+    std::vector<int> children;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (graph->shareLoop(stmt, i, level)) {
+            children.push_back(
+                schedules[i].scheduleTuple[2 * level + 2].value);
+        }
+    }
+    std::sort(children.begin(), children.end());
+    children.erase(std::unique(children.begin(), children.end()),
+                   children.end());
+    return children;
+}
+
+std::vector<unsigned int> LoopRestructurer::findLoops(int level) const {
+    std::vector<unsigned int> loops;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (graph->getLoopDepth(i) > level &&
+            std::none_of(loops.begin(), loops.end(), [&](unsigned int it) {
+                return graph->shareLoop(it, i, level);
+            })) {
+            loops.push_back(i);
+        }
+    }
+    return loops;
+}
+
+bool LoopRestructurer::canRename(const std::vector<unsigned int>& loop,
+                                 int level, const std::string& from,
+                                 const std::string& to) const {
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        const StmtSpec& spec = stmts[i];
+        const bool isIterator =
+            std::any_of(spec.iterSpace.tuple.begin(),
+                        spec.iterSpace.tuple.end(),
+                        [&](const TupleElem& it) {
+                            return !it.isConst && it.var == to;
+                        });
+        if (std::find(loop.begin(), loop.end(), i) != loop.end()) {
+            // the new name must not already mean something in the loop
+            if (Utils::usesIdentifier(spec.sourceCode, to) || isIterator) {
+                return false;
+            }
+        } else if (Utils::usesIdentifier(spec.sourceCode, from) &&
+                   !CodeGenerator::declares(spec, from) &&
+                   std::none_of(spec.iterSpace.tuple.begin(),
+                                spec.iterSpace.tuple.end(),
+                                [&](const TupleElem& it) {
+                                    return !it.isConst && it.var == from;
+                                })) {
+            // nor may the old name's value after the loop be used
+            return false;
+        }
+    }
+    return true;
+}
+
+const Dependence* LoopRestructurer::findViolation(
+    const std::vector<StmtSpec>& changed,
+    const std::vector<bool>& isChanged) const {
+    for (const auto& it : graph->getDependences()) {
+        if ((isChanged[it.source] || isChanged[it.sink]) &&
+            it.reduction == ReductionOp::None &&
+            !DependenceGraph::isPreservedBy(it, changed[it.source],
+                                            changed[it.sink])) {
+            return &it;
+        }
+    }
+    return nullptr;
+}
+
+void LoopRestructurer::update(std::vector<StmtSpec>& changed) {
+    stmts.swap(changed);
+    schedules.clear();
+    unscheduledStmt.clear();
+    for (const auto& it : stmts) {
+        ExecSchedule schedule;
+        if (!it.getSchedule(schedule) && unscheduledStmt.empty()) {
+            unscheduledStmt = it.sourceCode;
+        }
+        schedules.push_back(schedule);
+    }
+    graph = std::make_unique<DependenceGraph>(stmts);
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,276 @@
+#include "LoopTiler.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.hpp"
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+//! Add tuple variables to the start of a set's or relation's tuple (and
+//! input tuple, for a relation)
+static void prependTupleVars(SetRelationSpec& spec,
+                             const std::vector<TupleElem>& vars) {
+    for (auto& it : spec.equalities) {
+        it.shiftTupleVars(vars.size());
+    }
+    for (auto& it : spec.inequalities) {
+        it.shiftTupleVars(vars.size());
+    }
+    spec.tuple.insert(spec.tuple.begin(), vars.begin(), vars.end());
+    spec.inArity += vars.size();
+}
+
+//! Get an expression's negation
+static SpecExp negated(SpecExp exp) {
+    exp.multiplyBy(-1);
+    return exp;
+}
+
+//! Get an expression with its constant terms added into one, which is left
+//! out if it is 0
+static SpecExp withConstantsCombined(const SpecExp& exp) {
+    SpecExp combined;
+    int constant = 0;
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::Const) {
+            constant += term.coeff;
+        } else {
+            combined.terms.push_back(term);
+        }
+    }
+    if (constant != 0 || combined.terms.empty()) {
+        combined.terms.push_back(SpecTerm::makeConst(constant));
+    }
+    return combined;
+}
+
+/* LoopTiler */
+
+bool LoopTiler::findLoop(std::string& reason) {
+    return Utils::findOutermostLoop(
+        stmts,
+        [this](const std::vector<unsigned int>& loopStmts,
+               std::string& loopReason) {
+            return checkLoop(loopStmts, loopReason);
+        },
+        reason, loop);
+}
+
+bool LoopTiler::checkLoop(const std::vector<unsigned int>& nest,
+                          std::string& reason) {
+    const int numTiled = tileSizes.size();
+    const bool isDeepEnough =
+        std::any_of(nest.begin(), nest.end(), [&](unsigned int it) {
+            return graph.getLoopDepth(it) >= numTiled;
+        });
+    if (!isDeepEnough) {
+        reason = "it has fewer than " + std::to_string(numTiled) +
+                 " loops nested in each other";
+        return false;
+    }
+    std::vector<StmtSpec> tiled;
+    const std::map<std::string, std::string> names =
+        makeNames(nest, CodeGenerator::getUsedCode(stmts, ""));
+    if (!makeTiledStmts(nest, names, tiled, reason)) {
+        return false;
+    }
+
+    // every dependence between statements in the nest must still be
+    // respected; the order of the nest and other statements is unchanged
+    auto isInNest = [&](unsigned int stmt) {
+        return std::find(nest.begin(), nest.end(), stmt) != nest.end();
+    };
+    for (const auto& it : graph.getDependences()) {
+        if (isInNest(it.source) && isInNest(it.sink) &&
+            it.reduction == ReductionOp::None &&
+            !DependenceGraph::isPreservedBy(it, tiled[it.source],
+                                            tiled[it.sink])) {
+            reason = "its tiles would not respect a dependence through '" +
+                     it.dataSpace + "'";
+            return false;
+        }
+    }
+    loopStmts = nest;
+    tiledStmts = tiled;
+    return true;
+}
+
+std::map<std::string, std::string> LoopTiler::makeNames(
+    const std::vector<unsigned int>& nest,
+    const std::string& usedCode) const {
+    std::vector<std::string> taken;
+    std::map<std::string, std::string> names;
+    for (const auto& stmt : nest) {
+        const std::vector<TupleElem>& tuple = stmts[stmt].iterSpace.tuple;
+        const int numTiled = std::min<int>(graph.getLoopDepth(stmt),
+                                           tileSizes.size());
+        for (int level = 0; level < numTiled; ++level) {
+            if (!names.count(tuple[level].var)) {
+                names[tuple[level].var] = Utils::makeUniqueName(
+                    tuple[level].var + "_tile", usedCode, taken);
+            }
+        }
+    }
+    return names;
+}
+
+bool LoopTiler::makeTiledStmts(const std::vector<unsigned int>& nest,
+                               const std::map<std::string, std::string>& names,
+                               std::vector<StmtSpec>& tiled,
+                               std::string& reason) const {
+    tiled = stmts;
+    for (const auto& stmt : nest) {
+        const StmtSpec& spec = stmts[stmt];
+        ExecSchedule schedule;
+        if (!spec.getSchedule(schedule)) {
+            reason = "the schedule of '" + spec.sourceCode +
+                     "' is not made of numbers and iterators";
+            return false;
+        }
+        const int numTiled =
+            std::min<int>(graph.getLoopDepth(stmt), tileSizes.size());
+
+        // the bounds on each iterator in a tile come before the others, so
+        // that they are its loop's bounds
+        std::vector<TupleElem> tileIterators;
+        std::vector<SpecExp> tileBounds;
+        std::vector<SpecExp> replacedBounds;
+        for (int level = 0; level < numTiled; ++level) {
+            const std::string& iterator = spec.iterSpace.tuple[level].var;
+            std::vector<const StmtSpec*> loopSpecs;
+            for (const auto& other : nest) {
+                if (graph.shareLoop(stmt, other, level)) {
+                    loopSpecs.push_back(&stmts[other]);
+                }
+            }
+            SpecExp lowerBound;
+            SpecExp upperBound;
+            if (!CodeGenerator::getLoopBounds(loopSpecs, level, lowerBound,
+                                              upperBound)) {
+                reason = "the bounds of its loop over '" + iterator +
+                         "' could not be found";
+                return false;
+            }
+            const SpecExp lower =
+                CodeGenerator::getBoundValue(lowerBound, level);
+            const SpecExp upper =
+                CodeGenerator::getBoundValue(upperBound, level);
+            if (lower.usesTupleVarAfter(-1) || upper.usesTupleVarAfter(-1)) {
+                reason = "the bounds of its loop over '" + iterator +
+                         "' depend on other iterators, so its tiles would not "
+                         "be rectangular";
+                return false;
+            }
+            const int size = tileSizes[level];
+            const int position = numTiled + level;
+            tileIterators.emplace_back(names.at(iterator));
+
+            // ti >= 0, and S * ti < U - L
+            SpecExp first;
+            first.terms.push_back(SpecTerm::makeTupleVar(level));
+            tileBounds.push_back(first);
+            SpecExp last = upper;
+            last.add(negated(lower));
+            last.terms.push_back(SpecTerm::makeTupleVar(level, -size));
+            last.terms.push_back(SpecTerm::makeConst(-1));
+            tileBounds.push_back(withConstantsCombined(last));
+            // i >= L + S * ti, which implies i >= L, and i < L + S * ti + S
+            SpecExp start = negated(lower);
+            start.terms.push_back(SpecTerm::makeTupleVar(position));
+            start.terms.push_back(SpecTerm::makeTupleVar(level, -size));
+            tileBounds.push_back(withConstantsCombined(start));
+            SpecExp end = lower;
+            end.terms.push_back(SpecTerm::makeTupleVar(level, size));
+            end.terms.push_back(SpecTerm::makeConst(size - 1));
+            end.terms.push_back(SpecTerm::makeTupleVar(position, -1));
+            tileBounds.push_back(withConstantsCombined(end));
+            lowerBound.shiftTupleVars(numTiled);
+            replacedBounds.push_back(lowerBound);
+        }
+
+        StmtSpec& tiledSpec = tiled[stmt];
+        prependTupleVars(tiledSpec.iterSpace, tileIterators);
+        std::vector<SpecExp>& inequalities = tiledSpec.iterSpace.inequalities;
+        for (const auto& it : replacedBounds) {
+            auto found =
+                std::find(inequalities.begin(), inequalities.end(), it);
+            if (found != inequalities.end()) {
+                inequalities.erase(found);
+            }
+        }
+        inequalities.insert(inequalities.begin(), tileBounds.begin(),
+                            tileBounds.end());
+        for (auto& it : tiledSpec.dataReads) {
+            prependTupleVars(it.second, tileIterators);
+        }
+        for (auto& it : tiledSpec.dataWrites) {
+            prependTupleVars(it.second, tileIterators);
+        }
+
+        // the loops over tiles, then those over iterations in them, in the
+        // statement's place among the loops in the innermost tile
+        ExecSchedule tiledSchedule;
+        for (int level = 0; level < numTiled; ++level) {
+            tiledSchedule.pushValue(schedule.scheduleTuple[2 * level]);
+            tiledSchedule.pushValue(ScheduleVal::makeVar(level));
+        }
+        tiledSchedule.pushValue(schedule.scheduleTuple[2 * numTiled]);
+        for (int i = 1; i < schedule.getDimension(); ++i) {
+            const ScheduleVal& value = schedule.scheduleTuple[i];
+            tiledSchedule.pushValue(
+                value.valueIsVar ? ScheduleVal::makeVar(value.value + numTiled)
+                                 : value);
+        }
+        tiledSpec.setSchedule(tiledSchedule);
+    }
+
+    // schedules are padded with zeroes to the same dimension
+    int dimension = 0;
+    std::vector<ExecSchedule> schedules(tiled.size());
+    for (unsigned int i = 0; i < tiled.size(); ++i) {
+        if (!tiled[i].getSchedule(schedules[i])) {
+            reason = "the schedule of '" + tiled[i].sourceCode +
+                     "' is not made of numbers and iterators";
+            return false;
+        }
+        dimension = std::max(dimension, schedules[i].getDimension());
+    }
+    for (unsigned int i = 0; i < tiled.size(); ++i) {
+        while (schedules[i].getDimension() < dimension) {
+            schedules[i].pushValue(ScheduleVal::makeNum(0));
+        }
+        tiled[i].setSchedule(schedules[i]);
+    }
+    return true;
+}
+
+bool LoopTiler::writeFunction(llvm::raw_ostream& os, const std::string& name,
+                              const std::string& returnType,
+                              const std::string& parameters) const {
+    std::vector<StmtSpec> tiled;
+    std::string reason;
+    if (!makeTiledStmts(
+            loopStmts,
+            makeNames(loopStmts, CodeGenerator::getUsedCode(stmts, parameters)),
+            tiled, reason)) {
+        return false;
+    }
+    std::string body;
+    llvm::raw_string_ostream bodyStream(body);
+    if (!CodeGenerator(tiled).writeBody(bodyStream)) {
+        return false;
+    }
+    os << returnType << " " << name << "_tiled(" << parameters << ") {\n"
+       << bodyStream.str() << "}\n";
+    return true;
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,643 @@
+#include "Parallelizer.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DataAccessHandler.hpp"
+#include "DependenceGraph.hpp"
+#include "ExecSchedule.hpp"
+#include "PrivatizationAnalysis.hpp"
+#include "SetRelationSpec.hpp"
+#include "Utils.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+namespace spf_ie {
+
+//! Get whether a statement's schedule starts with a prefix
+static bool hasSchedulePrefix(const ExecSchedule& schedule,
+                              const ExecSchedule& prefix) {
+    if (schedule.getDimension() < prefix.getDimension()) {
+        return false;
+    }
+    for (int i = 0; i < prefix.getDimension(); ++i) {
+        const ScheduleVal& value = schedule.scheduleTuple[i];
+        const ScheduleVal& prefixValue = prefix.scheduleTuple[i];
+        if (value.valueIsVar != prefixValue.valueIsVar ||
+            value.value != prefixValue.value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Library functions known to have no side effects (other than perhaps
+//! setting errno), with their float and long double variants
+static const char* const PURE_FUNCTIONS[] = {
+    "abs",   "labs",  "fabs",  "sqrt",  "cbrt",  "exp",   "exp2",  "log",
+    "log2",  "log10", "pow",   "sin",   "cos",   "tan",   "asin",  "acos",
+    "atan",  "atan2", "sinh",  "cosh",  "tanh",  "floor", "ceil",  "round",
+    "trunc", "fmin",  "fmax",  "fmod",  "hypot", "fma",   "copysign"};
+
+//! Get the pointer parameter an expression indexes or dereferences, if any
+static const ParmVarDecl* getPointerParam(Expr* expr) {
+    expr = expr->IgnoreParenImpCasts();
+    while (true) {
+        if (ArraySubscriptExpr* asSubscript =
+                dyn_cast<ArraySubscriptExpr>(expr)) {
+            expr = asSubscript->getBase()->IgnoreParenImpCasts();
+        } else if (UnaryOperator* asUnOper = dyn_cast<UnaryOperator>(expr)) {
+            if (asUnOper->getOpcode() != UO_Deref) {
+                return nullptr;
+            }
+            expr = asUnOper->getSubExpr()->IgnoreParenImpCasts();
+        } else {
+            break;
+        }
+    }
+    DeclRefExpr* ref = dyn_cast<DeclRefExpr>(expr);
+    const ParmVarDecl* param =
+        ref ? dyn_cast<ParmVarDecl>(ref->getDecl()) : nullptr;
+    return param && param->getType()->isPointerType() ? param : nullptr;
+}
+
+//! Add the pointer parameters a statement refers to, and find whether it
+//! writes through any of them
+//! \param[in] stmt Statement to search
+//! \param[in,out] accessed Pointer parameters referred to
+//! \param[in,out] writes Set if the statement writes through one
+static void collectPointerParams(clang::Stmt* stmt,
+                                 std::vector<const ParmVarDecl*>& accessed,
+                                 bool& writes) {
+    if (!stmt) {
+        return;
+    }
+    if (DeclRefExpr* ref = dyn_cast<DeclRefExpr>(stmt)) {
+        const ParmVarDecl* param = dyn_cast<ParmVarDecl>(ref->getDecl());
+        if (param && param->getType()->isPointerType() &&
+            std::find(accessed.begin(), accessed.end(), param) ==
+                accessed.end()) {
+            accessed.push_back(param);
+        }
+    } else if (BinaryOperator* asBinOper = dyn_cast<BinaryOperator>(stmt)) {
+        if (asBinOper->isAssignmentOp() &&
+            getPointerParam(asBinOper->getLHS())) {
+            writes = true;
+        }
+    } else if (UnaryOperator* asUnOper = dyn_cast<UnaryOperator>(stmt)) {
+        if (asUnOper->isIncrementDecrementOp() &&
+            getPointerParam(asUnOper->getSubExpr())) {
+            writes = true;
+        }
+    }
+    for (auto child : stmt->children()) {
+        collectPointerParams(child, accessed, writes);
+    }
+}
+
+//! Get a clause listing variables, preceded by a space, or nothing if there
+//! are none
+static std::string getVarsClause(const std::string& name,
+                                 const std::vector<std::string>& vars) {
+    if (vars.empty()) {
+        return "";
+    }
+    std::string clause = " " + name + "(";
+    for (const auto& it : vars) {
+        clause += (&it == &vars.front() ? "" : ", ");
+        clause += it;
+    }
+    return clause + ")";
+}
+
+//! Get the clauses of a loop's annotation, each preceded by a space
+static std::string getClauses(const LoopDecision& decision) {
+    std::string clauses = getVarsClause("private", decision.privateVars) +
+                          getVarsClause("lastprivate",
+                                        decision.lastPrivateVars);
+    for (const auto& it : decision.reductions) {
+        clauses += " reduction(" + it + ")";
+    }
+    return clauses;
+}
+
+/* Parallelizer */
+
+Parallelizer::Parallelizer(ASTContext* Context)
+    : Context(Context),
+      rewriter(Context->getSourceManager(), Context->getLangOpts()) {}
+
+void Parallelizer::addFunction(FunctionDecl* funcDecl,
+                               const std::vector<StmtSpec>* stmtSpecs) {
+    llvm::TimeTraceScope parallelizeScope("Parallelize", [&]() {
+        return funcDecl->getQualifiedNameAsString();
+    });
+    std::vector<LoopInfo> loops;
+    ExecSchedule schedule;
+    functionStmts.clear();
+    collectLoops(funcDecl->getBody(), schedule, 0, -1, loops);
+
+    std::unique_ptr<DependenceGraph> graph;
+    std::unique_ptr<PrivatizationAnalysis> analysis;
+    if (stmtSpecs) {
+        graph = std::make_unique<DependenceGraph>(*stmtSpecs);
+        analysis = std::make_unique<PrivatizationAnalysis>(*stmtSpecs, *graph);
+    }
+    for (size_t i = 0; i < loops.size(); ++i) {
+        if (loops[i].depth == 0) {
+            decide(loops, i, analysis.get(), false);
+        }
+    }
+}
+
+void Parallelizer::writeReport(llvm::raw_ostream& os) const {
+    const SourceManager& SM = Context->getSourceManager();
+    for (const auto& it : decisions) {
+        os << it.loop->getBeginLoc().printToString(SM) << ": ";
+        if (it.parallelized) {
+            os << "parallelized loop over '" << it.iterator << "'";
+            const std::string clauses = getClauses(it);
+            if (!clauses.empty()) {
+                os << ", with" << clauses;
+            }
+            for (const auto& param : it.assumedDisjoint) {
+                os << (&param == &it.assumedDisjoint.front() ? ", assuming '"
+                                                             : "', '")
+                   << param;
+            }
+            if (!it.assumedDisjoint.empty()) {
+                os << "' do not overlap";
+            }
+        } else {
+            os << "did not parallelize loop over '" << it.iterator
+               << "': " << it.reason;
+        }
+        os << "\n";
+    }
+}
+
+void Parallelizer::writeRewrittenFile(llvm::raw_ostream& os) const {
+    const SourceManager& SM = Context->getSourceManager();
+    const FileID mainFile = SM.getMainFileID();
+    if (const RewriteBuffer* buffer = rewriter.getRewriteBufferFor(mainFile)) {
+        buffer->write(os);
+    } else {
+        os << SM.getBufferData(mainFile);
+    }
+}
+
+std::string Parallelizer::getOutputPath(llvm::StringRef inputPath) {
+    llvm::SmallString<128> path(inputPath);
+    llvm::sys::path::replace_extension(
+        path, ".omp" + llvm::sys::path::extension(inputPath).str());
+    return path.str().str();
+}
+
+void Parallelizer::collectLoops(clang::Stmt* stmt, ExecSchedule& schedule,
+                                int depth, int parent,
+                                std::vector<LoopInfo>& loops) {
+    if (CompoundStmt* asCompoundStmt = dyn_cast<CompoundStmt>(stmt)) {
+        for (auto it : asCompoundStmt->body()) {
+            collectLoops(it, schedule, depth, parent, loops);
+        }
+    } else if (ForStmt* asForStmt = dyn_cast<ForStmt>(stmt)) {
+        schedule.advanceSchedule();
+        schedule.pushValue(ScheduleVal::makeVar(depth));
+        const size_t index = loops.size();
+        loops.push_back({asForStmt, depth, schedule, {}});
+        if (parent >= 0) {
+            loops[parent].innerLoops.push_back(index);
+        }
+        collectLoops(asForStmt->getBody(), schedule, depth + 1, index, loops);
+        // as StmtContext::exitFor does
+        schedule.popValue();
+        schedule.popValue();
+    } else if (IfStmt* asIfStmt = dyn_cast<IfStmt>(stmt)) {
+        collectLoops(asIfStmt->getThen(), schedule, depth, parent, loops);
+        if (asIfStmt->hasElseStorage()) {
+            collectLoops(asIfStmt->getElse(), schedule, depth, parent,
+                         loops);
+        }
+    } else {
+        schedule.advanceSchedule();
+        functionStmts.push_back(stmt);
+    }
+}
+
+void Parallelizer::decide(const std::vector<LoopInfo>& loops, size_t loop,
+                          const PrivatizationAnalysis* analysis,
+                          bool insideParallelLoop) {
+    const DependenceGraph* graph = analysis ? &analysis->getGraph() : nullptr;
+    const LoopInfo& info = loops[loop];
+    LoopDecision decision;
+    decision.loop = info.loop;
+    VarDecl* iterator = getIterator(info.loop);
+    decision.iterator = iterator ? iterator->getName().str() : "";
+    decision.parallelized = false;
+
+    int stmtInLoop = -1;
+    if (graph) {
+        for (unsigned int i = 0; i < graph->getNumStmts(); ++i) {
+            if (hasSchedulePrefix(graph->getSchedule(i),
+                                  info.schedulePrefix)) {
+                stmtInLoop = i;
+                break;
+            }
+        }
+    }
+    const Dependence* carried =
+        stmtInLoop >= 0
+            ? analysis->findCarriedDependence(stmtInLoop, info.depth)
+            : nullptr;
+    std::vector<ScalarClassification> scalars;
+    std::vector<std::string> handledScalars;
+    std::vector<std::string> privateScalars;
+    std::vector<const Dependence*> reductions;
+    if (stmtInLoop >= 0) {
+        scalars = analysis->classifyScalars(stmtInLoop, info.depth);
+        for (const auto& it : scalars) {
+            if (it.use == ScalarUse::Private) {
+                privateScalars.push_back(it.scalar);
+            }
+            if (it.use != ScalarUse::Carried) {
+                handledScalars.push_back(it.scalar);
+            }
+        }
+        // private scalars may still be reduced into within an iteration
+        for (const auto& it :
+             graph->findCarriedReductions(stmtInLoop, info.depth)) {
+            if (std::find(privateScalars.begin(), privateScalars.end(),
+                          it->dataSpace) == privateScalars.end()) {
+                reductions.push_back(it);
+            }
+        }
+    }
+    VarDecl* sharedScalar = findSharedScalarWrite(
+        info.loop, info.loop->getBody(), handledScalars);
+    CallExpr* impureCall = findImpureCall(info.loop->getBody());
+    std::vector<std::string> reductionItems;
+    const std::string unreducible =
+        getReductionItems(info.loop, reductions, reductionItems);
+    if (insideParallelLoop) {
+        decision.reason = "an enclosing loop was parallelized";
+    } else if (!graph) {
+        decision.reason =
+            "the function has constraints which cannot be analyzed";
+    } else if (stmtInLoop < 0) {
+        decision.reason = "it contains no statements";
+    } else if (impureCall) {
+        const FunctionDecl* callee = impureCall->getDirectCallee();
+        decision.reason =
+            "it calls " +
+            (callee ? "'" + callee->getNameAsString() + "'"
+                    : std::string("a function")) +
+            ", which may have side effects";
+    } else if (carried) {
+        decision.reason =
+            std::string("it carries a ") +
+            DependenceGraph::getKindName(carried->kind) +
+            " dependence on '" + carried->dataSpace + "' from '" +
+            graph->getSourceCode(carried->source) + "' to '" +
+            graph->getSourceCode(carried->sink) + "'";
+    } else if (sharedScalar) {
+        decision.reason = "it assigns to '" + sharedScalar->getName().str() +
+                          "', which is shared by every iteration";
+    } else if (!unreducible.empty()) {
+        decision.reason = "it reduces into '" + unreducible +
+                          "' at an element which is not the same in every "
+                          "iteration";
+    } else if (info.loop->getBeginLoc().isMacroID()) {
+        decision.reason = "it is in a macro expansion";
+    } else {
+        decision.parallelized = true;
+    }
+
+    if (decision.parallelized) {
+        std::vector<VarDecl*> innerIterators;
+        collectInnerIterators(info.loop->getBody(), innerIterators);
+        for (const auto& it : innerIterators) {
+            const std::string name = it->getName().str();
+            if (!isDeclaredIn(it, info.loop) &&
+                std::find(decision.privateVars.begin(),
+                          decision.privateVars.end(),
+                          name) == decision.privateVars.end()) {
+                decision.privateVars.push_back(name);
+            }
+        }
+        for (const auto& it : scalars) {
+            VarDecl* var = it.use == ScalarUse::Private
+                               ? findVarDecl(info.loop->getBody(), it.scalar)
+                               : nullptr;
+            if (var && !isDeclaredIn(var, info.loop)) {
+                (it.isLiveOut ? decision.lastPrivateVars
+                              : decision.privateVars)
+                    .push_back(it.scalar);
+            }
+        }
+        decision.reductions = reductionItems;
+        std::vector<const ParmVarDecl*> pointerParams;
+        bool writesThroughPointer = false;
+        collectPointerParams(info.loop->getBody(), pointerParams,
+                             writesThroughPointer);
+        for (const auto& it : pointerParams) {
+            if (!it->getType().isRestrictQualified()) {
+                decision.assumedDisjoint.push_back(it->getName().str());
+            }
+        }
+        if (!writesThroughPointer || decision.assumedDisjoint.size() < 2) {
+            decision.assumedDisjoint.clear();
+        }
+        const std::string pragma =
+            "#pragma omp parallel for" + getClauses(decision);
+        std::string comment;
+        if (!decision.assumedDisjoint.empty()) {
+            comment = "// assumes ";
+            for (const auto& it : decision.assumedDisjoint) {
+                comment += (&it == &decision.assumedDisjoint.front() ? ""
+                                                                     : ", ");
+                comment += it;
+            }
+            comment += " do not overlap";
+        }
+        // put the comment and pragma on their own lines, indented like the
+        // loop
+        // functions are added while others are being built, sharing the
+        // ASTContext whose source locations are looked up
+        std::lock_guard<std::recursive_mutex> lock(Utils::getSourceMutex());
+        const SourceManager& SM = Context->getSourceManager();
+        const SourceLocation loc = info.loop->getBeginLoc();
+        llvm::StringRef buffer = SM.getBufferData(SM.getFileID(loc));
+        const size_t offset = SM.getFileOffset(loc);
+        const size_t lineEnd = buffer.rfind('\n', offset);
+        const size_t lineStart =
+            lineEnd == llvm::StringRef::npos ? 0 : lineEnd + 1;
+        llvm::StringRef indent = buffer.slice(lineStart, offset);
+        if (indent.find_first_not_of(" \t") == llvm::StringRef::npos) {
+            const std::string lines =
+                comment.empty() ? pragma
+                                : comment + "\n" + indent.str() + pragma;
+            rewriter.InsertTextBefore(loc, lines + "\n" + indent.str());
+        } else {
+            const std::string lines =
+                comment.empty() ? pragma : comment + "\n" + pragma;
+            rewriter.InsertTextBefore(loc, "\n" + lines + "\n");
+        }
+    }
+    decisions.push_back(decision);
+
+    for (const auto& it : info.innerLoops) {
+        decide(loops, it, analysis,
+               insideParallelLoop || decision.parallelized);
+    }
+}
+
+VarDecl* Parallelizer::getIterator(ForStmt* loop) {
+    if (BinaryOperator* init =
+            dyn_cast_or_null<BinaryOperator>(loop->getInit())) {
+        if (DeclRefExpr* ref =
+                dyn_cast<DeclRefExpr>(init->getLHS()->IgnoreParenImpCasts())) {
+            return dyn_cast<VarDecl>(ref->getDecl());
+        }
+    } else if (DeclStmt* init = dyn_cast_or_null<DeclStmt>(loop->getInit())) {
+        if (init->isSingleDecl()) {
+            return dyn_cast<VarDecl>(init->getSingleDecl());
+        }
+    }
+    return nullptr;
+}
+
+std::string Parallelizer::getReductionItems(
+    ForStmt* loop, const std::vector<const Dependence*>& reductions,
+    std::vector<std::string>& items) const {
+    for (const auto& it : reductions) {
+        for (unsigned int stmt : {it->source, it->sink}) {
+            clang::Stmt* reduction =
+                stmt < functionStmts.size() ? functionStmts[stmt] : nullptr;
+            Expr* target = nullptr;
+            if (BinaryOperator* asBinOper =
+                    dyn_cast_or_null<BinaryOperator>(reduction)) {
+                target = asBinOper->getLHS()->IgnoreParenImpCasts();
+            } else if (UnaryOperator* asUnOper =
+                           dyn_cast_or_null<UnaryOperator>(reduction)) {
+                target = asUnOper->getSubExpr()->IgnoreParenImpCasts();
+            }
+            std::string item = getReductionIdentifier(it->reduction);
+            if (DeclRefExpr* ref = dyn_cast_or_null<DeclRefExpr>(target)) {
+                // a scalar declared in the loop is private to each iteration
+                VarDecl* var = dyn_cast<VarDecl>(ref->getDecl());
+                if (!var) {
+                    return it->dataSpace;
+                }
+                item += ":" + var->getName().str();
+                if (!isDeclaredIn(var, loop) &&
+                    std::find(items.begin(), items.end(), item) ==
+                        items.end()) {
+                    items.push_back(item);
+                }
+                continue;
+            }
+            ArraySubscriptExpr* lhs =
+                dyn_cast_or_null<ArraySubscriptExpr>(target);
+            if (!lhs) {
+                return it->dataSpace;
+            }
+            // the element is given as an array section of length 1 in each
+            // dimension
+            Expr* base;
+            llvm::SmallVector<Expr*, 4> indexes;
+            DataAccessHandler::getArrayAccessParts(lhs, base, indexes,
+                                                   Context);
+            if (!isInvariantIn(base, loop)) {
+                return it->dataSpace;
+            }
+            item += ":" + Utils::stmtToString(base, Context);
+            for (const auto& index : indexes) {
+                if (!isInvariantIn(index, loop)) {
+                    return it->dataSpace;
+                }
+                item += "[" + Utils::stmtToString(index, Context) + ":1]";
+            }
+            if (std::find(items.begin(), items.end(), item) == items.end()) {
+                items.push_back(item);
+            }
+        }
+    }
+    return "";
+}
+
+bool Parallelizer::isInvariantIn(Expr* expr, ForStmt* loop) const {
+    if (isa<ArraySubscriptExpr>(expr)) {
+        return false;
+    }
+    if (DeclRefExpr* ref = dyn_cast<DeclRefExpr>(expr)) {
+        if (VarDecl* var = dyn_cast<VarDecl>(ref->getDecl())) {
+            std::vector<VarDecl*> iterators;
+            collectInnerIterators(loop, iterators);
+            if (isDeclaredIn(var, loop) ||
+                std::find(iterators.begin(), iterators.end(), var) !=
+                    iterators.end()) {
+                return false;
+            }
+        }
+    }
+    for (auto child : expr->children()) {
+        Expr* childExpr = dyn_cast_or_null<Expr>(child);
+        if (!childExpr || !isInvariantIn(childExpr, loop)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Parallelizer::isDeclaredIn(const VarDecl* decl, ForStmt* loop) const {
+    std::lock_guard<std::recursive_mutex> lock(Utils::getSourceMutex());
+    const SourceManager& SM = Context->getSourceManager();
+    const SourceLocation declLoc = SM.getExpansionLoc(decl->getLocation());
+    const SourceLocation begin = SM.getExpansionLoc(loop->getBeginLoc());
+    const SourceLocation end = SM.getExpansionLoc(loop->getEndLoc());
+    if (SM.getFileID(declLoc) != SM.getFileID(begin)) {
+        return false;
+    }
+    const unsigned int declOffset = SM.getFileOffset(declLoc);
+    return declOffset >= SM.getFileOffset(begin) &&
+           declOffset <= SM.getFileOffset(end);
+}
+
+VarDecl* Parallelizer::findSharedScalarWrite(
+    ForStmt* loop, clang::Stmt* stmt,
+    const std::vector<std::string>& handledScalars) const {
+    if (!stmt) {
+        return nullptr;
+    }
+    Expr* target = nullptr;
+    if (BinaryOperator* asBinOper = dyn_cast<BinaryOperator>(stmt)) {
+        if (asBinOper->isAssignmentOp()) {
+            target = asBinOper->getLHS();
+        }
+    } else if (UnaryOperator* asUnOper = dyn_cast<UnaryOperator>(stmt)) {
+        if (asUnOper->isIncrementDecrementOp()) {
+            target = asUnOper->getSubExpr();
+        }
+    } else if (ForStmt* asForStmt = dyn_cast<ForStmt>(stmt)) {
+        // inner loops' iterators are made private, so only their bodies
+        // matter
+        return findSharedScalarWrite(loop, asForStmt->getBody(),
+                                     handledScalars);
+    }
+    if (target) {
+        if (DeclRefExpr* ref =
+                dyn_cast<DeclRefExpr>(target->IgnoreParenImpCasts())) {
+            VarDecl* var = dyn_cast<VarDecl>(ref->getDecl());
+            if (var && !isDeclaredIn(var, loop) &&
+                std::find(handledScalars.begin(), handledScalars.end(),
+                          var->getName().str()) == handledScalars.end()) {
+                return var;
+            }
+        }
+    }
+    for (auto child : stmt->children()) {
+        if (VarDecl* found =
+                findSharedScalarWrite(loop, child, handledScalars)) {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+CallExpr* Parallelizer::findImpureCall(clang::Stmt* stmt) const {
+    if (!stmt) {
+        return nullptr;
+    }
+    if (CallExpr* call = dyn_cast<CallExpr>(stmt)) {
+        const FunctionDecl* callee = call->getDirectCallee();
+        bool isPure = false;
+        if (callee) {
+            isPure =
+                callee->hasAttr<ConstAttr>() || callee->hasAttr<PureAttr>();
+            // library functions are builtins, or declared in system headers
+            // (as overloads in namespace std are)
+            const IdentifierInfo* name = callee->getIdentifier();
+            std::lock_guard<std::recursive_mutex> lock(
+                Utils::getSourceMutex());
+            if (!isPure && name &&
+                (callee->getBuiltinID() != 0 ||
+                 Context->getSourceManager().isInSystemHeader(
+                     callee->getLocation()))) {
+                llvm::StringRef base = name->getName();
+                for (const auto it : PURE_FUNCTIONS) {
+                    if (base == it || base == std::string(it) + "f" ||
+                        base == std::string(it) + "l") {
+                        isPure = true;
+                    }
+                }
+            }
+        }
+        if (!isPure) {
+            return call;
+        }
+    }
+    for (auto child : stmt->children()) {
+        if (CallExpr* found = findImpureCall(child)) {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+VarDecl* Parallelizer::findVarDecl(clang::Stmt* stmt, llvm::StringRef name) {
+    if (!stmt) {
+        return nullptr;
+    }
+    if (DeclRefExpr* ref = dyn_cast<DeclRefExpr>(stmt)) {
+        VarDecl* var = dyn_cast<VarDecl>(ref->getDecl());
+        if (var && var->getName() == name) {
+            return var;
+        }
+    } else if (DeclStmt* asDeclStmt = dyn_cast<DeclStmt>(stmt)) {
+        for (auto it : asDeclStmt->decls()) {
+            VarDecl* var = dyn_cast<VarDecl>(it);
+            if (var && var->getName() == name) {
+                return var;
+            }
+        }
+    }
+    for (auto child : stmt->children()) {
+        if (VarDecl* found = findVarDecl(child, name)) {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+void Parallelizer::collectInnerIterators(clang::Stmt* stmt,
+                                         std::vector<VarDecl*>& iterators) {
+    if (!stmt) {
+        return;
+    }
+    if (ForStmt* asForStmt = dyn_cast<ForStmt>(stmt)) {
+        if (VarDecl* iterator = getIterator(asForStmt)) {
+            iterators.push_back(iterator);
+        }
+    }
+    for (auto child : stmt->children()) {
+        collectInnerIterators(child, iterators);
+    }
+}
+
+}  // namespace spf_ie
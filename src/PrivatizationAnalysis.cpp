@@ -0,0 +1,203 @@
+#include "PrivatizationAnalysis.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DependenceGraph.hpp"
+#include "SetRelationSpec.hpp"
+
+namespace spf_ie {
+
+//! Get whether any of a list of accesses is to a data space
+static bool hasAccessTo(
+    const std::vector<std::pair<std::string, SetRelationSpec>>& accesses,
+    const std::string& dataSpace) {
+    return std::any_of(accesses.begin(), accesses.end(),
+                       [&](const std::pair<std::string, SetRelationSpec>& it) {
+                           return it.first == dataSpace;
+                       });
+}
+
+//! Get whether an expression refers to a symbolic constant, including
+//! within uninterpreted function call arguments
+static bool refersTo(const SpecExp& exp, const std::string& symbol) {
+    for (const auto& term : exp.terms) {
+        if (term.kind == SpecTerm::Kind::Symbol && term.name == symbol) {
+            return true;
+        }
+        for (const auto& arg : term.args) {
+            if (refersTo(arg, symbol)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//! Get whether a set or relation's constraints refer to a symbolic constant
+static bool refersTo(const SetRelationSpec& spec, const std::string& symbol) {
+    auto refers = [&](const SpecExp& it) { return refersTo(it, symbol); };
+    return std::any_of(spec.equalities.begin(), spec.equalities.end(),
+                       refers) ||
+           std::any_of(spec.inequalities.begin(), spec.inequalities.end(),
+                       refers);
+}
+
+//! Get whether every one of a list of constraints is also in another
+static bool isSubset(const std::vector<SpecExp>& subset,
+                     const std::vector<SpecExp>& set) {
+    return std::all_of(subset.begin(), subset.end(), [&](const SpecExp& it) {
+        return std::find(set.begin(), set.end(), it) != set.end();
+    });
+}
+
+/* PrivatizationAnalysis */
+
+std::vector<ScalarClassification> PrivatizationAnalysis::classifyScalars(
+    unsigned int stmt, int level) const {
+    std::vector<std::string> written;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (!graph.shareLoop(stmt, i, level)) {
+            continue;
+        }
+        for (const auto& it : stmts[i].scalars) {
+            if (hasAccessTo(stmts[i].dataWrites, it) &&
+                std::find(written.begin(), written.end(), it) ==
+                    written.end()) {
+                written.push_back(it);
+            }
+        }
+    }
+
+    std::vector<ScalarClassification> classifications;
+    for (const auto& it : written) {
+        classifications.push_back(classifyScalar(it, stmt, level));
+    }
+    return classifications;
+}
+
+std::vector<const Dependence*> PrivatizationAnalysis::findCarriedDependences(
+    unsigned int stmt, int level) const {
+    const std::vector<ScalarClassification> scalars =
+        classifyScalars(stmt, level);
+    std::vector<const Dependence*> carried;
+    for (const auto& it : graph.getDependences()) {
+        if (it.level != level || it.reduction != ReductionOp::None ||
+            !graph.shareLoop(it.source, stmt, level)) {
+            continue;
+        }
+        auto scalar = std::find_if(
+            scalars.begin(), scalars.end(),
+            [&](const ScalarClassification& classification) {
+                return classification.scalar == it.dataSpace;
+            });
+        if (scalar == scalars.end() || scalar->use == ScalarUse::Carried) {
+            carried.push_back(&it);
+        }
+    }
+    return carried;
+}
+
+const Dependence* PrivatizationAnalysis::findCarriedDependence(
+    unsigned int stmt, int level) const {
+    const std::vector<const Dependence*> carried =
+        findCarriedDependences(stmt, level);
+    return carried.empty() ? nullptr : carried.front();
+}
+
+ScalarClassification PrivatizationAnalysis::classifyScalar(
+    const std::string& scalar, unsigned int stmt, int level) const {
+    ScalarClassification classification;
+    classification.scalar = scalar;
+    classification.use = ScalarUse::Carried;
+    classification.reduction = ReductionOp::None;
+    classification.isLiveOut = false;
+    for (const auto& it : graph.getDependences()) {
+        if (it.kind == DependenceKind::Flow && it.dataSpace == scalar &&
+            graph.shareLoop(stmt, it.source, level) &&
+            !graph.shareLoop(stmt, it.sink, level)) {
+            classification.isLiveOut = true;
+        }
+    }
+
+    bool usedInConstraints = false;
+    bool allReductions = true;
+    bool allReadsCovered = true;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (!graph.shareLoop(stmt, i, level)) {
+            continue;
+        }
+        const StmtSpec& spec = stmts[i];
+        if (refersTo(spec.iterSpace, scalar)) {
+            usedInConstraints = true;
+        }
+        const bool isReduction =
+            spec.reduction != ReductionOp::None && !spec.dataWrites.empty() &&
+            spec.dataWrites.front().first == scalar;
+        const bool reads = hasAccessTo(spec.dataReads, scalar);
+        if (isReduction) {
+            if (classification.reduction == ReductionOp::None) {
+                classification.reduction = spec.reduction;
+            } else if (classification.reduction != spec.reduction) {
+                allReductions = false;
+            }
+        } else if (reads || hasAccessTo(spec.dataWrites, scalar)) {
+            allReductions = false;
+        }
+        if (reads && !isReadCovered(i, scalar, level)) {
+            allReadsCovered = false;
+        }
+    }
+
+    if (!usedInConstraints && allReductions &&
+        classification.reduction != ReductionOp::None) {
+        classification.use = ScalarUse::Reduction;
+    } else {
+        classification.reduction = ReductionOp::None;
+        // the value kept from a private copy is the one from the last
+        // iteration, which must then have written it
+        if (!usedInConstraints && allReadsCovered &&
+            (!classification.isLiveOut ||
+             isWrittenInEveryIteration(scalar, stmt, level))) {
+            classification.use = ScalarUse::Private;
+        }
+    }
+    return classification;
+}
+
+bool PrivatizationAnalysis::isWrittenInEveryIteration(
+    const std::string& scalar, unsigned int stmt, int level) const {
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        if (graph.shareLoop(stmt, i, level) &&
+            graph.getLoopDepth(i) == level + 1 && !stmts[i].isConditional &&
+            hasAccessTo(stmts[i].dataWrites, scalar)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PrivatizationAnalysis::isReadCovered(unsigned int reader,
+                                          const std::string& scalar,
+                                          int level) const {
+    const SetRelationSpec& readerSpace = stmts[reader].iterSpace;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        // the writer runs once in every iteration the reader does, before
+        // it: it is directly in the loop, and its constraints (those of the
+        // loops and if statements around it) are among the reader's
+        const SetRelationSpec& writerSpace = stmts[i].iterSpace;
+        if (i != reader && graph.shareLoop(reader, i, level) &&
+            graph.getLoopDepth(i) == level + 1 &&
+            graph.isTextuallyBefore(i, reader) &&
+            hasAccessTo(stmts[i].dataWrites, scalar) &&
+            isSubset(writerSpace.equalities, readerSpace.equalities) &&
+            isSubset(writerSpace.inequalities, readerSpace.inequalities)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,125 @@
+/*!
+ * \file SPFComputationBench.cpp
+ *
+ * \brief Benchmarks measuring how building SPFComputations scales with the
+ * shape of the input code.
+ *
+ * Each benchmark varies one dimension of a generated kernel's shape, holding
+ * the others at a small baseline, and reports the time and memory per
+ * statement built, in two columns:
+ * - max_rss_growth_kb: the largest growth of the resident set size measured
+ *   around one build, with the Computations built still alive. Memory freed
+ *   by earlier builds may be reused, so this is a lower bound on what one
+ *   build needs.
+ * - process_peak_rss_kb: the peak resident set size of the whole process so
+ *   far, which never decreases, so compare it by running one benchmark at a
+ *   time (with --benchmark_filter).
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "KernelGenerator.hpp"
+#include "SPFComputationBuilder.hpp"
+#include "Stats.hpp"
+#include "benchmark/benchmark.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/Tooling.h"
+#include "iegenlib.h"
+
+using namespace clang;
+using namespace spf_ie;
+
+//! Build Computations for every function of a generated kernel, timing
+//! only the building (not parsing)
+static void buildKernel(benchmark::State& state, const KernelShape& shape) {
+    std::unique_ptr<ASTUnit> AST = tooling::buildASTFromCode(
+        KernelGenerator::generate(shape), "bench_input.c",
+        std::make_shared<PCHContainerOperations>());
+    ASTContext& Context = AST->getASTContext();
+    std::vector<FunctionDecl*> funcs;
+    for (auto it : Context.getTranslationUnitDecl()->decls()) {
+        FunctionDecl* func = dyn_cast<FunctionDecl>(it);
+        if (func && func->doesThisDeclarationHaveABody()) {
+            funcs.push_back(func);
+        }
+    }
+
+    uint64_t rssGrowth = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        const uint64_t rssBefore = Stats::getCurrentRSSKilobytes();
+        state.ResumeTiming();
+        std::vector<std::unique_ptr<iegenlib::Computation>> computations =
+            SPFComputationBuilder::buildComputationsFromFunctions(&Context,
+                                                                  funcs, 1);
+        benchmark::DoNotOptimize(computations.data());
+        state.PauseTiming();
+        const uint64_t rssAfter = Stats::getCurrentRSSKilobytes();
+        if (rssAfter > rssBefore && rssAfter - rssBefore > rssGrowth) {
+            rssGrowth = rssAfter - rssBefore;
+        }
+        computations.clear();
+        state.ResumeTiming();
+    }
+
+    const double numStmts =
+        KernelGenerator::getStmtsPerFunction(shape) * shape.numFunctions;
+    state.counters["stmts"] = numStmts;
+    state.counters["time_per_stmt"] = benchmark::Counter(
+        numStmts, benchmark::Counter::kIsIterationInvariantRate |
+                      benchmark::Counter::kInvert);
+    state.counters["max_rss_growth_kb"] = rssGrowth;
+    state.counters["max_rss_growth_kb_per_stmt"] = rssGrowth / numStmts;
+    const double peakRSS = Stats::getPeakRSSKilobytes();
+    state.counters["process_peak_rss_kb"] = peakRSS;
+    state.counters["process_peak_rss_kb_per_stmt"] = peakRSS / numStmts;
+}
+
+static void BM_LoopDepth(benchmark::State& state) {
+    KernelShape shape;
+    shape.loopDepth = state.range(0);
+    buildKernel(state, shape);
+}
+BENCHMARK(BM_LoopDepth)->DenseRange(1, 8, 1);
+
+static void BM_StmtsPerBody(benchmark::State& state) {
+    KernelShape shape;
+    shape.stmtsPerBody = state.range(0);
+    buildKernel(state, shape);
+}
+BENCHMARK(BM_StmtsPerBody)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_ArrayDims(benchmark::State& state) {
+    KernelShape shape;
+    shape.arrayDims = state.range(0);
+    buildKernel(state, shape);
+}
+BENCHMARK(BM_ArrayDims)->DenseRange(1, 8, 1);
+
+static void BM_IndirectionDepth(benchmark::State& state) {
+    KernelShape shape;
+    shape.indirectionDepth = state.range(0);
+    buildKernel(state, shape);
+}
+BENCHMARK(BM_IndirectionDepth)->DenseRange(0, 8, 1);
+
+static void BM_IfDepth(benchmark::State& state) {
+    KernelShape shape;
+    shape.ifDepth = state.range(0);
+    buildKernel(state, shape);
+}
+BENCHMARK(BM_IfDepth)->DenseRange(0, 8, 1);
+
+static void BM_NumFunctions(benchmark::State& state) {
+    KernelShape shape;
+    shape.numFunctions = state.range(0);
+    buildKernel(state, shape);
+}
+BENCHMARK(BM_NumFunctions)->RangeMultiplier(4)->Range(1, 256);
+
+BENCHMARK_MAIN();
@@ -1,105 +1,586 @@
 #include "SPFComputationBuilder.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "Archive.hpp"
+#include "ComputationCache.hpp"
+#include "SetRelationSpec.hpp"
+#include "Stats.hpp"
+#include "SymbolTable.hpp"
+#include "TimeTrace.hpp"
 #include "Utils.hpp"
 #include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
 #include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceManager.h"
 #include "iegenlib.h"
+#include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
 namespace spf_ie {
 
+//! Check whether two expressions are the same, ignoring parentheses and
+//! implicit casts around them
+static bool isSameExpr(const Expr* expr1, const Expr* expr2,
+                       const ASTContext* Context) {
+    llvm::FoldingSetNodeID id1;
+    llvm::FoldingSetNodeID id2;
+    expr1->IgnoreParenImpCasts()->Profile(id1, *Context, true);
+    expr2->IgnoreParenImpCasts()->Profile(id2, *Context, true);
+    return id1 == id2;
+}
+
+//! Get whether a variable is a scalar which may be tracked as a data space.
+//! Globals and statics are left out, since their values may be read after
+//! the function returns.
+static bool isTrackableScalar(const VarDecl* var) {
+    return !var->hasGlobalStorage() && (var->getType()->isIntegerType() ||
+                                        var->getType()->isFloatingType());
+}
+
+//! Count the variables declared in a statement and everything inside it, by
+//! name
+static void countDeclaredNames(const clang::Stmt* stmt,
+                               llvm::StringMap<unsigned int>& counts) {
+    if (const DeclStmt* asDeclStmt = dyn_cast<DeclStmt>(stmt)) {
+        for (const auto it : asDeclStmt->decls()) {
+            if (const VarDecl* var = dyn_cast<VarDecl>(it)) {
+                counts[var->getName()]++;
+            }
+        }
+    }
+    for (const auto child : stmt->children()) {
+        if (child) {
+            countDeclaredNames(child, counts);
+        }
+    }
+}
+
+//! Recognize an assignment which combines a value into its left-hand side
+//! with an associative and commutative operator: x += e, x -= e, x *= e,
+//! x = x + e (and the like), or x = x < e ? x : e (and the like, for min
+//! and max)
+//! \param[in] assignment Assignment to check
+//! \param[out] numLHSReads Number of times the pattern reads the left-hand
+//! side
+//! \param[in] Context ASTContext the assignment belongs to
+//! \return the operator, or None if the assignment is not of such a form
+static ReductionOp getReductionPattern(BinaryOperator* assignment,
+                                       int& numLHSReads,
+                                       const ASTContext* Context) {
+    Expr* lhs = assignment->getLHS();
+    numLHSReads = 1;
+    switch (assignment->getOpcode()) {
+        case BO_AddAssign:
+        case BO_SubAssign:
+            return ReductionOp::Sum;
+        case BO_MulAssign:
+            return ReductionOp::Product;
+        case BO_Assign:
+            break;
+        default:
+            return ReductionOp::None;
+    }
+
+    Expr* rhs = assignment->getRHS()->IgnoreParenImpCasts();
+    if (BinaryOperator* asBinOper = dyn_cast<BinaryOperator>(rhs)) {
+        const bool lhsFirst = isSameExpr(lhs, asBinOper->getLHS(), Context);
+        const bool lhsSecond = isSameExpr(lhs, asBinOper->getRHS(), Context);
+        switch (asBinOper->getOpcode()) {
+            case BO_Add:
+                return lhsFirst || lhsSecond ? ReductionOp::Sum
+                                             : ReductionOp::None;
+            case BO_Sub:
+                return lhsFirst ? ReductionOp::Sum : ReductionOp::None;
+            case BO_Mul:
+                return lhsFirst || lhsSecond ? ReductionOp::Product
+                                             : ReductionOp::None;
+            default:
+                return ReductionOp::None;
+        }
+    }
+
+    ConditionalOperator* asCondOper = dyn_cast<ConditionalOperator>(rhs);
+    if (!asCondOper) {
+        return ReductionOp::None;
+    }
+    BinaryOperator* cond =
+        dyn_cast<BinaryOperator>(asCondOper->getCond()->IgnoreParenImpCasts());
+    if (!cond) {
+        return ReductionOp::None;
+    }
+    bool isLess;
+    switch (cond->getOpcode()) {
+        case BO_LT:
+        case BO_LE:
+            isLess = true;
+            break;
+        case BO_GT:
+        case BO_GE:
+            isLess = false;
+            break;
+        default:
+            return ReductionOp::None;
+    }
+    Expr* first = cond->getLHS();
+    Expr* second = cond->getRHS();
+    if (!isSameExpr(lhs, first, Context) &&
+        !isSameExpr(lhs, second, Context)) {
+        return ReductionOp::None;
+    }
+    // a < b ? a : b is the minimum, and a < b ? b : a the maximum
+    bool choosesFirst;
+    if (isSameExpr(asCondOper->getTrueExpr(), first, Context) &&
+        isSameExpr(asCondOper->getFalseExpr(), second, Context)) {
+        choosesFirst = true;
+    } else if (isSameExpr(asCondOper->getTrueExpr(), second, Context) &&
+               isSameExpr(asCondOper->getFalseExpr(), first, Context)) {
+        choosesFirst = false;
+    } else {
+        return ReductionOp::None;
+    }
+    numLHSReads = 2;
+    return isLess == choosesFirst ? ReductionOp::Min : ReductionOp::Max;
+}
+
 /* SPFComputationBuilder */
 
-SPFComputationBuilder::SPFComputationBuilder(){};
+std::mutex SPFComputationBuilder::iegenlibMutex;
+
+SPFComputationBuilder::SPFComputationBuilder(const ASTContext* Context)
+    : Context(Context),
+      symbols(Context),
+      constructFromStrings(false),
+      cache(nullptr),
+      archive(nullptr),
+      keepStmtSpecs(false),
+      keptStmtSpecsComplete(false),
+      currentStmtContext(&symbols, &functionArena){};
+
+SPFComputationBuilder::~SPFComputationBuilder() {
+    std::lock_guard<std::mutex> lock(iegenlibMutex);
+    computation.reset();
+}
 
 std::unique_ptr<iegenlib::Computation>
 SPFComputationBuilder::buildComputationFromFunction(FunctionDecl* funcDecl) {
     if (CompoundStmt* funcBody = dyn_cast<CompoundStmt>(funcDecl->getBody())) {
+        llvm::TimeTraceScope functionScope("BuildFunction", [&]() {
+            return funcDecl->getQualifiedNameAsString();
+        });
+        std::string cacheKey;
+        keptStmtSpecs.clear();
+        keptStmtSpecsComplete = false;
+        if (cache) {
+            cacheKey = ComputationCache::getKey(funcDecl, Context);
+            std::vector<StmtSpec> cachedStmts;
+            if (cache->load(cacheKey, cachedStmts)) {
+                Stats::add(Stat::CacheHits);
+                if (Stats::isEnabled()) {
+                    Stats::recordFunction(
+                        {getMainFileName(),
+                         funcDecl->getQualifiedNameAsString(), "cache",
+                         cachedStmts.size(), 0,
+                         Stats::getPeakRSSKilobytes()});
+                }
+                if (archive) {
+                    archive->addFunction(getMainFileName(),
+                                         funcDecl->getQualifiedNameAsString(),
+                                         cachedStmts);
+                }
+                std::unique_ptr<iegenlib::Computation> cachedComputation =
+                    makeComputationFromSpecs(cachedStmts);
+                if (keepStmtSpecs) {
+                    keptStmtSpecs = std::move(cachedStmts);
+                    keptStmtSpecsComplete = true;
+                }
+                return cachedComputation;
+            }
+            Stats::add(Stat::CacheMisses);
+        }
+
         // reset builder components
+        writtenScalars.clear();
+        collectWrittenScalars(funcBody);
+        untrackShadowedScalars(funcDecl);
         stmtNumber = 0;
+        replacementVarNumber = 0;
         largestScheduleDimension = 0;
-        currentStmtContext = StmtContext();
+        currentStmtContext = StmtContext(&symbols, &functionArena);
         stmtContexts.clear();
-        computation = std::make_unique<iegenlib::Computation>();
+        stmtSpecs.clear();
+        allStmtsDescribed = !constructFromStrings;
+        {
+            std::lock_guard<std::mutex> lock(iegenlibMutex);
+            computation = std::make_unique<iegenlib::Computation>();
+        }
+        Stats::add(Stat::IEGenLibObjectsCreated);
 
         // perform processing
-        processBody(funcBody);
+        {
+            llvm::TimeTraceScope bodyScope("ProcessBody");
+            processBody(funcBody);
+        }
 
         // collect results into Computation
         for (auto& stmtContext : stmtContexts) {
-            // source code
-            std::string stmtSourceCode = Utils::stmtToString(stmtContext.stmt);
-            // iteration space
-            std::string iterationSpace = stmtContext.getIterSpaceString();
-            // execution schedule
-            // zero-pad schedule to maximum dimension encountered
-            stmtContext.schedule.zeroPadDimension(largestScheduleDimension);
-            std::string executionSchedule = stmtContext.getExecScheduleString();
-            // data accesses
-            std::vector<std::pair<std::string, std::string>> dataReads;
-            std::vector<std::pair<std::string, std::string>> dataWrites;
+            llvm::TimeTraceScope stmtScope("BuildStmt", [&]() {
+                return Utils::stmtToString(stmtContext.stmt, Context);
+            });
+            // enforce loop invariance
             for (auto& it_accesses : stmtContext.dataAccesses.arrayAccesses) {
-                std::string dataSpaceAccessed =
-                    Utils::stmtToString(it_accesses.second.base);
-                // enforce loop invariance
-                if (!it_accesses.second.isRead) {
-                    for (const auto& invariantGroup : stmtContext.invariants) {
-                        if (std::find(
-                                invariantGroup.begin(), invariantGroup.end(),
-                                dataSpaceAccessed) != invariantGroup.end()) {
-                            Utils::printErrorAndExit(
-                                "Code may not modify loop-invariant data "
-                                "space '" +
-                                    dataSpaceAccessed + "'",
-                                stmtContext.stmt);
-                        }
-                    }
+                if (it_accesses.isRead) {
+                    continue;
+                }
+                SymbolID dataSpaceAccessed = it_accesses.dataSpace;
+                if (stmtContext.isInvariant(dataSpaceAccessed)) {
+                    Utils::printErrorAndExit(
+                        "Code may not modify loop-invariant data space '" +
+                            symbols.getText(dataSpaceAccessed).str() + "'",
+                        stmtContext.stmt, Context);
                 }
-                // insert data access
-                (it_accesses.second.isRead ? dataReads : dataWrites)
-                    .push_back(std::make_pair(
-                        dataSpaceAccessed,
-                        stmtContext.getDataAccessString(&it_accesses.second)));
             }
 
-            // insert Computation data spaces
-            auto stmtDataSpaces = stmtContext.dataAccesses.dataSpaces;
-            for (const auto& dataSpaceName :
+            iegenlib::Stmt newStmt = makeStmt(stmtContext);
+
+            // insert Computation data spaces and statement
+            std::lock_guard<std::mutex> lock(iegenlibMutex);
+            for (const auto& dataSpace :
                  stmtContext.dataAccesses.dataSpaces) {
-                computation->addDataSpace(dataSpaceName);
+                computation->addDataSpace(symbols.getText(dataSpace).str());
             }
-
-            // create and insert iegenlib Stmt
-            computation->addStmt(std::move(
-                iegenlib::Stmt(stmtSourceCode, iterationSpace,
-                               executionSchedule, dataReads, dataWrites)));
+            computation->addStmt(std::move(newStmt));
         }
 
         // sanity check Computation completeness
-        if (!computation->isComplete()) {
+        bool complete;
+        {
+            llvm::TimeTraceScope completeScope("IsComplete");
+            std::lock_guard<std::mutex> lock(iegenlibMutex);
+            complete = computation->isComplete();
+        }
+        if (!complete) {
             Utils::printErrorAndExit(
                 "Computation is in an inconsistent/incomplete state after "
                 "building from function '" +
                     funcDecl->getQualifiedNameAsString() +
                     "'. This "
                     "should not be possible and most likely indicates a bug.",
-                funcBody);
+                funcBody, Context);
+        }
+
+        if (cache && allStmtsDescribed) {
+            llvm::TimeTraceScope storeScope("StoreInCache");
+            cache->store(cacheKey, stmtSpecs);
+        }
+        if (archive) {
+            if (allStmtsDescribed) {
+                archive->addFunction(
+                    getMainFileName(), funcDecl->getQualifiedNameAsString(),
+                    keepStmtSpecs ? stmtSpecs : std::move(stmtSpecs));
+            } else {
+                Utils::warnNotDescribed("archiving",
+                                        funcDecl->getQualifiedNameAsString());
+            }
+        }
+
+        if (keepStmtSpecs) {
+            keptStmtSpecs = std::move(stmtSpecs);
+            keptStmtSpecsComplete = allStmtsDescribed;
+        }
+
+        if (Stats::isEnabled()) {
+            Stats::recordFunction(
+                {getMainFileName(), funcDecl->getQualifiedNameAsString(),
+                 "built", stmtNumber, functionArena.getBytesAllocated(),
+                 Stats::getPeakRSSKilobytes()});
         }
 
+        // release everything describing this function's statements at once
+        stmtContexts.clear();
+        stmtSpecs.clear();
+        currentStmtContext = StmtContext(&symbols, &functionArena);
+        functionArena.Reset();
+
         return std::move(computation);
     } else {
-        Utils::printErrorAndExit("Invalid function body", funcDecl->getBody());
+        Utils::printErrorAndExit("Invalid function body", funcDecl->getBody(),
+                                 Context);
+    }
+}
+
+std::vector<std::unique_ptr<iegenlib::Computation>>
+SPFComputationBuilder::buildComputationsFromFunctions(
+    const ASTContext* Context, const std::vector<FunctionDecl*>& funcDecls,
+    unsigned int numThreads, ComputationCache* cache, ArchiveWriter* archive) {
+    std::vector<std::unique_ptr<iegenlib::Computation>> computations(
+        funcDecls.size());
+    buildComputationsFromFunctions(
+        Context, funcDecls, numThreads, cache, archive,
+        [&computations](size_t index,
+                        std::unique_ptr<iegenlib::Computation> computation,
+                        const std::vector<StmtSpec>*) {
+            computations[index] = std::move(computation);
+        });
+    return computations;
+}
+
+void SPFComputationBuilder::buildComputationsFromFunctions(
+    const ASTContext* Context, const std::vector<FunctionDecl*>& funcDecls,
+    unsigned int numThreads, ComputationCache* cache, ArchiveWriter* archive,
+    const ComputationHandler& onBuilt, bool keepStmtSpecs) {
+    numThreads = std::min<size_t>(numThreads, funcDecls.size());
+    if (numThreads <= 1) {
+        SPFComputationBuilder builder(Context);
+        builder.setCache(cache);
+        builder.setArchive(archive);
+        builder.setKeepStmtSpecs(keepStmtSpecs);
+        std::vector<StmtSpec> stmtSpecs;
+        for (size_t i = 0; i < funcDecls.size(); ++i) {
+            std::unique_ptr<iegenlib::Computation> computation =
+                builder.buildComputationFromFunction(funcDecls[i]);
+            const bool haveSpecs = builder.takeStmtSpecs(stmtSpecs);
+            onBuilt(i, std::move(computation),
+                    haveSpecs ? &stmtSpecs : nullptr);
+        }
+        return;
+    }
+
+    // each worker claims the next unbuilt function and parks its result in
+    // that function's slot; whichever worker fills the slot the handler is
+    // waiting on takes every consecutive finished result and passes them to
+    // the handler outside the lock, taking any which become ready meanwhile,
+    // so the handler sees input order and is never called concurrently while
+    // other workers keep building
+    struct FinishedFunction {
+        std::unique_ptr<iegenlib::Computation> computation;
+        std::vector<StmtSpec> stmtSpecs;
+        bool haveSpecs;
+    };
+    using ReadyFunctions = std::vector<std::pair<size_t, FinishedFunction>>;
+    std::vector<FinishedFunction> finished(funcDecls.size());
+    size_t nextToHandle = 0;
+    // whether some worker is passing results to the handler
+    bool handling = false;
+    std::mutex finishedMutex;
+    std::atomic<size_t> nextFunc(0);
+    // the first error stops every worker once its current function is done,
+    // and is passed on to the calling thread
+    std::exception_ptr error;
+    // the workers share only this ASTContext, so other translation units'
+    // workers do not wait for its queries
+    std::recursive_mutex sourceMutex;
+    // take the finished results the handler can be given next, with
+    // finishedMutex held
+    auto takeReady = [&](ReadyFunctions& ready) {
+        while (nextToHandle < funcDecls.size() &&
+               finished[nextToHandle].computation) {
+            ready.emplace_back(nextToHandle,
+                               std::move(finished[nextToHandle]));
+            nextToHandle++;
+        }
+    };
+    auto worker = [&]() {
+        TimeTrace::ThreadScope traceThread;
+        Utils::ExitDeferral deferral;
+        Utils::SourceSharing sourceSharing(sourceMutex);
+        SPFComputationBuilder builder(Context);
+        builder.setCache(cache);
+        builder.setArchive(archive);
+        builder.setKeepStmtSpecs(keepStmtSpecs);
+        ReadyFunctions ready;
+        try {
+            for (size_t i = nextFunc++; i < funcDecls.size();
+                 i = nextFunc++) {
+                FinishedFunction result;
+                result.computation =
+                    builder.buildComputationFromFunction(funcDecls[i]);
+                result.haveSpecs = builder.takeStmtSpecs(result.stmtSpecs);
+                {
+                    std::lock_guard<std::mutex> lock(finishedMutex);
+                    finished[i] = std::move(result);
+                    if (!handling) {
+                        takeReady(ready);
+                        handling = !ready.empty();
+                    }
+                }
+                while (!ready.empty()) {
+                    for (auto& it : ready) {
+                        onBuilt(it.first, std::move(it.second.computation),
+                                it.second.haveSpecs ? &it.second.stmtSpecs
+                                                    : nullptr);
+                    }
+                    ready.clear();
+                    std::lock_guard<std::mutex> lock(finishedMutex);
+                    takeReady(ready);
+                    handling = !ready.empty();
+                }
+            }
+        } catch (const BuildError&) {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            nextFunc = funcDecls.size();
+            // results taken but not handled are freed like the parked ones
+            std::lock_guard<std::mutex> iegenlibLock(iegenlibMutex);
+            ready.clear();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto& it : workers) {
+        it.join();
+    }
+    if (error) {
+        // functions built after the failed one are never handled
+        {
+            std::lock_guard<std::mutex> lock(iegenlibMutex);
+            finished.clear();
+        }
+        if (!Utils::isExitDeferred()) {
+            exit(1);
+        }
+        std::rethrow_exception(error);
+    }
+}
+
+bool SPFComputationBuilder::takeStmtSpecs(std::vector<StmtSpec>& stmts) {
+    stmts = std::move(keptStmtSpecs);
+    keptStmtSpecs.clear();
+    return keepStmtSpecs && keptStmtSpecsComplete;
+}
+
+std::string SPFComputationBuilder::getMainFileName() const {
+    std::lock_guard<std::recursive_mutex> lock(Utils::getSourceMutex());
+    const SourceManager& SM = Context->getSourceManager();
+    const FileEntry* mainFile = SM.getFileEntryForID(SM.getMainFileID());
+    return mainFile ? mainFile->getName().str() : "";
+}
+
+std::unique_ptr<iegenlib::Computation>
+SPFComputationBuilder::makeComputationFromSpecs(
+    const std::vector<StmtSpec>& stmts) {
+    llvm::TimeTraceScope loadScope("ConstructCachedStmts");
+    std::lock_guard<std::mutex> lock(iegenlibMutex);
+    auto cachedComputation = std::make_unique<iegenlib::Computation>();
+    Stats::add(Stat::IEGenLibObjectsCreated);
+    for (const auto& stmt : stmts) {
+        for (const auto& dataSpace : stmt.dataSpaces) {
+            cachedComputation->addDataSpace(dataSpace);
+        }
+        cachedComputation->addStmt(stmt.toStmt());
+    }
+    return cachedComputation;
+}
+
+iegenlib::Stmt SPFComputationBuilder::makeStmt(StmtContext& stmtContext) {
+    std::string stmtSourceCode = Utils::stmtToString(stmtContext.stmt, Context);
+    if (constructFromStrings) {
+        return makeStmtFromStrings(stmtContext, stmtSourceCode);
+    }
+
+    // describe everything before constructing anything, so that the whole
+    // statement can fall back to the string form if some part can't be
+    // described
+    const unsigned int initialReplacementVarNumber = replacementVarNumber;
+    StmtSpec spec;
+    bool describable;
+    {
+        llvm::TimeTraceScope describeScope("DescribeStmt");
+        spec.sourceCode = stmtSourceCode;
+        describable = stmtContext.getIterSpaceSpec(spec.iterSpace);
+        for (auto& it_accesses : stmtContext.dataAccesses.arrayAccesses) {
+            if (!describable) {
+                break;
+            }
+            SetRelationSpec accessSpec;
+            describable = stmtContext.getDataAccessSpec(
+                &it_accesses, replacementVarNumber, accessSpec);
+            (it_accesses.isRead ? spec.dataReads : spec.dataWrites)
+                .push_back(std::make_pair(
+                    symbols.getText(it_accesses.dataSpace).str(),
+                    accessSpec));
+        }
+    }
+    if (!describable) {
+        replacementVarNumber = initialReplacementVarNumber;
+        return makeStmtFromStrings(stmtContext, stmtSourceCode);
+    }
+    spec.execSchedule =
+        stmtContext.getExecScheduleSpec(largestScheduleDimension);
+    spec.reduction = stmtContext.reduction;
+    spec.isConditional = stmtContext.isConditional();
+
+    if (cache || archive || keepStmtSpecs) {
+        for (const auto& dataSpace : stmtContext.dataAccesses.dataSpaces) {
+            spec.dataSpaces.push_back(symbols.getText(dataSpace).str());
+        }
+        for (const auto& it : stmtContext.dataAccesses.arrayAccesses) {
+            const std::string name = symbols.getText(it.dataSpace).str();
+            if (it.indexes.empty() &&
+                std::find(spec.scalars.begin(), spec.scalars.end(), name) ==
+                    spec.scalars.end()) {
+                spec.scalars.push_back(name);
+            }
+        }
+        stmtSpecs.push_back(spec);
     }
+
+    llvm::TimeTraceScope constructScope("ConstructStmt");
+    std::lock_guard<std::mutex> lock(iegenlibMutex);
+    return spec.toStmt();
+}
+
+iegenlib::Stmt SPFComputationBuilder::makeStmtFromStrings(
+    StmtContext& stmtContext, const std::string& stmtSourceCode) {
+    // the cache only holds functions which can be built without parsing
+    allStmtsDescribed = false;
+
+    std::string iterationSpace;
+    std::string executionSchedule;
+    std::vector<std::pair<std::string, std::string>> dataReads;
+    std::vector<std::pair<std::string, std::string>> dataWrites;
+    {
+        llvm::TimeTraceScope formatScope("FormatStmtStrings");
+        iterationSpace = stmtContext.getIterSpaceString();
+        executionSchedule =
+            stmtContext.getExecScheduleString(largestScheduleDimension);
+        for (auto& it_accesses : stmtContext.dataAccesses.arrayAccesses) {
+            (it_accesses.isRead ? dataReads : dataWrites)
+                .push_back(std::make_pair(
+                    symbols.getText(it_accesses.dataSpace).str(),
+                    stmtContext.getDataAccessString(&it_accesses,
+                                                    replacementVarNumber)));
+        }
+    }
+
+    llvm::TimeTraceScope parseScope("ParseStmtStrings");
+    // the Stmt, its iteration space and schedule, and each access relation
+    Stats::add(Stat::IEGenLibObjectsCreated,
+               3 + dataReads.size() + dataWrites.size());
+    std::lock_guard<std::mutex> lock(iegenlibMutex);
+    return iegenlib::Stmt(stmtSourceCode, iterationSpace, executionSchedule,
+                          dataReads, dataWrites);
 }
 
 void SPFComputationBuilder::processBody(clang::Stmt* stmt) {
@@ -121,7 +602,7 @@ void SPFComputationBuilder::processSingleStmt(clang::Stmt* stmt) {
         isa<CallExpr>(stmt)) {
         Utils::printErrorAndExit("Unsupported stmt type " +
                                      std::string(stmt->getStmtClassName()),
-                                 stmt);
+                                 stmt, Context);
     }
 
     if (ForStmt* asForStmt = dyn_cast<ForStmt>(stmt)) {
@@ -133,7 +614,7 @@ void SPFComputationBuilder::processSingleStmt(clang::Stmt* stmt) {
         if (asIfStmt->getConditionVariable()) {
             Utils::printErrorAndExit(
                 "If statement condition variable declarations are unsupported",
-                asIfStmt);
+                asIfStmt, Context);
         }
         currentStmtContext.enterIf(asIfStmt);
         processBody(asIfStmt->getThen());
@@ -152,32 +633,193 @@ void SPFComputationBuilder::processSingleStmt(clang::Stmt* stmt) {
 }
 
 void SPFComputationBuilder::addStmt(clang::Stmt* stmt) {
+    DataAccessHandler& dataAccesses = currentStmtContext.dataAccesses;
     // capture reads and writes made in statement
     if (DeclStmt* asDeclStmt = dyn_cast<DeclStmt>(stmt)) {
         VarDecl* decl = cast<VarDecl>(asDeclStmt->getSingleDecl());
         if (decl->hasInit()) {
-            currentStmtContext.dataAccesses.processAsReads(decl->getInit());
+            dataAccesses.processAsReads(decl->getInit());
+            processScalarReads(decl->getInit());
+            if (writtenScalars.count(decl)) {
+                dataAccesses.processScalarAccess(
+                    asDeclStmt->getID(*Context), nullptr,
+                    symbols.intern(decl->getName()), false);
+            }
         }
     } else if (BinaryOperator* asBinOper = dyn_cast<BinaryOperator>(stmt)) {
-        if (ArraySubscriptExpr* lhsAsArrayAccess =
-                dyn_cast<ArraySubscriptExpr>(asBinOper->getLHS())) {
-            currentStmtContext.dataAccesses.processAsWrite(lhsAsArrayAccess);
+        ArraySubscriptExpr* lhsAsArrayAccess =
+            dyn_cast<ArraySubscriptExpr>(asBinOper->getLHS());
+        DeclRefExpr* lhsAsScalar = getTrackedScalar(asBinOper->getLHS());
+        if (lhsAsArrayAccess) {
+            dataAccesses.processAsWrite(lhsAsArrayAccess);
+            processScalarReads(lhsAsArrayAccess);
+        } else if (lhsAsScalar) {
+            dataAccesses.processScalarAccess(lhsAsScalar->getID(*Context),
+                                             lhsAsScalar,
+                                             symbols.getSymbol(lhsAsScalar),
+                                             false);
         }
         if (asBinOper->isCompoundAssignmentOp()) {
-            currentStmtContext.dataAccesses.processAsReads(asBinOper->getLHS());
+            dataAccesses.processAsReads(asBinOper->getLHS());
+            if (lhsAsScalar) {
+                processScalarReads(lhsAsScalar);
+            }
+        }
+        dataAccesses.processAsReads(asBinOper->getRHS());
+        processScalarReads(asBinOper->getRHS());
+
+        if (lhsAsArrayAccess || lhsAsScalar) {
+            int numLHSReads;
+            const ReductionOp reduction =
+                getReductionPattern(asBinOper, numLHSReads, Context);
+            recordReduction(reduction, numLHSReads);
+        }
+    } else if (UnaryOperator* asUnOper = dyn_cast<UnaryOperator>(stmt)) {
+        // an increment or decrement reads and writes its operand, which is a
+        // sum reduction
+        Expr* operand = asUnOper->getSubExpr()->IgnoreParens();
+        ArraySubscriptExpr* operandAsArrayAccess =
+            dyn_cast<ArraySubscriptExpr>(operand);
+        DeclRefExpr* operandAsScalar = getTrackedScalar(operand);
+        if (asUnOper->isIncrementDecrementOp() &&
+            (operandAsArrayAccess || operandAsScalar)) {
+            if (operandAsArrayAccess) {
+                dataAccesses.processAsWrite(operandAsArrayAccess);
+                dataAccesses.processAsReads(operandAsArrayAccess);
+            } else {
+                dataAccesses.processScalarAccess(
+                    operandAsScalar->getID(*Context), operandAsScalar,
+                    symbols.getSymbol(operandAsScalar), false);
+            }
+            processScalarReads(operand);
+            recordReduction(ReductionOp::Sum, 1);
+        }
+    } else if (ReturnStmt* asReturnStmt = dyn_cast<ReturnStmt>(stmt)) {
+        if (Expr* value = asReturnStmt->getRetValue()) {
+            dataAccesses.processAsReads(value);
+            processScalarReads(value);
         }
-        currentStmtContext.dataAccesses.processAsReads(asBinOper->getRHS());
     }
 
     // increase largest schedule dimension, if necessary
     largestScheduleDimension = std::max(
         largestScheduleDimension, currentStmtContext.schedule.getDimension());
 
-    // store processed statement
+    // store processed statement; the next statement starts with the same
+    // (shared) scope
     currentStmtContext.stmt = stmt;
-    stmtContexts.push_back(currentStmtContext);
-    currentStmtContext = StmtContext(&currentStmtContext);
+    Stats::add(Stat::StmtsProcessed);
+    StmtContext nextStmtContext(&currentStmtContext);
+    stmtContexts.push_back(std::move(currentStmtContext));
+    currentStmtContext = std::move(nextStmtContext);
     stmtNumber++;
 }
 
+void SPFComputationBuilder::collectWrittenScalars(clang::Stmt* stmt) {
+    if (CompoundStmt* asCompoundStmt = dyn_cast<CompoundStmt>(stmt)) {
+        for (auto it : asCompoundStmt->body()) {
+            collectWrittenScalars(it);
+        }
+        return;
+    } else if (ForStmt* asForStmt = dyn_cast<ForStmt>(stmt)) {
+        collectWrittenScalars(asForStmt->getBody());
+        return;
+    } else if (IfStmt* asIfStmt = dyn_cast<IfStmt>(stmt)) {
+        collectWrittenScalars(asIfStmt->getThen());
+        if (asIfStmt->getElse()) {
+            collectWrittenScalars(asIfStmt->getElse());
+        }
+        return;
+    }
+
+    Expr* target = nullptr;
+    if (DeclStmt* asDeclStmt = dyn_cast<DeclStmt>(stmt)) {
+        VarDecl* decl = dyn_cast<VarDecl>(asDeclStmt->getSingleDecl());
+        if (decl && decl->hasInit() && isTrackableScalar(decl)) {
+            writtenScalars.insert(decl);
+        }
+    } else if (BinaryOperator* asBinOper = dyn_cast<BinaryOperator>(stmt)) {
+        if (asBinOper->isAssignmentOp()) {
+            target = asBinOper->getLHS();
+        }
+    } else if (UnaryOperator* asUnOper = dyn_cast<UnaryOperator>(stmt)) {
+        if (asUnOper->isIncrementDecrementOp()) {
+            target = asUnOper->getSubExpr();
+        }
+    }
+    if (target) {
+        if (DeclRefExpr* ref =
+                dyn_cast<DeclRefExpr>(target->IgnoreParenImpCasts())) {
+            VarDecl* var = dyn_cast<VarDecl>(ref->getDecl());
+            if (var && isTrackableScalar(var)) {
+                writtenScalars.insert(var);
+            }
+        }
+    }
+}
+
+void SPFComputationBuilder::untrackShadowedScalars(FunctionDecl* funcDecl) {
+    llvm::StringMap<unsigned int> counts;
+    for (const auto it : funcDecl->parameters()) {
+        counts[it->getName()]++;
+    }
+    countDeclaredNames(funcDecl->getBody(), counts);
+    llvm::SmallVector<const VarDecl*, 8> shadowed;
+    for (const auto it : writtenScalars) {
+        if (counts.lookup(it->getName()) > 1) {
+            shadowed.push_back(it);
+        }
+    }
+    for (const auto it : shadowed) {
+        writtenScalars.erase(it);
+    }
+}
+
+DeclRefExpr* SPFComputationBuilder::getTrackedScalar(Expr* expr) {
+    DeclRefExpr* ref = dyn_cast<DeclRefExpr>(expr->IgnoreParenImpCasts());
+    if (!ref) {
+        return nullptr;
+    }
+    VarDecl* var = dyn_cast<VarDecl>(ref->getDecl());
+    if (!var || !writtenScalars.count(var) ||
+        currentStmtContext.isIterator(symbols.getSymbol(ref))) {
+        return nullptr;
+    }
+    return ref;
+}
+
+void SPFComputationBuilder::processScalarReads(Expr* expr) {
+    if (DeclRefExpr* scalar = getTrackedScalar(expr)) {
+        currentStmtContext.dataAccesses.processScalarAccess(
+            scalar->getID(*Context), scalar, symbols.getSymbol(scalar), true);
+        return;
+    }
+    for (auto child : expr->children()) {
+        if (Expr* childExpr = dyn_cast_or_null<Expr>(child)) {
+            processScalarReads(childExpr);
+        }
+    }
+}
+
+void SPFComputationBuilder::recordReduction(ReductionOp reduction,
+                                            int numLHSReads) {
+    if (reduction == ReductionOp::None) {
+        return;
+    }
+    const auto& accesses = currentStmtContext.dataAccesses.arrayAccesses;
+    auto write =
+        std::find_if(accesses.begin(), accesses.end(),
+                     [](const ArrayAccess& it) { return !it.isRead; });
+    if (write == accesses.end()) {
+        return;
+    }
+    const int numReads = std::count_if(
+        accesses.begin(), accesses.end(), [&](const ArrayAccess& it) {
+            return it.isRead && it.dataSpace == write->dataSpace;
+        });
+    if (numReads == numLHSReads) {
+        currentStmtContext.reduction = reduction;
+    }
+}
+
 }  // namespace spf_ie
@@ -6,31 +6,51 @@
  *
  * \author Anna Rift
  */
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
-#include "Driver.hpp"
+#include "Archive.hpp"
+#include "CodeGenerator.hpp"
+#include "ComputationCache.hpp"
+#include "ComputationJSON.hpp"
+#include "DataReorderer.hpp"
+#include "DependenceGraph.hpp"
+#include "FormatConverter.hpp"
+#include "LevelSetGenerator.hpp"
+#include "LoopRestructurer.hpp"
+#include "LoopTiler.hpp"
+#include "Parallelizer.hpp"
+#include "PrivatizationAnalysis.hpp"
 #include "SPFComputationBuilder.hpp"
+#include "Server.hpp"
+#include "Stats.hpp"
+#include "SymbolTable.hpp"
 #include "Utils.hpp"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/Frontend/ASTUnit.h"
 #include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
 #include "gtest/gtest.h"
 #include "iegenlib.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 using namespace spf_ie;
 
-const ASTContext* spf_ie::Context;
-
 /*!
  * \class SPFComputationTest
  *
@@ -46,23 +66,125 @@ class SPFComputationTest : public ::testing::Test {
 
     std::string replacementVarName = REPLACEMENT_VAR_BASE_NAME;
 
-    //! Build SPFComputations from every function in the provided code.
-    std::vector<std::unique_ptr<iegenlib::Computation>>
-    buildSPFComputationsFromCode(std::string code) {
-        std::unique_ptr<ASTUnit> AST = tooling::buildASTFromCode(
-            code, "test_input.cpp", std::make_shared<PCHContainerOperations>());
-        Context = &AST->getASTContext();
-
+    /*!
+     * \struct ParsedCode
+     *
+     * \brief Parsed source code, the functions in it, and what was built
+     * from them
+     */
+    struct ParsedCode {
+        //! AST of the code, which the functions belong to
+        std::unique_ptr<ASTUnit> AST;
+        //! Every function with a body, in source order
+        std::vector<FunctionDecl*> funcs;
+        //! Specs of each function's statements, if built
+        std::vector<std::vector<StmtSpec>> stmtSpecs;
+        //! Computation of each function, if built
         std::vector<std::unique_ptr<iegenlib::Computation>> computations;
-        SPFComputationBuilder builder;
-        for (auto it : Context->getTranslationUnitDecl()->decls()) {
+
+        ASTContext& getContext() { return AST->getASTContext(); }
+    };
+
+    //! Parse code and find every function with a body in it
+    //! \param[in] code Source code to parse
+    ParsedCode parseCode(std::string code) {
+        ParsedCode parsed;
+        parsed.AST = tooling::buildASTFromCode(
+            code, "test_input.cpp", std::make_shared<PCHContainerOperations>());
+        for (auto it : parsed.getContext().getTranslationUnitDecl()->decls()) {
             FunctionDecl* func = dyn_cast<FunctionDecl>(it);
             if (func && func->doesThisDeclarationHaveABody()) {
+                parsed.funcs.push_back(func);
+            }
+        }
+        return parsed;
+    }
+
+    //! Build a Computation from every function in the provided code, also
+    //! keeping the specs of each function's statements.
+    //! \param[in] code Source code to process
+    ParsedCode buildFunctionsFromCode(std::string code) {
+        ParsedCode parsed = parseCode(code);
+        parsed.stmtSpecs.resize(parsed.funcs.size());
+        parsed.computations.resize(parsed.funcs.size());
+        SPFComputationBuilder::buildComputationsFromFunctions(
+            &parsed.getContext(), parsed.funcs, 1, nullptr, nullptr,
+            [&](size_t index,
+                std::unique_ptr<iegenlib::Computation> computation,
+                const std::vector<StmtSpec>* stmtSpecs) {
+                EXPECT_NE(nullptr, stmtSpecs);
+                if (stmtSpecs) {
+                    parsed.stmtSpecs[index] = *stmtSpecs;
+                }
+                parsed.computations[index] = std::move(computation);
+            },
+            true);
+        return parsed;
+    }
+
+    //! Build SPFComputations from every function in the provided code.
+    //! \param[in] code Source code to process
+    //! \param[in] numThreads Number of threads to build functions on
+    //! \param[in] constructFromStrings Whether to build IEGenLib objects
+    //! from strings rather than directly
+    //! \param[in] cache Cache of Computations to use, if any
+    //! \param[in] archive Archive to add Computations to, if any
+    std::vector<std::unique_ptr<iegenlib::Computation>>
+    buildSPFComputationsFromCode(std::string code, unsigned int numThreads = 1,
+                                 bool constructFromStrings = false,
+                                 ComputationCache* cache = nullptr,
+                                 ArchiveWriter* archive = nullptr) {
+        ParsedCode parsed = parseCode(code);
+        if (constructFromStrings) {
+            std::vector<std::unique_ptr<iegenlib::Computation>> computations;
+            SPFComputationBuilder builder(&parsed.getContext());
+            builder.setConstructFromStrings(true);
+            for (const auto& func : parsed.funcs) {
                 computations.push_back(
                     builder.buildComputationFromFunction(func));
             }
+            return computations;
+        }
+        return SPFComputationBuilder::buildComputationsFromFunctions(
+            &parsed.getContext(), parsed.funcs, numThreads, cache, archive);
+    }
+
+    //! Use expectations to check that two Computations are equivalent.
+    void compareComputations(iegenlib::Computation* expected,
+                             iegenlib::Computation* actual) {
+        EXPECT_EQ(expected->getDataSpaces(), actual->getDataSpaces());
+        ASSERT_EQ(expected->getNumStmts(), actual->getNumStmts());
+        for (int i = 0; i < expected->getNumStmts(); ++i) {
+            iegenlib::Stmt* const expectedStmt = expected->getStmt(i);
+            iegenlib::Stmt* const actualStmt = actual->getStmt(i);
+            SCOPED_TRACE("S" + std::to_string(i) + ": " +
+                         expectedStmt->getStmtSourceCode());
+            EXPECT_EQ(expectedStmt->getStmtSourceCode(),
+                      actualStmt->getStmtSourceCode());
+            EXPECT_EQ(expectedStmt->getIterationSpace()->prettyPrintString(),
+                      actualStmt->getIterationSpace()->prettyPrintString());
+            EXPECT_EQ(
+                expectedStmt->getExecutionSchedule()->prettyPrintString(),
+                actualStmt->getExecutionSchedule()->prettyPrintString());
+            auto expectedReads = expectedStmt->getDataReads();
+            auto actualReads = actualStmt->getDataReads();
+            ASSERT_EQ(expectedReads.size(), actualReads.size());
+            for (unsigned int j = 0; j < expectedReads.size(); ++j) {
+                SCOPED_TRACE("read " + std::to_string(j));
+                EXPECT_EQ(expectedReads[j].first, actualReads[j].first);
+                EXPECT_EQ(expectedReads[j].second->prettyPrintString(),
+                          actualReads[j].second->prettyPrintString());
+            }
+            auto expectedWrites = expectedStmt->getDataWrites();
+            auto actualWrites = actualStmt->getDataWrites();
+            ASSERT_EQ(expectedWrites.size(), actualWrites.size());
+            for (unsigned int j = 0; j < expectedWrites.size(); ++j) {
+                SCOPED_TRACE("write " + std::to_string(j));
+                EXPECT_EQ(expectedWrites[j].first, actualWrites[j].first);
+                EXPECT_EQ(expectedWrites[j].second->prettyPrintString(),
+                          actualWrites[j].second->prettyPrintString());
+            }
         }
-        return computations;
     }
 
     //! Use assertions/expectations to compare an SPFComputation to
@@ -278,6 +400,1171 @@ int CSR_SpMV(int a, int N, int A[a], int index[N + 1], int col[a], int x[N], int
         expectedExecSchedules, expectedReads, expectedWrites);
 }
 
+//! Test that replacement variable naming does not depend on which functions
+//! were built before, so builds are deterministic regardless of order
+TEST_F(SPFComputationTest, replacement_vars_per_function) {
+    std::string code =
+        "void scatter1(int n, int a[n], int b[n], int c[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[b[i]] = c[i];\
+    }\
+}\
+void scatter2(int n, int a[n], int b[n], int c[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[b[i]] = c[i];\
+    }\
+}";
+
+    std::vector<std::unique_ptr<iegenlib::Computation>> computations =
+        buildSPFComputationsFromCode(code);
+    ASSERT_EQ(2, computations.size());
+
+    unsigned int expectedNumStmts = 2;
+    std::unordered_set<std::string> expectedDataSpaces = {"a", "b", "c"};
+    std::vector<std::string> expectedIterSpaces = {"{[]}",
+                                                   "{[i]: 0 <= i && i < n}"};
+    std::vector<std::string> expectedExecSchedules = {"{[]->[0,0,0]}",
+                                                      "{[i]->[1,i,0]}"};
+    std::vector<std::vector<std::pair<std::string, std::string>>>
+        expectedReads = {{}, {{"b", "{[i]->[i]}"}, {"c", "{[i]->[i]}"}}};
+    std::vector<std::vector<std::pair<std::string, std::string>>>
+        expectedWrites = {{},
+                          {{"a", "{[i]->[" + replacementVarName + "0]: " +
+                                     replacementVarName + "0 = b(i)}"}}};
+
+    for (const auto& computation : computations) {
+        compareComputationToExpectations(
+            computation.get(), expectedNumStmts, expectedDataSpaces,
+            expectedIterSpaces, expectedExecSchedules, expectedReads,
+            expectedWrites);
+    }
+}
+
+//! Test that building functions concurrently gives the same results, in
+//! source order, as building them one at a time
+TEST_F(SPFComputationTest, concurrent_build_matches_serial) {
+    std::string code;
+    for (int f = 0; f < 8; ++f) {
+        code += "void kernel" + std::to_string(f) +
+                "(int n, int a[n], int b[n], int c[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[b[i]] = c[i + " +
+                std::to_string(f) + "];\
+    }\
+}";
+    }
+
+    std::vector<std::unique_ptr<iegenlib::Computation>> serial =
+        buildSPFComputationsFromCode(code);
+    std::vector<std::unique_ptr<iegenlib::Computation>> concurrent =
+        buildSPFComputationsFromCode(code, 4);
+    ASSERT_EQ(8, serial.size());
+    ASSERT_EQ(serial.size(), concurrent.size());
+    for (size_t i = 0; i < serial.size(); ++i) {
+        SCOPED_TRACE("function " + std::to_string(i));
+        compareComputations(serial[i].get(), concurrent[i].get());
+    }
+}
+
+//! Test that functions built concurrently through the cache, which reads
+//! their source text on each worker, match those built one at a time
+TEST_F(SPFComputationTest, concurrent_cached_build_matches_serial) {
+    std::string code;
+    for (int f = 0; f < 8; ++f) {
+        code += "void kernel" + std::to_string(f) +
+                "(int n, int a[n], int b[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[i] = b[i + " +
+                std::to_string(f) + "];\
+    }\
+}";
+    }
+    llvm::SmallString<128> cacheDir;
+    ASSERT_FALSE(static_cast<bool>(
+        llvm::sys::fs::createUniqueDirectory("spf-ie-cache", cacheDir)));
+    ComputationCache cache(cacheDir.str().str());
+
+    std::vector<std::unique_ptr<iegenlib::Computation>> serial =
+        buildSPFComputationsFromCode(code);
+    std::vector<std::unique_ptr<iegenlib::Computation>> built =
+        buildSPFComputationsFromCode(code, 4, false, &cache);
+    std::vector<std::unique_ptr<iegenlib::Computation>> loaded =
+        buildSPFComputationsFromCode(code, 4, false, &cache);
+    ASSERT_EQ(8, serial.size());
+    ASSERT_EQ(serial.size(), built.size());
+    ASSERT_EQ(serial.size(), loaded.size());
+    for (size_t i = 0; i < serial.size(); ++i) {
+        SCOPED_TRACE("function " + std::to_string(i));
+        compareComputations(serial[i].get(), built[i].get());
+        compareComputations(serial[i].get(), loaded[i].get());
+    }
+
+    llvm::sys::fs::remove_directories(cacheDir);
+}
+
+//! Test that, with exiting deferred, an invalid function fails the build
+//! with an error instead of ending the process, whether or not functions
+//! are built concurrently
+TEST_F(SPFComputationTest, concurrent_build_error_deferred) {
+    std::string code;
+    for (int f = 0; f < 8; ++f) {
+        code += "void kernel" + std::to_string(f) +
+                "(int n, int a[n]) {\
+    for (int i = 0; i < n; i += " +
+                std::to_string(f == 5 ? 2 : 1) + ") {\
+        a[i] = i;\
+    }\
+}";
+    }
+
+    Utils::ExitDeferral deferral;
+    EXPECT_THROW(buildSPFComputationsFromCode(code), BuildError);
+    EXPECT_THROW(buildSPFComputationsFromCode(code, 4), BuildError);
+}
+
+//! Test that constructing IEGenLib objects directly gives the same results
+//! as printing and parsing strings
+TEST_F(SPFComputationTest, direct_construction_matches_strings) {
+    std::string code =
+        "\
+int CSR_SpMV(int a, int N, int A[a], int index[N + 1], int col[a], int x[N], int product[N]) {\
+    int i;\
+    int k;\
+    for (i = 0; i < N; i++) {\
+        for (k = index[i]; k < index[i + 1]; k++) {\
+            product[i] += A[k] * x[col[k]];\
+        }\
+    }\
+    return 0;\
+}\
+void stencil(int n, int a[n], int b[n][n]) {\
+    int i;\
+    int j;\
+    for (i = 1; i < n - 1; i++) {\
+        for (j = i + 1; j <= n; j++) {\
+            if (i + j >= 3) {\
+                a[i] = b[i - 1][j] + b[-i + n][a[j]];\
+            }\
+        }\
+    }\
+}";
+
+    std::vector<std::unique_ptr<iegenlib::Computation>> fromStrings =
+        buildSPFComputationsFromCode(code, 1, true);
+    std::vector<std::unique_ptr<iegenlib::Computation>> direct =
+        buildSPFComputationsFromCode(code);
+    ASSERT_EQ(2, fromStrings.size());
+    ASSERT_EQ(fromStrings.size(), direct.size());
+    for (size_t i = 0; i < fromStrings.size(); ++i) {
+        SCOPED_TRACE("function " + std::to_string(i));
+        compareComputations(fromStrings[i].get(), direct[i].get());
+    }
+}
+
+//! Test that array accesses anywhere in a constraint are written as
+//! function calls when constructing from strings, including accesses under
+//! unary operators and accesses whose text contains another access's text
+TEST_F(SPFComputationTest, string_construction_converts_nested_accesses) {
+    std::string code =
+        "void nested(int n, int x[n], int y[n], int xy[n], int z[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        if (-x[i] + xy[y[x[i]]] < (y[i] + x[i])) {\
+            z[i] = 0;\
+        }\
+    }\
+}";
+
+    std::vector<std::unique_ptr<iegenlib::Computation>> fromStrings =
+        buildSPFComputationsFromCode(code, 1, true);
+    std::vector<std::unique_ptr<iegenlib::Computation>> direct =
+        buildSPFComputationsFromCode(code);
+    ASSERT_EQ(1, fromStrings.size());
+    ASSERT_EQ(fromStrings.size(), direct.size());
+    compareComputations(fromStrings.back().get(), direct.back().get());
+}
+
+//! Test that equal text is interned to the same ID, whether it comes from
+//! a string or from the source of an AST node
+TEST_F(SPFComputationTest, symbol_table_interns_text) {
+    std::string code = "void f(int i, int x, int y) { x = i; y = i; }";
+    ParsedCode parsed = parseCode(code);
+    ASSERT_EQ(1, parsed.funcs.size());
+    CompoundStmt* body = cast<CompoundStmt>(parsed.funcs[0]->getBody());
+    BinaryOperator* first = cast<BinaryOperator>(body->body_front());
+    BinaryOperator* second = cast<BinaryOperator>(body->body_back());
+
+    SymbolTable symbols(&parsed.getContext());
+    SymbolID i = symbols.intern("i");
+    EXPECT_EQ(i, symbols.getSymbol(first->getRHS()));
+    EXPECT_EQ(i, symbols.getSymbol(second->getRHS()));
+    EXPECT_NE(symbols.getSymbol(first->getLHS()),
+              symbols.getSymbol(second->getLHS()));
+    EXPECT_EQ("x = i", symbols.getString(first));
+    EXPECT_EQ(symbols.intern("x = i"), symbols.getSymbol(first));
+    EXPECT_EQ("i", symbols.getText(i).str());
+}
+
+//! Test that statistics count the statements and accesses built
+TEST_F(SPFComputationTest, stats_count_stmts_and_accesses) {
+    std::string code =
+        "void add(int n, int x[n], int y[n], int sum[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        sum[i] = x[i] + y[i];\
+    }\
+}";
+
+    Stats::enable();
+    const uint64_t initialStmts = Stats::get(Stat::StmtsProcessed);
+    const uint64_t initialAccesses = Stats::get(Stat::ArrayAccessesBuilt);
+    std::vector<std::unique_ptr<iegenlib::Computation>> computations =
+        buildSPFComputationsFromCode(code);
+    ASSERT_EQ(1, computations.size());
+    EXPECT_EQ(2, Stats::get(Stat::StmtsProcessed) - initialStmts);
+    EXPECT_EQ(3, Stats::get(Stat::ArrayAccessesBuilt) - initialAccesses);
+}
+
+//! Test that Computations loaded from the cache match those built, and
+//! that changing a function invalidates its entry
+TEST_F(SPFComputationTest, cache_matches_built) {
+    std::string code =
+        "void spmv(int n, int a, int index[n + 1], int col[a], int A[a], int x[n], int y[n]) {\
+    int i;\
+    int k;\
+    for (i = 0; i < n; i++) {\
+        for (k = index[i]; k < index[i + 1]; k++) {\
+            y[i] += A[k] * x[col[k]];\
+        }\
+    }\
+}";
+    llvm::SmallString<128> cacheDir;
+    ASSERT_FALSE(static_cast<bool>(
+        llvm::sys::fs::createUniqueDirectory("spf-ie-cache", cacheDir)));
+    ComputationCache cache(cacheDir.str().str());
+
+    Stats::enable();
+    const uint64_t initialHits = Stats::get(Stat::CacheHits);
+    const size_t initialFunctions = Stats::getFunctions().size();
+    std::vector<std::unique_ptr<iegenlib::Computation>> built =
+        buildSPFComputationsFromCode(code, 1, false, &cache);
+    EXPECT_EQ(initialHits, Stats::get(Stat::CacheHits));
+    std::vector<std::unique_ptr<iegenlib::Computation>> loaded =
+        buildSPFComputationsFromCode(code, 1, false, &cache);
+    EXPECT_EQ(initialHits + 1, Stats::get(Stat::CacheHits));
+    std::vector<FunctionStats> functions = Stats::getFunctions();
+    ASSERT_EQ(initialFunctions + 2, functions.size());
+    EXPECT_EQ("built", functions[initialFunctions].source);
+    EXPECT_EQ("cache", functions[initialFunctions + 1].source);
+    EXPECT_EQ("spmv", functions[initialFunctions + 1].name);
+    EXPECT_EQ(functions[initialFunctions].file,
+              functions[initialFunctions + 1].file);
+    ASSERT_EQ(1, built.size());
+    ASSERT_EQ(built.size(), loaded.size());
+    compareComputations(built.back().get(), loaded.back().get());
+
+    code.replace(code.find("y[i] +="), 7, "y[i] -=");
+    buildSPFComputationsFromCode(code, 1, false, &cache);
+    EXPECT_EQ(initialHits + 1, Stats::get(Stat::CacheHits));
+
+    llvm::sys::fs::remove_directories(cacheDir);
+}
+
+//! Test that Computations read back from an archive match those built
+TEST_F(SPFComputationTest, archive_matches_built) {
+    std::string code =
+        "void spmv(int n, int a, int index[n + 1], int col[a], int A[a], int x[n], int y[n]) {\
+    int i;\
+    int k;\
+    for (i = 0; i < n; i++) {\
+        for (k = index[i]; k < index[i + 1]; k++) {\
+            y[i] += A[k] * x[col[k]];\
+        }\
+    }\
+}\
+void zero(int n, int a[n]) {\
+    for (int i = 0; i < n; i++) {\
+        a[i] = 0;\
+    }\
+}";
+    ArchiveWriter writer;
+    std::vector<std::unique_ptr<iegenlib::Computation>> built =
+        buildSPFComputationsFromCode(code, 2, false, nullptr, &writer);
+    ASSERT_EQ(2, built.size());
+    std::string bytes;
+    llvm::raw_string_ostream os(bytes);
+    writer.write(os);
+    os.flush();
+
+    std::string error;
+    std::unique_ptr<ArchiveReader> reader = ArchiveReader::create(
+        llvm::MemoryBuffer::getMemBufferCopy(bytes), error);
+    ASSERT_TRUE(static_cast<bool>(reader));
+    ASSERT_EQ(2, reader->getNumFunctions());
+    uint32_t function;
+    EXPECT_FALSE(reader->findFunction("missing", function));
+    ASSERT_TRUE(reader->findFunction("spmv", function));
+    EXPECT_EQ("test_input.cpp", reader->getFileName(function));
+    EXPECT_EQ(1, reader->getNumStmts(function));
+    EXPECT_EQ("y[i] += A[k] * x[col[k]];",
+              reader->getStmtSourceCode(function, 0));
+    std::unique_ptr<iegenlib::Computation> loaded =
+        reader->loadComputation(function);
+    ASSERT_TRUE(static_cast<bool>(loaded));
+    compareComputations(built[0].get(), loaded.get());
+    ASSERT_TRUE(reader->findFunction("zero", function));
+    loaded = reader->loadComputation(function);
+    ASSERT_TRUE(static_cast<bool>(loaded));
+    compareComputations(built[1].get(), loaded.get());
+    EXPECT_FALSE(
+        static_cast<bool>(reader->loadComputation(reader->getNumFunctions())));
+
+    // a damaged statement count is found before anything is allocated for it
+    std::string damaged = bytes;
+    const uint32_t indexOffset =
+        llvm::support::endian::read32le(damaged.data() + 12);
+    llvm::support::endian::write32le(&damaged[indexOffset + 16 * function + 8],
+                                     0xFFFFFFFF);
+    reader = ArchiveReader::create(
+        llvm::MemoryBuffer::getMemBufferCopy(damaged), error);
+    ASSERT_TRUE(static_cast<bool>(reader));
+    EXPECT_FALSE(static_cast<bool>(reader->loadComputation(function)));
+
+    bytes[0] ^= 1;
+    EXPECT_FALSE(static_cast<bool>(ArchiveReader::create(
+        llvm::MemoryBuffer::getMemBufferCopy(bytes), error)));
+}
+
+//! Test that the server answers repeated requests for a file, and requests
+//! for single functions
+TEST_F(SPFComputationTest, server_answers_requests) {
+    int fd;
+    llvm::SmallString<128> path;
+    ASSERT_FALSE(static_cast<bool>(
+        llvm::sys::fs::createTemporaryFile("spf-ie-serve", "c", fd, path)));
+    {
+        llvm::raw_fd_ostream file(fd, true);
+        file << "void zero(int n, int a[n]) {\n"
+                "    int i;\n"
+                "    for (i = 0; i < n; i++) {\n"
+                "        a[i] = 0;\n"
+                "    }\n"
+                "}\n"
+                "void copy(int n, int a[n], int b[n]) {\n"
+                "    int i;\n"
+                "    for (i = 0; i < n; i++) {\n"
+                "        a[i] = b[i];\n"
+                "    }\n"
+                "}\n";
+    }
+    llvm::SmallString<128> invalidPath;
+    ASSERT_FALSE(static_cast<bool>(llvm::sys::fs::createTemporaryFile(
+        "spf-ie-serve", "c", fd, invalidPath)));
+    {
+        llvm::raw_fd_ostream file(fd, true);
+        file << "void retry(int n, int a[n]) {\n"
+                "    int i;\n"
+                "again:\n"
+                "    for (i = 0; i < n; i++) {\n"
+                "        a[i] = 0;\n"
+                "    }\n"
+                "    if (a[0]) {\n"
+                "        goto again;\n"
+                "    }\n"
+                "}\n";
+    }
+
+    // building the invalid file must fail only its own request
+    const std::string request = "{\"file\": \"" + path.str().str() + "\"";
+    std::istringstream requests(
+        request + "}\n" + request + "}\n" + request +
+        ", \"function\": \"copy\"}\n" + request +
+        ", \"function\": \"none\"}\n{\"file\": \"" + invalidPath.str().str() +
+        "\"}\n" + request + ", \"function\": \"zero\"}\n");
+    std::string responses;
+    llvm::raw_string_ostream responsesStream(responses);
+    tooling::FixedCompilationDatabase compilations(".", {});
+    Server server(compilations, "", 1, nullptr);
+    server.serve(requests, responsesStream);
+    llvm::sys::fs::remove(path);
+    llvm::sys::fs::remove(invalidPath);
+
+    std::istringstream responseLines(responsesStream.str());
+    std::string line;
+    for (int i = 0; i < 2; ++i) {
+        SCOPED_TRACE("request " + std::to_string(i));
+        ASSERT_TRUE(static_cast<bool>(std::getline(responseLines, line)));
+        EXPECT_NE(std::string::npos, line.find("\"name\":\"zero\""));
+        EXPECT_NE(std::string::npos, line.find("\"name\":\"copy\""));
+    }
+    ASSERT_TRUE(static_cast<bool>(std::getline(responseLines, line)));
+    EXPECT_EQ(std::string::npos, line.find("\"name\":\"zero\""));
+    EXPECT_NE(std::string::npos, line.find("\"name\":\"copy\""));
+    ASSERT_TRUE(static_cast<bool>(std::getline(responseLines, line)));
+    EXPECT_NE(std::string::npos, line.find("\"error\""));
+    ASSERT_TRUE(static_cast<bool>(std::getline(responseLines, line)));
+    EXPECT_NE(std::string::npos, line.find("Unsupported stmt type LabelStmt"));
+    ASSERT_TRUE(static_cast<bool>(std::getline(responseLines, line)));
+    EXPECT_NE(std::string::npos, line.find("\"name\":\"zero\""));
+    EXPECT_FALSE(static_cast<bool>(std::getline(responseLines, line)));
+}
+
+//! Test that Computations built concurrently are emitted one line each, in
+//! source order
+TEST_F(SPFComputationTest, emitter_streams_in_source_order) {
+    std::string code;
+    for (int f = 0; f < 8; ++f) {
+        code += "void kernel" + std::to_string(f) +
+                "(int n, int a[n], int b[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[i] = b[i];\
+    }\
+}";
+    }
+    ParsedCode parsed = parseCode(code);
+
+    std::string records;
+    llvm::raw_string_ostream recordsStream(records);
+    NDJSONEmitter emitter(recordsStream);
+    SPFComputationBuilder::buildComputationsFromFunctions(
+        &parsed.getContext(), parsed.funcs, 4, nullptr, nullptr,
+        [&](size_t index, std::unique_ptr<iegenlib::Computation> computation,
+            const std::vector<StmtSpec>*) {
+            emitter.emit("test_input.cpp",
+                         parsed.funcs[index]->getQualifiedNameAsString(),
+                         computation.get());
+        });
+
+    std::istringstream recordLines(recordsStream.str());
+    std::string line;
+    for (int f = 0; f < 8; ++f) {
+        ASSERT_TRUE(static_cast<bool>(std::getline(recordLines, line)));
+        EXPECT_NE(std::string::npos,
+                  line.find("\"name\":\"kernel" + std::to_string(f) + "\""));
+    }
+    EXPECT_FALSE(static_cast<bool>(std::getline(recordLines, line)));
+}
+
+//! Test that dependences are found, and carried only by the loops which
+//! carry them
+TEST_F(SPFComputationTest, dependences_forward_solve) {
+    std::string code =
+        "int forward_solve(int n, int l[n][n], double b[n], double x[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        x[i] = b[i];\
+    }\
+    int j;\
+    for (j = 0; j < n; j++) {\
+        x[j] /= l[j][j];\
+        for (i = j + 1; i < n; i++) {\
+            x[i] -= l[i][j] * x[j];\
+        }\
+    }\
+    return 0;\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    ASSERT_EQ(1, parsed.stmtSpecs.size());
+    std::unique_ptr<DependenceGraph> graph =
+        std::make_unique<DependenceGraph>(parsed.stmtSpecs[0]);
+    ASSERT_EQ(6, graph->getNumStmts());
+
+    // S1: x[i] = b[i]; S3: x[j] /= l[j][j]; S4: x[i] -= l[i][j] * x[j];
+    EXPECT_FALSE(graph->isCarriedByLoop(1, 0));
+    EXPECT_TRUE(graph->isCarriedByLoop(4, 0));
+    EXPECT_FALSE(graph->isCarriedByLoop(4, 1));
+    bool foundIndependentFlow = false;
+    for (const auto& it : graph->getDependences()) {
+        EXPECT_EQ("x", it.dataSpace);
+        if (it.source == 3 && it.sink == 4 && it.kind == DependenceKind::Flow &&
+            !it.isLoopCarried()) {
+            foundIndependentFlow = true;
+        }
+        // nothing in the first loop depends on anything after it
+        EXPECT_FALSE(it.sink == 1 && it.source != 1);
+    }
+    EXPECT_TRUE(foundIndependentFlow);
+}
+
+//! Test that only loops carrying no dependences are annotated, with inner
+//! iterators declared outside them made private
+TEST_F(SPFComputationTest, parallelize_dependence_free_loops) {
+    std::string code =
+        "int mvm(int a, int b, int x[a][b], int y[b], int product[a]) {\
+    int i;\
+    int j;\
+    for (i = 0; i < a; i++) {\
+        product[i] = 0;\
+        for (j = 0; j < b; j++) {\
+            product[i] += x[i][j] * y[j];\
+        }\
+    }\
+    return 0;\
+}\
+int forward_solve(int n, int l[n][n], double b[n], double x[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        x[i] = b[i];\
+    }\
+    int j;\
+    for (j = 0; j < n; j++) {\
+        x[j] /= l[j][j];\
+        for (i = j + 1; i < n; i++) {\
+            x[i] -= l[i][j] * x[j];\
+        }\
+    }\
+    return 0;\
+}\
+double f(double v);\
+int apply(int n, double a[n], double b[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[i] = f(b[i]);\
+    }\
+    return 0;\
+}\
+int copy(int n, double *__restrict a, double *__restrict b) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        a[i] = b[i];\
+    }\
+    return 0;\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    Parallelizer parallelizer(&parsed.getContext());
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        parallelizer.addFunction(parsed.funcs[i], &parsed.stmtSpecs[i]);
+    }
+
+    const std::vector<LoopDecision>& decisions = parallelizer.getDecisions();
+    ASSERT_EQ(7, decisions.size());
+    // mvm: the row loop, but not the inner loop as well
+    EXPECT_TRUE(decisions[0].parallelized);
+    EXPECT_EQ(std::vector<std::string>{"j"}, decisions[0].privateVars);
+    EXPECT_EQ((std::vector<std::string>{"product", "x", "y"}),
+              decisions[0].assumedDisjoint);
+    EXPECT_FALSE(decisions[1].parallelized);
+    // forward_solve: the copy loop and the update loop, but not the column
+    // loop carrying the solve
+    EXPECT_TRUE(decisions[2].parallelized);
+    EXPECT_FALSE(decisions[3].parallelized);
+    EXPECT_NE(std::string::npos, decisions[3].reason.find("'x'"));
+    EXPECT_TRUE(decisions[4].parallelized);
+    EXPECT_TRUE(decisions[4].privateVars.empty());
+    // apply: f may have side effects
+    EXPECT_FALSE(decisions[5].parallelized);
+    EXPECT_NE(std::string::npos, decisions[5].reason.find("'f'"));
+    // copy: restrict pointers cannot overlap
+    EXPECT_TRUE(decisions[6].parallelized);
+    EXPECT_TRUE(decisions[6].assumedDisjoint.empty());
+
+    std::string rewritten;
+    llvm::raw_string_ostream os(rewritten);
+    parallelizer.writeRewrittenFile(os);
+    os.flush();
+    EXPECT_NE(std::string::npos,
+              rewritten.find("// assumes product, x, y do not overlap\n"
+                             "#pragma omp parallel for private(j)\n"
+                             "for (i = 0; i < a; i++)"));
+    EXPECT_EQ("dir/a.omp.c", Parallelizer::getOutputPath("dir/a.c"));
+}
+
+//! Test that reductions are recognized, only when the value combined does
+//! not read the element reduced into, and given reduction clauses
+TEST_F(SPFComputationTest, reductions) {
+    std::string code =
+        "int dot(int n, double a[n], double b[n], double sum[1], double m[1]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        sum[0] += a[i] * b[i];\
+        m[0] = m[0] < a[i] ? a[i] : m[0];\
+    }\
+    return 0;\
+}\
+int prefix(int n, double x[n]) {\
+    int i;\
+    for (i = 1; i < n; i++) {\
+        x[i] = x[i] + x[i - 1];\
+    }\
+    return 0;\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    const std::vector<std::vector<StmtSpec>>& specs = parsed.stmtSpecs;
+    Parallelizer parallelizer(&parsed.getContext());
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        parallelizer.addFunction(parsed.funcs[i], &specs[i]);
+    }
+    ASSERT_EQ(2, specs.size());
+    ASSERT_EQ(4, specs[0].size());
+    EXPECT_EQ(ReductionOp::Sum, specs[0][1].reduction);
+    EXPECT_EQ(ReductionOp::Max, specs[0][2].reduction);
+    EXPECT_EQ(ReductionOp::None, specs[1][1].reduction);
+
+    DependenceGraph graph(specs[0]);
+    EXPECT_FALSE(graph.isCarriedByLoop(1, 0));
+    EXPECT_FALSE(graph.findCarriedReductions(1, 0).empty());
+
+    const std::vector<LoopDecision>& decisions = parallelizer.getDecisions();
+    ASSERT_EQ(2, decisions.size());
+    EXPECT_TRUE(decisions[0].parallelized);
+    EXPECT_EQ((std::vector<std::string>{"+:sum[0:1]", "max:m[0:1]"}),
+              decisions[0].reductions);
+    EXPECT_FALSE(decisions[1].parallelized);
+
+    std::string rewritten;
+    llvm::raw_string_ostream os(rewritten);
+    parallelizer.writeRewrittenFile(os);
+    os.flush();
+    EXPECT_NE(std::string::npos,
+              rewritten.find("#pragma omp parallel for reduction(+:sum[0:1]) "
+                             "reduction(max:m[0:1])\n"));
+}
+
+//! Test that scalars are tracked as data spaces with one element, and that
+//! those private to each iteration or reduced into do not prevent a loop
+//! from being annotated
+TEST_F(SPFComputationTest, scalars_privatized) {
+    std::string code =
+        "int scale(int n, double a[n], double b[n], double c[1]) {\
+    int i;\
+    double t;\
+    double s = 0;\
+    double last = 0;\
+    for (i = 0; i < n; i++) {\
+        t = a[i] * 2;\
+        b[i] = t + 1;\
+        s += t;\
+        last = b[i];\
+    }\
+    c[0] = s + last;\
+    return 0;\
+}\
+int carry(int n, double a[n]) {\
+    int i;\
+    double prev = 0;\
+    for (i = 0; i < n; i++) {\
+        a[i] = prev;\
+        prev = a[i] + 1;\
+    }\
+    return 0;\
+}\
+int lastBelow(int n, int m) {\
+    int i;\
+    int last = -1;\
+    for (i = 0; i < n; i++) {\
+        if (i < m) {\
+            last = i;\
+        }\
+    }\
+    return last;\
+}\
+double total;\
+int keepTotal(int n, double a[n], double b[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        total = a[i];\
+        b[i] = total;\
+    }\
+    return 0;\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    const std::vector<std::vector<StmtSpec>>& specs = parsed.stmtSpecs;
+    Parallelizer parallelizer(&parsed.getContext());
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        parallelizer.addFunction(parsed.funcs[i], &specs[i]);
+    }
+    ASSERT_EQ(4, specs.size());
+    ASSERT_EQ(10, specs[0].size());
+    // S4: t = a[i] * 2;
+    ASSERT_EQ(1, specs[0][4].dataWrites.size());
+    EXPECT_EQ("t", specs[0][4].dataWrites[0].first);
+    EXPECT_EQ("{[i]->[0]}", specs[0][4].dataWrites[0].second.toString());
+    EXPECT_EQ(std::vector<std::string>{"t"}, specs[0][4].scalars);
+    EXPECT_EQ(ReductionOp::Sum, specs[0][6].reduction);
+
+    DependenceGraph graph(specs[0]);
+    PrivatizationAnalysis analysis(specs[0], graph);
+    const std::vector<ScalarClassification> scalars =
+        analysis.classifyScalars(4, 0);
+    ASSERT_EQ(3, scalars.size());
+    EXPECT_EQ(ScalarUse::Private, scalars[0].use);
+    EXPECT_FALSE(scalars[0].isLiveOut);
+    EXPECT_EQ(ScalarUse::Reduction, scalars[1].use);
+    EXPECT_EQ(ScalarUse::Private, scalars[2].use);
+    EXPECT_TRUE(scalars[2].isLiveOut);
+    EXPECT_NE(nullptr, graph.findCarriedDependence(4, 0));
+    EXPECT_EQ(nullptr, analysis.findCarriedDependence(4, 0));
+
+    // S2: last = i; is not run in every iteration, so the value after the
+    // loop is not necessarily the last iteration's
+    ASSERT_EQ(4, specs[2].size());
+    EXPECT_TRUE(specs[2][2].isConditional);
+    EXPECT_FALSE(specs[0][7].isConditional);
+    DependenceGraph conditionalGraph(specs[2]);
+    PrivatizationAnalysis conditionalAnalysis(specs[2], conditionalGraph);
+    const std::vector<ScalarClassification> conditionalScalars =
+        conditionalAnalysis.classifyScalars(2, 0);
+    ASSERT_EQ(1, conditionalScalars.size());
+    EXPECT_EQ("last", conditionalScalars[0].scalar);
+    EXPECT_EQ(ScalarUse::Carried, conditionalScalars[0].use);
+    EXPECT_TRUE(conditionalScalars[0].isLiveOut);
+
+    const std::vector<LoopDecision>& decisions = parallelizer.getDecisions();
+    ASSERT_EQ(4, decisions.size());
+    EXPECT_TRUE(decisions[0].parallelized);
+    EXPECT_FALSE(decisions[1].parallelized);
+    EXPECT_NE(std::string::npos, decisions[1].reason.find("'prev'"));
+    EXPECT_FALSE(decisions[2].parallelized);
+    EXPECT_NE(std::string::npos, decisions[2].reason.find("'last'"));
+    // a global's value may be read after the function returns
+    EXPECT_TRUE(specs[3][1].scalars.empty());
+    EXPECT_FALSE(decisions[3].parallelized);
+    EXPECT_NE(std::string::npos, decisions[3].reason.find("'total'"));
+
+    std::string rewritten;
+    llvm::raw_string_ostream os(rewritten);
+    parallelizer.writeRewrittenFile(os);
+    os.flush();
+    EXPECT_NE(std::string::npos,
+              rewritten.find("#pragma omp parallel for private(t) "
+                             "lastprivate(last) reduction(+:s)\n"));
+}
+
+//! Test that code generated from Computations builds the same Computations
+TEST_F(SPFComputationTest, generated_code_round_trips) {
+    std::string code =
+        "int CSR_SpMV(int a, int N, int A[a], int index[N + 1], int col[a], int x[N], int product[N]) {\
+    int i;\
+    int k;\
+    for (i = 0; i < N; i++) {\
+        for (k = index[i]; k < index[i + 1]; k++) {\
+            product[i] += A[k] * x[col[k]];\
+        }\
+    }\
+    return 0;\
+}\
+int forward_solve(int n, int l[n][n], double b[n], double x[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        x[i] = b[i];\
+    }\
+    int j;\
+    for (j = 0; j < n; j++) {\
+        x[j] /= l[j][j];\
+        for (i = j + 1; i < n; i++) {\
+            if (i > j + 2) {\
+                x[i] -= l[i][j] * x[j];\
+            }\
+        }\
+    }\
+    return 0;\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    const std::vector<std::unique_ptr<iegenlib::Computation>>& built =
+        parsed.computations;
+    std::string generated;
+    llvm::raw_string_ostream os(generated);
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        EXPECT_TRUE(CodeGenerator(parsed.stmtSpecs[i])
+                        .writeFunction(os, CodeGenerator::getPrototype(
+                                               parsed.funcs[i],
+                                               &parsed.getContext())));
+    }
+    os.flush();
+    EXPECT_NE(std::string::npos,
+              generated.find("        for (k = index[i]; k < index[i + 1]; "
+                             "k++) {\n"
+                             "            product[i] += A[k] * x[col[k]];\n"));
+    EXPECT_NE(std::string::npos,
+              generated.find("        for (i = j + 1; i < n; i++) {\n"
+                             "            if (i >= j + 3) {\n"));
+
+    std::vector<std::unique_ptr<iegenlib::Computation>> rebuilt =
+        buildSPFComputationsFromCode(generated);
+    ASSERT_EQ(2, built.size());
+    ASSERT_EQ(2, rebuilt.size());
+    compareComputations(built[0].get(), rebuilt[0].get());
+    compareComputations(built[1].get(), rebuilt[1].get());
+}
+
+//! Test that a level-set inspector and executor are generated for the row
+//! loop of a sparse triangular solve, and why loops without carried
+//! dependences are not run by level
+TEST_F(SPFComputationTest, level_sets_generated_for_sparse_solve) {
+    std::string code =
+        "void sptrsv(int n, int rowptr[n + 1], int col[], double val[], double b[n], double x[n]) {\
+    int i;\
+    int k;\
+    for (i = 0; i < n; i++) {\
+        x[i] = b[i];\
+        for (k = rowptr[i]; k < rowptr[i + 1] - 1; k++) {\
+            x[i] -= val[k] * x[col[k]];\
+        }\
+        x[i] /= val[rowptr[i + 1] - 1];\
+    }\
+}\
+int scale(int n, double a[n]) {\
+    for (int i = 0; i < n; i++) {\
+        a[i] *= 2;\
+    }\
+    return 0;\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    std::string generated;
+    std::vector<std::string> reasons;
+    llvm::raw_string_ostream os(generated);
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        DependenceGraph graph(parsed.stmtSpecs[i]);
+        PrivatizationAnalysis analysis(parsed.stmtSpecs[i], graph);
+        LevelSetGenerator generator(parsed.stmtSpecs[i], analysis);
+        std::string reason;
+        if (generator.findLoop(reason)) {
+            EXPECT_TRUE(generator.writeFunctions(
+                os, parsed.funcs[i]->getNameAsString(), "void",
+                CodeGenerator::getParameters(parsed.funcs[i],
+                                             &parsed.getContext())));
+        } else {
+            reasons.push_back(reason);
+        }
+    }
+    os.flush();
+
+    EXPECT_NE(std::string::npos,
+              generated.find("/* level_ptr must hold n + 1 ints and "
+                             "level_order must hold n ints */\n"
+                             "int sptrsv_inspector("));
+    EXPECT_NE(std::string::npos,
+              generated.find("int sptrsv_inspector(int n, int rowptr[n + 1], "
+                             "int col[], double val[], double b[n], double "
+                             "x[n], int *level_ptr, int *level_order) {\n"));
+    EXPECT_NE(std::string::npos,
+              generated.find("if (col[k] >= 0 && col[k] < i && level[col[k]] "
+                             ">= level[i]) level[i] = level[col[k]] + 1;"));
+    EXPECT_NE(std::string::npos,
+              generated.find("if (col[k] > i && col[k] < n && level[i] >= "
+                             "level[col[k]]) level[col[k]] = level[i] + "
+                             "1;"));
+    EXPECT_NE(std::string::npos,
+              generated.find("    for (int l = 0; l < num_levels; l++) {\n"
+                             "        #pragma omp parallel for private(i, "
+                             "k)\n"
+                             "        for (int p = level_ptr[l]; p < "
+                             "level_ptr[l + 1]; p++) {\n"
+                             "            i = level_order[p];\n"
+                             "            x[i] = b[i];\n"));
+    ASSERT_EQ(1, reasons.size());
+    EXPECT_NE(std::string::npos, reasons[0].find("no dependences"));
+}
+
+//! Test that a CSR traversal is converted to ELL, BCSR and CSC, and that
+//! loops which cannot be converted (including a traversal not multiplying
+//! by the matrix's values, to ELL or BCSR) are reported with why
+TEST_F(SPFComputationTest, csr_traversal_converted_to_other_formats) {
+    std::string code =
+        "void spmv(int n, int rowptr[n + 1], int col[], double A[], double x[], double y[n]) {\
+    for (int i = 0; i < n; i++) {\
+        for (int k = rowptr[i]; k < rowptr[i + 1]; k++) {\
+            y[i] += A[k] * x[col[k]];\
+        }\
+    }\
+}\
+void scale(int n, double a[n]) {\
+    for (int i = 0; i < n; i++) {\
+        a[i] *= 2;\
+    }\
+}\
+void pattern(int n, int rowptr[n + 1], int col[], double x[], double y[n]) {\
+    for (int i = 0; i < n; i++) {\
+        for (int k = rowptr[i]; k < rowptr[i + 1]; k++) {\
+            y[i] += x[col[k]];\
+        }\
+    }\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    std::map<SparseFormat, std::string> generated;
+    std::vector<std::string> reasons;
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        for (auto format :
+             {SparseFormat::ELL, SparseFormat::BCSR, SparseFormat::CSC}) {
+            FormatConverter converter(parsed.stmtSpecs[i], format, 2);
+            std::string reason;
+            if (!converter.findLoop(reason)) {
+                reasons.push_back(reason);
+                continue;
+            }
+            llvm::raw_string_ostream os(generated[format]);
+            EXPECT_TRUE(converter.writeFunctions(
+                os, parsed.funcs[i]->getNameAsString(), "void",
+                CodeGenerator::getParameters(parsed.funcs[i],
+                                             &parsed.getContext()),
+                CodeGenerator::getElementTypes(parsed.funcs[i])));
+        }
+    }
+
+    const std::string parameters =
+        "int n, int rowptr[n + 1], int col[], double A[], double x[], double "
+        "y[n]";
+    const std::string& ell = generated[SparseFormat::ELL];
+    EXPECT_NE(std::string::npos,
+              ell.find("int spmv_ell_width(" + parameters + ") {\n"));
+    EXPECT_NE(std::string::npos,
+              ell.find("void spmv_ell(" + parameters +
+                       ", int ell_width, double A_ell[][ell_width], int "
+                       "col_ell[][ell_width]) {\n"));
+    EXPECT_NE(std::string::npos,
+              ell.find("        for (int k = 0; k < ell_width; k++) {\n"
+                       "            y[i] += A_ell[i][k] * "
+                       "x[col_ell[i][k]];\n"));
+    const std::string& bcsr = generated[SparseFormat::BCSR];
+    EXPECT_NE(std::string::npos,
+              bcsr.find("int spmv_to_bcsr(" + parameters +
+                        ", int num_cols, int rowptr_bcsr[], int col_bcsr[], "
+                        "double A_bcsr[][2][2]) {\n"));
+    EXPECT_NE(std::string::npos,
+              bcsr.find("y[2 * ib + r] += A_bcsr[kb][r][c] * x[2 * "
+                        "col_bcsr[kb] + c];"));
+    const std::string& csc = generated[SparseFormat::CSC];
+    EXPECT_NE(std::string::npos,
+              csc.find("void spmv_to_csc(" + parameters +
+                       ", int num_cols, int rowptr_csc[], int row_csc[], "
+                       "double A_csc[]) {\n"));
+    EXPECT_NE(std::string::npos,
+              csc.find("    for (int j = 0; j < num_cols; j++) {\n"
+                       "        for (int k = rowptr_csc[j]; k < rowptr_csc[j "
+                       "+ 1]; k++) {\n"
+                       "            y[row_csc[k]] += A_csc[k] * x[j];\n"));
+    // a pattern-only traversal would add x at ELL padding and BCSR fill,
+    // but may be converted to CSC
+    ASSERT_EQ(5, reasons.size());
+    EXPECT_NE(std::string::npos, reasons[0].find("no inner loop"));
+    EXPECT_NE(std::string::npos,
+              reasons[3].find("does not add a product with the matrix's "
+                              "values"));
+    EXPECT_NE(std::string::npos,
+              reasons[4].find("does not add a product with the matrix's "
+                              "values"));
+}
+
+//! Test that a loop without carried dependences gets a reordering inspector
+//! and executor permuting its rows and data, and that loops carrying a
+//! dependence are not reordered
+TEST_F(SPFComputationTest, rows_and_data_reordered_for_locality) {
+    std::string code =
+        "void spmv(int n, int rowptr[n + 1], int col[], double A[], double x[n], double y[n]) {\
+    for (int i = 0; i < n; i++) {\
+        y[i] = 0;\
+        for (int k = rowptr[i]; k < rowptr[i + 1]; k++) {\
+            y[i] += A[k] * x[col[k]];\
+        }\
+    }\
+}\
+void sptrsv(int n, int rowptr[n + 1], int col[], double val[], double x[n]) {\
+    for (int i = 0; i < n; i++) {\
+        for (int k = rowptr[i]; k < rowptr[i + 1] - 1; k++) {\
+            x[i] -= val[k] * x[col[k]];\
+        }\
+    }\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    std::string generated;
+    std::vector<std::string> permuted;
+    std::vector<std::string> reasons;
+    llvm::raw_string_ostream os(generated);
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        DependenceGraph graph(parsed.stmtSpecs[i]);
+        PrivatizationAnalysis analysis(parsed.stmtSpecs[i], graph);
+        DataReorderer reorderer(parsed.stmtSpecs[i], analysis);
+        std::string reason;
+        if (reorderer.findLoop(reason)) {
+            permuted = reorderer.getPermutedArrays();
+            EXPECT_TRUE(reorderer.writeFunctions(
+                os, parsed.funcs[i]->getNameAsString(), "void",
+                CodeGenerator::getParameters(parsed.funcs[i],
+                                             &parsed.getContext()),
+                CodeGenerator::getElementTypes(parsed.funcs[i])));
+        } else {
+            reasons.push_back(reason);
+        }
+    }
+    os.flush();
+
+    std::sort(permuted.begin(), permuted.end());
+    EXPECT_EQ(std::vector<std::string>({"x", "y"}), permuted);
+    const std::string parameters =
+        "int n, int rowptr[n + 1], int col[], double A[], double x[n], "
+        "double y[n]";
+    EXPECT_NE(std::string::npos,
+              generated.find("int spmv_rcm(" + parameters +
+                             ", int perm[], int inv_perm[]) {\n"));
+    EXPECT_NE(std::string::npos,
+              generated.find("    for (int p = 0; p < n; p++) {\n"
+                             "        y_rcm[p] = 0;\n"
+                             "        for (int k = rowptr[perm[p]]; k < "
+                             "rowptr[perm[p] + 1]; k++) {\n"
+                             "            y_rcm[p] += A[k] * "
+                             "x_rcm[inv_perm[col[k]]];\n"));
+    EXPECT_NE(std::string::npos,
+              generated.find("        y[perm[p]] = y_rcm[p];\n"));
+    ASSERT_EQ(1, reasons.size());
+    EXPECT_NE(std::string::npos,
+              reasons[0].find("carries a dependence through 'x'"));
+}
+
+//! Test that loop nests are tiled when their dependences allow it, and that
+//! tiled code builds Computations again
+TEST_F(SPFComputationTest, loop_nest_tiled_when_legal) {
+    std::string code =
+        "int mvm(int a, int b, int x[a][b], int y[b], int product[a]) {\
+    int i;\
+    int j;\
+    for (i = 0; i < a; i++) {\
+        product[i] = 0;\
+        for (j = 0; j < b; j++) {\
+            product[i] += x[i][j] * y[j];\
+        }\
+    }\
+    return 0;\
+}\
+void skew(int n, int s[n][n]) {\
+    for (int i = 1; i < n; i++) {\
+        for (int j = 1; j < n - 1; j++) {\
+            s[i][j] = s[i - 1][j + 1] + 1;\
+        }\
+    }\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    std::string generated;
+    std::vector<std::string> reasons;
+    llvm::raw_string_ostream os(generated);
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        DependenceGraph graph(parsed.stmtSpecs[i]);
+        LoopTiler tiler(parsed.stmtSpecs[i], graph, {32, 32});
+        std::string reason;
+        if (tiler.findLoop(reason)) {
+            EXPECT_TRUE(tiler.writeFunction(
+                os, parsed.funcs[i]->getNameAsString(), "int",
+                CodeGenerator::getParameters(parsed.funcs[i],
+                                             &parsed.getContext())));
+        } else {
+            reasons.push_back(reason);
+        }
+    }
+    os.flush();
+
+    EXPECT_NE(
+        std::string::npos,
+        generated.find(
+            "    for (int i_tile = 0; 32 * i_tile < a; i_tile++) {\n"
+            "        for (i = 32 * i_tile; i < 32 * i_tile + 32 && i < a; "
+            "i++) {\n"
+            "            product[i] = 0;\n"
+            "        }\n"
+            "        for (int j_tile = 0; 32 * j_tile < b; j_tile++) {\n"
+            "            for (i = 32 * i_tile; i < 32 * i_tile + 32 && i < a; "
+            "i++) {\n"
+            "                for (j = 32 * j_tile; j < 32 * j_tile + 32 && "
+            "j < b; j++) {\n"
+            "                    product[i] += x[i][j] * y[j];\n"));
+    ASSERT_EQ(1, reasons.size());
+    EXPECT_NE(std::string::npos,
+              reasons[0].find("would not respect a dependence through 's'"));
+    EXPECT_EQ(1, buildSPFComputationsFromCode(generated).size());
+}
+
+//! Test that adjacent loops are fused and loops distributed only where that
+//! respects every dependence, with notes for those which are not
+TEST_F(SPFComputationTest, loops_fused_and_distributed_when_legal) {
+    std::string code =
+        "int forward_solve(int n, int l[n][n], double b[n], double x[n]) {\
+    int i;\
+    for (i = 0; i < n; i++) {\
+        x[i] = b[i];\
+    }\
+    int j;\
+    for (j = 0; j < n; j++) {\
+        x[j] /= l[j][j];\
+        for (i = j + 1; i < n; i++) {\
+            x[i] -= l[i][j] * x[j];\
+        }\
+    }\
+    return 0;\
+}\
+void scale_add(int n, double a[n], double b[n], double c[n]) {\
+    for (int i = 0; i < n; i++) {\
+        a[i] = b[i] * 2;\
+    }\
+    for (int j = 0; j < n; j++) {\
+        c[j] = a[j] + b[j];\
+    }\
+}\
+void prefix(int n, double a[n], double b[n], double s[n]) {\
+    for (int i = 1; i < n; i++) {\
+        a[i] = b[i] * 2;\
+        s[i] = s[i - 1] + a[i];\
+    }\
+}";
+    ParsedCode parsed = buildFunctionsFromCode(code);
+    std::string generated;
+    std::vector<std::string> fuseNotes;
+    std::vector<std::string> distributeNotes;
+    std::vector<StmtSpec> distributed;
+    llvm::raw_string_ostream os(generated);
+    for (size_t i = 0; i < parsed.funcs.size(); ++i) {
+        const std::string name = parsed.funcs[i]->getNameAsString();
+        const std::string parameters =
+            CodeGenerator::getParameters(parsed.funcs[i], &parsed.getContext());
+        LoopRestructurer fuser(parsed.stmtSpecs[i]);
+        if (fuser.fuseAll(fuseNotes) != 0) {
+            EXPECT_TRUE(CodeGenerator(fuser.getStmts())
+                            .writeFunction(os, "void " + name + "_fused(" +
+                                                   parameters + ")"));
+        }
+        LoopRestructurer distributer(parsed.stmtSpecs[i]);
+        if (distributer.distributeAll(distributeNotes) != 0) {
+            EXPECT_TRUE(CodeGenerator(distributer.getStmts())
+                            .writeFunction(os, "void " + name +
+                                                   "_distributed(" +
+                                                   parameters + ")"));
+            distributed = distributer.getStmts();
+        }
+    }
+    os.flush();
+
+    // the second loop's iterator is renamed to the first's
+    EXPECT_NE(std::string::npos,
+              generated.find("    for (int i = 0; i < n; i++) {\n"
+                             "        a[i] = b[i] * 2;\n"
+                             "        c[i] = a[i] + b[i];\n"
+                             "    }\n"));
+    EXPECT_NE(std::string::npos,
+              generated.find("    for (int i = 1; i < n; i++) {\n"
+                             "        a[i] = b[i] * 2;\n"
+                             "    }\n"
+                             "    for (int i = 1; i < n; i++) {\n"
+                             "        s[i] = s[i - 1] + a[i];\n"
+                             "    }\n"));
+    ASSERT_EQ(2, distributed.size());
+    ExecSchedule schedule;
+    ASSERT_TRUE(distributed[1].getSchedule(schedule));
+    EXPECT_EQ(1, schedule.scheduleTuple[0].value);
+    EXPECT_TRUE(schedule.scheduleTuple[1].valueIsVar);
+
+    // in forward_solve, x[i] = b[i] would run after x[i] -= ... for i > j
+    ASSERT_EQ(1, fuseNotes.size());
+    EXPECT_EQ(
+        "loops over 'i' and 'j' were not fused: the fused loop would not "
+        "respect a dependence through 'x'",
+        fuseNotes[0]);
+    ASSERT_EQ(1, distributeNotes.size());
+    EXPECT_NE(std::string::npos, distributeNotes[0].find("loop over 'j'"));
+    EXPECT_EQ(2, buildSPFComputationsFromCode(generated).size());
+}
+
 /** Death tests, checking failure on invalid input **/
 
 TEST_F(SPFComputationDeathTest, incorrect_increment_fails) {
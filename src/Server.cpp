@@ -0,0 +1,184 @@
+#include "Server.hpp"
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ComputationCache.hpp"
+#include "ComputationJSON.hpp"
+#include "SPFComputationBuilder.hpp"
+#include "Utils.hpp"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "iegenlib.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/* Server */
+
+Server::Server(const tooling::CompilationDatabase& compilations,
+               std::string resourceDir, unsigned int numFunctionJobs,
+               ComputationCache* cache)
+    : compilations(compilations),
+      resourceDir(resourceDir),
+      numFunctionJobs(numFunctionJobs),
+      cache(cache),
+      PCHContainerOps(std::make_shared<PCHContainerOperations>()) {}
+
+void Server::serve(std::istream& in, llvm::raw_ostream& out) {
+    std::string request;
+    while (std::getline(in, request)) {
+        if (llvm::StringRef(request).trim().empty()) {
+            continue;
+        }
+        {
+            llvm::json::OStream json(out);
+            handleRequest(request, json);
+        }
+        out << "\n";
+        out.flush();
+    }
+}
+
+void Server::handleRequest(llvm::StringRef request,
+                           llvm::json::OStream& json) {
+    llvm::Expected<llvm::json::Value> parsed = llvm::json::parse(request);
+    if (!parsed) {
+        std::string error = llvm::toString(parsed.takeError());
+        json.object([&]() {
+            json.attribute("error", "Invalid request: " + error);
+        });
+        return;
+    }
+    const llvm::json::Object* object = parsed->getAsObject();
+    llvm::Optional<llvm::StringRef> file =
+        object ? object->getString("file") : llvm::None;
+    if (!file) {
+        json.object([&]() {
+            json.attribute("error", "Request must give a \"file\"");
+        });
+        return;
+    }
+    llvm::Optional<llvm::StringRef> function = object->getString("function");
+
+    llvm::TimeTraceScope requestScope("ServeRequest", *file);
+    llvm::SmallString<128> path(*file);
+    llvm::sys::fs::make_absolute(path);
+    std::string error;
+    ASTUnit* unit = getUnit(path.str().str(), error);
+
+    std::vector<FunctionDecl*> funcs;
+    if (unit) {
+        ASTContext& Context = unit->getASTContext();
+        for (auto it : Context.getTranslationUnitDecl()->decls()) {
+            FunctionDecl* func = dyn_cast<FunctionDecl>(it);
+            if (func && func->doesThisDeclarationHaveABody() &&
+                (!function || func->getQualifiedNameAsString() == *function)) {
+                funcs.push_back(func);
+            }
+        }
+        if (funcs.empty()) {
+            error = function ? "No function '" + function->str() + "' found"
+                             : "No valid functions found for processing";
+        }
+    }
+
+    if (funcs.empty()) {
+        json.object([&]() {
+            json.attribute("file", *file);
+            json.attribute("error", error);
+        });
+        return;
+    }
+    std::vector<std::unique_ptr<iegenlib::Computation>> computations;
+    try {
+        // an invalid function must only fail this request, not the server
+        Utils::ExitDeferral deferral;
+        computations = SPFComputationBuilder::buildComputationsFromFunctions(
+            &unit->getASTContext(), funcs, numFunctionJobs, cache);
+    } catch (const BuildError& buildError) {
+        json.object([&]() {
+            json.attribute("file", *file);
+            json.attribute("error", buildError.what());
+        });
+        return;
+    }
+    json.object([&]() {
+        json.attribute("file", *file);
+        json.attributeArray("functions", [&]() {
+            for (size_t i = 0; i < funcs.size(); ++i) {
+                ComputationJSON::write(json,
+                                       funcs[i]->getQualifiedNameAsString(),
+                                       computations[i].get());
+            }
+        });
+    });
+}
+
+ASTUnit* Server::getUnit(const std::string& path, std::string& error) {
+    auto it = units.find(path);
+    if (it != units.end()) {
+        llvm::TimeTraceScope reparseScope("ReparseFile", path);
+        // reparsing reuses the preamble as long as it is still valid
+        if (it->second->Reparse(PCHContainerOps) ||
+            it->second->getDiagnostics().hasErrorOccurred()) {
+            units.erase(it);
+            error = "Could not parse file";
+            return nullptr;
+        }
+        return it->second.get();
+    }
+
+    llvm::TimeTraceScope parseScope("ParseFile", path);
+    std::vector<tooling::CompileCommand> commands =
+        compilations.getCompileCommands(path);
+    if (commands.empty()) {
+        error = "No compile command found for file";
+        return nullptr;
+    }
+    // adjust the command line as ClangTool would
+    std::vector<std::string> commandLine = commands.front().CommandLine;
+    commandLine = tooling::getClangSyntaxOnlyAdjuster()(commandLine, path);
+    commandLine = tooling::getClangStripOutputAdjuster()(commandLine, path);
+    commandLine =
+        tooling::getClangStripDependencyFileAdjuster()(commandLine, path);
+    std::vector<const char*> args;
+    for (const auto& arg : commandLine) {
+        args.push_back(arg.c_str());
+    }
+
+    llvm::IntrusiveRefCntPtr<DiagnosticsEngine> diags =
+        CompilerInstance::createDiagnostics(new DiagnosticOptions());
+    std::unique_ptr<ASTUnit> unit(ASTUnit::LoadFromCommandLine(
+        args.data(), args.data() + args.size(), PCHContainerOps, diags,
+        resourceDir, /*OnlyLocalDecls=*/false, CaptureDiagsKind::None,
+        /*RemappedFiles=*/llvm::None, /*RemappedFilesKeepOriginalName=*/true,
+        /*PrecompilePreambleAfterNParses=*/1));
+    if (!unit || unit->getDiagnostics().hasErrorOccurred()) {
+        error = "Could not parse file";
+        return nullptr;
+    }
+    ASTUnit* result = unit.get();
+    units[path] = std::move(unit);
+    return result;
+}
+
+}  // namespace spf_ie
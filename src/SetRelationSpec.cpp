@@ -0,0 +1,514 @@
+#include "SetRelationSpec.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Stats.hpp"
+#include "Utils.hpp"
+#include "iegenlib.h"
+
+namespace spf_ie {
+
+//! Make an IEGenLib expression from a spec expression
+static iegenlib::Exp* makeIEGenLibExp(const SpecExp& spec);
+
+//! Make an IEGenLib term from a spec term
+static iegenlib::Term* makeIEGenLibTerm(const SpecTerm& spec) {
+    switch (spec.kind) {
+        case SpecTerm::Kind::Const:
+            return new iegenlib::Term(spec.coeff);
+        case SpecTerm::Kind::Symbol:
+            return new iegenlib::VarTerm(spec.coeff, spec.name);
+        case SpecTerm::Kind::TupleVar:
+            return new iegenlib::TupleVarTerm(spec.coeff, spec.tuplePos);
+        case SpecTerm::Kind::UFCall: {
+            iegenlib::UFCallTerm* call = new iegenlib::UFCallTerm(
+                spec.coeff, spec.name, spec.args.size());
+            for (unsigned int i = 0; i < spec.args.size(); ++i) {
+                call->setParamAt(i, makeIEGenLibExp(spec.args[i]));
+            }
+            return call;
+        }
+    }
+    return nullptr;
+}
+
+static iegenlib::Exp* makeIEGenLibExp(const SpecExp& spec) {
+    iegenlib::Exp* exp = new iegenlib::Exp();
+    for (const auto& term : spec.terms) {
+        exp->addTerm(makeIEGenLibTerm(term));
+    }
+    return exp;
+}
+
+//! Write a spec expression in IEGenLib syntax
+static void printSpecExp(std::ostringstream& os, const SpecExp& spec,
+                         const std::vector<TupleElem>& tuple) {
+    if (spec.terms.empty()) {
+        os << "0";
+        return;
+    }
+    bool first = true;
+    for (const auto& term : spec.terms) {
+        int coeff = term.coeff;
+        if (!first) {
+            os << (coeff < 0 ? " - " : " + ");
+            coeff = coeff < 0 ? -coeff : coeff;
+        }
+        first = false;
+        if (term.kind == SpecTerm::Kind::Const) {
+            os << coeff;
+            continue;
+        }
+        if (coeff == -1) {
+            os << "-";
+        } else if (coeff != 1) {
+            os << coeff << " ";
+        }
+        switch (term.kind) {
+            case SpecTerm::Kind::Symbol:
+                os << term.name;
+                break;
+            case SpecTerm::Kind::TupleVar:
+                if (tuple[term.tuplePos].isConst) {
+                    os << tuple[term.tuplePos].constant;
+                } else {
+                    os << tuple[term.tuplePos].var;
+                }
+                break;
+            case SpecTerm::Kind::UFCall:
+                os << term.name << "(";
+                for (const auto& arg : term.args) {
+                    if (&arg != &term.args.front()) {
+                        os << ",";
+                    }
+                    printSpecExp(os, arg, tuple);
+                }
+                os << ")";
+                break;
+            case SpecTerm::Kind::Const:
+                break;
+        }
+    }
+}
+
+/* SpecTerm */
+
+SpecTerm SpecTerm::makeConst(int value) {
+    SpecTerm term;
+    term.kind = Kind::Const;
+    term.coeff = value;
+    term.tuplePos = -1;
+    return term;
+}
+
+SpecTerm SpecTerm::makeSymbol(std::string name, int coeff) {
+    SpecTerm term;
+    term.kind = Kind::Symbol;
+    term.coeff = coeff;
+    term.name = name;
+    term.tuplePos = -1;
+    return term;
+}
+
+SpecTerm SpecTerm::makeTupleVar(int position, int coeff) {
+    SpecTerm term;
+    term.kind = Kind::TupleVar;
+    term.coeff = coeff;
+    term.tuplePos = position;
+    return term;
+}
+
+SpecTerm SpecTerm::makeUFCall(std::string name, std::vector<SpecExp> args,
+                              int coeff) {
+    SpecTerm term;
+    term.kind = Kind::UFCall;
+    term.coeff = coeff;
+    term.name = name;
+    term.tuplePos = -1;
+    term.args = args;
+    return term;
+}
+
+bool SpecTerm::operator==(const SpecTerm& other) const {
+    if (kind != other.kind || coeff != other.coeff) {
+        return false;
+    }
+    switch (kind) {
+        case Kind::Const:
+            return true;
+        case Kind::Symbol:
+            return name == other.name;
+        case Kind::TupleVar:
+            return tuplePos == other.tuplePos;
+        case Kind::UFCall:
+            return name == other.name && args == other.args;
+    }
+    return false;
+}
+
+/* SpecExp */
+
+void SpecExp::add(const SpecExp& other) {
+    terms.insert(terms.end(), other.terms.begin(), other.terms.end());
+}
+
+void SpecExp::multiplyBy(int factor) {
+    for (auto& term : terms) {
+        term.coeff *= factor;
+    }
+}
+
+bool SpecExp::isConst(int* value) const {
+    int sum = 0;
+    for (const auto& term : terms) {
+        if (term.kind != SpecTerm::Kind::Const) {
+            return false;
+        }
+        sum += term.coeff;
+    }
+    if (value) {
+        *value = sum;
+    }
+    return true;
+}
+
+void SpecExp::shiftTupleVars(int offset) {
+    for (auto& term : terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar) {
+            term.tuplePos += offset;
+        }
+        for (auto& arg : term.args) {
+            arg.shiftTupleVars(offset);
+        }
+    }
+}
+
+bool SpecExp::isTupleVar(int position) const {
+    return terms.size() == 1 && terms[0].kind == SpecTerm::Kind::TupleVar &&
+           terms[0].tuplePos == position && terms[0].coeff == 1;
+}
+
+bool SpecExp::usesTupleVarAfter(int position) const {
+    for (const auto& term : terms) {
+        if (term.kind == SpecTerm::Kind::TupleVar &&
+            term.tuplePos > position) {
+            return true;
+        }
+        for (const auto& arg : term.args) {
+            if (arg.usesTupleVarAfter(position)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool SpecExp::calls(const std::string& function) const {
+    for (const auto& term : terms) {
+        if (term.kind == SpecTerm::Kind::UFCall && term.name == function) {
+            return true;
+        }
+        for (const auto& arg : term.args) {
+            if (arg.calls(function)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool SpecExp::isCallAt(int position, int offset,
+                       std::string& function) const {
+    // constants, such as those left by moving terms between sides, may
+    // surround the call as long as they cancel out
+    const SpecTerm* call = nullptr;
+    int constant = 0;
+    for (const auto& term : terms) {
+        if (term.kind == SpecTerm::Kind::Const) {
+            constant += term.coeff;
+        } else if (term.kind == SpecTerm::Kind::UFCall && !call &&
+                   term.coeff == 1 && term.args.size() == 1) {
+            call = &term;
+        } else {
+            return false;
+        }
+    }
+    if (!call || constant != 0) {
+        return false;
+    }
+    int argConstant = 0;
+    bool hasTupleVar = false;
+    for (const auto& term : call->args[0].terms) {
+        if (term.kind == SpecTerm::Kind::Const) {
+            argConstant += term.coeff;
+        } else if (term.kind == SpecTerm::Kind::TupleVar &&
+                   term.tuplePos == position && term.coeff == 1 &&
+                   !hasTupleVar) {
+            hasTupleVar = true;
+        } else {
+            return false;
+        }
+    }
+    function = call->name;
+    return hasTupleVar && argConstant == offset;
+}
+
+bool SpecExp::operator==(const SpecExp& other) const {
+    return terms == other.terms;
+}
+
+/* SetRelationSpec */
+
+iegenlib::Set* SetRelationSpec::toSet() const {
+    Stats::add(Stat::IEGenLibObjectsCreated);
+    iegenlib::Set* set = new iegenlib::Set(tuple.size());
+    set->addConjunction(makeConjunction());
+    return set;
+}
+
+iegenlib::Relation* SetRelationSpec::toRelation() const {
+    Stats::add(Stat::IEGenLibObjectsCreated);
+    iegenlib::Relation* relation =
+        new iegenlib::Relation(inArity, tuple.size() - inArity);
+    relation->addConjunction(makeConjunction());
+    return relation;
+}
+
+iegenlib::Conjunction* SetRelationSpec::makeConjunction() const {
+    iegenlib::TupleDecl tupleDecl(tuple.size());
+    for (unsigned int i = 0; i < tuple.size(); ++i) {
+        if (tuple[i].isConst) {
+            tupleDecl.setTupleElem(i, tuple[i].constant);
+        } else {
+            tupleDecl.setTupleElem(i, tuple[i].var);
+        }
+    }
+    iegenlib::Conjunction* conjunction =
+        isRelation ? new iegenlib::Conjunction(tupleDecl, inArity)
+                   : new iegenlib::Conjunction(tupleDecl);
+    for (const auto& it : equalities) {
+        iegenlib::Exp* exp = makeIEGenLibExp(it);
+        exp->setEquality();
+        conjunction->addEquality(exp);
+    }
+    for (const auto& it : inequalities) {
+        iegenlib::Exp* exp = makeIEGenLibExp(it);
+        exp->setInequality();
+        conjunction->addInequality(exp);
+    }
+    return conjunction;
+}
+
+std::string SetRelationSpec::toString() const {
+    std::ostringstream os;
+    os << "{[";
+    for (unsigned int i = 0; i < tuple.size(); ++i) {
+        if (isRelation && static_cast<int>(i) == inArity) {
+            os << "]->[";
+        } else if (i != 0) {
+            os << ",";
+        }
+        if (tuple[i].isConst) {
+            os << tuple[i].constant;
+        } else {
+            os << tuple[i].var;
+        }
+    }
+    if (isRelation && static_cast<int>(tuple.size()) == inArity) {
+        os << "]->[";
+    }
+    os << "]";
+    bool first = true;
+    for (const auto& it : equalities) {
+        os << (first ? ": " : " && ");
+        first = false;
+        printSpecExp(os, it, tuple);
+        os << " = 0";
+    }
+    for (const auto& it : inequalities) {
+        os << (first ? ": " : " && ");
+        first = false;
+        printSpecExp(os, it, tuple);
+        os << " >= 0";
+    }
+    os << "}";
+    return os.str();
+}
+
+bool SetRelationSpec::getOutputExp(int outPos, SpecExp& exp) const {
+    const TupleElem& elem = tuple[outPos];
+    if (elem.isConst) {
+        exp.terms.push_back(SpecTerm::makeConst(elem.constant));
+        return true;
+    }
+    for (const auto& it : equalities) {
+        const SpecTerm* outTerm = nullptr;
+        bool otherOutputs = false;
+        for (const auto& term : it.terms) {
+            if (term.kind != SpecTerm::Kind::TupleVar ||
+                term.tuplePos < inArity) {
+                continue;
+            }
+            if (term.tuplePos == outPos && !outTerm &&
+                (term.coeff == 1 || term.coeff == -1)) {
+                outTerm = &term;
+            } else {
+                otherOutputs = true;
+            }
+        }
+        if (!outTerm || otherOutputs) {
+            continue;
+        }
+        SpecExp rest;
+        for (const auto& term : it.terms) {
+            if (&term != outTerm) {
+                rest.terms.push_back(term);
+            }
+        }
+        // out + rest = 0 means out = -rest
+        if (outTerm->coeff == 1) {
+            rest.multiplyBy(-1);
+        }
+        exp.add(rest);
+        return true;
+    }
+    // an unconstrained element is named after the variable indexing with
+    // it, which is not an iterator
+    exp.terms.push_back(SpecTerm::makeSymbol(elem.var));
+    return true;
+}
+
+bool SetRelationSpec::getOutputExps(std::vector<SpecExp>& exps) const {
+    exps.clear();
+    for (int i = inArity; i < static_cast<int>(tuple.size()); ++i) {
+        exps.emplace_back();
+        if (!getOutputExp(i, exps.back())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SetRelationSpec SetRelationSpec::makeAccess(
+    const std::vector<TupleElem>& iterators,
+    const std::vector<SpecExp>& indexes) {
+    SetRelationSpec access;
+    access.isRelation = true;
+    access.tuple = iterators;
+    access.inArity = iterators.size();
+    for (const auto& it : indexes) {
+        const int outPos = access.tuple.size();
+        int value;
+        if (it.isConst(&value)) {
+            access.tuple.emplace_back(value);
+            continue;
+        }
+        SpecExp equality = it;
+        equality.multiplyBy(-1);
+        equality.terms.push_back(SpecTerm::makeTupleVar(outPos));
+        access.equalities.push_back(equality);
+        if (it.terms.size() == 1 &&
+            it.terms[0].kind == SpecTerm::Kind::TupleVar &&
+            it.terms[0].coeff == 1) {
+            access.tuple.push_back(iterators[it.terms[0].tuplePos]);
+        } else {
+            access.tuple.emplace_back(REPLACEMENT_VAR_BASE_NAME +
+                                      std::to_string(outPos));
+        }
+    }
+    return access;
+}
+
+/* ReductionOp */
+
+const char* getReductionIdentifier(ReductionOp op) {
+    switch (op) {
+        case ReductionOp::Sum:
+            return "+";
+        case ReductionOp::Product:
+            return "*";
+        case ReductionOp::Min:
+            return "min";
+        case ReductionOp::Max:
+            return "max";
+        case ReductionOp::None:
+            break;
+    }
+    return "";
+}
+
+/* StmtSpec */
+
+iegenlib::Stmt StmtSpec::toStmt() const {
+    Stats::add(Stat::IEGenLibObjectsCreated);
+    iegenlib::Stmt stmt;
+    stmt.setStmtSourceCode(sourceCode);
+    stmt.setIterationSpace(iterSpace.toSet());
+    stmt.setExecutionSchedule(execSchedule.toRelation());
+    for (const auto& it : dataReads) {
+        stmt.addRead(it.first, it.second.toRelation());
+    }
+    for (const auto& it : dataWrites) {
+        stmt.addWrite(it.first, it.second.toRelation());
+    }
+    return stmt;
+}
+
+bool StmtSpec::getSchedule(ExecSchedule& schedule) const {
+    schedule = ExecSchedule();
+    const int inArity = execSchedule.inArity;
+    for (int i = inArity; i < static_cast<int>(execSchedule.tuple.size());
+         ++i) {
+        if (execSchedule.tuple[i].isConst) {
+            schedule.pushValue(
+                ScheduleVal::makeNum(execSchedule.tuple[i].constant));
+            continue;
+        }
+        // look for the equality making this entry equal to an iterator
+        int iteratorPos = -1;
+        for (const auto& it : execSchedule.equalities) {
+            if (it.terms.size() != 2 ||
+                it.terms[0].kind != SpecTerm::Kind::TupleVar ||
+                it.terms[1].kind != SpecTerm::Kind::TupleVar ||
+                it.terms[0].coeff + it.terms[1].coeff != 0 ||
+                (it.terms[0].coeff != 1 && it.terms[0].coeff != -1)) {
+                continue;
+            }
+            if (it.terms[0].tuplePos == i && it.terms[1].tuplePos < inArity) {
+                iteratorPos = it.terms[1].tuplePos;
+            } else if (it.terms[1].tuplePos == i &&
+                       it.terms[0].tuplePos < inArity) {
+                iteratorPos = it.terms[0].tuplePos;
+            }
+        }
+        if (iteratorPos < 0) {
+            return false;
+        }
+        schedule.pushValue(ScheduleVal::makeVar(iteratorPos));
+    }
+    return true;
+}
+
+void StmtSpec::setSchedule(const ExecSchedule& schedule) {
+    execSchedule = SetRelationSpec();
+    execSchedule.isRelation = true;
+    execSchedule.tuple = iterSpace.tuple;
+    execSchedule.inArity = iterSpace.tuple.size();
+    for (const auto& it : schedule.scheduleTuple) {
+        if (it.valueIsVar) {
+            // output variable equals the corresponding iterator
+            SpecExp equality;
+            equality.terms.push_back(
+                SpecTerm::makeTupleVar(execSchedule.tuple.size()));
+            equality.terms.push_back(SpecTerm::makeTupleVar(it.value, -1));
+            execSchedule.equalities.push_back(equality);
+            execSchedule.tuple.push_back(iterSpace.tuple[it.value]);
+        } else {
+            execSchedule.tuple.emplace_back(it.value);
+        }
+    }
+}
+
+}  // namespace spf_ie
@@ -0,0 +1,93 @@
+#include "Stats.hpp"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/* Stats */
+
+std::atomic<bool> Stats::enabled(false);
+std::atomic<uint64_t> Stats::counters[static_cast<int>(Stat::NumStats)];
+const char* const Stats::counterNames[static_cast<int>(Stat::NumStats)] = {
+    "stmts_processed",         "array_accesses_built",
+    "replacement_vars_issued", "constraint_string_bytes",
+    "access_string_bytes",     "iegenlib_objects_created",
+    "cache_hits",              "cache_misses"};
+std::vector<FunctionStats> Stats::functions;
+std::mutex Stats::functionsMutex;
+
+void Stats::recordFunction(FunctionStats function) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(functionsMutex);
+    functions.push_back(std::move(function));
+}
+
+std::vector<FunctionStats> Stats::getFunctions() {
+    std::lock_guard<std::mutex> lock(functionsMutex);
+    return functions;
+}
+
+uint64_t Stats::getPeakRSSKilobytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    // ru_maxrss is in kilobytes on Linux
+    return usage.ru_maxrss;
+}
+
+uint64_t Stats::getCurrentRSSKilobytes() {
+    // the second field of statm is the number of resident pages
+    std::ifstream statm("/proc/self/statm");
+    uint64_t totalPages, residentPages;
+    if (!(statm >> totalPages >> residentPages)) {
+        return 0;
+    }
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void Stats::writeJSON(llvm::raw_ostream& os) {
+    llvm::json::OStream json(os, 2);
+    json.object([&]() {
+        json.attributeObject("counters", [&]() {
+            for (int i = 0; i < static_cast<int>(Stat::NumStats); ++i) {
+                json.attribute(counterNames[i],
+                               static_cast<int64_t>(counters[i].load()));
+            }
+        });
+        json.attribute("peak_rss_kb",
+                       static_cast<int64_t>(getPeakRSSKilobytes()));
+        std::lock_guard<std::mutex> lock(functionsMutex);
+        json.attributeArray("functions", [&]() {
+            for (const auto& it : functions) {
+                json.object([&]() {
+                    json.attribute("file", it.file);
+                    json.attribute("name", it.name);
+                    json.attribute("source", it.source);
+                    json.attribute("stmts", static_cast<int64_t>(it.stmts));
+                    json.attribute("arena_bytes",
+                                   static_cast<int64_t>(it.arenaBytes));
+                    json.attribute(
+                        "process_peak_rss_kb",
+                        static_cast<int64_t>(it.processPeakRSSKilobytes));
+                });
+            }
+        });
+    });
+    os << "\n";
+}
+
+}  // namespace spf_ie
@@ -1,76 +1,174 @@
 #include "StmtContext.hpp"
 
-#include <memory>
+#include <algorithm>
 #include <sstream>
-#include <stack>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "DataAccessHandler.hpp"
-#include "Driver.hpp"
 #include "ExecSchedule.hpp"
+#include "SetRelationSpec.hpp"
+#include "Stats.hpp"
+#include "SymbolTable.hpp"
 #include "Utils.hpp"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/OperationKinds.h"
 #include "clang/AST/Stmt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
 namespace spf_ie {
 
+//! Collect the comparisons a condition joins with &&, such as a loop
+//! condition bounding its iterator by more than one value
+//! \param[in] cond The condition
+//! \param[out] comparisons The comparisons, in order
+//! \return whether every operand of && is a binary operation
+static bool getConjuncts(Expr* cond,
+                         llvm::SmallVectorImpl<BinaryOperator*>& comparisons) {
+    BinaryOperator* asBinOper = dyn_cast<BinaryOperator>(cond->IgnoreParens());
+    if (!asBinOper) {
+        return false;
+    }
+    if (asBinOper->getOpcode() == BO_LAnd) {
+        return getConjuncts(asBinOper->getLHS(), comparisons) &&
+               getConjuncts(asBinOper->getRHS(), comparisons);
+    }
+    comparisons.push_back(asBinOper);
+    return true;
+}
+
+//! Evaluate a constant integer expression, holding the source mutex, since
+//! evaluation may update the ASTContext other builders share
+//! \param[in] expr The expression
+//! \param[in] Context ASTContext the expression belongs to
+//! \param[out] value Its value, if it is constant
+//! \return whether it is constant
+static bool evaluateAsInt(const Expr* expr, const ASTContext* Context,
+                          llvm::APSInt& value) {
+    std::lock_guard<std::recursive_mutex> lock(Utils::getSourceMutex());
+    Expr::EvalResult result;
+    if (!expr->EvaluateAsInt(result, *Context)) {
+        return false;
+    }
+    value = result.Val.getInt();
+    return true;
+}
+
 /* StmtContext */
 
-StmtContext::StmtContext() {}
+StmtContext::StmtContext(SymbolTable* symbols, llvm::BumpPtrAllocator* arena)
+    : Context(symbols->getContext()),
+      symbols(symbols),
+      arena(arena),
+      stmt(nullptr),
+      scope(nullptr),
+      dataAccesses(symbols, arena),
+      reduction(ReductionOp::None) {}
+
+StmtContext::StmtContext(StmtContext* other)
+    : Context(other->Context),
+      symbols(other->symbols),
+      arena(other->arena),
+      stmt(nullptr),
+      scope(other->scope),
+      schedule(other->schedule),
+      dataAccesses(other->symbols, other->arena),
+      reduction(ReductionOp::None) {}
+
+std::vector<SymbolID> StmtContext::getIterators() const {
+    std::vector<SymbolID> iterators(scope ? scope->loopDepth : 0);
+    for (const ScopeNode* node = scope; node;
+         node = node->parent) {
+        if (node->iterator != NO_SYMBOL) {
+            iterators[node->loopDepth - 1] = node->iterator;
+        }
+    }
+    return iterators;
+}
 
-StmtContext::StmtContext(StmtContext* other) {
-    iterators = other->iterators;
-    constraints = other->constraints;
-    schedule = other->schedule;
-    invariants = other->invariants;
+std::vector<const Constraint*> StmtContext::getConstraints() const {
+    std::vector<const Constraint*> constraints;
+    for (const ScopeNode* node = scope; node;
+         node = node->parent) {
+        for (auto it = node->constraints.rbegin();
+             it != node->constraints.rend(); ++it) {
+            constraints.push_back(&*it);
+        }
+    }
+    std::reverse(constraints.begin(), constraints.end());
+    return constraints;
+}
+
+bool StmtContext::isInvariant(SymbolID dataSpace) const {
+    for (const ScopeNode* node = scope; node;
+         node = node->parent) {
+        if (std::find(node->invariants.begin(), node->invariants.end(),
+                      dataSpace) != node->invariants.end()) {
+            return true;
+        }
+    }
+    return false;
 }
 
 std::string StmtContext::getIterSpaceString() {
     std::ostringstream os;
+    std::vector<const Constraint*> constraints = getConstraints();
     if (!constraints.empty()) {
         os << "{" << getItersTupleString() << ": ";
         for (const auto& it : constraints) {
-            if (it != *constraints.begin()) {
+            if (it != constraints.front()) {
                 os << " and ";
             }
-            os << std::get<0>(*it) << " "
+            os << constraintSideToString(std::get<0>(*it)) << " "
                << Utils::binaryOperatorKindToString(std::get<2>(*it)) << " "
-               << std::get<1>(*it);
+               << constraintSideToString(std::get<1>(*it));
         }
         os << "}";
     } else {
         os << "{[]}";
     }
+    Stats::add(Stat::ConstraintStringBytes, os.tellp());
     return os.str();
 }
 
-std::string StmtContext::getExecScheduleString() {
+std::string StmtContext::getExecScheduleString(int paddedDimension) {
+    std::vector<SymbolID> iterators = getIterators();
     std::ostringstream os;
     os << "{" << getItersTupleString() << "->[";
     for (const auto& it : schedule.scheduleTuple) {
-        if (it != *schedule.scheduleTuple.begin()) {
+        if (&it != schedule.scheduleTuple.begin()) {
             os << ",";
         }
-        if (it->valueIsVar) {
-            os << it->var;
+        if (it.valueIsVar) {
+            os << symbols->getText(iterators[it.value]).str();
         } else {
-            os << it->num;
+            os << it.value;
         }
     }
+    for (int i = schedule.getDimension(); i < paddedDimension; ++i) {
+        os << (i == 0 ? "0" : ",0");
+    }
     os << "]}";
+    Stats::add(Stat::ConstraintStringBytes, os.tellp());
     return os.str();
 }
 
-std::string StmtContext::getDataAccessString(ArrayAccess* access) {
+std::string StmtContext::getDataAccessString(
+    ArrayAccess* access, unsigned int& replacementVarNumber) {
     std::ostringstream os;
     std::vector<std::pair<std::string, std::string>> constraintsToAdd;
     os << "{" << getItersTupleString() << "->[";
+    if (access->indexes.empty()) {
+        // a scalar's one element
+        os << "0";
+    }
     for (const auto& it : access->indexes) {
         if (it != *access->indexes.begin()) {
             os << ",";
@@ -78,19 +176,21 @@ std::string StmtContext::getDataAccessString(ArrayAccess* access) {
         std::vector<ArraySubscriptExpr*> subAccesses;
         Utils::getExprArrayAccesses(it, subAccesses);
         if (!subAccesses.empty()) {
-            std::string replacementName = Utils::getVarReplacementName();
+            std::string replacementName =
+                Utils::getVarReplacementName(replacementVarNumber);
             os << replacementName;
             constraintsToAdd.push_back(
                 {replacementName, exprToStringWithSafeArrays(it)});
         } else if (isa<DeclRefExpr>(it->IgnoreParenImpCasts())) {
-            os << Utils::stmtToString(it);
+            os << symbols->getString(it);
         } else {
             // if the expression is not a nested access or single variable
             // simply assign it to a replacement variable and use that
-            std::string replacementName = Utils::getVarReplacementName();
+            std::string replacementName =
+                Utils::getVarReplacementName(replacementVarNumber);
             os << replacementName;
             constraintsToAdd.push_back(
-                {replacementName, Utils::stmtToString(it)});
+                {replacementName, symbols->getString(it)});
         }
     }
     os << "]";
@@ -104,25 +204,148 @@ std::string StmtContext::getDataAccessString(ArrayAccess* access) {
         }
     }
     os << "}";
+    Stats::add(Stat::AccessStringBytes, os.tellp());
     return os.str();
 }
 
+bool StmtContext::getIterSpaceSpec(SetRelationSpec& spec) {
+    spec = SetRelationSpec();
+    for (const auto& it : getIterators()) {
+        spec.tuple.emplace_back(symbols->getText(it).str());
+    }
+    spec.inArity = spec.tuple.size();
+    for (const auto& it : getConstraints()) {
+        SpecExp lhs;
+        SpecExp rhs;
+        if (!constraintSideToSpecExp(std::get<0>(*it), lhs) ||
+            !constraintSideToSpecExp(std::get<1>(*it), rhs)) {
+            return false;
+        }
+        // rearrange into the form exp >= 0 or exp = 0
+        SpecExp constraint;
+        switch (std::get<2>(*it)) {
+            case BinaryOperatorKind::BO_LT:
+                lhs.terms.push_back(SpecTerm::makeConst(1));
+                // fall through
+            case BinaryOperatorKind::BO_LE:
+                lhs.multiplyBy(-1);
+                constraint.add(rhs);
+                constraint.add(lhs);
+                spec.inequalities.push_back(constraint);
+                break;
+            case BinaryOperatorKind::BO_GT:
+                rhs.terms.push_back(SpecTerm::makeConst(1));
+                // fall through
+            case BinaryOperatorKind::BO_GE:
+                rhs.multiplyBy(-1);
+                constraint.add(lhs);
+                constraint.add(rhs);
+                spec.inequalities.push_back(constraint);
+                break;
+            case BinaryOperatorKind::BO_EQ:
+                rhs.multiplyBy(-1);
+                constraint.add(lhs);
+                constraint.add(rhs);
+                spec.equalities.push_back(constraint);
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+SetRelationSpec StmtContext::getExecScheduleSpec(int paddedDimension) {
+    std::vector<SymbolID> iterators = getIterators();
+    SetRelationSpec spec;
+    spec.isRelation = true;
+    for (const auto& it : iterators) {
+        spec.tuple.emplace_back(symbols->getText(it).str());
+    }
+    spec.inArity = spec.tuple.size();
+    for (const auto& it : schedule.scheduleTuple) {
+        if (it.valueIsVar) {
+            // output variable equals the corresponding iterator
+            SpecExp equality;
+            equality.terms.push_back(
+                SpecTerm::makeTupleVar(spec.tuple.size()));
+            equality.terms.push_back(SpecTerm::makeTupleVar(it.value, -1));
+            spec.equalities.push_back(equality);
+            spec.tuple.emplace_back(
+                symbols->getText(iterators[it.value]).str());
+        } else {
+            spec.tuple.emplace_back(it.value);
+        }
+    }
+    for (int i = schedule.getDimension(); i < paddedDimension; ++i) {
+        spec.tuple.emplace_back(0);
+    }
+    return spec;
+}
+
+bool StmtContext::getDataAccessSpec(ArrayAccess* access,
+                                    unsigned int& replacementVarNumber,
+                                    SetRelationSpec& spec) {
+    spec = SetRelationSpec();
+    spec.isRelation = true;
+    for (const auto& it : getIterators()) {
+        spec.tuple.emplace_back(symbols->getText(it).str());
+    }
+    spec.inArity = spec.tuple.size();
+    if (access->indexes.empty()) {
+        // a scalar's one element
+        spec.tuple.emplace_back(0);
+    }
+    for (const auto& it : access->indexes) {
+        const int outPos = spec.tuple.size();
+        std::vector<ArraySubscriptExpr*> subAccesses;
+        Utils::getExprArrayAccesses(it, subAccesses);
+        if (subAccesses.empty() &&
+            isa<DeclRefExpr>(it->IgnoreParenImpCasts())) {
+            SymbolID var = symbols->getSymbol(it);
+            int iterPos = getIteratorPosition(var);
+            if (iterPos >= 0) {
+                SpecExp equality;
+                equality.terms.push_back(SpecTerm::makeTupleVar(outPos));
+                equality.terms.push_back(SpecTerm::makeTupleVar(iterPos, -1));
+                spec.equalities.push_back(equality);
+            }
+            spec.tuple.emplace_back(symbols->getText(var).str());
+        } else {
+            // as with the string form, name the index with a replacement
+            // variable constrained to equal the index expression
+            SpecExp equality;
+            if (!exprToSpecExp(it, equality)) {
+                return false;
+            }
+            equality.multiplyBy(-1);
+            equality.terms.push_back(SpecTerm::makeTupleVar(outPos));
+            spec.equalities.push_back(equality);
+            spec.tuple.emplace_back(
+                Utils::getVarReplacementName(replacementVarNumber));
+        }
+    }
+    return true;
+}
+
 void StmtContext::enterFor(ForStmt* forStmt) {
+    llvm::SmallVector<Constraint, 2> constraints;
+    llvm::SmallVector<SymbolID, 2> invariants;
     std::string error;
     std::string errorReason;
 
     // initializer
-    std::string initVar;
+    SymbolID initVar = NO_SYMBOL;
     if (BinaryOperator* init = dyn_cast<BinaryOperator>(forStmt->getInit())) {
-        makeAndInsertConstraint(init->getRHS(), init->getLHS(),
+        makeAndInsertConstraint(constraints, init->getRHS(), init->getLHS(),
                                 BinaryOperatorKind::BO_LE);
-        initVar = Utils::stmtToString(init->getLHS());
+        initVar = symbols->getSymbol(init->getLHS());
     } else if (DeclStmt* init = dyn_cast<DeclStmt>(forStmt->getInit())) {
         if (VarDecl* initDecl = dyn_cast<VarDecl>(init->getSingleDecl())) {
-            makeAndInsertConstraint(initDecl->getNameAsString(),
+            initVar = symbols->intern(initDecl->getName());
+            makeAndInsertConstraint(constraints, initVar,
                                     initDecl->getInit(),
                                     BinaryOperatorKind::BO_LE);
-            initVar = initDecl->getNameAsString();
         } else {
             error = "initializer";
             errorReason = "declarative initializer must declare a variable";
@@ -132,25 +355,25 @@ void StmtContext::enterFor(ForStmt* forStmt) {
         errorReason = "must initialize iterator";
     }
 
-    // condition
-    if (BinaryOperator* cond = dyn_cast<BinaryOperator>(forStmt->getCond())) {
-        makeAndInsertConstraint(cond->getLHS(), cond->getRHS(),
-                                cond->getOpcode());
-        // add any data spaces accessed in the condition to loop invariants
-        std::vector<std::string> newInvariants;
+    // condition, which may join comparisons with &&
+    llvm::SmallVector<BinaryOperator*, 2> comparisons;
+    if (forStmt->getCond() && getConjuncts(forStmt->getCond(), comparisons)) {
         std::vector<ArraySubscriptExpr*> accessExprs;
-        Utils::getExprArrayAccesses(cond->getLHS(), accessExprs);
-        Utils::getExprArrayAccesses(cond->getRHS(), accessExprs);
-        std::vector<std::pair<std::string, ArrayAccess>> accessComponents;
+        for (const auto& cond : comparisons) {
+            makeAndInsertConstraint(constraints, cond->getLHS(),
+                                    cond->getRHS(), cond->getOpcode());
+            Utils::getExprArrayAccesses(cond->getLHS(), accessExprs);
+            Utils::getExprArrayAccesses(cond->getRHS(), accessExprs);
+        }
+        // add any data spaces accessed in the condition to loop invariants
+        llvm::SmallVector<ArrayAccess, ACCESSES_INLINE_SIZE> accessComponents;
         for (const auto& accessExpr : accessExprs) {
-            DataAccessHandler::buildDataAccess(accessExpr, true,
-                                               accessComponents);
+            DataAccessHandler::buildDataAccess(
+                accessExpr, true, accessComponents, symbols, *arena);
         }
-        for (const auto& accessInfo : accessComponents) {
-            newInvariants.push_back(
-                Utils::stmtToString(accessInfo.second.base));
+        for (const auto& access : accessComponents) {
+            invariants.push_back(access.dataSpace);
         }
-        invariants.push_back(newInvariants);
     } else {
         error = "condition";
         errorReason = "must be a binary operation";
@@ -167,9 +390,8 @@ void StmtContext::enterFor(ForStmt* forStmt) {
         BinaryOperatorKind oper = incOper->getOpcode();
         if (oper == BO_AddAssign || oper == BO_SubAssign) {
             // operator is += or -=
-            Expr::EvalResult result;
-            if (incOper->getRHS()->EvaluateAsInt(result, *Context)) {
-                llvm::APSInt incVal = result.Val.getInt();
+            llvm::APSInt incVal;
+            if (evaluateAsInt(incOper->getRHS(), Context, incVal)) {
                 validIncrement = (oper == BO_AddAssign && incVal == 1) ||
                                  (oper == BO_SubAssign && incVal == -1);
             }
@@ -180,21 +402,21 @@ void StmtContext::enterFor(ForStmt* forStmt) {
             // (e.g. with i = i + 1, this is i + 1)
             BinaryOperator* secondOp = cast<BinaryOperator>(incOper->getRHS());
             // Get variable being incremented
-            std::string iterStr = Utils::stmtToString(incOper->getLHS());
+            SymbolID iterSym = symbols->getSymbol(incOper->getLHS());
             if (secondOp->getOpcode() == BO_Add) {
-                // Get our lh and rh expression, also in string form
+                // Get our lh and rh expression, also as symbols
                 Expr* lhs = secondOp->getLHS();
                 Expr* rhs = secondOp->getRHS();
-                std::string lhsStr = Utils::stmtToString(lhs);
-                std::string rhsStr = Utils::stmtToString(rhs);
-                Expr::EvalResult result;
+                SymbolID lhsSym = symbols->getSymbol(lhs);
+                SymbolID rhsSym = symbols->getSymbol(rhs);
+                llvm::APSInt value;
                 // one side must be iter var, other must be 1
-                validIncrement = (lhsStr.compare(iterStr) == 0 &&
-                                  rhs->EvaluateAsInt(result, *Context) &&
-                                  result.Val.getInt() == 1) ||
-                                 (rhsStr.compare(iterStr) == 0 &&
-                                  lhs->EvaluateAsInt(result, *Context) &&
-                                  result.Val.getInt() == 1);
+                validIncrement = (lhsSym == iterSym &&
+                                  evaluateAsInt(rhs, Context, value) &&
+                                  value == 1) ||
+                                 (rhsSym == iterSym &&
+                                  evaluateAsInt(lhs, Context, value) &&
+                                  value == 1);
             }
         }
     }
@@ -205,78 +427,189 @@ void StmtContext::enterFor(ForStmt* forStmt) {
 
     if (!error.empty()) {
         Utils::printErrorAndExit(
-            "Invalid " + error + " in for loop -- " + errorReason, forStmt);
+            "Invalid " + error + " in for loop -- " + errorReason, forStmt,
+            Context);
     } else {
-        iterators.push_back(initVar);
-        schedule.pushValue(initVar);
+        enterNestedScope(initVar, constraints, invariants);
+        schedule.pushValue(ScheduleVal::makeVar(scope->loopDepth - 1));
     }
 }
 
 void StmtContext::exitFor() {
-    constraints.pop_back();
-    constraints.pop_back();
-    iterators.pop_back();
+    scope = scope->parent;
     schedule.popValue();
     schedule.popValue();
-    invariants.pop_back();
 }
 
 void StmtContext::enterIf(IfStmt* ifStmt, bool invert) {
     if (BinaryOperator* cond = dyn_cast<BinaryOperator>(ifStmt->getCond())) {
+        llvm::SmallVector<Constraint, 1> constraints;
         makeAndInsertConstraint(
-            cond->getLHS(), cond->getRHS(),
+            constraints, cond->getLHS(), cond->getRHS(),
             (invert ? BinaryOperator::negateComparisonOp(cond->getOpcode())
                     : cond->getOpcode()));
+        enterNestedScope(NO_SYMBOL, constraints, {});
     } else {
         Utils::printErrorAndExit(
-            "If statement condition must be a binary operation", ifStmt);
+            "If statement condition must be a binary operation", ifStmt,
+            Context);
     }
 }
 
-void StmtContext::exitIf() { constraints.pop_back(); }
+void StmtContext::exitIf() { scope = scope->parent; }
 
-void StmtContext::makeAndInsertConstraint(Expr* lower, Expr* upper,
-                                          BinaryOperatorKind oper) {
-    makeAndInsertConstraint(exprToStringWithSafeArrays(lower), upper, oper);
+void StmtContext::enterNestedScope(SymbolID iterator,
+                                   llvm::ArrayRef<Constraint> constraints,
+                                   llvm::ArrayRef<SymbolID> invariants) {
+    ScopeNode* node = new (*arena) ScopeNode();
+    node->parent = scope;
+    node->iterator = iterator;
+    node->constraints = constraints.copy(*arena);
+    node->invariants = invariants.copy(*arena);
+    node->loopDepth =
+        (scope ? scope->loopDepth : 0) + (iterator != NO_SYMBOL ? 1 : 0);
+    scope = node;
 }
 
-void StmtContext::makeAndInsertConstraint(std::string lower, Expr* upper,
-                                          BinaryOperatorKind oper) {
+void StmtContext::makeAndInsertConstraint(
+    llvm::SmallVectorImpl<Constraint>& constraints, ConstraintSide lower,
+    Expr* upper, BinaryOperatorKind oper) {
     if (oper == BinaryOperatorKind::BO_NE) {
         Utils::printErrorAndExit(
             "Not-equal conditions are unsupported by SPF: in condition " +
-                lower + " != " + Utils::stmtToString(upper),
-            upper);
+                constraintSideToString(lower) + " != " +
+                symbols->getString(upper),
+            upper, Context);
     }
-    constraints.push_back(
-        std::make_shared<
-            std::tuple<std::string, std::string, BinaryOperatorKind>>(
-            lower, exprToStringWithSafeArrays(upper), oper));
+    constraints.emplace_back(lower, ConstraintSide(upper), oper);
 }
 
-std::string StmtContext::exprToStringWithSafeArrays(Expr* expr) {
-    std::string initialStr = Utils::stmtToString(expr);
-    std::vector<ArraySubscriptExpr*> accesses;
-    Utils::getExprArrayAccesses(expr, accesses);
-    for (const auto& access : accesses) {
-        std::vector<std::pair<std::string, ArrayAccess>> accessComponents;
-        DataAccessHandler::buildDataAccess(access, true, accessComponents);
-        std::string accessStr = DataAccessHandler::makeStringForArrayAccess(
-            &accessComponents.back().second, accessComponents);
-        initialStr = Utils::replaceInString(
-            initialStr, Utils::stmtToString(access), accessStr);
+std::string StmtContext::constraintSideToString(const ConstraintSide& side) {
+    return side.expr ? exprToStringWithSafeArrays(side.expr)
+                     : symbols->getText(side.var).str();
+}
+
+bool StmtContext::constraintSideToSpecExp(const ConstraintSide& side,
+                                          SpecExp& spec) {
+    if (side.expr) {
+        return exprToSpecExp(side.expr, spec);
     }
-    return initialStr;
+    int iterPos = getIteratorPosition(side.var);
+    spec.terms.push_back(
+        iterPos >= 0 ? SpecTerm::makeTupleVar(iterPos)
+                     : SpecTerm::makeSymbol(symbols->getText(side.var).str()));
+    return true;
+}
+
+bool StmtContext::exprToSpecExp(Expr* expr, SpecExp& spec) {
+    Expr* usableExpr = expr->IgnoreParenImpCasts();
+    if (IntegerLiteral* asLiteral = dyn_cast<IntegerLiteral>(usableExpr)) {
+        spec.terms.push_back(
+            SpecTerm::makeConst(asLiteral->getValue().getSExtValue()));
+        return true;
+    } else if (isa<DeclRefExpr>(usableExpr)) {
+        SymbolID var = symbols->getSymbol(usableExpr);
+        int iterPos = getIteratorPosition(var);
+        spec.terms.push_back(
+            iterPos >= 0
+                ? SpecTerm::makeTupleVar(iterPos)
+                : SpecTerm::makeSymbol(symbols->getText(var).str()));
+        return true;
+    } else if (UnaryOperator* asUnaryOper =
+                   dyn_cast<UnaryOperator>(usableExpr)) {
+        if (asUnaryOper->getOpcode() != UO_Minus &&
+            asUnaryOper->getOpcode() != UO_Plus) {
+            return false;
+        }
+        SpecExp operand;
+        if (!exprToSpecExp(asUnaryOper->getSubExpr(), operand)) {
+            return false;
+        }
+        if (asUnaryOper->getOpcode() == UO_Minus) {
+            operand.multiplyBy(-1);
+        }
+        spec.add(operand);
+        return true;
+    } else if (BinaryOperator* asBinOper =
+                   dyn_cast<BinaryOperator>(usableExpr)) {
+        SpecExp lhs;
+        SpecExp rhs;
+        if (!exprToSpecExp(asBinOper->getLHS(), lhs) ||
+            !exprToSpecExp(asBinOper->getRHS(), rhs)) {
+            return false;
+        }
+        int constVal;
+        switch (asBinOper->getOpcode()) {
+            case BO_Add:
+                break;
+            case BO_Sub:
+                rhs.multiplyBy(-1);
+                break;
+            case BO_Mul:
+                // only multiplication by a constant is affine
+                if (lhs.isConst(&constVal)) {
+                    rhs.multiplyBy(constVal);
+                    lhs = SpecExp();
+                } else if (rhs.isConst(&constVal)) {
+                    lhs.multiplyBy(constVal);
+                    rhs = SpecExp();
+                } else {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+        spec.add(lhs);
+        spec.add(rhs);
+        return true;
+    } else if (ArraySubscriptExpr* asArrayAccess =
+                   dyn_cast<ArraySubscriptExpr>(usableExpr)) {
+        // array accesses become uninterpreted function calls
+        Expr* base;
+        llvm::SmallVector<Expr*, 4> indexes;
+        DataAccessHandler::getArrayAccessParts(asArrayAccess, base, indexes,
+                                               Context);
+        std::vector<SpecExp> args(indexes.size());
+        for (unsigned int i = 0; i < indexes.size(); ++i) {
+            if (!exprToSpecExp(indexes[i], args[i])) {
+                return false;
+            }
+        }
+        spec.terms.push_back(
+            SpecTerm::makeUFCall(symbols->getString(base), args));
+        return true;
+    }
+    return false;
+}
+
+int StmtContext::getIteratorPosition(SymbolID var) const {
+    // search from the innermost loop outward
+    for (const ScopeNode* node = scope; node;
+         node = node->parent) {
+        if (node->iterator == var) {
+            return node->loopDepth - 1;
+        }
+    }
+    return -1;
+}
+
+std::string StmtContext::exprToStringWithSafeArrays(Expr* expr) {
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    DataAccessHandler::printExprWithSafeArrays(expr, os, symbols);
+    return os.str();
 }
 
-std::string StmtContext::getItersTupleString() {
+std::string StmtContext::getItersTupleString() const {
+    std::vector<SymbolID> iterators = getIterators();
     std::ostringstream os;
     os << "[";
     for (const auto& it : iterators) {
-        if (it != *iterators.begin()) {
+        if (&it != &iterators.front()) {
             os << ",";
         }
-        os << it;
+        os << symbols->getText(it).str();
     }
     os << "]";
     return os.str();
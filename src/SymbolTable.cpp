@@ -0,0 +1,35 @@
+#include "SymbolTable.hpp"
+
+#include "Utils.hpp"
+#include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/StringRef.h"
+
+using namespace clang;
+
+namespace spf_ie {
+
+/* SymbolTable */
+
+SymbolID SymbolTable::intern(llvm::StringRef text) {
+    auto inserted = ids.try_emplace(text, texts.size());
+    if (inserted.second) {
+        texts.push_back(inserted.first->getKey());
+    }
+    return inserted.first->getValue();
+}
+
+SymbolID SymbolTable::getSymbol(const clang::Stmt* stmt) {
+    auto found = nodeSymbols.find(stmt);
+    if (found != nodeSymbols.end()) {
+        return found->second;
+    }
+    // the returned text points into the source buffer, so it is only copied
+    // when it is interned for the first time
+    SymbolID id = intern(Utils::getSourceText(
+        CharSourceRange::getTokenRange(stmt->getSourceRange()), Context));
+    nodeSymbols[stmt] = id;
+    return id;
+}
+
+}  // namespace spf_ie
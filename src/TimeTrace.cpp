@@ -0,0 +1,52 @@
+#include "TimeTrace.hpp"
+
+#include <string>
+#include <system_error>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace spf_ie {
+
+/* TimeTrace */
+
+bool TimeTrace::enabled = false;
+unsigned int TimeTrace::granularity = 0;
+std::string TimeTrace::procName;
+
+void TimeTrace::enable(unsigned int granularity, llvm::StringRef procName) {
+    TimeTrace::granularity = granularity;
+    TimeTrace::procName = procName.str();
+    enabled = true;
+    llvm::timeTraceProfilerInitialize(granularity, procName);
+}
+
+bool TimeTrace::writeAndDisable(const std::string& fileName) {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(fileName, EC, llvm::sys::fs::OF_None);
+    if (!EC) {
+        llvm::timeTraceProfilerWrite(os);
+    }
+    llvm::timeTraceProfilerCleanup();
+    enabled = false;
+    return !EC;
+}
+
+/* TimeTrace::ThreadScope */
+
+TimeTrace::ThreadScope::ThreadScope()
+    : active(enabled && !llvm::timeTraceProfilerEnabled()) {
+    if (active) {
+        llvm::timeTraceProfilerInitialize(granularity, procName);
+    }
+}
+
+TimeTrace::ThreadScope::~ThreadScope() {
+    if (active) {
+        llvm::timeTraceProfilerFinishThread();
+    }
+}
+
+}  // namespace spf_ie
@@ -1,9 +1,13 @@
 #include "Utils.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <map>
 #include <string>
+#include <vector>
 
-#include "Driver.hpp"
+#include "SetRelationSpec.hpp"
+#include "Stats.hpp"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/Stmt.h"
@@ -15,40 +19,53 @@ using namespace clang;
 
 namespace spf_ie {
 
+thread_local bool Utils::exitDeferred = false;
+
+thread_local std::recursive_mutex* Utils::sharedSourceMutex = nullptr;
+
+thread_local std::recursive_mutex Utils::unsharedSourceMutex;
+
 void Utils::printErrorAndExit(std::string message) {
-    printErrorAndExit(message, nullptr);
+    printErrorAndExit(message, nullptr, nullptr);
 }
 
-void Utils::printErrorAndExit(std::string message, clang::Stmt* stmt) {
+void Utils::printErrorAndExit(std::string message, clang::Stmt* stmt,
+                              const ASTContext* Context) {
     llvm::errs() << "ERROR: " << message << "\n";
-    if (stmt) {
+    if (stmt && Context) {
+        std::lock_guard<std::recursive_mutex> lock(getSourceMutex());
         llvm::errs() << "At "
                      << stmt->getBeginLoc().printToString(
                             Context->getSourceManager())
                      << ":\n"
-                     << stmtToString(stmt) << "\n";
+                     << stmtToString(stmt, Context) << "\n";
+    }
+    if (exitDeferred) {
+        throw BuildError(message);
     }
     exit(1);
 }
 
+void Utils::warnNotDescribed(llvm::StringRef action, llvm::StringRef name) {
+    llvm::errs() << "Warning: not " << action << " function '" << name
+                 << "', which has constraints that can only be built from "
+                    "strings\n";
+}
+
 void Utils::printSmallLine() { llvm::outs() << "---------------\n"; }
 
-std::string Utils::stmtToString(clang::Stmt* stmt) {
-    return Lexer::getSourceText(
-               CharSourceRange::getTokenRange(stmt->getSourceRange()),
-               Context->getSourceManager(), Context->getLangOpts())
+std::string Utils::stmtToString(clang::Stmt* stmt,
+                                const ASTContext* Context) {
+    return getSourceText(
+               CharSourceRange::getTokenRange(stmt->getSourceRange()), Context)
         .str();
 }
 
-std::string Utils::replaceInString(std::string input, std::string toFind,
-                                   std::string replaceWith) {
-    size_t pos = input.find(toFind);
-    if (pos == std::string::npos) {
-        return input;
-    } else {
-        return replaceInString(input.replace(pos, toFind.length(), replaceWith),
-                               toFind, replaceWith);
-    }
+llvm::StringRef Utils::getSourceText(CharSourceRange range,
+                                     const ASTContext* Context) {
+    std::lock_guard<std::recursive_mutex> lock(getSourceMutex());
+    return Lexer::getSourceText(range, Context->getSourceManager(),
+                                Context->getLangOpts());
 }
 
 void Utils::getExprArrayAccesses(
@@ -57,16 +74,66 @@ void Utils::getExprArrayAccesses(
     if (BinaryOperator* binOper = dyn_cast<BinaryOperator>(usableExpr)) {
         getExprArrayAccesses(binOper->getLHS(), currentList);
         getExprArrayAccesses(binOper->getRHS(), currentList);
+    } else if (ConditionalOperator* condOper =
+                   dyn_cast<ConditionalOperator>(usableExpr)) {
+        // either branch may be read
+        getExprArrayAccesses(condOper->getCond(), currentList);
+        getExprArrayAccesses(condOper->getTrueExpr(), currentList);
+        getExprArrayAccesses(condOper->getFalseExpr(), currentList);
     } else if (ArraySubscriptExpr* asArrayAccessExpr =
                    dyn_cast<ArraySubscriptExpr>(usableExpr)) {
         currentList.push_back(asArrayAccessExpr);
     }
 }
 
-std::string Utils::getVarReplacementName() {
+std::string Utils::getVarReplacementName(unsigned int& replacementVarNumber) {
+    Stats::add(Stat::ReplacementVarsIssued);
     return REPLACEMENT_VAR_BASE_NAME + std::to_string(replacementVarNumber++);
 }
 
+bool Utils::usesIdentifier(const std::string& code, const std::string& name) {
+    auto isIdentifierChar = [](char c) { return std::isalnum(c) || c == '_'; };
+    for (size_t pos = code.find(name); pos != std::string::npos;
+         pos = code.find(name, pos + 1)) {
+        const size_t end = pos + name.size();
+        if ((pos == 0 || !isIdentifierChar(code[pos - 1])) &&
+            (end == code.size() || !isIdentifierChar(code[end]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string Utils::replaceIdentifier(const std::string& code,
+                                     const std::string& name,
+                                     const std::string& replacement) {
+    auto isIdentifierChar = [](char c) { return std::isalnum(c) || c == '_'; };
+    std::string replaced;
+    size_t copied = 0;
+    for (size_t pos = code.find(name); pos != std::string::npos;
+         pos = code.find(name, pos + 1)) {
+        const size_t end = pos + name.size();
+        if ((pos == 0 || !isIdentifierChar(code[pos - 1])) &&
+            (end == code.size() || !isIdentifierChar(code[end]))) {
+            replaced += code.substr(copied, pos - copied) + replacement;
+            copied = end;
+        }
+    }
+    return replaced + code.substr(copied);
+}
+
+std::string Utils::makeUniqueName(const std::string& base,
+                                  const std::string& code,
+                                  std::vector<std::string>& taken) {
+    std::string name = base;
+    while (usesIdentifier(code, name) ||
+           std::find(taken.begin(), taken.end(), name) != taken.end()) {
+        name += "_";
+    }
+    taken.push_back(name);
+    return name;
+}
+
 std::string Utils::binaryOperatorKindToString(BinaryOperatorKind bo) {
     if (!operatorStrings.count(bo)) {
         printErrorAndExit("Invalid operator type encountered.");
@@ -74,11 +141,69 @@ std::string Utils::binaryOperatorKindToString(BinaryOperatorKind bo) {
     return operatorStrings.at(bo);
 }
 
+bool Utils::getOutermostLoops(const std::vector<StmtSpec>& stmts,
+                              std::vector<std::vector<unsigned int>>& loops,
+                              std::string& reason) {
+    loops.clear();
+    int loopPosition = 0;
+    for (unsigned int i = 0; i < stmts.size(); ++i) {
+        ExecSchedule schedule;
+        if (!stmts[i].getSchedule(schedule)) {
+            reason = "its execution schedules could not be read";
+            return false;
+        }
+        // schedules alternate positions and iterators, so a statement is in
+        // a loop if its second entry is an iterator
+        if (schedule.getDimension() < 2 ||
+            !schedule.scheduleTuple[1].valueIsVar) {
+            continue;
+        }
+        if (loops.empty() ||
+            schedule.scheduleTuple[0].value != loopPosition) {
+            loops.emplace_back();
+            loopPosition = schedule.scheduleTuple[0].value;
+        }
+        loops.back().push_back(i);
+    }
+    if (loops.empty()) {
+        reason = "it has no loops";
+        return false;
+    }
+    return true;
+}
+
+bool Utils::findOutermostLoop(const std::vector<StmtSpec>& stmts,
+                              const LoopCheck& check, std::string& reason,
+                              unsigned int only) {
+    std::vector<std::vector<unsigned int>> loops;
+    if (!getOutermostLoops(stmts, loops, reason)) {
+        return false;
+    }
+    if (only > loops.size()) {
+        reason = "it has only " + std::to_string(loops.size()) +
+                 " outermost loop" + (loops.size() == 1 ? "" : "s");
+        return false;
+    }
+
+    reason.clear();
+    for (unsigned int i = 0; i < loops.size(); ++i) {
+        if (only != 0 && i + 1 != only) {
+            continue;
+        }
+        std::string loopReason;
+        if (check(loops[i], loopReason)) {
+            return true;
+        }
+        reason += (reason.empty() ? "" : "; ") + std::string("loop over '") +
+                  stmts[loops[i].front()].iterSpace.tuple[0].var +
+                  "': " + loopReason;
+    }
+    return false;
+}
+
 const std::map<BinaryOperatorKind, std::string> Utils::operatorStrings = {
     {BinaryOperatorKind::BO_LT, "<"}, {BinaryOperatorKind::BO_LE, "<="},
     {BinaryOperatorKind::BO_GT, ">"}, {BinaryOperatorKind::BO_GE, ">="},
     {BinaryOperatorKind::BO_EQ, "="}, {BinaryOperatorKind::BO_NE, "!="}};
 
-unsigned int Utils::replacementVarNumber = 0;
-
 }  // namespace spf_ie